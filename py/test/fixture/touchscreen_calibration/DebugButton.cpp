@@ -0,0 +1,93 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The gesture detector of the debug button on the left side of the fixture.
+ */
+
+#include "Arduino.h"
+#include "DebugButton.h"
+
+// The raw button value is sampled at a fixed interval. A press (or a release)
+// is confirmed when all of the 8 samples in the history are active (or
+// inactive), i.e., 7 sample intervals after the first of them.
+const unsigned long BUTTON_SAMPLE_INTERVALS = 7;
+const uint8_t BUTTON_ALL_ACTIVE = 0xff;
+const uint8_t BUTTON_ALL_INACTIVE = 0x00;
+
+// A press held longer than this is a long press.
+const unsigned long LONG_PRESS_TIME = 800;
+
+// A press confirmed within this interval after the previous release is a
+// double press.
+const unsigned long DOUBLE_PRESS_WINDOW = 400;
+
+
+/**
+ * Initialize the detector with the button released.
+ */
+DebugButton::DebugButton() {
+  history_ = BUTTON_ALL_INACTIVE;
+  sampleInterval_ = DEFAULT_DEBOUNCE_TIME / BUTTON_SAMPLE_INTERVALS;
+  lastSample_ = 0;
+  pressed_ = false;
+  pressTime_ = 0;
+  longPressReported_ = false;
+  releaseTime_ = 0;
+}
+
+/**
+ * Set the time to confirm a press or a release in milli-seconds, which is
+ * rounded down to a multiple of the sample intervals.
+ *
+ * The sample interval is at least 1 ms. Otherwise every loop iteration would
+ * take a sample and a glitch longer than a few iterations would be confirmed.
+ */
+void DebugButton::setDebounceTime(unsigned long debounceTime) {
+  sampleInterval_ = debounceTime / BUTTON_SAMPLE_INTERVALS;
+  if (sampleInterval_ == 0)
+    sampleInterval_ = 1;
+}
+
+unsigned long DebugButton::debounceTime() const {
+  return sampleInterval_ * BUTTON_SAMPLE_INTERVALS;
+}
+
+/**
+ * Sample the raw button value and detect the gestures.
+ *
+ * This is called in every loop iteration. The raw value is taken only once
+ * every sample interval so that the window of consistent samples does not
+ * depend on how fast the loop runs.
+ */
+enum DebugButton::Event DebugButton::update(bool rawActive,
+                                            unsigned long now) {
+  if (now - lastSample_ < sampleInterval_)
+    return NONE;
+  lastSample_ = now;
+  history_ = (history_ << 1) | (rawActive ? 1 : 0);
+
+  if (!pressed_ && history_ == BUTTON_ALL_ACTIVE) {
+    pressed_ = true;
+    pressTime_ = now;
+    longPressReported_ = false;
+    if (releaseTime_ > 0 && now - releaseTime_ < DOUBLE_PRESS_WINDOW) {
+      releaseTime_ = 0;
+      return DOUBLE_PRESS;
+    }
+    return PRESS;
+  }
+
+  if (pressed_ && history_ == BUTTON_ALL_INACTIVE) {
+    pressed_ = false;
+    releaseTime_ = now;
+    return RELEASE;
+  }
+
+  if (pressed_ && !longPressReported_ && now - pressTime_ >= LONG_PRESS_TIME) {
+    longPressReported_ = true;
+    return LONG_PRESS;
+  }
+  return NONE;
+}
@@ -0,0 +1,68 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The gesture detector of the debug button on the left side of the fixture.
+ *
+ * The raw button value is sampled at a fixed interval and a press is
+ * confirmed only when all of the samples in a short window are consistent.
+ * A voltage glitch which flips a few samples in the window is thereby
+ * rejected, while the operator gets a response in tens of milli-seconds
+ * instead of waiting for the long active duration of BUTTON_DEBUG.
+ */
+
+
+#ifndef DebugButton_h
+#define DebugButton_h
+
+#include <stdint.h>
+
+// The number of sample intervals to confirm a press or a release.
+extern const unsigned long BUTTON_SAMPLE_INTERVALS;
+
+class DebugButton {
+  public:
+    // The gestures reported by update().
+    enum Event {NONE = 0,
+                // a confirmed press, reported as soon as it is confirmed
+                PRESS,
+                // the release of a confirmed press, reported as soon as it is
+                // confirmed
+                RELEASE,
+                // a press held for LONG_PRESS_TIME, reported once per press
+                LONG_PRESS,
+                // a press confirmed shortly after the release of a previous
+                // one, reported instead of PRESS
+                DOUBLE_PRESS,
+    };
+
+    // The default time to confirm a press or a release in milli-seconds.
+    static const unsigned long DEFAULT_DEBOUNCE_TIME = 35;
+
+    DebugButton();
+
+    enum Event update(bool rawActive, unsigned long now);
+    bool isPressed() const { return pressed_; }
+    void setDebounceTime(unsigned long debounceTime);
+    unsigned long debounceTime() const;
+
+  private:
+    // The latest samples, one bit per sample with the newest in bit 0.
+    uint8_t history_;
+    // The interval between the samples in milli-seconds.
+    unsigned long sampleInterval_;
+    // The millis() when the latest sample was taken.
+    unsigned long lastSample_;
+    // Whether a press has been confirmed and not released yet.
+    bool pressed_;
+    // The millis() when the current press was confirmed.
+    unsigned long pressTime_;
+    // Whether LONG_PRESS has been reported for the current press.
+    bool longPressReported_;
+    // The millis() when the previous press was released, or 0 if the
+    // previous press has been consumed by a double press.
+    unsigned long releaseTime_;
+};
+
+#endif
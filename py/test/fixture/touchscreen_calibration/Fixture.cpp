@@ -41,10 +41,38 @@ unsigned long SENSOR_ACTIVE_TIMES[] = {0, 0, 0, 0, 0, 0};
 // due to unstable voltage.
 // The active duration of safety sensor is assigned a shorter value for safety
 // purpose.
-unsigned const long SENSOR_ACTIVE_DURATIONS[] = {500, 500, 200, 200, 200, 100};
+// These are the default values which could be tuned by a motion profile.
+unsigned long SENSOR_ACTIVE_DURATIONS[] = {500, 500, 200, 200, 200, 100};
+
+// An array of the latest times when the sensors became inactive ranging from
+// SENSOR_MIN to SENSOR_MAX. The value 0 indicates that a sensor has never been
+// active since boot.
+unsigned long SENSOR_INACTIVE_TIMES[] = {0, 0, 0, 0, 0, 0};
+
+// An array of flags ranging from SENSOR_MIN to SENSOR_MAX indicating whether
+// the current activation of a sensor has been confirmed by its active duration.
+bool SENSOR_CONFIRMED[] = {false, false, false, false, false, false};
+
+// An array of sensor health statistics ranging from SENSOR_MIN to SENSOR_MAX.
+// They are kept in RAM only and are cleared on reset or by the host.
+Fixture::SensorStats SENSOR_STATS[Fixture::SENSOR_MAX + 1];
+
+// Whether the raw sensor values are traced through the native USB port.
+bool TRACE_ENABLED = false;
+// The raw sensor values last traced, one bit per sensor from SENSOR_MIN, and
+// the micros() when they were traced.
+unsigned int TRACE_LAST_BITS = 0;
+unsigned long TRACE_LAST_TIME = 0;
+// The raw sensor values are traced again after this interval in micro-seconds
+// even if they do not change so that the host could unwrap micros().
+const unsigned long TRACE_KEEPALIVE_INTERVAL = 60000000;
 
 // The serial baud rate used by the programming port and the native USB port.
 const int SERIAL_BAUD_RATE = 9600;
+// The timeout of the blocking reads of the programming port in milli-seconds,
+// which is far shorter than the default one second of Stream so that a read
+// never holds loop() off the safety sensor for long.
+const unsigned long SERIAL_TIMEOUT = 10;
 
 // Fixture states
 // Initial state. This state is only possible when the arduino board
@@ -97,6 +125,7 @@ Fixture::Fixture() {
   // Initialize the jumper, the debug button, and the four sensor pins
   for (int sensor = SENSOR_MIN; sensor <= SENSOR_MAX; sensor++)
     pinMode(getPin((enum Sensors) sensor), INPUT);
+  resetSensorStats();
 
   // Initialize the output pins for the motor control
   // Note: there is no need to configure pinMotorStep as OUTPUT
@@ -178,6 +207,7 @@ void Fixture::getInitSensorStatus() {
 void Fixture::start() {
   // Set the baud rate for Programming Port and Native USB Port.
   Serial.begin(SERIAL_BAUD_RATE);
+  Serial.setTimeout(SERIAL_TIMEOUT);
   SerialUSB.begin(SERIAL_BAUD_RATE);
 
   // For safety, the motor should always be enabled to prevent from falling down
@@ -225,19 +255,29 @@ bool Fixture::checkSensorValue(enum Sensors sensor) {
  * Check if the sensors are active. Update the active times accordingly.
  */
 void Fixture::updateSensorStatus() {
+  unsigned long now = millis();
+  unsigned int bits = 0;
   for (int sensor = SENSOR_MIN; sensor <= SENSOR_MAX; sensor++) {
-    if (digitalRead(getPin((enum Sensors) sensor)) ==
-        SENSOR_ACTIVE_VALUES[sensor]) {
+    bool active = (digitalRead(getPin((enum Sensors) sensor)) ==
+                   SENSOR_ACTIVE_VALUES[sensor]);
+    if (active)
+      bits |= 1 << sensor;
+    updateSensorStats((enum Sensors) sensor, active, now);
+    if (active) {
       if (SENSOR_ACTIVE_TIMES[sensor] == 0) {
-        SENSOR_ACTIVE_TIMES[sensor] = millis();
+        SENSOR_ACTIVE_TIMES[sensor] = now;
       }
     } else {
       if (SENSOR_ACTIVE_TIMES[sensor] > 0) {
         SENSOR_ACTIVE_TIMES[sensor] = 0;
+        SENSOR_INACTIVE_TIMES[sensor] = now;
       }
     }
   }
 
+  if (TRACE_ENABLED)
+    traceSensors(bits);
+
   checkJumper();
   buttonDebug_ = checkSensorValue(BUTTON_DEBUG);
   sensorExtremeUp_ = checkSensorValue(SENSOR_EXTREME_UP);
@@ -246,6 +286,66 @@ void Fixture::updateSensorStatus() {
   sensorSafety_ = checkSensorValue(SENSOR_SAFETY);
 }
 
+/**
+ * Update the health counters of a sensor with its latest raw value.
+ *
+ * This must be called before SENSOR_ACTIVE_TIMES is updated so that an edge
+ * could be detected by comparing the raw value with the recorded active time.
+ * An active pulse released before its active duration is counted as a glitch.
+ */
+void Fixture::updateSensorStats(enum Sensors sensor, bool active,
+                                unsigned long now) {
+  SensorStats &stats = SENSOR_STATS[sensor];
+  unsigned long activeTime = SENSOR_ACTIVE_TIMES[sensor];
+  unsigned long duration = activeTime > 0 ? now - activeTime : 0;
+  bool longEnough = duration > SENSOR_ACTIVE_DURATIONS[sensor];
+
+  if (active) {
+    if (activeTime == 0) {
+      stats.edges++;
+    } else if (!SENSOR_CONFIRMED[sensor] && longEnough) {
+      SENSOR_CONFIRMED[sensor] = true;
+      stats.activations++;
+    }
+  } else if (activeTime > 0) {
+    if (SENSOR_CONFIRMED[sensor] || longEnough) {
+      if (!SENSOR_CONFIRMED[sensor])
+        stats.activations++;
+      if (stats.releases == 0 || duration < stats.minDuration)
+        stats.minDuration = duration;
+      if (duration > stats.maxDuration)
+        stats.maxDuration = duration;
+      stats.totalDuration += duration;
+      stats.releases++;
+    } else {
+      stats.glitches++;
+    }
+    SENSOR_CONFIRMED[sensor] = false;
+  }
+}
+
+/**
+ * Get the health counters of a sensor.
+ */
+const Fixture::SensorStats& Fixture::sensorStats(enum Sensors sensor) const {
+  return SENSOR_STATS[sensor];
+}
+
+/**
+ * Clear the health counters of all sensors.
+ */
+void Fixture::resetSensorStats() {
+  for (int sensor = SENSOR_MIN; sensor <= SENSOR_MAX; sensor++) {
+    SENSOR_STATS[sensor].edges = 0;
+    SENSOR_STATS[sensor].activations = 0;
+    SENSOR_STATS[sensor].glitches = 0;
+    SENSOR_STATS[sensor].releases = 0;
+    SENSOR_STATS[sensor].minDuration = 0;
+    SENSOR_STATS[sensor].maxDuration = 0;
+    SENSOR_STATS[sensor].totalDuration = 0;
+  }
+}
+
 /**
  * Is the pinSensorExtremeUp detected?
  */
@@ -281,6 +381,37 @@ bool Fixture::isDebugPressed() {
   return buttonDebug_;
 }
 
+/**
+ * Is the raw sensor value active now regardless of its active duration?
+ */
+bool Fixture::isRawActive(enum Sensors sensor) const {
+  return (SENSOR_ACTIVE_TIMES[sensor] > 0);
+}
+
+/**
+ * How long has the raw sensor value been inactive (in milli-seconds)?
+ * Return 0 if the sensor is active now.
+ */
+unsigned long Fixture::inactiveDuration(enum Sensors sensor) const {
+  if (SENSOR_ACTIVE_TIMES[sensor] > 0)
+    return 0;
+  return millis() - SENSOR_INACTIVE_TIMES[sensor];
+}
+
+/**
+ * Get the active duration of a sensor to be considered as triggered.
+ */
+unsigned long Fixture::activeDuration(enum Sensors sensor) const {
+  return SENSOR_ACTIVE_DURATIONS[sensor];
+}
+
+/**
+ * Set the active duration of a sensor to be considered as triggered.
+ */
+void Fixture::setActiveDuration(enum Sensors sensor, unsigned long duration) {
+  SENSOR_ACTIVE_DURATIONS[sensor] = duration;
+}
+
 /**
  * Check if the jumper is set.
  */
@@ -383,6 +514,9 @@ char Fixture::getCmdByNativeUSBPort() const {
 /**
  * Send the fixture's state vector through the native USB port.
  * This information is for debugging purpose.
+ *
+ * The state vector ends with the millis() when it is sent so that the host
+ * could place it on its own timeline.
  */
 void Fixture::sendStateVectorByNativeUSBPort(Fixture &fixture) const {
   SerialUSB.print("<");
@@ -401,5 +535,119 @@ void Fixture::sendStateVectorByNativeUSBPort(Fixture &fixture) const {
   SerialUSB.print(pwmFrequency_);
   SerialUSB.print('.');
   SerialUSB.print(count_);
+  SerialUSB.print('.');
+  SerialUSB.print(millis());
   SerialUSB.print(">");
 }
+
+/**
+ * Send the sensor health statistics through the programming port.
+ *
+ * The statistics look like <t3,2,1,2,230,260,245;...> where each sensor from
+ * SENSOR_MIN to SENSOR_MAX reports its edges, activations, glitches, releases,
+ * and the min/max/mean durations of its released confirmed activations.
+ */
+void Fixture::sendSensorStatsByProgrammingPort() const {
+  Serial.print("<t");
+  for (int sensor = SENSOR_MIN; sensor <= SENSOR_MAX; sensor++) {
+    const SensorStats &stats = SENSOR_STATS[sensor];
+    if (sensor > SENSOR_MIN)
+      Serial.print(';');
+    Serial.print(stats.edges);
+    Serial.print(',');
+    Serial.print(stats.activations);
+    Serial.print(',');
+    Serial.print(stats.glitches);
+    Serial.print(',');
+    Serial.print(stats.releases);
+    Serial.print(',');
+    Serial.print(stats.minDuration);
+    Serial.print(',');
+    Serial.print(stats.maxDuration);
+    Serial.print(',');
+    Serial.print(stats.releases ? stats.totalDuration / stats.releases : 0);
+  }
+  Serial.print(">");
+}
+
+/**
+ * Send the current millis() through the programming port, e.g., <m123456>.
+ *
+ * The host pings this to synchronize its clock with the fixture clock.
+ */
+void Fixture::sendTimeByProgrammingPort() const {
+  Serial.print("<m");
+  Serial.print(millis());
+  Serial.print(">");
+}
+
+/**
+ * Start tracing the raw sensor values through the native USB port.
+ *
+ * The trace frames are enclosed in [] so that they could be told apart from
+ * the state vectors enclosed in <>. The caller should send a trace header
+ * and the state vector right after this to mark the initial condition.
+ */
+void Fixture::startTrace() {
+  TRACE_ENABLED = true;
+  TRACE_LAST_BITS = rawSensorBits();
+  TRACE_LAST_TIME = micros();
+}
+
+/**
+ * Stop tracing the raw sensor values.
+ */
+void Fixture::stopTrace() {
+  TRACE_ENABLED = false;
+}
+
+/**
+ * Are the raw sensor values traced?
+ */
+bool Fixture::isTracing() const {
+  return TRACE_ENABLED;
+}
+
+/**
+ * Get the raw sensor values, one bit per sensor from SENSOR_MIN, as of the
+ * latest updateSensorStatus().
+ */
+unsigned int Fixture::rawSensorBits() const {
+  unsigned int bits = 0;
+  for (int sensor = SENSOR_MIN; sensor <= SENSOR_MAX; sensor++) {
+    if (SENSOR_ACTIVE_TIMES[sensor] > 0)
+      bits |= 1 << sensor;
+  }
+  return bits;
+}
+
+/**
+ * Trace the raw sensor values if they have changed, e.g., [S12345678,2c],
+ * where the values follow micros() in hex.
+ */
+void Fixture::traceSensors(unsigned int bits) {
+  unsigned long now = micros();
+  if (bits == TRACE_LAST_BITS &&
+      now - TRACE_LAST_TIME < TRACE_KEEPALIVE_INTERVAL)
+    return;
+  TRACE_LAST_BITS = bits;
+  TRACE_LAST_TIME = now;
+  SerialUSB.print("[S");
+  SerialUSB.print(now);
+  SerialUSB.print(',');
+  SerialUSB.print(bits, HEX);
+  SerialUSB.print("]");
+}
+
+/**
+ * Trace a command received from the host, e.g., [C12345678,d].
+ */
+void Fixture::traceCommand(char command) const {
+  if (!TRACE_ENABLED)
+    return;
+  SerialUSB.print("[C");
+  SerialUSB.print(micros());
+  SerialUSB.print(',');
+  SerialUSB.print(command);
+  SerialUSB.print("]");
+}
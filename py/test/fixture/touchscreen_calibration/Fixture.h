@@ -41,6 +41,23 @@ class Fixture {
     static const enum Sensors SENSOR_MIN = JUMPER;
     static const enum Sensors SENSOR_MAX = SENSOR_SAFETY;
 
+    // The health counters of a sensor since boot or since the last reset.
+    // All durations are in milli-seconds.
+    struct SensorStats {
+      // the number of raw active edges seen on the pin
+      unsigned long edges;
+      // the number of activations confirmed by the debounce window
+      unsigned long activations;
+      // the number of active pulses shorter than the debounce window
+      unsigned long glitches;
+      // the number of confirmed activations which have been released
+      unsigned long releases;
+      // the min/max/total durations of the released confirmed activations
+      unsigned long minDuration;
+      unsigned long maxDuration;
+      unsigned long totalDuration;
+    };
+
     // A default constructor which configures pins in addition to initializing
     // its data members.
     Fixture();
@@ -58,6 +75,10 @@ class Fixture {
     bool isSensorDown();
     bool isSensorSafety();
     bool isDebugPressed();
+    bool isRawActive(enum Sensors sensor) const;
+    unsigned long inactiveDuration(enum Sensors sensor) const;
+    unsigned long activeDuration(enum Sensors sensor) const;
+    void setActiveDuration(enum Sensors sensor, unsigned long duration);
     void checkJumper();
     bool isInStopState() const;
     void setSpeed(unsigned int pwmFrequency);
@@ -72,6 +93,8 @@ class Fixture {
     char state() const { return state_; }
     void set_state(char state) { state_ = state; }
     bool jumper() const { return jumper_; }
+    bool motorDir() const { return motorDir_; }
+    bool isMotorRunning() const { return motorDutyCycle_; }
     unsigned int count() const { return count_; }
     void inc_count() { count_++; }
     void reset_count() { count_ = 0; }
@@ -81,12 +104,31 @@ class Fixture {
     void sendResponseByProgrammingPort(char ret_code) const;
     char getCmdByNativeUSBPort() const;
     void sendStateVectorByNativeUSBPort(Fixture &fixture) const;
+    void sendSensorStatsByProgrammingPort() const;
+    void sendTimeByProgrammingPort() const;
+
+    // raw sensor tracing through the native USB port
+    void startTrace();
+    void stopTrace();
+    bool isTracing() const;
+    unsigned int rawSensorBits() const;
+    void traceCommand(char command) const;
+
+    // sensor health statistics
+    const SensorStats& sensorStats(enum Sensors sensor) const;
+    void resetSensorStats();
 
   private:
+    // The host microbenchmark in sim/ times the private hot paths.
+    friend class FixtureMicrobench;
+
     bool checkSensorValue(enum Sensors sensor);
     int getPin(enum Sensors sensor) const;
     unsigned long maxActiveDuration() const;
     void getInitSensorStatus();
+    void updateSensorStats(enum Sensors sensor, bool active,
+                           unsigned long now);
+    void traceSensors(unsigned int bits);
 
     // Fixture's state vector
     // the main state
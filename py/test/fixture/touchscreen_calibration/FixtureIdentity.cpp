@@ -0,0 +1,123 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The identity of the fixture.
+ */
+
+#include "Arduino.h"
+#include <DueFlashStorage.h>
+#include "FixtureIdentity.h"
+#include "MotionProfile.h"
+#include "WearLog.h"
+
+// The identity is stored right before the motion profiles.
+const uint32_t IDENTITY_STORE_SIZE = 256;
+const uint32_t IDENTITY_STORE_START = PROFILE_STORE_START - IDENTITY_STORE_SIZE;
+const uint32_t IDENTITY_STORE_MAGIC = 0x544e4449;  // "IDNT"
+
+
+/**
+ * Initialize the identity. It is loaded by begin().
+ */
+FixtureIdentity::FixtureIdentity() {
+  memset(&store_, 0, sizeof(store_));
+  memset(uniqueId_, 0, sizeof(uniqueId_));
+}
+
+/**
+ * Load the name from flash and read the unique identifier of the chip.
+ *
+ * The name is empty if it has never been set or a new firmware has been
+ * flashed.
+ */
+void FixtureIdentity::begin() {
+  const Store *store =
+      (const Store *) flashStorage.readAddress(IDENTITY_STORE_START);
+  if (store->magic == IDENTITY_STORE_MAGIC &&
+      store->checksum == computeFletcher32(store, offsetof(Store, checksum)) &&
+      memchr(store->name, '\0', sizeof(store->name)) != NULL) {
+    memcpy(&store_, store, sizeof(store_));
+  } else {
+    memset(&store_, 0, sizeof(store_));
+    store_.magic = IDENTITY_STORE_MAGIC;
+  }
+  flash_read_unique_id(uniqueId_, 4);
+}
+
+/**
+ * Assign a new name to the fixture. An empty name clears it.
+ *
+ * Return false if the name is not legitimate. Flash is not written if the
+ * name is the same.
+ */
+bool FixtureIdentity::setName(const char *name) {
+  if (!isValidName(name))
+    return false;
+  if (strcmp(store_.name, name) != 0) {
+    memset(store_.name, 0, sizeof(store_.name));
+    strcpy(store_.name, name);
+    commit();
+  }
+  return true;
+}
+
+/**
+ * Is the name legitimate? It takes only letters, digits, '-' and '_' so that
+ * it never breaks the frames it is sent in.
+ */
+bool FixtureIdentity::isValidName(const char *name) {
+  size_t length = strlen(name);
+  if (length > MAX_NAME_LENGTH)
+    return false;
+  for (size_t i = 0; i < length; i++) {
+    if (!isalnum(name[i]) && name[i] != '-' && name[i] != '_')
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Write the identity to flash.
+ *
+ * This must be called only when the probe is at rest since a flash write
+ * stalls the loop for a few milli-seconds.
+ */
+void FixtureIdentity::commit() {
+  store_.checksum = computeFletcher32(&store_, offsetof(Store, checksum));
+  flashStorage.write(IDENTITY_STORE_START, (byte *) &store_, sizeof(store_));
+}
+
+/**
+ * Print the name and the unique identifier in hex, e.g.,
+ * line3-a,3A1B4C5D0000A1B20123456789ABCDEF.
+ */
+void FixtureIdentity::print(Print &port) const {
+  port.print(store_.name);
+  port.print(',');
+  for (unsigned int i = 0; i < 4; i++) {
+    for (int shift = 28; shift >= 0; shift -= 4)
+      port.print((uniqueId_[i] >> shift) & 0xf, HEX);
+  }
+}
+
+/**
+ * Send the identity through the programming port, e.g.,
+ * <nline3-a,3A1B4C5D0000A1B20123456789ABCDEF>.
+ */
+void FixtureIdentity::sendByProgrammingPort() const {
+  Serial.print("<n");
+  print(Serial);
+  Serial.print(">");
+}
+
+/**
+ * Send the identity through the native USB port in a bracketed frame like the
+ * trace frames, e.g., [nline3-a,3A1B4C5D0000A1B20123456789ABCDEF].
+ */
+void FixtureIdentity::sendByNativeUSBPort() const {
+  SerialUSB.print("[n");
+  print(SerialUSB);
+  SerialUSB.print("]");
+}
@@ -0,0 +1,55 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The identity of the fixture which lets a host drive several fixtures and
+ * pair the programming port and the native USB port of each.
+ *
+ * The identity is reported on both ports as the name assigned by the host,
+ * which is kept in flash, and the unique identifier of the SAM3X chip, which
+ * never changes.
+ */
+
+
+#ifndef FixtureIdentity_h
+#define FixtureIdentity_h
+
+#include <stdint.h>
+
+class Print;
+
+
+class FixtureIdentity {
+  public:
+    // The longest name, excluding the null terminator.
+    static const unsigned int MAX_NAME_LENGTH = 15;
+
+    FixtureIdentity();
+
+    void begin();
+    bool setName(const char *name);
+    static bool isValidName(const char *name);
+
+    const char* name() const { return store_.name; }
+
+    // communication
+    void print(Print &port) const;
+    void sendByProgrammingPort() const;
+    void sendByNativeUSBPort() const;
+
+  private:
+    void commit();
+
+    // The content kept in flash.
+    struct Store {
+      uint32_t magic;
+      char name[MAX_NAME_LENGTH + 1];
+      uint32_t checksum;
+    };
+    Store store_;
+    // The 128-bit unique identifier of the chip.
+    uint32_t uniqueId_[4];
+};
+
+#endif
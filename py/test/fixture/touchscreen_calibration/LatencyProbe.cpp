@@ -0,0 +1,140 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The probe of the emergency stop latency.
+ */
+
+#include "Arduino.h"
+#include "LatencyProbe.h"
+
+// The safety sensor input is active low.
+const int LOOPBACK_ACTIVE = LOW;
+const int LOOPBACK_INACTIVE = HIGH;
+
+// The trip happens at a random time in this window (in micro-seconds) after
+// the move starts, which covers the fast and the slow part of a move.
+const uint32_t TRIP_MIN_DELAY = 100000;
+const uint32_t TRIP_MAX_DELAY = 5000000;
+
+// The cycle counter runs at the core clock.
+const uint32_t CYCLES_PER_MICROSECOND = VARIANT_MCK / 1000000;
+
+
+LatencyProbe::LatencyProbe() {
+  armed_ = false;
+  moving_ = false;
+  tripped_ = false;
+  tripCycles_ = 0;
+  hasLatency_ = false;
+  latencyCycles_ = 0;
+}
+
+/**
+ * Enable the cycle counter and leave the loopback pin inactive.
+ */
+void LatencyProbe::begin() {
+#ifdef __SAM3X8E__
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+  pinMode(PIN_LOOPBACK, OUTPUT);
+  digitalWrite(PIN_LOOPBACK, LOOPBACK_INACTIVE);
+}
+
+/**
+ * Get the cycle counter. It wraps around in about 51 seconds, which is much
+ * longer than any latency to measure.
+ *
+ * Without the Cortex-M3, e.g., in the virtual fixture, it is derived from
+ * micros().
+ */
+uint32_t LatencyProbe::cycles() {
+#ifdef __SAM3X8E__
+  return DWT->CYCCNT;
+#else
+  return micros() * CYCLES_PER_MICROSECOND;
+#endif
+}
+
+/**
+ * Clear the last measurement and wait for the next move.
+ */
+void LatencyProbe::arm() {
+  release();
+  hasLatency_ = false;
+  armed_ = true;
+}
+
+/**
+ * Return true on the first move after arming, when the trip timer should be
+ * started with tripDelay().
+ */
+bool LatencyProbe::startMove() {
+  if (!armed_ || moving_)
+    return false;
+  moving_ = true;
+  return true;
+}
+
+uint32_t LatencyProbe::tripDelay() const {
+  return random(TRIP_MIN_DELAY, TRIP_MAX_DELAY);
+}
+
+/**
+ * Pull the safety sensor input active. This is called in a timer ISR.
+ */
+void LatencyProbe::trip() {
+  if (!armed_ || tripped_)
+    return;
+  digitalWrite(PIN_LOOPBACK, LOOPBACK_ACTIVE);
+  tripCycles_ = cycles();
+  tripped_ = true;
+}
+
+/**
+ * Take the latency if the emergency stop has locked a running motor.
+ *
+ * The input is released right away in any case, so the fixture stays in the
+ * emergency stop state until it is recovered as usual, and a trip at rest does
+ * not hold the safety sensor active forever.
+ */
+void LatencyProbe::emergencyStopped(bool motorLocked) {
+  if (!tripped_)
+    return;
+  if (motorLocked) {
+    latencyCycles_ = cycles() - tripCycles_;
+    hasLatency_ = true;
+  }
+  release();
+}
+
+/**
+ * Release the safety sensor input and disarm the probe.
+ */
+void LatencyProbe::release() {
+  digitalWrite(PIN_LOOPBACK, LOOPBACK_INACTIVE);
+  armed_ = false;
+  moving_ = false;
+  tripped_ = false;
+}
+
+/**
+ * Send the last latency through the programming port, e.g., <K8400,84> which
+ * is the latency in cycles and the cycles per micro-second, or <K> if there is
+ * none, e.g., the probe was at rest when the input was tripped. The probe is
+ * released and the latency is cleared.
+ */
+void LatencyProbe::sendByProgrammingPort() {
+  Serial.print("<K");
+  if (hasLatency_) {
+    Serial.print(latencyCycles_);
+    Serial.print(',');
+    Serial.print(CYCLES_PER_MICROSECOND);
+  }
+  Serial.print(">");
+  hasLatency_ = false;
+  release();
+}
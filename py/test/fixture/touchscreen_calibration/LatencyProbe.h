@@ -0,0 +1,55 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The probe of the emergency stop latency, i.e., the time from the safety
+ * sensor input becoming active until the step pwm of the motor is zeroed.
+ *
+ * It needs a loopback jumper from PIN_LOOPBACK to the safety sensor input in
+ * place of the safety curtain. Once armed, the probe pulls the input active
+ * from a timer interrupt at a random time of the next move, so the edge falls
+ * at a random phase of loop(). The edge and the lock are timestamped with the
+ * cycle counter of the Cortex-M3.
+ */
+
+
+#ifndef LatencyProbe_h
+#define LatencyProbe_h
+
+#include <stdint.h>
+
+
+class LatencyProbe {
+  public:
+    // The pin wired to the safety sensor input by the loopback jumper.
+    static const int PIN_LOOPBACK = 12;
+
+    LatencyProbe();
+
+    void begin();
+    void arm();
+    bool startMove();
+    void trip();
+    void emergencyStopped(bool motorLocked);
+    void release();
+
+    bool isArmed() const { return armed_; }
+    // A random delay in micro-seconds from the start of the move to the trip.
+    uint32_t tripDelay() const;
+
+    // communication
+    void sendByProgrammingPort();
+
+    static uint32_t cycles();
+
+  private:
+    volatile bool armed_;
+    bool moving_;
+    volatile bool tripped_;
+    volatile uint32_t tripCycles_;
+    bool hasLatency_;
+    uint32_t latencyCycles_;
+};
+
+#endif
@@ -0,0 +1,201 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The named motion profiles which tune the probe speeds and the sensor
+ * debounce windows for different products.
+ */
+
+#include "Arduino.h"
+#include <DueFlashStorage.h>
+#include "DebugButton.h"
+#include "MotionProfile.h"
+#include "WearLog.h"
+
+// The profiles are stored in the flash pages right before the wear log.
+const uint32_t PROFILE_STORE_SIZE = 1024;
+const uint32_t PROFILE_STORE_START = WEAR_LOG_START - PROFILE_STORE_SIZE;
+const uint32_t PROFILE_STORE_MAGIC = 0x4650544d;  // "MTPF"
+
+// The limits of a legitimate profile.
+// The pwm frequency is capped at twice the original FAST_PWM_FREQUENCY to keep
+// a margin from stalling the motor.
+const uint32_t MAX_PWM_FREQUENCY = 12000;
+// The debounce window of the safety sensor must not be longer than the
+// original one for safety purpose.
+const uint32_t MAX_SAFETY_DEBOUNCE = 100;
+const uint32_t MAX_DEBOUNCE = 1000;
+
+
+/**
+ * Initialize the store. The profiles are loaded from flash by begin().
+ */
+MotionProfiles::MotionProfiles() {
+  memset(&store_, 0, sizeof(store_));
+}
+
+/**
+ * Load the profiles from flash.
+ *
+ * The built-in default profile always occupies DEFAULT_SLOT. If the flash
+ * content is not valid, e.g., after a new firmware is flashed, only the
+ * default profile is available.
+ */
+void MotionProfiles::begin(const MotionProfile &defaultProfile) {
+  const Store *store =
+      (const Store *) flashStorage.readAddress(PROFILE_STORE_START);
+  if (store->magic == PROFILE_STORE_MAGIC &&
+      store->checksum == computeFletcher32(store, offsetof(Store, checksum)) &&
+      store->activeSlot < MAX_PROFILES) {
+    memcpy(&store_, store, sizeof(store_));
+  } else {
+    memset(&store_, 0, sizeof(store_));
+    store_.magic = PROFILE_STORE_MAGIC;
+    store_.activeSlot = DEFAULT_SLOT;
+  }
+  store_.profiles[DEFAULT_SLOT] = defaultProfile;
+  if (!isValid(active()))
+    store_.activeSlot = DEFAULT_SLOT;
+}
+
+/**
+ * Store a profile in a slot.
+ *
+ * Return false if the slot is reserved or the profile is not legitimate.
+ * Flash is not written if the profile is the same as the stored one.
+ */
+bool MotionProfiles::upload(unsigned int slot, const MotionProfile &profile) {
+  if (slot == DEFAULT_SLOT || slot >= MAX_PROFILES || !isValid(profile))
+    return false;
+  if (memcmp(&store_.profiles[slot], &profile, sizeof(profile)) != 0) {
+    store_.profiles[slot] = profile;
+    commit();
+  }
+  return true;
+}
+
+/**
+ * Select the profile in a slot as the active one.
+ *
+ * Return false if the slot holds no legitimate profile.
+ */
+bool MotionProfiles::select(unsigned int slot) {
+  if (slot >= MAX_PROFILES || !isValid(store_.profiles[slot]))
+    return false;
+  if (store_.activeSlot != slot) {
+    store_.activeSlot = slot;
+    commit();
+  }
+  return true;
+}
+
+/**
+ * Parse a profile like "1,samus,8000,2000,213333,3300000,200,200,100,500".
+ *
+ * The fields are the slot, the name, and the fields of MotionProfile in order.
+ */
+bool MotionProfiles::parse(const char *str, unsigned int *slot,
+                           MotionProfile *profile) {
+  uint32_t *values[] = {
+      &profile->fastPwmFrequency, &profile->slowPwmFrequency,
+      &profile->distanceToSlowDown, &profile->timeToSlowDown,
+      &profile->debounceUp, &profile->debounceDown,
+      &profile->debounceSafety, &profile->debounceButton,
+  };
+  char *end;
+
+  memset(profile, 0, sizeof(*profile));
+  *slot = strtoul(str, &end, 10);
+  if (end == str || *end != ',')
+    return false;
+
+  str = end + 1;
+  const char *comma = strchr(str, ',');
+  if (comma == NULL || comma == str ||
+      (size_t) (comma - str) >= sizeof(profile->name))
+    return false;
+  memcpy(profile->name, str, comma - str);
+
+  str = comma;
+  for (unsigned int i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    if (*str != ',')
+      return false;
+    *values[i] = strtoul(str + 1, &end, 10);
+    if (end == str + 1)
+      return false;
+    str = end;
+  }
+  return *str == '\0';
+}
+
+/**
+ * Is the profile legitimate?
+ *
+ * The probe would arrive at the peak speed without the slow-down distance and
+ * time, and the end sensors would act on every glitch without their debounce
+ * windows, so none of them could be 0.
+ */
+bool MotionProfiles::isValid(const MotionProfile &profile) {
+  return (profile.name[0] != '\0' &&
+          profile.slowPwmFrequency > 0 &&
+          profile.slowPwmFrequency <= profile.fastPwmFrequency &&
+          profile.fastPwmFrequency <= MAX_PWM_FREQUENCY &&
+          profile.distanceToSlowDown > 0 &&
+          profile.timeToSlowDown > 0 &&
+          profile.debounceUp > 0 &&
+          profile.debounceUp <= MAX_DEBOUNCE &&
+          profile.debounceDown > 0 &&
+          profile.debounceDown <= MAX_DEBOUNCE &&
+          profile.debounceSafety <= MAX_SAFETY_DEBOUNCE &&
+          profile.debounceButton >= BUTTON_SAMPLE_INTERVALS &&
+          profile.debounceButton <= MAX_DEBOUNCE);
+}
+
+/**
+ * Write the profiles to flash.
+ *
+ * This must be called only when the probe is at rest since a flash write
+ * stalls the loop for a few milli-seconds.
+ */
+void MotionProfiles::commit() {
+  store_.checksum = computeFletcher32(&store_, offsetof(Store, checksum));
+  flashStorage.write(PROFILE_STORE_START, (byte *) &store_, sizeof(store_));
+}
+
+/**
+ * Print the active profile to a port in the same format as parse(), e.g.,
+ * 1,samus,8000,2000,213333,3300000,200,200,100,500.
+ */
+void MotionProfiles::printActive(Print &port) const {
+  const MotionProfile &profile = active();
+  port.print(store_.activeSlot);
+  port.print(',');
+  port.print(profile.name);
+  port.print(',');
+  port.print(profile.fastPwmFrequency);
+  port.print(',');
+  port.print(profile.slowPwmFrequency);
+  port.print(',');
+  port.print(profile.distanceToSlowDown);
+  port.print(',');
+  port.print(profile.timeToSlowDown);
+  port.print(',');
+  port.print(profile.debounceUp);
+  port.print(',');
+  port.print(profile.debounceDown);
+  port.print(',');
+  port.print(profile.debounceSafety);
+  port.print(',');
+  port.print(profile.debounceButton);
+}
+
+/**
+ * Send the active profile through the programming port, e.g.,
+ * <q1,samus,8000,2000,213333,3300000,200,200,100,500>.
+ */
+void MotionProfiles::sendByProgrammingPort() const {
+  Serial.print("<q");
+  printActive(Serial);
+  Serial.print(">");
+}
@@ -0,0 +1,82 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The named motion profiles which tune the probe speeds and the sensor
+ * debounce windows for different products.
+ *
+ * The profiles are uploaded by the host from the board config and are kept in
+ * flash together with the selection so that the fixture keeps running the
+ * selected profile after a reset.
+ */
+
+
+#ifndef MotionProfile_h
+#define MotionProfile_h
+
+#include <stdint.h>
+
+class Print;
+
+// The offset of the profile store relative to the start of the flash bank 1.
+// It takes the flash pages right before the wear log.
+extern const uint32_t PROFILE_STORE_START;
+
+// A motion profile. All durations are in milli-seconds unless specified.
+struct MotionProfile {
+  // the profile name, null-terminated
+  char name[12];
+  // the pwm frequency at the peak speed and at the approach speed
+  uint32_t fastPwmFrequency;
+  uint32_t slowPwmFrequency;
+  // the probe slows down after this loop count or this time in micro-seconds
+  uint32_t distanceToSlowDown;
+  uint32_t timeToSlowDown;
+  // the debounce windows of the up (and extreme up), down, safety sensors, and
+  // the time to confirm a press or a release of the debug button
+  uint32_t debounceUp;
+  uint32_t debounceDown;
+  uint32_t debounceSafety;
+  uint32_t debounceButton;
+};
+
+
+class MotionProfiles {
+  public:
+    // Slot 0 is the built-in default profile which could not be overwritten.
+    static const unsigned int MAX_PROFILES = 8;
+    static const unsigned int DEFAULT_SLOT = 0;
+
+    MotionProfiles();
+
+    void begin(const MotionProfile &defaultProfile);
+    bool upload(unsigned int slot, const MotionProfile &profile);
+    bool select(unsigned int slot);
+    static bool parse(const char *str, unsigned int *slot,
+                      MotionProfile *profile);
+    static bool isValid(const MotionProfile &profile);
+
+    const MotionProfile& active() const {
+      return store_.profiles[store_.activeSlot];
+    }
+    unsigned int activeSlot() const { return store_.activeSlot; }
+
+    // communication
+    void printActive(Print &port) const;
+    void sendByProgrammingPort() const;
+
+  private:
+    void commit();
+
+    // The content kept in flash.
+    struct Store {
+      uint32_t magic;
+      uint32_t activeSlot;
+      MotionProfile profiles[MAX_PROFILES];
+      uint32_t checksum;
+    };
+    Store store_;
+};
+
+#endif
@@ -0,0 +1,265 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The wear log which keeps the lifetime odometer of the fixture in flash.
+ */
+
+#include "Arduino.h"
+#include <DueFlashStorage.h>
+#include "Fixture.h"
+#include "WearLog.h"
+
+// The size of a record slot. It divides the flash page size so that a record
+// never crosses a page boundary.
+const uint32_t WEAR_LOG_RECORD_SIZE = 64;
+
+// The wear log occupies the last WEAR_LOG_SIZE bytes of the flash bank 1
+// which is the bank managed by DueFlashStorage. The sketch is stored in
+// bank 0 and hence could not overlap with the wear log.
+// With 1024 slots and the commit interval below, a page is erased no more than
+// once every 4 hours even if the fixture never stops moving.
+const uint32_t WEAR_LOG_SIZE = 64 * 1024;
+const uint32_t WEAR_LOG_START = IFLASH1_SIZE - WEAR_LOG_SIZE;
+const unsigned int WEAR_LOG_SLOTS = WEAR_LOG_SIZE / WEAR_LOG_RECORD_SIZE;
+
+// The counters of normal cycles are committed no more often than this
+// interval (in milli-seconds). Emergency stops, fault stops, and reboots are
+// committed at the next rest state regardless of the interval.
+const unsigned long WEAR_LOG_COMMIT_INTERVAL = 60000;
+
+DueFlashStorage flashStorage;
+
+
+/**
+ * Initialize the counters. The counters are loaded from flash by begin().
+ */
+WearLog::WearLog() {
+  memset(&record_, 0, sizeof(record_));
+  slot_ = WEAR_LOG_SLOTS - 1;
+  dirty_ = false;
+  urgent_ = false;
+  lastCommit_ = 0;
+  running_ = false;
+  segmentDir_ = MOTOR_DIR_UP;
+  segmentPwm_ = 0;
+  segmentStart_ = 0;
+}
+
+/**
+ * Load the latest valid record from flash and count this boot.
+ *
+ * Erased flash reads 0xFF, so an erased slot never passes the checksum.
+ * If no valid record is found, the counters start from zero.
+ */
+void WearLog::begin() {
+  bool found = false;
+  for (unsigned int slot = 0; slot < WEAR_LOG_SLOTS; slot++) {
+    const Record *record =
+        (const Record *) flashStorage.readAddress(slotAddress(slot));
+    if (isValid(*record) && (!found || record->sequence > record_.sequence)) {
+      memcpy(&record_, record, sizeof(record_));
+      slot_ = slot;
+      found = true;
+    }
+  }
+  record_.reboots++;
+  dirty_ = true;
+  urgent_ = true;
+}
+
+/**
+ * Start accumulating the steps and the unlocked time of a motor segment.
+ *
+ * The motor segment is shared with the speed timer ISR, so it is updated with
+ * the interrupts masked. The mask is saved and restored rather than cleared
+ * since speedChanged() runs in the ISR.
+ */
+void WearLog::motorUnlocked(bool direction, unsigned int pwmFrequency) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  unsigned long now = micros();
+  if (running_)
+    closeSegment(now);
+  running_ = true;
+  segmentDir_ = direction;
+  segmentPwm_ = pwmFrequency;
+  segmentStart_ = now;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * Split the motor segment when the speed changes.
+ *
+ * This could be called in the speed timer ISR.
+ */
+void WearLog::speedChanged(unsigned int pwmFrequency) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (running_ && pwmFrequency != segmentPwm_) {
+    unsigned long now = micros();
+    closeSegment(now);
+    segmentPwm_ = pwmFrequency;
+    segmentStart_ = now;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * Stop accumulating the motor segment.
+ */
+void WearLog::motorLocked() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (running_) {
+    closeSegment(micros());
+    running_ = false;
+  }
+  __set_PRIMASK(primask);
+}
+
+/**
+ * Add the elapsed motor segment to the counters.
+ *
+ * A segment is at most a few seconds long so that the wrap-around of micros()
+ * is handled by the unsigned subtraction.
+ */
+void WearLog::closeSegment(unsigned long now) {
+  unsigned long elapsed = now - segmentStart_;
+  uint64_t steps = (uint64_t) elapsed * segmentPwm_ / 1000000;
+  if (segmentDir_ == MOTOR_DIR_DOWN)
+    record_.stepsDown += steps;
+  else
+    record_.stepsUp += steps;
+  record_.unlockedMillis += elapsed / 1000;
+  dirty_ = true;
+}
+
+/**
+ * Count a move which has reached its end position.
+ */
+void WearLog::addCycle(bool direction) {
+  if (direction == MOTOR_DIR_DOWN)
+    record_.downCycles++;
+  else
+    record_.upCycles++;
+  dirty_ = true;
+}
+
+/**
+ * Count an emergency stop.
+ */
+void WearLog::addEmergencyStop() {
+  record_.emergencyStops++;
+  dirty_ = true;
+  urgent_ = true;
+}
+
+/**
+ * Count a fault stop.
+ */
+void WearLog::addFaultStop() {
+  record_.faultStops++;
+  dirty_ = true;
+  urgent_ = true;
+}
+
+/**
+ * Commit the counters to flash if they are due.
+ *
+ * This must be called only when the probe is at rest since a flash write
+ * stalls the loop for a few milli-seconds.
+ */
+void WearLog::commitAtRest() {
+  if (!dirty_ || running_)
+    return;
+  if (urgent_ || millis() - lastCommit_ >= WEAR_LOG_COMMIT_INTERVAL)
+    commit();
+}
+
+/**
+ * Append the counters to the next slot in flash.
+ */
+void WearLog::commit() {
+  slot_ = (slot_ + 1) % WEAR_LOG_SLOTS;
+  record_.sequence++;
+  record_.checksum = computeFletcher32(&record_, offsetof(Record, checksum));
+  flashStorage.write(slotAddress(slot_), (byte *) &record_, sizeof(record_));
+  dirty_ = false;
+  urgent_ = false;
+  lastCommit_ = millis();
+}
+
+/**
+ * Get the flash address of a slot relative to the start of bank 1.
+ */
+uint32_t WearLog::slotAddress(unsigned int slot) const {
+  return WEAR_LOG_START + slot * WEAR_LOG_RECORD_SIZE;
+}
+
+/**
+ * Compute the Fletcher-32 checksum of the data of an even length in bytes.
+ */
+uint32_t computeFletcher32(const void *buf, size_t length) {
+  const uint16_t *data = (const uint16_t *) buf;
+  size_t words = length / sizeof(uint16_t);
+  uint32_t sum1 = 0xffff;
+  uint32_t sum2 = 0xffff;
+  for (size_t i = 0; i < words; i++) {
+    sum1 = (sum1 + data[i]) % 0xffff;
+    sum2 = (sum2 + sum1) % 0xffff;
+  }
+  return (sum2 << 16) | sum1;
+}
+
+/**
+ * Is the record written completely?
+ */
+bool WearLog::isValid(const Record &record) {
+  return (record.sequence != 0xffffffff &&
+          record.checksum ==
+              computeFletcher32(&record, offsetof(Record, checksum)));
+}
+
+/**
+ * Print an unsigned 64-bit value which is not supported by Print.
+ */
+static void printUint64(uint64_t value) {
+  char buf[21];
+  int pos = sizeof(buf) - 1;
+  buf[pos] = '\0';
+  do {
+    buf[--pos] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  Serial.print(&buf[pos]);
+}
+
+/**
+ * Send the counters through the programming port.
+ *
+ * The counters look like <o12,12,360000,360000,150000,1,0,3> which are
+ * downCycles, upCycles, stepsDown, stepsUp, unlockedMillis, emergencyStops,
+ * faultStops, and reboots in order. The values include the counters which
+ * have not been committed to flash yet.
+ */
+void WearLog::sendByProgrammingPort() const {
+  Serial.print("<o");
+  Serial.print(record_.downCycles);
+  Serial.print(',');
+  Serial.print(record_.upCycles);
+  Serial.print(',');
+  printUint64(record_.stepsDown);
+  Serial.print(',');
+  printUint64(record_.stepsUp);
+  Serial.print(',');
+  printUint64(record_.unlockedMillis);
+  Serial.print(',');
+  Serial.print(record_.emergencyStops);
+  Serial.print(',');
+  Serial.print(record_.faultStops);
+  Serial.print(',');
+  Serial.print(record_.reboots);
+  Serial.print(">");
+}
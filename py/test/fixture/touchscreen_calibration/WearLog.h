@@ -0,0 +1,99 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The wear log which keeps the lifetime odometer of the fixture in flash.
+ *
+ * The counters are accumulated in RAM and are appended to a ring of record
+ * slots in flash only when the probe is at rest so that a flash write never
+ * delays the motion. Every append goes to the next slot so that the erase
+ * cycles are spread over the whole region.
+ */
+
+
+#ifndef WearLog_h
+#define WearLog_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+class DueFlashStorage;
+
+// The flash storage shared by the wear log and the other persistent settings.
+extern DueFlashStorage flashStorage;
+// The offset of the wear log relative to the start of the flash bank 1.
+// The other persistent settings are stored right before it.
+extern const uint32_t WEAR_LOG_START;
+
+uint32_t computeFletcher32(const void *data, size_t length);
+
+
+class WearLog {
+  public:
+    // The lifetime counters of the fixture. A record occupies exactly one
+    // slot of WEAR_LOG_RECORD_SIZE bytes in flash.
+    struct Record {
+      // the sequence number of the record; the largest valid one is the latest
+      uint32_t sequence;
+      // the number of completed moves to the DOWN/UP end positions
+      uint32_t downCycles;
+      uint32_t upCycles;
+      // the number of emergency stops caused by the safety sensor
+      uint32_t emergencyStops;
+      // the number of stops at the extreme up sensor, i.e., an overtravel
+      uint32_t faultStops;
+      // the number of times the arduino board has been powered on or reset
+      uint32_t reboots;
+      // the motor steps in each direction
+      uint64_t stepsDown;
+      uint64_t stepsUp;
+      // the time in milli-seconds during which the motor has been unlocked
+      uint64_t unlockedMillis;
+      uint32_t reserved[3];
+      // the checksum of all the fields above
+      uint32_t checksum;
+    };
+
+    WearLog();
+
+    void begin();
+    void motorUnlocked(bool direction, unsigned int pwmFrequency);
+    void speedChanged(unsigned int pwmFrequency);
+    void motorLocked();
+    void addCycle(bool direction);
+    void addEmergencyStop();
+    void addFaultStop();
+    void commitAtRest();
+
+    const Record& record() const { return record_; }
+
+    // communication
+    void sendByProgrammingPort() const;
+
+  private:
+    void closeSegment(unsigned long now);
+    void commit();
+    uint32_t slotAddress(unsigned int slot) const;
+    static bool isValid(const Record &record);
+
+    // The counters in RAM which are ahead of the latest record in flash.
+    Record record_;
+    // The slot where the latest record is stored.
+    unsigned int slot_;
+    // Whether record_ has been changed since the last commit.
+    bool dirty_;
+    // Whether record_ holds an event which should be committed without delay.
+    bool urgent_;
+    // The millis() when record_ was committed last time.
+    unsigned long lastCommit_;
+
+    // The motor segment being accumulated: the motor runs in segmentDir_
+    // at segmentPwm_ since segmentStart_ in micro-seconds.
+    bool running_;
+    bool segmentDir_;
+    unsigned int segmentPwm_;
+    unsigned long segmentStart_;
+};
+
+#endif
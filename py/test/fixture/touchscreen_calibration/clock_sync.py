@@ -0,0 +1,176 @@
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Estimate the fixture firmware clock in terms of the host clock.
+
+The firmware only knows its millis() which starts from 0 at every reset and
+drifts with its crystal. The host pings the firmware for its millis() and
+records the host time before sending and after receiving the reply, like NTP
+does. The firmware time is sampled somewhere in between, so the middle of the
+round trip is the best guess of the host time at the moment of sampling and
+half of the round trip bounds the error.
+
+With two or more samples, the host time is fitted as a linear function of the
+firmware time so that both the offset and the drift are estimated. The samples
+with the shortest round trips are the most accurate and only those are used
+for the fitting.
+
+The firmware millis() advances with the host clock between two samples, or
+wraps around. If it does not, e.g., goes backwards without a wrap-around, the
+firmware has been reset and the earlier samples are dropped.
+"""
+
+import collections
+
+
+# millis() is an unsigned 32-bit counter in the firmware.
+FIRMWARE_MILLIS_WRAP = 1 << 32
+
+# The firmware millis() between two samples may differ from the host time by
+# this ratio for the drift plus this many milli-seconds for the round trips,
+# or the firmware is considered reset.
+MAX_DRIFT_RATIO = 0.01
+MAX_ROUND_TRIP_MILLIS = 1000
+
+ClockSample = collections.namedtuple(
+    'ClockSample', ['host_send', 'firmware_secs', 'host_receive'])
+
+
+class ClockSyncError(Exception):
+  """The clock synchronization has no samples yet."""
+
+
+class ClockSync:
+  """Translate the firmware millis() into the host time.
+
+  Usage:
+    clock_sync = ClockSync()
+    t0 = time.time()
+    millis = QueryFirmwareMillis()
+    clock_sync.AddSample(t0, millis, time.time())
+    host_time = clock_sync.ToHostTime(event_millis)
+  """
+
+  def __init__(self, max_samples=32, best_ratio=0.5):
+    """Constructor.
+
+    Args:
+      max_samples: the number of latest samples kept for the estimation.
+      best_ratio: the ratio of the samples with the shortest round trips
+          used for the estimation.
+    """
+    self.max_samples = max_samples
+    self.best_ratio = best_ratio
+    self._samples = collections.deque(maxlen=max_samples)
+    self._last_millis = None
+    self._last_host_time = None
+    self._wraps = 0
+    self._offset = None
+    self._drift = 0.0
+    self._error = None
+
+  def Reset(self):
+    """Forget all samples, e.g., after the firmware has been reset."""
+    self._samples.clear()
+    self._last_millis = None
+    self._last_host_time = None
+    self._wraps = 0
+    self._offset = None
+    self._drift = 0.0
+    self._error = None
+
+  def _IsReset(self, millis, host_time):
+    """Does the firmware millis() disagree with the host time elapsed?"""
+    elapsed_millis = (host_time - self._last_host_time) * 1000
+    advance = (millis - self._last_millis) % FIRMWARE_MILLIS_WRAP
+    return (abs(advance - elapsed_millis) >
+            abs(elapsed_millis) * MAX_DRIFT_RATIO + MAX_ROUND_TRIP_MILLIS)
+
+  def _UnwrapMillis(self, millis, host_time):
+    """Convert a firmware millis() into monotonic seconds.
+
+    The samples taken before a reset of the firmware are dropped.
+    """
+    if self._last_millis is not None and self._IsReset(millis, host_time):
+      self.Reset()
+    if self._last_millis is not None and millis < self._last_millis:
+      self._wraps += 1
+    self._last_millis = millis
+    self._last_host_time = host_time
+    return (self._wraps * FIRMWARE_MILLIS_WRAP + millis) / 1000.0
+
+  def AddSample(self, host_send, firmware_millis, host_receive):
+    """Add a ping sample and update the estimation.
+
+    Samples must be added in the order they are taken. If the firmware has
+    been reset since the previous sample, the estimation starts over.
+
+    Args:
+      host_send: the host time in seconds before sending the ping.
+      firmware_millis: the firmware millis() in the reply.
+      host_receive: the host time in seconds after receiving the reply.
+    """
+    firmware_secs = self._UnwrapMillis(firmware_millis, host_send)
+    self._samples.append(ClockSample(host_send, firmware_secs, host_receive))
+    self._Estimate()
+
+  def _Estimate(self):
+    """Fit host_time = offset + (1 + drift) * firmware_secs."""
+    samples = sorted(self._samples, key=lambda s: s.host_receive - s.host_send)
+    samples = samples[:max(1, int(len(samples) * self.best_ratio))]
+    points = [(s.firmware_secs, (s.host_send + s.host_receive) / 2.0)
+              for s in samples]
+    self._error = (samples[0].host_receive - samples[0].host_send) / 2.0
+
+    if len(points) > 1:
+      n = len(points)
+      mean_x = sum(x for x, unused_y in points) / n
+      mean_y = sum(y for unused_x, y in points) / n
+      sxx = sum((x - mean_x) ** 2 for x, unused_y in points)
+      sxy = sum((x - mean_x) * (y - mean_y) for x, y in points)
+      if sxx > 0:
+        self._drift = sxy / sxx - 1.0
+        self._offset = mean_y - (1.0 + self._drift) * mean_x
+        return
+
+    # Not enough spread to estimate the drift; keep the last drift estimation.
+    x, y = points[0]
+    self._offset = y - (1.0 + self._drift) * x
+
+  @property
+  def synchronized(self):
+    return self._offset is not None
+
+  @property
+  def offset(self):
+    """The host time in seconds when the firmware millis() was 0."""
+    return self._offset
+
+  @property
+  def drift_ppm(self):
+    """The rate of the firmware clock relative to the host clock in ppm.
+
+    A positive value means that the firmware clock runs slower than the host.
+    """
+    return self._drift * 1e6
+
+  @property
+  def error(self):
+    """The upper bound of the error of the latest estimation in seconds."""
+    return self._error
+
+  def ToHostTime(self, firmware_millis):
+    """Translate a firmware millis() into the host time in seconds.
+
+    The firmware millis() should be close to the latest sample, i.e., within
+    half of the 49-day wrap-around period.
+    """
+    if not self.synchronized:
+      raise ClockSyncError('No clock sample has been taken.')
+    delta = (firmware_millis - self._last_millis) % FIRMWARE_MILLIS_WRAP
+    if delta >= FIRMWARE_MILLIS_WRAP // 2:
+      delta -= FIRMWARE_MILLIS_WRAP
+    firmware_secs = (self._wraps * FIRMWARE_MILLIS_WRAP +
+                     self._last_millis + delta) / 1000.0
+    return self._offset + (1.0 + self._drift) * firmware_secs
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for clock_sync."""
+
+import unittest
+
+from cros.factory.test.fixture.touchscreen_calibration import clock_sync
+
+
+class ClockSyncTest(unittest.TestCase):
+
+  def _AddSample(self, sync, host_time, rtt, offset, drift=0.0):
+    """Add a sample taken in the middle of a round trip of rtt seconds."""
+    firmware_secs = (host_time - offset) / (1.0 + drift)
+    sync.AddSample(host_time - rtt / 2.0, int(firmware_secs * 1000),
+                   host_time + rtt / 2.0)
+
+  def testNotSynchronized(self):
+    sync = clock_sync.ClockSync()
+    self.assertFalse(sync.synchronized)
+    self.assertRaises(clock_sync.ClockSyncError, sync.ToHostTime, 1000)
+
+  def testSingleSample(self):
+    sync = clock_sync.ClockSync()
+    self._AddSample(sync, 1000.0, 0.01, offset=990.0)
+    self.assertTrue(sync.synchronized)
+    self.assertAlmostEqual(sync.offset, 990.0, places=3)
+    self.assertAlmostEqual(sync.error, 0.005)
+    self.assertAlmostEqual(sync.ToHostTime(12000), 1002.0, places=3)
+
+  def testDrift(self):
+    sync = clock_sync.ClockSync()
+    for i in range(10):
+      self._AddSample(sync, 1000.0 + i * 60, 0.01, offset=990.0, drift=50e-6)
+    self.assertAlmostEqual(sync.drift_ppm, 50, delta=1)
+    self.assertAlmostEqual(sync.ToHostTime(1000000), 1990.05, places=2)
+
+  def testPreferShortRoundTrips(self):
+    sync = clock_sync.ClockSync(best_ratio=0.5)
+    # The replies of the slow samples are delayed on the way back.
+    for i in range(10):
+      host_time = 1000.0 + i
+      self._AddSample(sync, host_time, 0.002, offset=990.0)
+      sync.AddSample(host_time - 0.001, int((host_time - 990.0) * 1000),
+                     host_time + 0.5)
+    self.assertAlmostEqual(sync.offset, 990.0, places=2)
+    self.assertAlmostEqual(sync.error, 0.001)
+
+  def testMillisWrapAround(self):
+    sync = clock_sync.ClockSync()
+    wrap = clock_sync.FIRMWARE_MILLIS_WRAP
+    sync.AddSample(99.999, wrap - 1000, 100.001)
+    sync.AddSample(101.999, 1000, 102.001)
+    self.assertAlmostEqual(sync.drift_ppm, 0, delta=1)
+    self.assertAlmostEqual(sync.ToHostTime(wrap - 500), 100.5, places=3)
+    self.assertAlmostEqual(sync.ToHostTime(1500), 102.5, places=3)
+
+  def testFirmwareReset(self):
+    sync = clock_sync.ClockSync()
+    for i in range(5):
+      self._AddSample(sync, 1000.0 + i * 60, 0.01, offset=900.0, drift=50e-6)
+    # The firmware is reset after running for a few minutes, so its millis()
+    # goes backwards.
+    self._AddSample(sync, 1300.0, 0.01, offset=1290.0)
+    self.assertAlmostEqual(sync.offset, 1290.0, places=3)
+    self.assertEqual(sync.drift_ppm, 0)
+    self.assertAlmostEqual(sync.ToHostTime(20000), 1310.0, places=3)
+
+  def testFirmwareResetMillisForward(self):
+    sync = clock_sync.ClockSync()
+    self._AddSample(sync, 1000.0, 0.01, offset=990.0)
+    # Reset shortly after the sample, then sampled again 10 minutes later.
+    self._AddSample(sync, 1600.0, 0.01, offset=1001.0)
+    self.assertAlmostEqual(sync.offset, 1001.0, places=3)
+    self.assertAlmostEqual(sync.ToHostTime(599000), 1600.0, places=3)
+
+  def testReset(self):
+    sync = clock_sync.ClockSync()
+    self._AddSample(sync, 1000.0, 0.01, offset=990.0)
+    sync.Reset()
+    self.assertFalse(sync.synchronized)
+
+
+if __name__ == '__main__':
+  unittest.main()
@@ -0,0 +1,423 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Benchmark the calibration cycle against the virtual fixture.
+
+Each scenario drives sim/build/virtual_fixture through FixtureSerialDevice,
+the same host code as the touchscreen_calibration test, and measures the wall
+time on the host and the virtual time on the firmware clock. The times are
+compared with the baseline committed next to this file so that a firmware or
+host change which slows down the line shows up as a per-scenario delta:
+
+  $ make -C sim
+  $ ./cycle_benchmark.py
+  $ ./cycle_benchmark.py --update-baseline   # after an intended change
+"""
+
+import argparse
+import collections
+import json
+import logging
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from cros.factory.test.fixture.touchscreen_calibration import fixture
+
+
+_DIR = os.path.dirname(os.path.abspath(__file__))
+DEFAULT_VIRTUAL_FIXTURE = os.path.join(_DIR, 'sim', 'build', 'virtual_fixture')
+DEFAULT_BASELINE = os.path.join(_DIR, 'cycle_benchmark_baseline.json')
+
+# The probe position in steps of the mid-travel, see sim/Plant.h.
+MID_TRAVEL_POSITION = 12000
+
+# The seconds to wait for the ptys of the virtual fixture.
+PORT_TIMEOUT = 10
+
+# The seconds the touchscreen_calibration test waits for the probe to touch
+# the panel stably.
+TOUCH_SETTLE_TIME = 1
+
+# A scenario regresses if it is slower than the baseline by both margins.
+DEFAULT_TOLERANCE_RATIO = 0.1
+DEFAULT_TOLERANCE_SECS = 0.2
+
+# The times of a scenario in seconds.
+Measurement = collections.namedtuple('Measurement',
+                                     ['wall_time', 'virtual_time'])
+# The change of a time of a scenario from the baseline.
+Delta = collections.namedtuple(
+    'Delta', ['scenario', 'key', 'baseline', 'current', 'regressed'])
+
+
+class BenchmarkError(Exception):
+  pass
+
+
+class FakeSensorService:
+  """A sensor service which returns canned touched deltas.
+
+  It implements the methods of sensors_server.BaseSensorService used by the
+  PHASE_DELTAS_TOUCHED phase, each of which takes read_time seconds.
+  """
+
+  def __init__(self, rows=4, cols=4, value=100, read_time=0):
+    self.data = [[value] * cols for unused_row in range(rows)]
+    self.read_time = read_time
+    self.calls = []
+
+  def _Call(self, name):
+    self.calls.append(name)
+    time.sleep(self.read_time)
+
+  def CheckStatus(self):
+    return True
+
+  def PreRead(self):
+    self._Call('PreRead')
+    return True
+
+  def Read(self, category):
+    self._Call('Read')
+    del category  # Unused.
+    return self.data
+
+  def VerifyDeltasTouched(self, data):
+    values = [value for row in data for value in row]
+    return True, [], min(values), max(values)
+
+  def PostRead(self):
+    self._Call('PostRead')
+    return True
+
+
+class VirtualFixture:
+  """Runs sim/build/virtual_fixture with its ports symlinked in a temp dir."""
+
+  def __init__(self, binary=DEFAULT_VIRTUAL_FIXTURE, position=0,
+               loopback=False):
+    self.binary = binary
+    self.position = position
+    self.loopback = loopback
+    self.temp_dir = None
+    self.process = None
+    self.port = None
+    self.native_usb_port = None
+
+  def Start(self):
+    self.temp_dir = tempfile.mkdtemp(prefix='virtual_fixture.')
+    self.port = os.path.join(self.temp_dir, 'programming')
+    self.native_usb_port = os.path.join(self.temp_dir, 'native')
+    command = [self.binary, '--programming-link', self.port,
+               '--native-link', self.native_usb_port,
+               '--position', str(self.position)]
+    if self.loopback:
+      command.append('--loopback')
+    self.process = subprocess.Popen(
+        command, stdin=subprocess.PIPE, stdout=subprocess.DEVNULL,
+        encoding='ascii')
+    deadline = time.time() + PORT_TIMEOUT
+    while not (os.path.exists(self.port) and
+               os.path.exists(self.native_usb_port)):
+      if time.time() > deadline or self.process.poll() is not None:
+        self.Stop()
+        raise BenchmarkError('%s did not create its ports' % self.binary)
+      time.sleep(0.01)
+
+  def Control(self, line):
+    """Send a control line like 'safety 1' to the plant."""
+    self.process.stdin.write(line + '\n')
+    self.process.stdin.flush()
+
+  def Stop(self):
+    if self.process:
+      if self.process.poll() is None:
+        try:
+          self.Control('quit')
+          self.process.wait(timeout=5)
+        except (OSError, subprocess.TimeoutExpired):
+          self.process.kill()
+          self.process.wait()
+      self.process = None
+    if self.temp_dir:
+      shutil.rmtree(self.temp_dir, ignore_errors=True)
+      self.temp_dir = None
+
+  def Connect(self):
+    return fixture.FixtureSerialDevice(
+        port=self.port, native_usb_port=self.native_usb_port)
+
+  def __enter__(self):
+    self.Start()
+    return self
+
+  def __exit__(self, *unused_args):
+    self.Stop()
+
+
+def _Disconnect(device):
+  device.native_usb.Disconnect()
+  device.Disconnect()
+
+
+def _FirmwareMillis(device):
+  """Get millis() of the firmware."""
+  device.FlushBuffer()
+  device.Send(fixture.COMMAND.TIME)
+  frame = device._ReceiveFrame()  # pylint: disable=protected-access
+  if not frame.startswith(fixture.COMMAND.TIME):
+    raise BenchmarkError('Unexpected time frame: %s' % frame)
+  return int(frame[1:])
+
+
+def _Measure(device, action):
+  """Measure an action on a connected fixture."""
+  millis = _FirmwareMillis(device)
+  start = time.time()
+  action()
+  wall_time = time.time() - start
+  virtual_time = (_FirmwareMillis(device) - millis) / 1000.0
+  return Measurement(wall_time, virtual_time)
+
+
+def _Boot(binary, position, ready_states):
+  """Boot a virtual fixture and connect to it until it is in a ready state.
+
+  The virtual time is from the power on of the firmware.
+  """
+  start = time.time()
+  with VirtualFixture(binary, position) as virtual_fixture:
+    device = virtual_fixture.Connect()
+    try:
+      device.AssertStateWithTimeout(ready_states, 60)
+      wall_time = time.time() - start
+      virtual_time = _FirmwareMillis(device) / 1000.0
+    finally:
+      _Disconnect(device)
+  return Measurement(wall_time, virtual_time)
+
+
+def ColdBoot(binary):
+  """From power on with the probe at UP until the host sees it ready."""
+  return _Boot(binary, 0, [fixture.STATE.INIT])
+
+
+def HomeFromMidTravel(binary):
+  """From power on with the probe mid-travel until it is homed to UP."""
+  return _Boot(binary, MID_TRAVEL_POSITION, [fixture.STATE.STOP_UP])
+
+
+def _RunConnected(binary, scenario):
+  with VirtualFixture(binary) as virtual_fixture:
+    device = virtual_fixture.Connect()
+    try:
+      return scenario(virtual_fixture, device)
+    finally:
+      _Disconnect(device)
+
+
+def NominalDown(binary):
+  """A down move from UP."""
+  def _Scenario(unused_virtual_fixture, device):
+    return _Measure(device, device.DriveProbeDown)
+  return _RunConnected(binary, _Scenario)
+
+
+def NominalUp(binary):
+  """An up move from DOWN."""
+  def _Scenario(unused_virtual_fixture, device):
+    device.DriveProbeDown()
+    return _Measure(device, device.DriveProbeUp)
+  return _RunConnected(binary, _Scenario)
+
+
+def RunDeltasTouched(device, sensors, settle_time=TOUCH_SETTLE_TIME):
+  """Run the fixture and sensor steps of PHASE_DELTAS_TOUCHED.
+
+  This follows touchscreen_calibration.TouchscreenCalibration._DoTest()
+  without the UI and the logs.
+  """
+  if not device.IsStateUp():
+    raise BenchmarkError('Fixture not in UP position.')
+  sensors.PreRead()
+  device.DriveProbeDown()
+  time.sleep(settle_time)
+  test_pass, unused_failed, unused_min, unused_max = (
+      sensors.VerifyDeltasTouched(sensors.Read('deltas')))
+  if not test_pass:
+    raise BenchmarkError('Fake deltas failed the verification.')
+  device.DriveProbeUp()
+  device.SyncClockIfDue()
+  sensors.PostRead()
+
+
+def DeltasTouched(binary):
+  """The PHASE_DELTAS_TOUCHED sequence with a fake sensor service."""
+  def _Scenario(unused_virtual_fixture, device):
+    sensors = FakeSensorService()
+    return _Measure(device, lambda: RunDeltasTouched(device, sensors))
+  return _RunConnected(binary, _Scenario)
+
+
+def _WaitForState(device, state, timeout=30):
+  deadline = time.time() + timeout
+  while device.QueryState() != state:
+    if time.time() > deadline:
+      raise BenchmarkError('Fixture never reached state %s' % state)
+    time.sleep(0.05)
+
+
+def EmergencyRecovery(binary):
+  """From a safety trip during a down move until the probe is back at UP.
+
+  The host requests the recovery as soon as the firmware accepts it.
+  """
+  def _Recover(virtual_fixture, device):
+    virtual_fixture.Control('safety 1')
+    _WaitForState(device, fixture.STATE.EMERGENCY_STOP)
+    virtual_fixture.Control('safety 0')
+    while True:
+      try:
+        device.RecoverFromEmergencyStop('cycle benchmark')
+        return
+      except fixture.FixtureException:
+        time.sleep(0.1)
+
+  def _Scenario(virtual_fixture, device):
+    device.Send(fixture.COMMAND.DOWN)
+    time.sleep(1)
+    return _Measure(device, lambda: _Recover(virtual_fixture, device))
+  return _RunConnected(binary, _Scenario)
+
+
+SCENARIOS = collections.OrderedDict([
+    ('cold_boot', ColdBoot),
+    ('home_from_mid_travel', HomeFromMidTravel),
+    ('nominal_down', NominalDown),
+    ('nominal_up', NominalUp),
+    ('deltas_touched', DeltasTouched),
+    ('emergency_recovery', EmergencyRecovery),
+])
+
+
+def RunScenario(name, binary, repeat=1):
+  """Run a scenario and take the median of each time over the repeats."""
+  measurements = [SCENARIOS[name](binary) for unused_i in range(repeat)]
+  return Measurement(*[_Median(values) for values in zip(*measurements)])
+
+
+def _Median(values):
+  values = sorted(values)
+  middle = len(values) // 2
+  if len(values) % 2:
+    return values[middle]
+  return (values[middle - 1] + values[middle]) / 2.0
+
+
+def LoadBaseline(path):
+  """Load the baseline like {scenario: {wall_time: secs, virtual_time: secs}}.
+
+  Returns an empty baseline if the file does not exist.
+  """
+  if not os.path.exists(path):
+    return {}
+  with open(path) as f:
+    return json.load(f)
+
+
+def SaveBaseline(path, baseline):
+  rounded = {name: {key: round(value, 3) for key, value in times.items()}
+             for name, times in baseline.items()}
+  with open(path, 'w') as f:
+    json.dump(rounded, f, indent=2, sort_keys=True)
+    f.write('\n')
+
+
+def Compare(baseline, results, tolerance_ratio=DEFAULT_TOLERANCE_RATIO,
+            tolerance_secs=DEFAULT_TOLERANCE_SECS):
+  """Compare the results with the baseline.
+
+  A time regresses if it exceeds the baseline by more than both the ratio and
+  the seconds of tolerance.
+
+  Returns:
+    A list of Delta, one per time of each scenario in the results. The
+    baseline is None if the scenario is not in the baseline.
+  """
+  deltas = []
+  for name, measurement in results.items():
+    for key, current in measurement._asdict().items():
+      base = baseline.get(name, {}).get(key)
+      regressed = (base is not None and
+                   current - base > max(base * tolerance_ratio,
+                                        tolerance_secs))
+      deltas.append(Delta(name, key, base, current, regressed))
+  return deltas
+
+
+def FormatDelta(delta):
+  if delta.baseline is None:
+    return '%-22s %-12s %8.3f s (no baseline)' % (
+        delta.scenario, delta.key, delta.current)
+  change = delta.current - delta.baseline
+  percent = change / delta.baseline * 100 if delta.baseline else 0.0
+  return '%-22s %-12s %8.3f s, baseline %8.3f s, %+7.3f s (%+.1f%%)%s' % (
+      delta.scenario, delta.key, delta.current, delta.baseline, change,
+      percent, '  REGRESSED' if delta.regressed else '')
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('scenarios', nargs='*',
+                      help='the scenarios to run, all if omitted: %s' %
+                      ', '.join(SCENARIOS))
+  parser.add_argument('--binary', default=DEFAULT_VIRTUAL_FIXTURE,
+                      help='the virtual_fixture binary built in sim')
+  parser.add_argument('--baseline', default=DEFAULT_BASELINE,
+                      help='the baseline json file')
+  parser.add_argument('--update-baseline', action='store_true',
+                      help='write the results to the baseline')
+  parser.add_argument('--repeat', type=int, default=1,
+                      help='take the median of this many runs per scenario')
+  parser.add_argument('--tolerance-ratio', type=float,
+                      default=DEFAULT_TOLERANCE_RATIO)
+  parser.add_argument('--tolerance-secs', type=float,
+                      default=DEFAULT_TOLERANCE_SECS)
+  args = parser.parse_args()
+  logging.basicConfig(level=logging.WARNING)
+  for name in args.scenarios:
+    if name not in SCENARIOS:
+      parser.error('unknown scenario: %s' % name)
+
+  results = collections.OrderedDict()
+  for name in args.scenarios or SCENARIOS:
+    results[name] = RunScenario(name, args.binary, args.repeat)
+
+  baseline = LoadBaseline(args.baseline)
+  deltas = Compare(baseline, results, args.tolerance_ratio,
+                   args.tolerance_secs)
+  for delta in deltas:
+    print(FormatDelta(delta))
+
+  if args.update_baseline:
+    baseline.update({name: dict(measurement._asdict())
+                     for name, measurement in results.items()})
+    SaveBaseline(args.baseline, baseline)
+    print('Updated %s' % args.baseline)
+    return
+
+  regressions = sum(delta.regressed for delta in deltas)
+  print('%d scenarios, %d regressed times' % (len(results), regressions))
+  sys.exit(1 if regressions else 0)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for cycle_benchmark."""
+
+import os
+import shutil
+import tempfile
+import unittest
+
+from cros.factory.test.fixture.touchscreen_calibration import cycle_benchmark
+
+
+Measurement = cycle_benchmark.Measurement
+
+
+class FakeDevice:
+  """Records the fixture calls of a scenario."""
+
+  def __init__(self, calls, state='U'):
+    self.calls = calls
+    self.state = state
+
+  def IsStateUp(self):
+    return self.state in ('i', 'U')
+
+  def SyncClockIfDue(self):
+    self.calls.append('SyncClockIfDue')
+
+  def DriveProbeDown(self):
+    self.calls.append('DriveProbeDown')
+
+  def DriveProbeUp(self):
+    self.calls.append('DriveProbeUp')
+
+
+class CompareTest(unittest.TestCase):
+
+  def testRegression(self):
+    baseline = {'nominal_down': {'wall_time': 6.0, 'virtual_time': 6.0}}
+    results = {'nominal_down': Measurement(7.0, 6.1)}
+    deltas = cycle_benchmark.Compare(baseline, results)
+    self.assertEqual([(d.key, d.regressed) for d in deltas],
+                     [('wall_time', True), ('virtual_time', False)])
+
+  def testToleranceSecs(self):
+    # 50% slower but only by 0.1 s.
+    baseline = {'cold_boot': {'wall_time': 0.2, 'virtual_time': 0.2}}
+    results = {'cold_boot': Measurement(0.3, 0.3)}
+    deltas = cycle_benchmark.Compare(baseline, results)
+    self.assertFalse(any(delta.regressed for delta in deltas))
+
+  def testNoBaseline(self):
+    deltas = cycle_benchmark.Compare({}, {'cold_boot': Measurement(1, 1)})
+    self.assertEqual([delta.baseline for delta in deltas], [None, None])
+    self.assertFalse(any(delta.regressed for delta in deltas))
+    self.assertIn('no baseline', cycle_benchmark.FormatDelta(deltas[0]))
+
+  def testFormatDelta(self):
+    delta = cycle_benchmark.Delta('nominal_up', 'wall_time', 5.0, 6.0, True)
+    line = cycle_benchmark.FormatDelta(delta)
+    self.assertIn('+1.000 s (+20.0%)', line)
+    self.assertIn('REGRESSED', line)
+
+
+class MedianTest(unittest.TestCase):
+
+  def testMedian(self):
+    # pylint: disable=protected-access
+    self.assertEqual(cycle_benchmark._Median([3, 1, 2]), 2)
+    self.assertEqual(cycle_benchmark._Median([4, 1, 2, 3]), 2.5)
+
+
+class BaselineTest(unittest.TestCase):
+
+  def setUp(self):
+    self.temp_dir = tempfile.mkdtemp()
+    self.path = os.path.join(self.temp_dir, 'baseline.json')
+
+  def tearDown(self):
+    shutil.rmtree(self.temp_dir)
+
+  def testMissing(self):
+    self.assertEqual(cycle_benchmark.LoadBaseline(self.path), {})
+
+  def testSaveAndLoad(self):
+    cycle_benchmark.SaveBaseline(
+        self.path, {'nominal_down': {'wall_time': 6.00049,
+                                     'virtual_time': 5.9}})
+    self.assertEqual(cycle_benchmark.LoadBaseline(self.path),
+                     {'nominal_down': {'wall_time': 6.0,
+                                       'virtual_time': 5.9}})
+
+
+class RunDeltasTouchedTest(unittest.TestCase):
+
+  def testSequence(self):
+    calls = []
+    sensors = cycle_benchmark.FakeSensorService()
+    sensors.calls = calls
+    cycle_benchmark.RunDeltasTouched(FakeDevice(calls), sensors,
+                                     settle_time=0)
+    self.assertEqual(calls, ['PreRead', 'DriveProbeDown', 'Read',
+                             'DriveProbeUp', 'SyncClockIfDue', 'PostRead'])
+
+  def testNotUp(self):
+    self.assertRaises(cycle_benchmark.BenchmarkError,
+                      cycle_benchmark.RunDeltasTouched,
+                      FakeDevice([], state='D'),
+                      cycle_benchmark.FakeSensorService(), 0)
+
+
+if __name__ == '__main__':
+  unittest.main()
@@ -0,0 +1,333 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Detect the drift of the fixture moves from a rolling robust baseline.
+
+Mechanical wear, a slipping belt or a loosening sensor bracket shows up as a
+slow drift of how the moves go long before a move fails. Each down and up move
+is taken from the state vectors of the fixture as a MoveRecord:
+
+  travel_ms: the time from the start of the move to the arrival.
+  slow_down_ms: the time from the start until the pwm frequency drops.
+  confirm_ms: the time from holding the probe on the raw edge of the end
+      sensor until the sensor is confirmed by its debounce window.
+  arrival_count: the count of the firmware at the arrival.
+
+Each of them is watched by an EWMA control chart against a baseline of its
+own. The baseline starts from the median and the MAD of the first moves, and
+then follows the moves with a much slower EWMA. Both EWMAs take the values
+clipped to 3 sigmas from the baseline, so that an outlier does not drag them.
+A metric drifts when its fast EWMA is more than 4 of its own sigmas away from
+the baseline. The baseline stops following a metric while it drifts, so a
+drift stays flagged until it goes away or the baseline is reset, e.g., after
+the fixture is serviced.
+
+The detector runs in the touchscreen_calibration test on the live state
+vectors, and could be replayed over a telemetry file:
+
+  $ ./drift.py /var/tmp/touchscreen_calibration/fixture_telemetry.bin
+"""
+
+import argparse
+import collections
+import json
+import math
+import time
+
+from cros.factory.test.fixture.touchscreen_calibration import telemetry
+
+
+MoveRecord = collections.namedtuple(
+    'MoveRecord', ['direction', 'start_ms', 'travel_ms', 'slow_down_ms',
+                   'confirm_ms', 'arrival_count'])
+METRICS = ['travel_ms', 'slow_down_ms', 'confirm_ms', 'arrival_count']
+DIRECTION_NAMES = {'d': 'down', 'u': 'up'}
+
+# The smallest sigma of each metric, which keeps a metric steady to the
+# milli-second, e.g., on the virtual fixture, from flagging every jitter.
+MIN_SIGMAS = {'travel_ms': 10.0, 'slow_down_ms': 10.0, 'confirm_ms': 2.0,
+              'arrival_count': 10.0}
+
+WARMUP_MOVES = 30
+BASELINE_ALPHA = 0.002
+ALPHA = 0.05
+THRESHOLD = 4.0
+# The values are clipped to this many sigmas from the baseline.
+CLIP_SIGMAS = 3.0
+
+# The sigma of a normal distribution in terms of its MAD and its mean absolute
+# deviation.
+MAD_TO_SIGMA = 1.4826
+MEAN_ABS_DEVIATION_TO_SIGMA = math.sqrt(math.pi / 2)
+
+DriftEvent = collections.namedtuple(
+    'DriftEvent', ['fixture_id', 'metric', 'drifting', 'baseline', 'current',
+                   'z'])
+
+_DUTY_CYCLE_MASK = 1 << telemetry.FLAG_NAMES.index('motor duty cycle')
+
+
+class MoveTracker:
+  """Assemble the MoveRecords from the frames of the state vectors."""
+
+  def __init__(self):
+    self._start = None
+    self._slow_down_ms = None
+    self._hold_ms = None
+
+  def AddFrame(self, frame):
+    """Add the next frame.
+
+    Returns:
+      The MoveRecord if the frame completes a move, or None.
+    """
+    start = self._start
+    if start is not None and frame.state == start.state:
+      if (self._slow_down_ms is None and
+          frame.pwm_frequency < start.pwm_frequency):
+        self._slow_down_ms = frame.time_ms - start.time_ms
+      if frame.sensor_bits & _DUTY_CYCLE_MASK:
+        # The probe resumes the move after a glitch of the end sensor.
+        self._hold_ms = None
+      elif self._hold_ms is None:
+        self._hold_ms = frame.time_ms
+      return None
+
+    self._start = None
+    if frame.state in telemetry.MOVE_END_STATES:
+      self._start = frame
+      self._slow_down_ms = None
+      self._hold_ms = None
+    elif start is not None and (
+        frame.state == telemetry.MOVE_END_STATES[start.state]):
+      return MoveRecord(
+          start.state, start.time_ms, frame.time_ms - start.time_ms,
+          self._slow_down_ms,
+          None if self._hold_ms is None else frame.time_ms - self._hold_ms,
+          frame.count)
+    return None
+
+
+class RobustBaseline:
+  """An EWMA control chart of a metric against its rolling robust baseline."""
+
+  def __init__(self, min_sigma, warmup=WARMUP_MOVES,
+               baseline_alpha=BASELINE_ALPHA, alpha=ALPHA):
+    self.min_sigma = min_sigma
+    self.warmup = warmup
+    self.baseline_alpha = baseline_alpha
+    self.alpha = alpha
+    self.Reset()
+
+  def Add(self, value):
+    """Add a value.
+
+    Returns:
+      The z-score of the fast EWMA from the baseline, or None while warming
+      up.
+    """
+    if self.center is None:
+      self.warmup_values.append(value)
+      if len(self.warmup_values) >= self.warmup:
+        self.center = _Median(self.warmup_values)
+        self.sigma = MAD_TO_SIGMA * _Median(
+            [abs(v - self.center) for v in self.warmup_values])
+        self.ewma = self.center
+        self.warmup_values = []
+      return None
+
+    sigma = max(self.sigma, self.min_sigma)
+    clip = CLIP_SIGMAS * sigma
+    clipped = min(max(value, self.center - clip), self.center + clip)
+    self.ewma += self.alpha * (clipped - self.ewma)
+    z = (self.ewma - self.center) / (
+        sigma * math.sqrt(self.alpha / (2 - self.alpha)))
+
+    if not self.drifting:
+      self.center += self.baseline_alpha * (clipped - self.center)
+      self.sigma += self.baseline_alpha * (
+          MEAN_ABS_DEVIATION_TO_SIGMA * abs(clipped - self.center) -
+          self.sigma)
+    return z
+
+  def Reset(self):
+    """Start over with a new baseline."""
+    self.warmup_values = []
+    self.center = None
+    self.sigma = None
+    self.ewma = None
+    self.drifting = False
+
+  def ToDict(self):
+    return {'warmup_values': self.warmup_values, 'center': self.center,
+            'sigma': self.sigma, 'ewma': self.ewma,
+            'drifting': self.drifting}
+
+  def FromDict(self, state):
+    self.warmup_values = list(state['warmup_values'])
+    self.center = state['center']
+    self.sigma = state['sigma']
+    self.ewma = state['ewma']
+    self.drifting = state['drifting']
+
+
+class DriftDetector:
+  """Watch the metrics of the moves of a fixture for drift.
+
+  Usage:
+    detector = DriftDetector('fixture-1')
+    tracker = MoveTracker()
+    for frame in frames:
+      record = tracker.AddFrame(frame)
+      if record:
+        for event in detector.AddMove(record):
+          print(FormatEvent(event))
+  """
+
+  def __init__(self, fixture_id, threshold=THRESHOLD, **kwargs):
+    self.fixture_id = fixture_id
+    self.threshold = threshold
+    self.baselines = collections.OrderedDict()
+    for direction in ('d', 'u'):
+      for metric in METRICS:
+        self.baselines[_MetricName(direction, metric)] = RobustBaseline(
+            MIN_SIGMAS[metric], **kwargs)
+
+  def AddMove(self, record):
+    """Add a move.
+
+    Returns:
+      A list of DriftEvents of the metrics which start or stop drifting.
+    """
+    events = []
+    for metric in METRICS:
+      value = getattr(record, metric)
+      if value is None:
+        continue
+      name = _MetricName(record.direction, metric)
+      baseline = self.baselines[name]
+      z = baseline.Add(value)
+      if z is None:
+        continue
+      # Clear the drift with a hysteresis so that it does not flap.
+      if baseline.drifting:
+        drifting = abs(z) >= self.threshold / 2
+      else:
+        drifting = abs(z) > self.threshold
+      if drifting != baseline.drifting:
+        baseline.drifting = drifting
+        events.append(DriftEvent(self.fixture_id, name, drifting,
+                                 baseline.center, baseline.ewma, z))
+    return events
+
+  def Reset(self):
+    """Start over with new baselines, e.g., after the fixture is serviced."""
+    for baseline in self.baselines.values():
+      baseline.Reset()
+
+  def Drifting(self):
+    """Get the names of the metrics which are drifting."""
+    return [name for name, baseline in self.baselines.items()
+            if baseline.drifting]
+
+  def ToDict(self):
+    return {name: baseline.ToDict()
+            for name, baseline in self.baselines.items()}
+
+  def FromDict(self, state):
+    for name, baseline_state in state.items():
+      if name in self.baselines:
+        self.baselines[name].FromDict(baseline_state)
+
+
+def LoadDetector(path, fixture_id):
+  """Load the detector of a fixture from a JSON file of all the fixtures.
+
+  A new detector is returned if the file or the fixture is not there.
+  """
+  detector = DriftDetector(fixture_id)
+  try:
+    with open(path) as f:
+      states = json.load(f)
+  except (IOError, ValueError):
+    return detector
+  if fixture_id in states:
+    detector.FromDict(states[fixture_id])
+  return detector
+
+
+def SaveDetector(path, detector):
+  """Save the detector into a JSON file of all the fixtures."""
+  try:
+    with open(path) as f:
+      states = json.load(f)
+  except (IOError, ValueError):
+    states = {}
+  states[detector.fixture_id] = detector.ToDict()
+  with open(path, 'w') as f:
+    json.dump(states, f, indent=2, sort_keys=True)
+
+
+def FormatEvent(event):
+  if not event.drifting:
+    return '%s: %s is back to its baseline %.1f' % (
+        event.fixture_id, event.metric, event.baseline)
+  return '%s: %s drifts to %.1f from its baseline %.1f (z=%.1f)' % (
+      event.fixture_id, event.metric, event.current, event.baseline, event.z)
+
+
+def _MetricName(direction, metric):
+  return '%s %s' % (DIRECTION_NAMES[direction], metric)
+
+
+def _Median(values):
+  values = sorted(values)
+  middle = len(values) // 2
+  if len(values) % 2:
+    return values[middle]
+  return (values[middle - 1] + values[middle]) / 2.0
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('path', help='the telemetry file')
+  parser.add_argument('--fixture-id', default='fixture',
+                      help='the name of the fixture in the output')
+  parser.add_argument('--threshold', type=float, default=THRESHOLD,
+                      help='the z-score of the EWMA to flag a drift')
+  args = parser.parse_args()
+
+  detector = DriftDetector(args.fixture_id, threshold=args.threshold)
+  tracker = MoveTracker()
+  reader = telemetry.TelemetryReader(args.path)
+  moves = 0
+  try:
+    for frame in reader.Frames():
+      record = tracker.AddFrame(frame)
+      if record is None:
+        continue
+      moves += 1
+      for event in detector.AddMove(record):
+        print('%s %s' % (
+            time.strftime('%Y-%m-%d %H:%M:%S',
+                          time.localtime(record.start_ms / 1000.0)),
+            FormatEvent(event)))
+  finally:
+    reader.Close()
+
+  print('moves: %d' % moves)
+  for name, baseline in detector.baselines.items():
+    if baseline.center is None:
+      print('%-20s warming up' % name)
+    else:
+      print('%-20s baseline %.1f sigma %.1f ewma %.1f%s' % (
+          name, baseline.center, baseline.sigma, baseline.ewma,
+          '  DRIFTING' if baseline.drifting else ''))
+
+
+if __name__ == '__main__':
+  main()
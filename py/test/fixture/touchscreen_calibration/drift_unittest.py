@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for drift."""
+
+import os
+import random
+import shutil
+import tempfile
+import unittest
+
+from cros.factory.test.fixture.touchscreen_calibration import drift
+from cros.factory.test.fixture.touchscreen_calibration import telemetry
+
+
+MOVING_BITS = 0x1 | 0x80 | 0x200
+HOLDING_BITS = 0x1 | 0x80 | 0x100
+
+
+def _MakeMove(direction, start_ms, travel_ms, slow_down_ms, confirm_ms, count):
+  end = telemetry.MOVE_END_STATES[direction]
+  return [
+      telemetry.Frame(start_ms, direction, MOVING_BITS, 6000, 0),
+      telemetry.Frame(start_ms + slow_down_ms, direction, MOVING_BITS, 2000,
+                      0),
+      telemetry.Frame(start_ms + travel_ms - confirm_ms, direction,
+                      HOLDING_BITS, 2000, 0),
+      telemetry.Frame(start_ms + travel_ms, end, HOLDING_BITS, 2000, count),
+  ]
+
+
+def _MakeRecord(travel_ms, direction='d'):
+  return drift.MoveRecord(direction, 0, travel_ms, None, None, None)
+
+
+class MoveTrackerTest(unittest.TestCase):
+
+  def testMove(self):
+    tracker = drift.MoveTracker()
+    records = [tracker.AddFrame(frame)
+               for frame in _MakeMove('d', 1000, 5000, 3300, 100, 4321)]
+    self.assertEqual(records[:3], [None] * 3)
+    self.assertEqual(records[3],
+                     drift.MoveRecord('d', 1000, 5000, 3300, 100, 4321))
+
+  def testGlitchResumes(self):
+    frames = _MakeMove('u', 0, 4000, 2000, 50, 100)
+    # The probe was held on a glitch at 2500 ms and resumed.
+    frames[2:2] = [telemetry.Frame(2500, 'u', HOLDING_BITS, 2000, 0),
+                   telemetry.Frame(2510, 'u', MOVING_BITS, 2000, 0)]
+    tracker = drift.MoveTracker()
+    records = [tracker.AddFrame(frame) for frame in frames]
+    self.assertEqual(records[-1].confirm_ms, 50)
+
+  def testEmergencyStopAbortsMove(self):
+    frames = _MakeMove('d', 0, 5000, 3300, 100, 4321)[:2] + [
+        telemetry.Frame(4000, 'e', HOLDING_BITS, 2000, 0),
+        telemetry.Frame(6000, 'b', MOVING_BITS, 2000, 0),
+        telemetry.Frame(9000, 'U', HOLDING_BITS, 2000, 100)]
+    tracker = drift.MoveTracker()
+    self.assertEqual([tracker.AddFrame(frame) for frame in frames],
+                     [None] * 5)
+
+  def testNoSlowDownNorHold(self):
+    tracker = drift.MoveTracker()
+    tracker.AddFrame(telemetry.Frame(0, 'u', MOVING_BITS, 2000, 0))
+    self.assertEqual(
+        tracker.AddFrame(telemetry.Frame(900, 'U', HOLDING_BITS, 2000, 9)),
+        drift.MoveRecord('u', 0, 900, None, None, 9))
+
+
+class DriftDetectorTest(unittest.TestCase):
+
+  def setUp(self):
+    self.random = random.Random(0)
+
+  def _Feed(self, detector, travel_times, direction='d'):
+    events = []
+    for index, travel_ms in enumerate(travel_times):
+      for event in detector.AddMove(_MakeRecord(travel_ms, direction)):
+        events.append((index, event))
+    return events
+
+  def _Noisy(self, center, num_moves, sigma=30):
+    return [self.random.gauss(center, sigma) for unused_i in range(num_moves)]
+
+  def testSteadyNoFlags(self):
+    detector = drift.DriftDetector('f1')
+    self.assertEqual(self._Feed(detector, self._Noisy(5000, 3000)), [])
+    baseline = detector.baselines['down travel_ms']
+    self.assertAlmostEqual(baseline.center, 5000, delta=10)
+    self.assertAlmostEqual(baseline.sigma, 30, delta=5)
+
+  def testOutliersNoFlags(self):
+    travel_times = self._Noisy(5000, 1000)
+    for index in range(100, 1000, 97):
+      travel_times[index] = 9000
+    detector = drift.DriftDetector('f1')
+    self.assertEqual(self._Feed(detector, travel_times), [])
+
+  def testSlowDrift(self):
+    # The travel time grows by 0.2 ms a move, 40 ms after 200 moves.
+    travel_times = self._Noisy(5000, 500)
+    travel_times += [value + 0.2 * i
+                     for i, value in enumerate(self._Noisy(5000, 2000))]
+    events = self._Feed(drift.DriftDetector('f1'), travel_times)
+    self.assertTrue(events)
+    index, event = events[0]
+    self.assertTrue(event.drifting)
+    self.assertEqual(event.metric, 'down travel_ms')
+    self.assertEqual(event.fixture_id, 'f1')
+    self.assertGreater(event.z, drift.THRESHOLD)
+    # Flagged before the drift reaches 3 sigmas of a single move.
+    self.assertLess(index, 500 + 450)
+    self.assertIn('drifts to', drift.FormatEvent(event))
+
+  def testStepThenRecover(self):
+    travel_times = (self._Noisy(5000, 300) + self._Noisy(4800, 100) +
+                    self._Noisy(5000, 300))
+    events = self._Feed(drift.DriftDetector('f1'), travel_times, 'u')
+    self.assertEqual([(event.metric, event.drifting)
+                      for unused_index, event in events],
+                     [('up travel_ms', True), ('up travel_ms', False)])
+    self.assertLess(events[0][0], 320)
+    self.assertLess(events[0][1].z, 0)
+    self.assertIn('back to its baseline', drift.FormatEvent(events[1][1]))
+
+  def testConstantValuesUseMinSigma(self):
+    detector = drift.DriftDetector('f1')
+    self.assertEqual(self._Feed(detector, [5000] * 100 + [5005] * 100), [])
+    self.assertTrue(self._Feed(detector, [5100] * 100))
+
+  def testResetAfterService(self):
+    detector = drift.DriftDetector('f1')
+    self._Feed(detector, self._Noisy(5000, 100) + self._Noisy(4700, 100))
+    self.assertEqual(detector.Drifting(), ['down travel_ms'])
+    # The baseline does not follow the drift until it is reset.
+    self._Feed(detector, self._Noisy(4700, 1000))
+    self.assertEqual(detector.Drifting(), ['down travel_ms'])
+    detector.Reset()
+    self.assertEqual(self._Feed(detector, self._Noisy(4700, 1000)), [])
+    self.assertEqual(detector.Drifting(), [])
+
+  def testSaveAndLoad(self):
+    temp_dir = tempfile.mkdtemp()
+    try:
+      path = os.path.join(temp_dir, 'drift.json')
+      detector = drift.LoadDetector(path, 'f1')
+      self._Feed(detector, self._Noisy(5000, 100))
+      drift.SaveDetector(path, detector)
+      drift.SaveDetector(path, drift.DriftDetector('f2'))
+
+      loaded = drift.LoadDetector(path, 'f1')
+      self.assertEqual(loaded.ToDict(), detector.ToDict())
+      self.assertIsNone(
+          drift.LoadDetector(path, 'f2').baselines['down travel_ms'].center)
+      more = self._Noisy(5000, 10)
+      self.assertEqual(self._Feed(loaded, more), self._Feed(detector, more))
+      self.assertEqual(loaded.ToDict(), detector.ToDict())
+    finally:
+      shutil.rmtree(temp_dir)
+
+
+if __name__ == '__main__':
+  unittest.main()
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Measure the emergency stop latency of the fixture with its latency probe.
+
+The latency is the time from the safety sensor input becoming active until
+the firmware zeroes the step pwm of the motor, taken by the cycle counter of
+the arduino DUE. Replace the safety curtain with a loopback jumper from pin 12
+to the safety sensor input, then:
+
+  $ ./estop_latency.py --trials 50
+
+Each trial arms the probe and starts a down move. The firmware trips the input
+at a random time of the move, locks the motor, and reports the latency. The
+host then recovers the probe to UP. Use --virtual to run against
+sim/build/virtual_fixture with the loopback wired; sim/build/estop_bench runs
+many more trials on the simulated clock.
+"""
+
+import argparse
+import collections
+import logging
+import sys
+import time
+
+from cros.factory.test.fixture.touchscreen_calibration import cycle_benchmark
+from cros.factory.test.fixture.touchscreen_calibration import fixture
+
+
+# The firmware trips the input within 5 seconds after the move starts, and
+# accepts the recovery 3 seconds after the input is released.
+TRIP_TIMEOUT = 10
+RECOVER_DELAY = 3.2
+# The seconds for the firmware to take a command before the next query flushes
+# the buffers of the port.
+COMMAND_SETTLE_TIME = 0.1
+
+PERCENTILES = [0, 50, 90, 99, 99.9, 100]
+
+Summary = collections.namedtuple('Summary',
+                                 ['trials', 'missed', 'percentiles'])
+
+
+class LatencyError(Exception):
+  pass
+
+
+def _WaitForStates(device, states, timeout):
+  deadline = time.time() + timeout
+  while True:
+    state = device.QueryState()
+    if state in states:
+      return state
+    if time.time() > deadline:
+      raise LatencyError('Fixture stuck in state %s' % state)
+    time.sleep(0.05)
+
+
+def RunTrial(device):
+  """Trip the safety sensor input once during a down move.
+
+  Returns:
+    The latency in seconds, or None if the move completed before the trip.
+  """
+  if not device.IsStateUp():
+    raise LatencyError('Fixture not in UP position.')
+  device.ArmLatencyProbe()
+  device.Send(fixture.COMMAND.DOWN)
+  time.sleep(COMMAND_SETTLE_TIME)
+  state = _WaitForStates(
+      device, [fixture.STATE.EMERGENCY_STOP, fixture.STATE.STOP_DOWN],
+      TRIP_TIMEOUT)
+  latency = device.GetLatency()
+  if state == fixture.STATE.STOP_DOWN:
+    device.DriveProbeUp()
+    return None
+  time.sleep(RECOVER_DELAY)
+  device.RecoverFromEmergencyStop('emergency stop latency probe')
+  return latency
+
+
+def Percentile(values, percentile):
+  """Get the percentile of the values by the nearest lower rank."""
+  values = sorted(values)
+  return values[int(percentile / 100.0 * (len(values) - 1))]
+
+
+def Summarize(latencies):
+  """Summarize the latencies of the trials, None for a missed trial."""
+  taken = [latency for latency in latencies if latency is not None]
+  percentiles = collections.OrderedDict(
+      (percentile, Percentile(taken, percentile) if taken else None)
+      for percentile in PERCENTILES)
+  return Summary(len(latencies), len(latencies) - len(taken), percentiles)
+
+
+def FormatSummary(summary):
+  lines = ['trials: %d, missed: %d' % (summary.trials, summary.missed)]
+  if summary.percentiles[100] is None:
+    lines.append('latency (ms)  no samples')
+  else:
+    lines.append('latency (ms)' + ''.join(
+        '  p%g=%.3f' % (percentile, value * 1000)
+        for percentile, value in summary.percentiles.items()))
+  return '\n'.join(lines)
+
+
+def _RunTrials(device, trials):
+  latencies = []
+  for trial in range(trials):
+    latency = RunTrial(device)
+    latencies.append(latency)
+    print('trial %d: %s' % (trial, 'missed' if latency is None else
+                            '%.3f ms' % (latency * 1000)))
+  return latencies
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('--trials', type=int, default=20,
+                      help='the number of emergency stops')
+  parser.add_argument('--port', help='the programming port of the fixture')
+  parser.add_argument('--native-usb-port',
+                      help='the native usb port of the fixture')
+  parser.add_argument('--virtual', action='store_true',
+                      help='run against the virtual fixture')
+  parser.add_argument('--binary',
+                      default=cycle_benchmark.DEFAULT_VIRTUAL_FIXTURE,
+                      help='the virtual_fixture binary built in sim')
+  parser.add_argument('--budget-ms', type=float,
+                      help='fail if the worst latency is over this')
+  args = parser.parse_args()
+  logging.basicConfig(level=logging.WARNING)
+
+  if args.virtual:
+    with cycle_benchmark.VirtualFixture(args.binary,
+                                        loopback=True) as virtual_fixture:
+      device = virtual_fixture.Connect()
+      latencies = _RunTrials(device, args.trials)
+  else:
+    device = fixture.FixtureSerialDevice(
+        port=args.port, native_usb_port=args.native_usb_port)
+    latencies = _RunTrials(device, args.trials)
+
+  summary = Summarize(latencies)
+  print(FormatSummary(summary))
+  worst = summary.percentiles[100]
+  if worst is None or (args.budget_ms is not None and
+                       worst * 1000 > args.budget_ms):
+    sys.exit(1)
+
+
+if __name__ == '__main__':
+  main()
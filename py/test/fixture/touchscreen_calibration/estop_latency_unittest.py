@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for estop_latency."""
+
+import unittest
+from unittest import mock
+
+from cros.factory.test.fixture.touchscreen_calibration import estop_latency
+
+
+class FakeDevice:
+  """A fixture which reaches the given states after a down command."""
+
+  def __init__(self, states, latency):
+    self.states = list(states)
+    self.latency = latency
+    self.calls = []
+
+  def IsStateUp(self):
+    return True
+
+  def ArmLatencyProbe(self):
+    self.calls.append('ArmLatencyProbe')
+
+  def Send(self, command):
+    self.calls.append(command)
+
+  def QueryState(self):
+    return self.states.pop(0)
+
+  def GetLatency(self):
+    return self.latency
+
+  def DriveProbeUp(self):
+    self.calls.append('DriveProbeUp')
+
+  def RecoverFromEmergencyStop(self, unused_reason):
+    self.calls.append('RecoverFromEmergencyStop')
+
+
+@mock.patch('time.sleep', mock.Mock())
+class RunTrialTest(unittest.TestCase):
+
+  def testEmergencyStop(self):
+    device = FakeDevice(['d', 'd', 'e'], 0.1005)
+    self.assertEqual(estop_latency.RunTrial(device), 0.1005)
+    self.assertEqual(device.calls,
+                     ['ArmLatencyProbe', 'd', 'RecoverFromEmergencyStop'])
+
+  def testMissed(self):
+    device = FakeDevice(['d', 'D'], None)
+    self.assertIsNone(estop_latency.RunTrial(device))
+    self.assertEqual(device.calls, ['ArmLatencyProbe', 'd', 'DriveProbeUp'])
+
+
+class SummarizeTest(unittest.TestCase):
+
+  def testPercentiles(self):
+    latencies = [0.1 + i / 1e6 for i in range(1000)] + [None]
+    summary = estop_latency.Summarize(latencies)
+    self.assertEqual(summary.trials, 1001)
+    self.assertEqual(summary.missed, 1)
+    self.assertAlmostEqual(summary.percentiles[0], 0.1)
+    self.assertAlmostEqual(summary.percentiles[99.9], 0.100998)
+    self.assertAlmostEqual(summary.percentiles[100], 0.100999)
+    self.assertIn('p99.9=100.998', estop_latency.FormatSummary(summary))
+
+  def testNoSamples(self):
+    summary = estop_latency.Summarize([None, None])
+    self.assertIsNone(summary.percentiles[100])
+    self.assertIn('no samples', estop_latency.FormatSummary(summary))
+
+
+if __name__ == '__main__':
+  unittest.main()
@@ -3,10 +3,12 @@
 # found in the LICENSE file.
 
 import collections
+import re
 import threading
 import time
 
 from cros.factory.test import event
+from cros.factory.test.fixture.touchscreen_calibration import clock_sync
 from cros.factory.test.i18n import _
 from cros.factory.test import session
 from cros.factory.test.utils import serial_utils
@@ -20,37 +22,146 @@ NATIVE_USB_PORT = 0
 PROGRAMMING_PORT = 1
 ARDUINO_DRIVER = 'cdc_acm'
 interface_protocol_dict = {NATIVE_USB_PORT: '00', PROGRAMMING_PORT: '01'}
+# The baud rate of both ports, which should match SERIAL_BAUD_RATE in
+# Fixture.cpp.
+BAUDRATE = 9600
+# Synchronize the fixture clock again after this many seconds to refresh the
+# drift estimation and to detect a reset of the firmware.
+CLOCK_SYNC_INTERVAL = 300
 
 
 ArduinoCommand = collections.namedtuple(
-    'ArduinoCommand', ['DOWN', 'UP', 'STATE', 'RESET'])
-COMMAND = ArduinoCommand('d', 'u', 's', 'r')
+    'ArduinoCommand', ['DOWN', 'UP', 'STATE', 'RESET', 'STATS', 'RESET_STATS',
+                       'ODOMETER', 'TIME', 'RECOVER', 'PROFILE',
+                       'UPLOAD_PROFILE', 'SELECT_PROFILE', 'START_TRACE',
+                       'STOP_TRACE', 'ARM_LATENCY_PROBE', 'LATENCY',
+                       'IDENTITY', 'SET_IDENTITY', 'SET_RECOVER_TIME'])
+COMMAND = ArduinoCommand('d', 'u', 's', 'r', 't', 'T', 'o', 'm', 'b', 'q', 'l',
+                         'w', 'x', 'X', 'k', 'K', 'n', 'N', 'B')
+
+# The ordering of the sensor names should match Fixture::Sensors in Fixture.h
+SENSOR_NAMES = ['jumper', 'button debug', 'sensor extreme up', 'sensor up',
+                'sensor down', 'sensor safety']
+SENSOR_STATS_FIELDS = ['edges', 'activations', 'glitches', 'releases',
+                       'min_duration', 'max_duration', 'mean_duration']
+
+# The ordering of the odometer fields should match WearLog::sendByProgrammingPort
+ODOMETER_FIELDS = ['down_cycles', 'up_cycles', 'steps_down', 'steps_up',
+                   'unlocked_millis', 'emergency_stops', 'fault_stops',
+                   'reboots']
 
 ArduinoState = collections.namedtuple(
     'ArduinoState', ['INIT', 'STOP_DOWN', 'STOP_UP', 'GOING_DOWN', 'GOING_UP',
-                     'EMERGENCY_STOP'])
-STATE = ArduinoState('i', 'D', 'U', 'd', 'u', 'e')
+                     'EMERGENCY_STOP', 'GOING_UP_AFTER_EMERGENCY'])
+STATE = ArduinoState('i', 'D', 'U', 'd', 'u', 'e', 'b')
+
+# A motion profile of the fixture. The ordering of the fields should match
+# MotionProfile in MotionProfile.h. The debounce windows are in milli-seconds.
+# The one of the debug button is the time to confirm a press or a release.
+MotionProfile = collections.namedtuple(
+    'MotionProfile', ['fast_pwm_frequency', 'slow_pwm_frequency',
+                      'distance_to_slow_down', 'time_to_slow_down',
+                      'debounce_up', 'debounce_down', 'debounce_safety',
+                      'debounce_button'])
+# The slot 0 is the built-in default profile in the firmware.
+DEFAULT_PROFILE_NAME = 'default'
+MAX_PROFILES = 8
+MAX_PROFILE_NAME_LENGTH = 11
+
+
+def ParseMotionProfile(value_str):
+  """Parse a motion profile like '8000,2000,213333,3300000,200,200,100,500'.
+
+  This is the format of a profile in the [FixtureProfiles] section of the
+  board config.
+  """
+  values = [int(value) for value in value_str.split(',')]
+  if len(values) != len(MotionProfile._fields):
+    raise FixtureException('Bad motion profile: %s' % value_str)
+  return MotionProfile(*values)
+
+
+# The identity of a fixture: the name assigned by the host, which may be empty,
+# and the unique id of its chip in hex.
+FixtureIdentity = collections.namedtuple('FixtureIdentity',
+                                         ['name', 'unique_id'])
+MAX_FIXTURE_NAME_LENGTH = 15
+FIXTURE_NAME_PATTERN = re.compile(r'^[A-Za-z0-9_-]*$')
+
+
+def ParseFixtureIdentity(frame):
+  """Parse the content of an identity frame like nline3-a,3A1B...CDEF.
+
+  The frame is <n...> on the programming port and [n...] on the native usb
+  port.
+
+  Returns:
+    The FixtureIdentity, or None if the frame is not an identity frame.
+  """
+  frame = frame.strip('<>[]')
+  if not frame.startswith(COMMAND.IDENTITY) or ',' not in frame:
+    return None
+  name, unique_id = frame[1:].split(',', 1)
+  if not unique_id:
+    return None
+  return FixtureIdentity(name, unique_id.upper())
+
+
+# The reasons why COMMAND.RECOVER is rejected by the fixture.
+RECOVER_ERRORS = {
+    '1': 'unknown error',
+    '2': 'the fixture is not in the emergency stop state',
+    '3': 'the safety sensor has not been clear long enough',
+}
+# The minimum seconds for the safety sensor to be clear before the fixture
+# accepts COMMAND.RECOVER, which should match MIN_SAFETY_CLEAR_TIME_TO_RECOVER
+# in the sketch.
+MIN_RECOVER_CLEAR_TIME = 1
 
 
 class FixtureException(Exception):
   """A dummy exception class for FixtureSerialDevice."""
 
 
-class FixutreNativeUSB(serial_utils.SerialDevice):
+class TextSerialDevice(serial_utils.SerialDevice):
+  """A serial device which exchanges ASCII strings instead of bytes.
+
+  The fixture protocol is made of printable characters only.
+  """
+
+  def Send(self, command, flush=True):
+    super(TextSerialDevice, self).Send(command.encode('ascii'), flush=flush)
+
+  def Receive(self, size=1):
+    return super(TextSerialDevice, self).Receive(size).decode('ascii')
+
+
+class FixutreNativeUSB(TextSerialDevice):
   """A native usb port used to monitor the internal state of the fixture."""
 
   def __init__(self, driver=ARDUINO_DRIVER,
                interface_protocol=interface_protocol_dict[NATIVE_USB_PORT],
-               timeout=86400):
+               timeout=86400, clock_sync_obj=None, port=None):
+    """Constructor.
+
+    Args:
+      port: the tty of the port, e.g., a pty of the virtual fixture. If None,
+          the port is found by the driver and the interface protocol.
+    """
     super(FixutreNativeUSB, self).__init__()
     self.driver = driver
     self.interface_protocol = interface_protocol
+    self.fixed_port = port
     self.timeout = timeout
+    self.clock_sync = clock_sync_obj
 
     self.port = self._GetPort()
     self._Connect(self.port)
     self.state_string = None
     self.last_state_string = None
+    self.state_millis = None
+    # The file to record the trace frames and the state vectors.
+    self.trace_file = None
 
     # The ordering of the state names should match that in
     # touchscreen_calibration.ino
@@ -71,6 +182,8 @@ class FixutreNativeUSB(serial_utils.SerialDevice):
     ]
 
   def _GetPort(self):
+    if self.fixed_port:
+      return self.fixed_port
     return serial_utils.FindTtyByDriver(self.driver, self.interface_protocol)
 
   def _Connect(self, port):
@@ -94,9 +207,14 @@ class FixutreNativeUSB(serial_utils.SerialDevice):
   def GetState(self):
     """Get the fixture state from the native usb port.
 
-    The complete state_string looks like: <i1001000000.6000.0>
+    The complete state_string looks like: <i1001000000.6000.0.12345>
     Its format is defined in self.state_name_dict in __init__() above.
-    The first character describes the main state.
+    The first character describes the main state. The last field is the
+    firmware millis() when the state is sent.
+
+    When tracing, the trace frames enclosed in [] are interleaved with the
+    state vectors. They are recorded to self.trace_file with the state
+    vectors, one frame per line.
 
     This call is blocked until a complete fixture state has been received.
     Call this method with a new thread if needed.
@@ -105,20 +223,49 @@ class FixutreNativeUSB(serial_utils.SerialDevice):
     reply = []
     while True:
       ch = self.Receive()
+      if ch in '<[':
+        reply = []
       reply.append(ch)
-      if ch == '>':
-        self.last_state_string = self.state_string
-        self.state_string = ''.join(reply)
-        return self.state_string
+      if ch in '>]':
+        frame = ''.join(reply)
+        reply = []
+        if self.trace_file:
+          self.trace_file.write(frame + '\n')
+        if ch == '>':
+          self.last_state_string = self.state_string
+          self.state_string = frame
+          self.state_millis = self._ExtractMillis(self.state_string)
+          return self.state_string
+
+  def CancelGetState(self):
+    """Wakes up GetState() blocked in another thread, which raises."""
+    if self._serial:
+      self._serial.cancel_read()
 
   def QueryFixtureState(self):
     """Query fixture internal state."""
     self._CheckReconnection()
     self.Send('s')
 
+  def _ExtractMillis(self, state_string):
+    fields = state_string.strip().strip('<>').split('.')
+    return int(fields[3]) if len(fields) > 3 else None
+
+  def StateHostTime(self):
+    """Get the host time when the latest state was sent by the fixture.
+
+    Returns:
+      The host time in seconds, or None if the clock is not synchronized.
+    """
+    if (self.state_millis is None or self.clock_sync is None or
+        not self.clock_sync.synchronized):
+      return None
+    return self.clock_sync.ToHostTime(self.state_millis)
+
   def _ExtractStateList(self, state_string):
     if state_string:
-      state, pwm_freq, count = state_string.strip().strip('<>').split('.')
+      fields = state_string.strip().strip('<>').split('.')
+      state, pwm_freq, count = fields[:3]
       state_list = list(state)
       state_list.extend([pwm_freq, count])
     else:
@@ -140,7 +287,7 @@ class FixutreNativeUSB(serial_utils.SerialDevice):
             for i in range(len(state_list))]
 
 
-class BaseFixture(serial_utils.SerialDevice):
+class BaseFixture(TextSerialDevice):
   """A base fixture class."""
 
   def __init__(self, state=None):
@@ -187,16 +334,51 @@ class FakeFixture(BaseFixture):
     """Notify that the DriveProbeUp has been done."""
     self.final_calibration_lock.set()
 
+  def GetSensorStats(self):
+    """Gets the sensor health statistics."""
+    return {}
+
+  def ResetSensorStats(self):
+    """Resets the sensor health statistics."""
+
+  def GetOdometer(self):
+    """Gets the lifetime odometer of the fixture."""
+    return {}
+
+  def RecoverFromEmergencyStop(self, reason):
+    """Drives the probe back to the 'up' position after an emergency stop."""
+    session.console.info('Recover from emergency stop: %s', reason)
+    self.state = STATE.STOP_UP
+
+  def SetRecoverClearTime(self, seconds):
+    """Sets how long the safety sensor must be clear before recovery."""
+
+  def UploadMotionProfiles(self, profiles):
+    """Uploads the motion profiles."""
+
+  def SelectMotionProfile(self, name):
+    """Selects the active motion profile."""
+    session.console.info('Select motion profile: %s', name)
+
 
 class FixtureSerialDevice(BaseFixture):
   """A serial device to control touchscreen fixture."""
 
   def __init__(self, driver=ARDUINO_DRIVER,
                interface_protocol=interface_protocol_dict[PROGRAMMING_PORT],
-               timeout=20):
+               timeout=20, port=None, native_usb_port=None):
+    """Constructor.
+
+    Args:
+      port, native_usb_port: the ttys of the programming port and the native
+          usb port, e.g., the ptys of the virtual fixture in the sim directory.
+          If None, the ports are found by the driver and the interface
+          protocols.
+    """
     super(FixtureSerialDevice, self).__init__()
     try:
-      port = serial_utils.FindTtyByDriver(driver, interface_protocol)
+      if port is None:
+        port = serial_utils.FindTtyByDriver(driver, interface_protocol)
       self.Connect(port=port, timeout=timeout)
       msg = 'Connect to programming port "%s" for issuing commands.'
       session.console.info(msg, port)
@@ -208,8 +390,17 @@ class FixtureSerialDevice(BaseFixture):
     self.AssertStateWithTimeout([STATE.INIT, STATE.STOP_UP,
                                  STATE.EMERGENCY_STOP], timeout)
 
+    # The slots of the uploaded motion profiles by their names.
+    self.profile_slots = {DEFAULT_PROFILE_NAME: 0}
+
+    # Translate the firmware timestamps into the host time.
+    self.clock_sync = clock_sync.ClockSync()
+    self.clock_sync_time = None
+    self.SyncClock()
+
     # The 2nd-generation tst fixture has a native usb port.
-    self.native_usb = FixutreNativeUSB()
+    self.native_usb = FixutreNativeUSB(clock_sync_obj=self.clock_sync,
+                                       port=native_usb_port)
     if not self.native_usb:
       raise FixtureException('Fail to connect the native usb port.')
 
@@ -284,3 +475,332 @@ class FixtureSerialDevice(BaseFixture):
       raise FixtureException('DriveProbeUp failed.')
 
     self.AssertState(STATE.STOP_UP)
+
+  def _ReceiveFrame(self):
+    """Receives a frame like <...> and returns the content inside."""
+    reply = []
+    while True:
+      ch = self.Receive()
+      if ch == '<':
+        reply = []
+      elif ch == '>':
+        return ''.join(reply)
+      else:
+        reply.append(ch)
+
+  def GetSensorStats(self):
+    """Gets the sensor health statistics kept in the fixture RAM.
+
+    The statistics frame looks like <t3,2,1,2,230,260,245;...>, where the
+    values of every sensor are ordered as SENSOR_STATS_FIELDS and the sensors
+    are ordered as SENSOR_NAMES.
+
+    Returns:
+      A dict mapping a sensor name to a dict of its statistics.
+    """
+    try:
+      self.FlushBuffer()
+      self.Send(COMMAND.STATS)
+      frame = self._ReceiveFrame()
+    except Exception:
+      raise FixtureException('GetSensorStats failed.')
+
+    if not frame.startswith(COMMAND.STATS):
+      raise FixtureException('Unexpected sensor stats frame: %s' % frame)
+    sensor_stats = {}
+    for name, values in zip(SENSOR_NAMES, frame[1:].split(';')):
+      sensor_stats[name] = dict(zip(SENSOR_STATS_FIELDS,
+                                    map(int, values.split(','))))
+    return sensor_stats
+
+  def ResetSensorStats(self):
+    """Resets the sensor health statistics kept in the fixture RAM."""
+    try:
+      response = self.SendReceive(COMMAND.RESET_STATS)
+    except Exception:
+      raise FixtureException('ResetSensorStats failed.')
+    if response != '0':
+      raise FixtureException('ResetSensorStats got response: %s' % response)
+
+  def GetOdometer(self):
+    """Gets the lifetime odometer of the fixture kept in the fixture flash.
+
+    The odometer frame looks like <o12,12,360000,360000,150000,1,0,3>, where
+    the values are ordered as ODOMETER_FIELDS.
+
+    Returns:
+      A dict mapping an odometer field to its value.
+    """
+    try:
+      self.FlushBuffer()
+      self.Send(COMMAND.ODOMETER)
+      frame = self._ReceiveFrame()
+    except Exception:
+      raise FixtureException('GetOdometer failed.')
+
+    if not frame.startswith(COMMAND.ODOMETER):
+      raise FixtureException('Unexpected odometer frame: %s' % frame)
+    return dict(zip(ODOMETER_FIELDS, map(int, frame[1:].split(','))))
+
+  def SyncClock(self, num_samples=8):
+    """Ping the fixture clock to synchronize it with the host clock.
+
+    Each ping is a round trip of the programming port, so this should be called
+    off the critical path of the moves. See SyncClockIfDue().
+
+    Args:
+      num_samples: the number of pings.
+    """
+    self.clock_sync_time = time.time()
+    try:
+      for unused_i in range(num_samples):
+        self.FlushBuffer()
+        host_send = time.time()
+        self.Send(COMMAND.TIME)
+        frame = self._ReceiveFrame()
+        host_receive = time.time()
+        if not frame.startswith(COMMAND.TIME):
+          raise FixtureException('Unexpected time frame: %s' % frame)
+        self.clock_sync.AddSample(host_send, int(frame[1:]), host_receive)
+    except Exception as e:
+      session.console.warn('SyncClock failed: %s', e)
+      return
+    session.console.info('Fixture clock: offset %.3f s, drift %.1f ppm, '
+                         'error %.1f ms', self.clock_sync.offset,
+                         self.clock_sync.drift_ppm,
+                         self.clock_sync.error * 1000)
+
+  def SyncClockIfDue(self, interval=CLOCK_SYNC_INTERVAL):
+    """Synchronizes the fixture clock if it is older than interval seconds."""
+    if (self.clock_sync_time is None or
+        time.time() - self.clock_sync_time >= interval):
+      self.SyncClock()
+
+  def RecoverFromEmergencyStop(self, reason, timeout=30):
+    """Drives the probe back to the 'up' position after an emergency stop.
+
+    This is the remote counterpart of pressing and releasing the debug button
+    on the fixture.
+    The fixture accepts it only in the emergency stop state when the safety
+    sensor has been clear for a while.
+
+    Args:
+      reason: why the recovery is requested, which is logged.
+      timeout: the seconds to wait for the probe to reach the 'up' position.
+    """
+    session.console.info('Request recovery from emergency stop: %s', reason)
+    try:
+      response = self.SendReceive(COMMAND.RECOVER)
+    except Exception:
+      raise FixtureException('RecoverFromEmergencyStop failed.')
+
+    if response != STATE.GOING_UP_AFTER_EMERGENCY:
+      msg = 'Recovery rejected (%s): %s' % (
+          RECOVER_ERRORS.get(response, 'response %r' % response), reason)
+      session.console.warn(msg)
+      raise FixtureException(msg)
+
+    session.console.info('Recovery accepted: %s', reason)
+    self.AssertStateWithTimeout([STATE.STOP_UP], timeout)
+
+  def SetRecoverClearTime(self, seconds):
+    """Sets how long the safety sensor must be clear before recovery.
+
+    The fixture rejects RecoverFromEmergencyStop() until the safety sensor has
+    been clear for this long, which is 3 seconds by default. The time is kept
+    until the fixture is reset, and could not be shorter than
+    MIN_RECOVER_CLEAR_TIME.
+
+    Args:
+      seconds: the time in seconds, which is rounded to milli-seconds.
+    """
+    if seconds < MIN_RECOVER_CLEAR_TIME:
+      raise FixtureException('Recover clear time too short: %s s' % seconds)
+    try:
+      response = self.SendReceive('%s%d\n' % (COMMAND.SET_RECOVER_TIME,
+                                              round(seconds * 1000)))
+    except Exception:
+      raise FixtureException('SetRecoverClearTime failed.')
+    if response != '0':
+      raise FixtureException('Recover clear time %s s rejected.' % seconds)
+    session.console.info('Set recover clear time: %s s', seconds)
+
+  def GetMotionProfile(self):
+    """Gets the active motion profile.
+
+    The profile frame looks like
+    <q1,samus,8000,2000,213333,3300000,200,200,100,500>.
+
+    Returns:
+      A tuple of (name, MotionProfile).
+    """
+    try:
+      self.FlushBuffer()
+      self.Send(COMMAND.PROFILE)
+      frame = self._ReceiveFrame()
+    except Exception:
+      raise FixtureException('GetMotionProfile failed.')
+
+    if not frame.startswith(COMMAND.PROFILE):
+      raise FixtureException('Unexpected profile frame: %s' % frame)
+    unused_slot, name, value_str = frame[1:].split(',', 2)
+    return name, ParseMotionProfile(value_str)
+
+  def UploadMotionProfiles(self, profiles):
+    """Uploads the motion profiles to the fixture flash.
+
+    The profiles are assigned to the slots from 1 in order. The fixture skips
+    writing flash if a profile is the same as the stored one, so it is cheap
+    to upload the profiles every time the fixture is connected.
+
+    The names are case-insensitive, like the option names of the board config,
+    and are uploaded in lower case. DEFAULT_PROFILE_NAME is reserved for the
+    built-in profile.
+
+    Args:
+      profiles: a list of (name, MotionProfile) tuples.
+    """
+    if len(profiles) >= MAX_PROFILES:
+      raise FixtureException('Too many motion profiles: %d' % len(profiles))
+    profiles = [(name.lower(), profile) for name, profile in profiles]
+    for name, unused_profile in profiles:
+      if (not name or len(name) > MAX_PROFILE_NAME_LENGTH or ',' in name or
+          name == DEFAULT_PROFILE_NAME):
+        raise FixtureException('Bad motion profile name: %r' % name)
+    self.profile_slots = {DEFAULT_PROFILE_NAME: 0}
+    for slot, (name, profile) in enumerate(profiles, 1):
+      command = '%s%d,%s,%s\n' % (COMMAND.UPLOAD_PROFILE, slot, name,
+                                  ','.join(map(str, profile)))
+      try:
+        response = self.SendReceive(command)
+      except Exception:
+        raise FixtureException('UploadMotionProfiles failed.')
+      if response != '0':
+        raise FixtureException('Motion profile %s rejected: %s' %
+                               (name, str(profile)))
+      self.profile_slots[name] = slot
+      session.console.info('Uploaded motion profile %s to slot %d: %s',
+                           name, slot, str(profile))
+
+  def SelectMotionProfile(self, name):
+    """Selects the active motion profile by its name.
+
+    The profile must be the default one or an uploaded one, and its name is
+    case-insensitive. The fixture accepts it only when the probe is at rest at
+    either end position.
+    """
+    slot = self.profile_slots.get(name.lower())
+    if slot is None:
+      raise FixtureException('Motion profile %s not uploaded.' % name)
+    try:
+      response = self.SendReceive('%s%d' % (COMMAND.SELECT_PROFILE, slot))
+    except Exception:
+      raise FixtureException('SelectMotionProfile failed.')
+    if response != '0':
+      raise FixtureException('Motion profile %s could not be selected.' % name)
+    session.console.info('Selected motion profile: %s', name)
+
+  def StartTrace(self, trace_path):
+    """Starts tracing the raw sensor values and the host commands.
+
+    The fixture sends the trace frames through the native usb port. They are
+    recorded to trace_path together with the state vectors by
+    FixutreNativeUSB.GetState(), which should be running in a monitor thread.
+    The trace could be replayed by trace_replay.py.
+    """
+    self.native_usb.trace_file = open(trace_path, 'a')
+    try:
+      response = self.SendReceive(COMMAND.START_TRACE)
+    except Exception:
+      raise FixtureException('StartTrace failed.')
+    if response != '0':
+      raise FixtureException('Unexpected StartTrace response: %s' % response)
+    session.console.info('Record fixture trace to %s', trace_path)
+
+  def StopTrace(self):
+    """Stops tracing and closes the trace file."""
+    try:
+      self.SendReceive(COMMAND.STOP_TRACE)
+    except Exception:
+      raise FixtureException('StopTrace failed.')
+    finally:
+      trace_file, self.native_usb.trace_file = self.native_usb.trace_file, None
+      if trace_file:
+        trace_file.close()
+
+  def ArmLatencyProbe(self):
+    """Arms the emergency stop latency probe of the fixture.
+
+    The fixture pulls the safety sensor input active at a random time of the
+    next move through a loopback jumper, which replaces the safety curtain.
+    It accepts this only when the probe is at rest.
+    """
+    try:
+      response = self.SendReceive(COMMAND.ARM_LATENCY_PROBE)
+    except Exception:
+      raise FixtureException('ArmLatencyProbe failed.')
+    if response != '0':
+      raise FixtureException('ArmLatencyProbe rejected in state %s.' %
+                             self.QueryState())
+
+  def GetLatency(self):
+    """Gets the emergency stop latency taken by the latency probe.
+
+    The latency frame looks like <K8400,84>, i.e., the cycles from the trip
+    of the safety sensor input until the motor was locked, and the cycles per
+    micro-second, or <K> if nothing has been taken. The probe is disarmed.
+
+    Returns:
+      The latency in seconds, or None.
+    """
+    try:
+      self.FlushBuffer()
+      self.Send(COMMAND.LATENCY)
+      frame = self._ReceiveFrame()
+    except Exception:
+      raise FixtureException('GetLatency failed.')
+
+    if not frame.startswith(COMMAND.LATENCY):
+      raise FixtureException('Unexpected latency frame: %s' % frame)
+    if len(frame) == 1:
+      return None
+    cycles, cycles_per_us = map(int, frame[1:].split(','))
+    return cycles / cycles_per_us / 1e6
+
+  def GetIdentity(self):
+    """Gets the identity of the fixture.
+
+    The identity frame looks like <nline3-a,3A1B4C5D0000A1B20123456789ABCDEF>.
+
+    Returns:
+      A FixtureIdentity.
+    """
+    try:
+      self.FlushBuffer()
+      self.Send(COMMAND.IDENTITY)
+      frame = self._ReceiveFrame()
+    except Exception:
+      raise FixtureException('GetIdentity failed.')
+
+    identity = ParseFixtureIdentity(frame)
+    if identity is None:
+      raise FixtureException('Unexpected identity frame: %s' % frame)
+    return identity
+
+  def SetFixtureName(self, name):
+    """Assigns a name to the fixture, which is kept in the fixture flash.
+
+    The fixture accepts it only when the probe is at rest. An empty name
+    clears it.
+    """
+    if (len(name) > MAX_FIXTURE_NAME_LENGTH or
+        not FIXTURE_NAME_PATTERN.match(name)):
+      raise FixtureException('Bad fixture name: %r' % name)
+    try:
+      response = self.SendReceive('%s%s\n' % (COMMAND.SET_IDENTITY, name))
+    except Exception:
+      raise FixtureException('SetFixtureName failed.')
+    if response != '0':
+      raise FixtureException('Fixture name %r rejected in state %s.' %
+                             (name, self.QueryState()))
+    session.console.info('Set fixture name: %s', name)
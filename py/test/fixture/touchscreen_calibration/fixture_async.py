@@ -0,0 +1,423 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""An asyncio client of the touchscreen calibration fixture.
+
+FixtureSerialDevice blocks in SendReceive() for up to its timeout on every
+command, and FixutreNativeUSB.GetState() blocks until the next state vector,
+so the native usb port needs a thread of its own. AsyncFixture reads both
+ports with loop.add_reader() on non-blocking ttys instead, so that one thread
+could drive the fixture, the sensors and the UI together:
+
+  async def Cycle():
+    async with AsyncFixture(port, native_usb_port) as fixture:
+      async def Monitor():
+        async for frame in fixture.StateFrames():
+          print(frame)
+      monitor = asyncio.ensure_future(Monitor())
+      await fixture.DriveProbeDown()
+      await fixture.DriveProbeUp()
+      monitor.cancel()
+
+The commands are sent one at a time. A move is answered by its end state, or
+fails on an emergency stop seen in the state vectors.
+
+  $ ./fixture_async.py --port /tmp/fixture_prog \\
+        --native-usb-port /tmp/fixture_native --cycles 3
+"""
+
+import argparse
+import asyncio
+import os
+import re
+import termios
+import time
+import tty
+
+from cros.factory.test.fixture.touchscreen_calibration import fixture
+from cros.factory.test.fixture.touchscreen_calibration import telemetry
+from cros.factory.test.utils import serial_utils
+
+
+# The fixture answers within this time unless it is moving. The board boots
+# within READY_TIMEOUT after the programming port is opened.
+COMMAND_TIMEOUT = 5
+MOVE_TIMEOUT = 30
+READY_TIMEOUT = 20
+READY_POLL_INTERVAL = 0.5
+# The state frames kept for a slow reader of StateFrames(). The oldest frames
+# are dropped beyond this.
+MAX_PENDING_FRAMES = 1024
+
+READY_STATES = (fixture.STATE.INIT, fixture.STATE.STOP_UP,
+                fixture.STATE.EMERGENCY_STOP)
+
+# How a command is answered.
+_CHAR = 'char'
+_FRAME = 'frame'
+_MOVE = 'move'
+_ERROR = '1'
+_NATIVE_FRAME = re.compile(r'<[^<>]*>|\[[^\[\]]*\]')
+
+
+def _OpenTty(path):
+  """Open a tty in the raw mode for non-blocking I/O at the fixture baud rate.
+
+  Returns:
+    The file descriptor.
+  """
+  fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+  try:
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    attrs[2] |= termios.CLOCAL | termios.CREAD
+    attrs[4] = attrs[5] = getattr(termios, 'B%d' % fixture.BAUDRATE)
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+  except Exception:
+    os.close(fd)
+    raise
+  return fd
+
+
+class _Port:
+  """A non-blocking tty on the event loop."""
+
+  def __init__(self, loop, path, on_data, on_error):
+    self.path = path
+    self._loop = loop
+    self._on_data = on_data
+    self._on_error = on_error
+    self._output = b''
+    self.fd = _OpenTty(path)
+    loop.add_reader(self.fd, self._Read)
+
+  def _Read(self):
+    try:
+      data = os.read(self.fd, 4096)
+    except BlockingIOError:
+      return
+    except OSError as e:
+      self._on_error(e)
+      return
+    if data:
+      self._on_data(data.decode('ascii', 'replace'))
+
+  def Write(self, text):
+    """Write without blocking. The rest is written when the tty is ready."""
+    pending = bool(self._output)
+    self._output += text.encode('ascii')
+    if not pending:
+      self._Flush()
+
+  def _Flush(self):
+    try:
+      written = os.write(self.fd, self._output)
+    except BlockingIOError:
+      written = 0
+    except OSError as e:
+      self._on_error(e)
+      return
+    self._output = self._output[written:]
+    if self._output:
+      self._loop.add_writer(self.fd, self._Flush)
+    else:
+      self._loop.remove_writer(self.fd)
+
+  def Close(self):
+    if self.fd is None:
+      return
+    self._loop.remove_reader(self.fd)
+    self._loop.remove_writer(self.fd)
+    os.close(self.fd)
+    self.fd = None
+
+
+class AsyncFixture:
+  """An asyncio client of the fixture on its programming and native usb ports.
+
+  The ports are found by the driver and the interface protocols if they are
+  not given, like FixtureSerialDevice.
+  """
+
+  def __init__(self, port=None, native_usb_port=None,
+               driver=fixture.ARDUINO_DRIVER):
+    if port is None:
+      port = serial_utils.FindTtyByDriver(
+          driver, fixture.interface_protocol_dict[fixture.PROGRAMMING_PORT])
+    if native_usb_port is None:
+      native_usb_port = serial_utils.FindTtyByDriver(
+          driver, fixture.interface_protocol_dict[fixture.NATIVE_USB_PORT])
+    if not port or not native_usb_port:
+      raise fixture.FixtureException('Failed to find the fixture ports.')
+    self.port = port
+    self.native_usb_port = native_usb_port
+    # The latest telemetry.Frame of the state vectors.
+    self.frame = None
+    # The file to record the trace frames and the state vectors.
+    self.trace_file = None
+
+    self._loop = None
+    self._programming = None
+    self._native = None
+    self._lock = None
+    self._pending = None
+    self._programming_buffer = ''
+    self._native_buffer = ''
+    self._subscribers = set()
+    self._state_waiters = []
+
+  async def Open(self, timeout=READY_TIMEOUT):
+    """Open the ports and wait for the fixture to be ready."""
+    self._loop = asyncio.get_running_loop()
+    self._lock = asyncio.Lock()
+    try:
+      self._programming = _Port(self._loop, self.port, self._OnProgramming,
+                                self._OnError)
+      self._native = _Port(self._loop, self.native_usb_port, self._OnNative,
+                           self._OnError)
+    except OSError as e:
+      self.Close()
+      raise fixture.FixtureException('Failed to open the fixture ports: %s' % e)
+
+    deadline = self._loop.time() + timeout
+    state = None
+    while state not in READY_STATES:
+      if self._loop.time() >= deadline:
+        self.Close()
+        raise fixture.FixtureException(
+            'The fixture is not ready in %d seconds: state %s.' %
+            (timeout, state))
+      try:
+        state = await self.QueryState(timeout=READY_POLL_INTERVAL)
+      except fixture.FixtureException:
+        state = None
+    # Ask for a state vector so that WaitState() knows the current state.
+    self._native.Write(fixture.COMMAND.STATE)
+
+  def Close(self):
+    """Close the ports. The pending calls and StateFrames() end."""
+    for port in (self._programming, self._native):
+      if port:
+        port.Close()
+    self._programming = self._native = None
+    self._Fail(fixture.FixtureException('The fixture is closed.'))
+    for queue in self._subscribers:
+      self._Put(queue, None)
+
+  async def __aenter__(self):
+    await self.Open()
+    return self
+
+  async def __aexit__(self, exc_type, exc_value, traceback):
+    self.Close()
+
+  async def SendReceive(self, command, timeout=COMMAND_TIMEOUT):
+    """Send a command which is answered by a character."""
+    return await self._Request(command, _CHAR, timeout)
+
+  async def Query(self, command, timeout=COMMAND_TIMEOUT):
+    """Send a command which is answered by a frame like <t...>.
+
+    Returns:
+      The content of the frame inside the brackets.
+    """
+    frame = await self._Request(command, _FRAME, timeout)
+    if not frame.startswith(command[0]):
+      raise fixture.FixtureException('Unexpected frame for %r: %s' %
+                                     (command, frame))
+    return frame
+
+  async def QueryState(self, timeout=COMMAND_TIMEOUT):
+    """Query the state of the fixture through the programming port."""
+    return await self.SendReceive(fixture.COMMAND.STATE, timeout)
+
+  async def GetIdentity(self):
+    """Get the FixtureIdentity of the fixture."""
+    return fixture.ParseFixtureIdentity(
+        await self.Query(fixture.COMMAND.IDENTITY))
+
+  async def DriveProbeDown(self, timeout=MOVE_TIMEOUT):
+    """Drive the probe to the down position."""
+    await self._Move(fixture.COMMAND.DOWN, fixture.STATE.STOP_DOWN, timeout)
+
+  async def DriveProbeUp(self, timeout=MOVE_TIMEOUT):
+    """Drive the probe to the up position."""
+    await self._Move(fixture.COMMAND.UP, fixture.STATE.STOP_UP, timeout)
+
+  async def WaitState(self, states, timeout=MOVE_TIMEOUT):
+    """Wait until the state vectors show one of the states.
+
+    Returns:
+      The telemetry.Frame of the state vector in one of the states.
+    """
+    if self.frame and self.frame.state in states:
+      return self.frame
+    future = self._loop.create_future()
+    waiter = (states, future)
+    self._state_waiters.append(waiter)
+    try:
+      return await asyncio.wait_for(future, timeout)
+    except asyncio.TimeoutError:
+      raise fixture.FixtureException(
+          'State %s is not reached in %d seconds: state %s.' %
+          (states, timeout, self.frame.state if self.frame else None))
+    finally:
+      if waiter in self._state_waiters:
+        self._state_waiters.remove(waiter)
+
+  async def StateFrames(self, max_pending=MAX_PENDING_FRAMES):
+    """Iterate the telemetry.Frames of the state vectors from now on.
+
+    Each iteration gets every frame until the fixture is closed. The oldest
+    frames are dropped if the reader falls behind by max_pending frames.
+    """
+    queue = asyncio.Queue(max_pending)
+    self._subscribers.add(queue)
+    try:
+      while True:
+        frame = await queue.get()
+        if frame is None:
+          return
+        yield frame
+    finally:
+      self._subscribers.discard(queue)
+
+  async def _Move(self, command, end_state, timeout):
+    response = await self._Request(command, _MOVE, timeout, end_state)
+    if response != end_state:
+      raise fixture.FixtureException(
+          'Move %r rejected in state %s.' %
+          (command, self.frame.state if self.frame else None))
+
+  async def _Request(self, command, kind, timeout, end_state=None):
+    if self._programming is None:
+      raise fixture.FixtureException('The fixture is not open.')
+    async with self._lock:
+      future = self._loop.create_future()
+      self._pending = (kind, end_state, future)
+      self._programming_buffer = ''
+      self._programming.Write(command)
+      try:
+        return await asyncio.wait_for(future, timeout)
+      except asyncio.TimeoutError:
+        raise fixture.FixtureException(
+            'Command %r is not answered in %s seconds.' % (command, timeout))
+      finally:
+        self._pending = None
+
+  def _Resolve(self, result=None, error=None):
+    unused_kind, unused_end_state, future = self._pending
+    self._pending = None
+    if future.done():
+      return
+    if error:
+      future.set_exception(error)
+    else:
+      future.set_result(result)
+
+  def _Fail(self, error):
+    if self._pending:
+      self._Resolve(error=error)
+    for unused_states, future in self._state_waiters:
+      if not future.done():
+        future.set_exception(error)
+
+  def _OnError(self, error):
+    self._Fail(fixture.FixtureException('The fixture is disconnected: %s' %
+                                        error))
+    self.Close()
+
+  def _OnProgramming(self, data):
+    self._programming_buffer += data
+    while self._pending and self._programming_buffer:
+      kind, end_state, unused_future = self._pending
+      buf = self._programming_buffer
+      if kind == _FRAME:
+        start = buf.find('<')
+        end = buf.find('>', start + 1)
+        if start < 0 or end < 0:
+          self._programming_buffer = buf[start:] if start >= 0 else ''
+          return
+        self._programming_buffer = buf[end + 1:]
+        self._Resolve(buf[start + 1:end])
+        continue
+      self._programming_buffer = buf[1:]
+      # The other characters of a move are left over from earlier commands.
+      if kind == _CHAR or buf[0] in (end_state, _ERROR):
+        self._Resolve(buf[0])
+    if not self._pending:
+      # Nothing is expected, e.g., the answer of a command timed out.
+      self._programming_buffer = ''
+
+  def _OnNative(self, data):
+    self._native_buffer += data
+    while True:
+      match = _NATIVE_FRAME.search(self._native_buffer)
+      if not match:
+        # Keep only the start of a frame cut short.
+        buf = self._native_buffer
+        start = max(buf.rfind('<'), buf.rfind('['))
+        self._native_buffer = buf[start:] if start >= 0 else ''
+        return
+      self._native_buffer = self._native_buffer[match.end():]
+      text = match.group(0)
+      if self.trace_file:
+        self.trace_file.write(text + '\n')
+      if text[0] != '<':
+        continue
+      frame = telemetry.ParseStateVector(text, time.time() * 1000)
+      if frame:
+        self._OnFrame(frame)
+
+  def _OnFrame(self, frame):
+    self.frame = frame
+    for queue in self._subscribers:
+      self._Put(queue, frame)
+    for states, future in self._state_waiters:
+      if frame.state in states and not future.done():
+        future.set_result(frame)
+    if (frame.state == fixture.STATE.EMERGENCY_STOP and self._pending and
+        self._pending[0] == _MOVE):
+      self._Resolve(error=fixture.FixtureException(
+          'Emergency stop while moving.'))
+
+  @staticmethod
+  def _Put(queue, item):
+    if queue.full():
+      queue.get_nowait()
+    queue.put_nowait(item)
+
+
+async def _Cycle(args):
+  async with AsyncFixture(args.port, args.native_usb_port) as client:
+    print('identity: %s' % (await client.GetIdentity(),))
+
+    async def _Monitor():
+      async for frame in client.StateFrames():
+        print('frame: %s' % (frame,))
+
+    monitor = asyncio.ensure_future(_Monitor())
+    try:
+      for cycle in range(args.cycles):
+        start = time.time()
+        await client.DriveProbeDown()
+        await client.DriveProbeUp()
+        print('cycle %d: %.2f seconds' % (cycle, time.time() - start))
+    finally:
+      monitor.cancel()
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('--port', help='the programming port')
+  parser.add_argument('--native-usb-port', help='the native usb port')
+  parser.add_argument('--cycles', type=int, default=1)
+  asyncio.run(_Cycle(parser.parse_args()))
+
+
+if __name__ == '__main__':
+  main()
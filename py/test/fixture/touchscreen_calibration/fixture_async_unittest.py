@@ -0,0 +1,206 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for fixture_async."""
+
+import asyncio
+import os
+import pty
+import time
+import tty
+import unittest
+
+from cros.factory.test.fixture.touchscreen_calibration import fixture
+from cros.factory.test.fixture.touchscreen_calibration import fixture_async
+
+
+class FakeFirmware:
+  """A fixture on a pair of ptys which answers on the same event loop."""
+
+  def __init__(self, move_secs=0.2, name='line3-a', unique_id='3A1B'):
+    self.loop = asyncio.get_running_loop()
+    self.move_secs = move_secs
+    self.identity = '%s,%s' % (name, unique_id)
+    self.state = 'U'
+    self.emergency_stop = False
+    self._move = None
+    self.programming_master, self._programming_slave, self.port = (
+        self._OpenPty())
+    self.native_master, self._native_slave, self.native_usb_port = (
+        self._OpenPty())
+    self.loop.add_reader(self.programming_master, self._OnProgramming)
+    self.loop.add_reader(self.native_master, self._OnNative)
+
+  def _OpenPty(self):
+    master, slave = pty.openpty()
+    tty.setraw(master)
+    tty.setraw(slave)
+    os.set_blocking(master, False)
+    return master, slave, os.ttyname(slave)
+
+  def Close(self):
+    if self._move:
+      self._move.cancel()
+    self.loop.remove_reader(self.programming_master)
+    self.loop.remove_reader(self.native_master)
+    for fd in (self.programming_master, self._programming_slave,
+               self.native_master, self._native_slave):
+      os.close(fd)
+
+  def _SendStateVector(self):
+    os.write(self.native_master,
+             b'<%s1001000000.6000.0.%d>' % (self.state.encode('ascii'),
+                                            int(time.time() * 1000)))
+
+  def _Respond(self, response):
+    os.write(self.programming_master, response.encode('ascii'))
+
+  def _OnProgramming(self):
+    for command in os.read(self.programming_master, 1024).decode('ascii'):
+      if command == 'n':
+        self._Respond('<n%s>' % self.identity)
+      elif command == 's':
+        self._Respond(self.state)
+      elif command == 'o':
+        # Never answered.
+        pass
+      elif command == 'd' and self.state in 'iU':
+        self._StartMove('d')
+      elif command == 'u' and self.state == 'D':
+        self._StartMove('u')
+      else:
+        self._Respond('1')
+
+  def _OnNative(self):
+    if b's' in os.read(self.native_master, 1024):
+      # A trace frame in between is skipped by the client.
+      os.write(self.native_master, b'[T123,d]')
+      self._SendStateVector()
+
+  def _StartMove(self, state):
+    self.state = state
+    self._SendStateVector()
+    if self.emergency_stop:
+      self._move = self.loop.call_later(self.move_secs / 2,
+                                        self._EmergencyStop)
+    else:
+      self._move = self.loop.call_later(self.move_secs, self._EndMove)
+
+  def _EndMove(self):
+    self.state = self.state.upper()
+    self._SendStateVector()
+    self._Respond(self.state)
+
+  def _EmergencyStop(self):
+    self.state = 'e'
+    self._SendStateVector()
+
+
+class AsyncFixtureTest(unittest.IsolatedAsyncioTestCase):
+
+  async def asyncSetUp(self):
+    self.firmwares = []
+    self.clients = []
+
+  async def asyncTearDown(self):
+    for client in self.clients:
+      client.Close()
+    for firmware in self.firmwares:
+      firmware.Close()
+
+  async def _Open(self, **kwargs):
+    firmware = FakeFirmware(**kwargs)
+    self.firmwares.append(firmware)
+    client = fixture_async.AsyncFixture(firmware.port,
+                                        firmware.native_usb_port)
+    self.clients.append(client)
+    await client.Open(timeout=2)
+    return firmware, client
+
+  async def testMovesDoNotBlockTheLoop(self):
+    unused_firmware, client = await self._Open()
+    ticks = []
+
+    async def _Tick():
+      while True:
+        ticks.append(time.time())
+        await asyncio.sleep(0.01)
+
+    ticker = asyncio.ensure_future(_Tick())
+    await client.DriveProbeDown()
+    self.assertEqual((await client.WaitState('D', timeout=1)).state, 'D')
+    await client.DriveProbeUp()
+    ticker.cancel()
+    # The ticker kept running through the 0.4 seconds of the moves.
+    self.assertGreater(len(ticks), 20)
+    self.assertEqual(await client.QueryState(), 'U')
+
+  async def testStateFrames(self):
+    unused_firmware, client = await self._Open()
+    # The state vector asked for by Open().
+    await client.WaitState('U', timeout=1)
+    states = []
+
+    async def _Monitor():
+      async for frame in client.StateFrames():
+        states.append(frame.state)
+
+    monitor = asyncio.ensure_future(_Monitor())
+    await asyncio.sleep(0)
+    await client.DriveProbeDown()
+    await client.DriveProbeUp()
+    await client.WaitState('U', timeout=1)
+    client.Close()
+    await asyncio.wait_for(monitor, 1)
+    self.assertEqual(states, ['d', 'D', 'u', 'U'])
+
+  async def testTwoFixturesConcurrently(self):
+    clients = [(await self._Open(move_secs=0.3))[1] for unused_i in range(2)]
+
+    async def _Cycle(client):
+      await client.DriveProbeDown()
+      await client.DriveProbeUp()
+
+    start = time.time()
+    await asyncio.gather(*[_Cycle(client) for client in clients])
+    self.assertLess(time.time() - start, 1.0)
+
+  async def testRejectedMove(self):
+    unused_firmware, client = await self._Open()
+    with self.assertRaisesRegex(fixture.FixtureException, 'rejected'):
+      await client.DriveProbeUp()
+
+  async def testEmergencyStop(self):
+    firmware, client = await self._Open()
+    firmware.emergency_stop = True
+    with self.assertRaisesRegex(fixture.FixtureException, 'Emergency stop'):
+      await client.DriveProbeDown()
+    self.assertEqual(client.frame.state, 'e')
+
+  async def testQuery(self):
+    unused_firmware, client = await self._Open()
+    self.assertEqual(await client.GetIdentity(),
+                     fixture.FixtureIdentity('line3-a', '3A1B'))
+
+  async def testTimeout(self):
+    unused_firmware, client = await self._Open()
+    with self.assertRaisesRegex(fixture.FixtureException, 'not answered'):
+      await client.Query('o', timeout=0.2)
+    # The next command still works.
+    self.assertEqual(await client.QueryState(), 'U')
+
+  async def testNotReady(self):
+    firmware = FakeFirmware()
+    self.firmwares.append(firmware)
+    firmware.state = 'd'
+    client = fixture_async.AsyncFixture(firmware.port,
+                                        firmware.native_usb_port)
+    with self.assertRaisesRegex(fixture.FixtureException, 'not ready'):
+      await client.Open(timeout=1)
+
+
+if __name__ == '__main__':
+  unittest.main()
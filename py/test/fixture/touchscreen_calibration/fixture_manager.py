@@ -0,0 +1,617 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Drive several touchscreen calibration fixtures from one host.
+
+FixtureSerialDevice and FixutreNativeUSB take the first port found by the
+driver and the interface protocol, so two fixtures on the same host collide.
+Each fixture reports its identity on both of its ports instead: the name
+assigned by the host, which is kept in the fixture flash, and the unique id of
+its chip. The programming port is behind the USB bridge chip of the board and
+the native usb port is the chip itself, i.e., they are separate USB devices,
+so they are paired by the unique id. The USB serial number of the programming
+port is kept too as another way to select a fixture.
+
+A fixture is selected by 'name:line3-a', 'uid:3A1B...', 'usb:8543...',
+'port:/dev/ttyACM0' or just one of the values.
+
+FixtureManager drives all the fixtures from one event loop. It keeps a queue
+of commands for each fixture, sends one command at a time to a fixture, and
+follows the state vectors of every fixture for its state and statistics.
+
+  $ ./fixture_manager.py list
+  $ ./fixture_manager.py name port:/dev/ttyACM1 line3-a
+  $ ./fixture_manager.py cycle --cycles 10 line3-a line3-b
+
+The ports of the virtual fixtures in the sim directory are given by --ports:
+
+  $ ./fixture_manager.py --ports /dev/pts/3,/dev/pts/4 \\
+        --ports /dev/pts/5,/dev/pts/6 cycle --cycles 10
+"""
+
+import argparse
+import collections
+import os
+import re
+import selectors
+import time
+
+from cros.factory.external import serial
+from cros.factory.test.fixture.touchscreen_calibration import drift
+from cros.factory.test.fixture.touchscreen_calibration import fixture
+from cros.factory.test.fixture.touchscreen_calibration import telemetry
+from cros.factory.test import session
+from cros.factory.test.utils import serial_utils
+
+
+PROGRAMMING = 'programming'
+NATIVE = 'native'
+PORT_KINDS = {PROGRAMMING: fixture.PROGRAMMING_PORT,
+              NATIVE: fixture.NATIVE_USB_PORT}
+
+# The programming port resets the board when it is opened, which takes a
+# while to boot before it answers.
+IDENTITY_TIMEOUT = 5
+IDENTITY_RETRY_INTERVAL = 0.5
+COMMAND_TIMEOUT = 5
+MOVE_TIMEOUT = 30
+
+# The ports of a port kind and a tty, and the identity reported on it.
+PortInfo = collections.namedtuple(
+    'PortInfo', ['tty', 'kind', 'usb_serial', 'identity'])
+# The paired ports of a fixture. The key is its name, or its unique id if it
+# has not been named.
+FixturePorts = collections.namedtuple(
+    'FixturePorts', ['key', 'identity', 'programming', 'native',
+                     'usb_serial'])
+
+_IDENTITY_FRAMES = {PROGRAMMING: re.compile(r'<(n[^<>]*)>'),
+                    NATIVE: re.compile(r'\[(n[^\[\]]*)\]')}
+
+# The commands answered by a frame and those answered at the end of a move.
+# The others are answered by a single character.
+FRAME = 'frame'
+CHAR = 'char'
+MOVE = 'move'
+_FRAME_COMMANDS = (fixture.COMMAND.STATS, fixture.COMMAND.ODOMETER,
+                   fixture.COMMAND.TIME, fixture.COMMAND.PROFILE,
+                   fixture.COMMAND.LATENCY, fixture.COMMAND.IDENTITY)
+_MOVE_END_STATES = {fixture.COMMAND.DOWN: fixture.STATE.STOP_DOWN,
+                    fixture.COMMAND.UP: fixture.STATE.STOP_UP}
+_ERROR = '1'
+
+STATS_FIELDS = ['commands', 'errors', 'frames', 'moves', 'emergency_stops']
+
+
+def UsbSerialNumber(tty):
+  """Get the serial number of the USB device of a tty, or '' if unknown.
+
+  /sys/class/tty/<tty>/device is the USB interface of the tty, whose parent
+  is the USB device.
+  """
+  device_path = os.path.realpath(
+      '/sys/class/tty/%s/device' % os.path.basename(tty))
+  try:
+    with open(os.path.join(os.path.dirname(device_path), 'serial')) as f:
+      return f.read().strip()
+  except IOError:
+    return ''
+
+
+def _OpenPort(tty):
+  return serial_utils.OpenSerial(port=tty, baudrate=fixture.BAUDRATE,
+                                 timeout=0, write_timeout=COMMAND_TIMEOUT)
+
+
+def QueryIdentity(tty, kind, timeout=IDENTITY_TIMEOUT):
+  """Query the identity of the fixture on a port.
+
+  Args:
+    tty: the tty of the port.
+    kind: PROGRAMMING or NATIVE.
+
+  Returns:
+    The FixtureIdentity, or None if the port does not answer in time.
+  """
+  pattern = _IDENTITY_FRAMES[kind]
+  port = _OpenPort(tty)
+  try:
+    received = ''
+    deadline = time.time() + timeout
+    next_query = 0
+    while time.time() < deadline:
+      if time.time() >= next_query:
+        port.write(fixture.COMMAND.IDENTITY.encode('ascii'))
+        next_query = time.time() + IDENTITY_RETRY_INTERVAL
+      data = port.read(port.in_waiting or 1)
+      if not data:
+        time.sleep(0.01)
+        continue
+      received += data.decode('ascii', 'replace')
+      match = pattern.search(received)
+      if match:
+        return fixture.ParseFixtureIdentity(match.group(1))
+  finally:
+    port.close()
+  return None
+
+
+def PairPorts(ports):
+  """Pair the programming ports and the native usb ports by their unique ids.
+
+  Args:
+    ports: a list of PortInfos.
+
+  The fixtures which have the same name are keyed by their unique ids instead
+  so that they could be told apart and renamed.
+
+  Returns:
+    A tuple of (a list of FixturePorts sorted by their keys, a list of the
+    PortInfos which are not paired).
+  """
+  by_unique_id = collections.OrderedDict()
+  unpaired = []
+  for port in ports:
+    if port.identity is None:
+      unpaired.append(port)
+      continue
+    by_unique_id.setdefault(port.identity.unique_id, {}).setdefault(
+        port.kind, []).append(port)
+
+  paired = []
+  for unique_id, kinds in by_unique_id.items():
+    programming = kinds.get(PROGRAMMING, [])
+    native = kinds.get(NATIVE, [])
+    if len(programming) != 1 or len(native) != 1:
+      unpaired.extend(programming + native)
+      continue
+    # The name is taken from the programming port, which is the port to
+    # assign it.
+    paired.append((programming[0], native[0]))
+
+  names = collections.Counter(
+      programming.identity.name for programming, unused_native in paired)
+  fixtures = []
+  for programming, native in paired:
+    identity = programming.identity
+    key = identity.name
+    if not key or names[key] > 1:
+      if key:
+        session.console.warn('Fixture %s has a duplicate name %s.',
+                             identity.unique_id, key)
+      key = identity.unique_id
+    fixtures.append(FixturePorts(key, identity, programming.tty, native.tty,
+                                 programming.usb_serial))
+  return sorted(fixtures), unpaired
+
+
+def DiscoverFixtures(driver=fixture.ARDUINO_DRIVER, timeout=IDENTITY_TIMEOUT):
+  """Find the fixtures attached to the host.
+
+  Returns:
+    A list of FixturePorts sorted by their keys.
+  """
+  ports = []
+  for kind, port_index in PORT_KINDS.items():
+    ttys = serial_utils.FindTtyByDriver(
+        driver, fixture.interface_protocol_dict[port_index],
+        multiple_ports=True)
+    for tty in ttys:
+      ports.append(PortInfo(tty, kind, UsbSerialNumber(tty),
+                            QueryIdentity(tty, kind, timeout)))
+  fixtures, unpaired = PairPorts(ports)
+  for port in unpaired:
+    session.console.warn('Fixture %s port %s is not paired: %s', port.kind,
+                         port.tty, port.identity)
+  return fixtures
+
+
+def SelectFixture(fixtures, selector):
+  """Select a fixture.
+
+  Args:
+    fixtures: a list of FixturePorts.
+    selector: 'name:<name>', 'uid:<unique id>', 'usb:<usb serial number>',
+        'port:<tty of either port>', or a value of any of them.
+
+  Returns:
+    The FixturePorts.
+
+  Raises:
+    FixtureException if no fixture or more than one fixture is selected.
+  """
+  field, sep, value = selector.partition(':')
+  if not sep or field not in ('name', 'uid', 'usb', 'port'):
+    field, value = None, selector
+
+  def _Values(ports):
+    return {
+        'name': [ports.identity.name],
+        'uid': [ports.identity.unique_id],
+        'usb': [ports.usb_serial],
+        'port': [ports.programming, ports.native],
+    }
+
+  def _Match(ports):
+    values = _Values(ports)
+    fields = [field] if field else values.keys()
+    for name in fields:
+      for candidate in values[name]:
+        if not candidate:
+          continue
+        # The unique id could be given without its leading zeros.
+        if (name == 'uid' and
+            candidate.upper().lstrip('0') == value.upper().lstrip('0')):
+          return True
+        if candidate == value:
+          return True
+    return False
+
+  selected = [ports for ports in fixtures if _Match(ports)]
+  if len(selected) != 1:
+    raise fixture.FixtureException(
+        '%s fixture matches %r among %s.' %
+        ('More than one' if selected else 'No', selector,
+         ', '.join(ports.key for ports in fixtures) or 'none'))
+  return selected[0]
+
+
+class Request:
+  """A command queued for a fixture."""
+
+  def __init__(self, command):
+    self.command = command
+    if command[0] in _MOVE_END_STATES:
+      self.kind = MOVE
+    elif command[0] in _FRAME_COMMANDS:
+      self.kind = FRAME
+    else:
+      self.kind = CHAR
+    self.sent_time = None
+    self.done = False
+    self.response = None
+    self.error = None
+
+  @property
+  def timeout(self):
+    return MOVE_TIMEOUT if self.kind == MOVE else COMMAND_TIMEOUT
+
+
+class _Channel:
+  """The ports, the command queue, and the state of a fixture."""
+
+  def __init__(self, ports):
+    self.ports = ports
+    self.programming = None
+    self.native = None
+    self.programming_buffer = ''
+    self.native_buffer = ''
+    self.queue = collections.deque()
+    self.current = None
+    self.frame = None
+    self.tracker = drift.MoveTracker()
+    self.stats = dict.fromkeys(STATS_FIELDS, 0)
+    self.travel_ms = {direction: [] for direction in _MOVE_END_STATES}
+
+
+class FixtureManager:
+  """Drive several fixtures concurrently from one event loop.
+
+  Usage:
+    manager = FixtureManager(DiscoverFixtures())
+    manager.Open()
+    for key in manager.keys:
+      manager.Submit(key, fixture.COMMAND.DOWN)
+      manager.Submit(key, fixture.COMMAND.UP)
+    manager.Run()
+    print(manager.Stats('line3-a'))
+    manager.Close()
+
+  A command fails if it is not answered in time, and a move fails if the
+  fixture rejects it or stops on an emergency. The remaining commands of a
+  fixture are dropped when one of them fails, and the other fixtures go on.
+  """
+
+  def __init__(self, fixtures):
+    self._channels = collections.OrderedDict(
+        (ports.key, _Channel(ports)) for ports in fixtures)
+    self._selector = selectors.DefaultSelector()
+
+  @property
+  def keys(self):
+    return list(self._channels)
+
+  def Open(self):
+    """Open the ports of all the fixtures."""
+    for channel in self._channels.values():
+      channel.programming = _OpenPort(channel.ports.programming)
+      channel.native = _OpenPort(channel.ports.native)
+      self._selector.register(channel.programming, selectors.EVENT_READ,
+                              (channel, PROGRAMMING))
+      self._selector.register(channel.native, selectors.EVENT_READ,
+                              (channel, NATIVE))
+
+  def Close(self):
+    for channel in self._channels.values():
+      for port in (channel.programming, channel.native):
+        if port:
+          self._selector.unregister(port)
+          port.close()
+      channel.programming = channel.native = None
+    self._selector.close()
+
+  def Submit(self, key, command):
+    """Queue a command for a fixture.
+
+    Args:
+      key: the key of the fixture.
+      command: the command followed by its payload if any.
+
+    Returns:
+      The Request, which is done by Run().
+    """
+    request = Request(command)
+    self._channels[key].queue.append(request)
+    return request
+
+  def Pending(self):
+    """Are there commands not done yet?"""
+    return any(channel.current or channel.queue
+               for channel in self._channels.values())
+
+  def Run(self, until=None, timeout=None):
+    """Run the event loop.
+
+    Args:
+      until: a function to stop the loop when it returns True. By default the
+          loop stops when all the commands are done.
+      timeout: the longest time to run in seconds.
+    """
+    deadline = None if timeout is None else time.time() + timeout
+    until = until or (lambda: not self.Pending())
+    while not until():
+      now = time.time()
+      if deadline is not None and now >= deadline:
+        break
+      wait = 0.1 if deadline is None else min(0.1, deadline - now)
+      for channel in self._channels.values():
+        self._SendNext(channel)
+      for key, unused_events in self._selector.select(wait):
+        channel, kind = key.data
+        port = key.fileobj
+        if channel.programming is None:
+          # Both ports are closed once either of them is disconnected.
+          continue
+        try:
+          data = port.read(port.in_waiting or 1).decode('ascii', 'replace')
+        except (OSError, serial.SerialException) as e:
+          self._Disconnect(channel, e)
+          continue
+        if kind == PROGRAMMING:
+          self._FeedProgramming(channel, data)
+        else:
+          self._FeedNative(channel, data)
+      self._CheckTimeouts()
+
+  def State(self, key):
+    """Get the last state of a fixture by its state vectors, or None."""
+    frame = self._channels[key].frame
+    return frame.state if frame else None
+
+  def Stats(self, key):
+    """Get the statistics of a fixture.
+
+    Returns:
+      A dict of the counters in STATS_FIELDS, the last state, and the mean
+      travel time of the down and up moves in milli-seconds.
+    """
+    channel = self._channels[key]
+    stats = dict(channel.stats)
+    stats['state'] = self.State(key)
+    for direction, values in channel.travel_ms.items():
+      stats['%s_travel_ms' % drift.DIRECTION_NAMES[direction]] = (
+          sum(values) / float(len(values)) if values else None)
+    return stats
+
+  def _SendNext(self, channel):
+    if channel.current or not channel.queue:
+      return
+    request = channel.queue.popleft()
+    channel.current = request
+    request.sent_time = time.time()
+    channel.stats['commands'] += 1
+    if channel.programming is None:
+      self._Complete(channel, error='disconnected')
+      return
+    channel.programming_buffer = ''
+    try:
+      channel.programming.write(request.command.encode('ascii'))
+    except (OSError, serial.SerialException) as e:
+      self._Disconnect(channel, e)
+
+  def _Disconnect(self, channel, error):
+    """Drop a fixture whose port has gone, e.g., unplugged."""
+    session.console.warn('Fixture %s is disconnected: %s', channel.ports.key,
+                         error)
+    for port in (channel.programming, channel.native):
+      if port:
+        self._selector.unregister(port)
+        port.close()
+    channel.programming = channel.native = None
+    if channel.current:
+      self._Complete(channel, error='disconnected')
+
+  def _Complete(self, channel, response=None, error=None):
+    request = channel.current
+    channel.current = None
+    request.response = response
+    request.error = error
+    request.done = True
+    if error:
+      channel.stats['errors'] += 1
+      session.console.warn('Fixture %s: command %r failed: %s',
+                           channel.ports.key, request.command, error)
+      for dropped in channel.queue:
+        dropped.error = 'dropped after %r failed' % request.command
+        dropped.done = True
+      channel.queue.clear()
+
+  def _FeedProgramming(self, channel, data):
+    channel.programming_buffer += data
+    while channel.programming_buffer:
+      buf = channel.programming_buffer
+      request = channel.current
+      if request is None:
+        # Nothing is expected, e.g., the answer of a command timed out.
+        channel.programming_buffer = ''
+        return
+      if request.kind == FRAME:
+        start = buf.find('<')
+        end = buf.find('>', start + 1)
+        if start < 0 or end < 0:
+          channel.programming_buffer = buf[start:] if start >= 0 else ''
+          return
+        channel.programming_buffer = buf[end + 1:]
+        self._Complete(channel, buf[start + 1:end])
+        continue
+      channel.programming_buffer = buf[1:]
+      if request.kind == MOVE:
+        if buf[0] == _MOVE_END_STATES[request.command[0]]:
+          self._Complete(channel, buf[0])
+        elif buf[0] == _ERROR:
+          self._Complete(channel, buf[0],
+                         'rejected in state %s' % self.State(
+                             channel.ports.key))
+        # The other characters are left over from the earlier commands.
+      else:
+        self._Complete(channel, buf[0])
+
+  def _FeedNative(self, channel, data):
+    channel.native_buffer += data
+    while True:
+      buf = channel.native_buffer
+      match = re.search(r'<([^<>]*)>|\[[^\[\]]*\]', buf)
+      if not match:
+        # Keep only the start of a frame cut short.
+        start = max(buf.rfind('<'), buf.rfind('['))
+        channel.native_buffer = buf[start:] if start >= 0 else ''
+        return
+      channel.native_buffer = buf[match.end():]
+      # The trace frames and the identity frames in [...] are skipped.
+      if match.group(1) is None:
+        continue
+      frame = telemetry.ParseStateVector(match.group(1), time.time() * 1000)
+      if frame:
+        self._OnFrame(channel, frame)
+
+  def _OnFrame(self, channel, frame):
+    last_state = channel.frame.state if channel.frame else None
+    channel.frame = frame
+    channel.stats['frames'] += 1
+    if (frame.state == fixture.STATE.EMERGENCY_STOP and
+        last_state != fixture.STATE.EMERGENCY_STOP):
+      channel.stats['emergency_stops'] += 1
+      if channel.current and channel.current.kind == MOVE:
+        self._Complete(channel, error='emergency stop')
+    record = channel.tracker.AddFrame(frame)
+    if record:
+      channel.stats['moves'] += 1
+      channel.travel_ms[record.direction].append(record.travel_ms)
+
+  def _CheckTimeouts(self):
+    now = time.time()
+    for channel in self._channels.values():
+      request = channel.current
+      if request and now - request.sent_time > request.timeout:
+        self._Complete(channel, error='timed out in %d seconds' %
+                       request.timeout)
+
+
+def _FormatStats(key, stats):
+  travel = ' '.join(
+      '%s %s' % (name, '-' if stats[name] is None else '%.0f ms' % stats[name])
+      for name in ('down_travel_ms', 'up_travel_ms'))
+  return '%-16s state %s %s %s' % (
+      key, stats['state'] or '-',
+      ' '.join('%s %d' % (name, stats[name]) for name in STATS_FIELDS), travel)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('--ports', action='append', metavar='PROGRAMMING,NATIVE',
+                      help='the ttys of a fixture instead of discovering them')
+  parser.add_argument('--timeout', type=float, default=IDENTITY_TIMEOUT,
+                      help='the time to wait for the identity of a port')
+  subparsers = parser.add_subparsers(dest='action', required=True)
+  subparsers.add_parser('list', help='list the fixtures')
+  name_parser = subparsers.add_parser('name', help='name a fixture')
+  name_parser.add_argument('selector')
+  name_parser.add_argument('name', help='the new name, or "" to clear it')
+  cycle_parser = subparsers.add_parser(
+      'cycle', help='cycle the probes of the fixtures concurrently')
+  cycle_parser.add_argument('--cycles', type=int, default=1)
+  cycle_parser.add_argument('selectors', nargs='*',
+                            help='the fixtures to cycle; all by default')
+  args = parser.parse_args()
+
+  if args.ports:
+    ports = []
+    for pair in args.ports:
+      programming, native = pair.split(',')
+      ports.append(PortInfo(programming, PROGRAMMING, '',
+                            QueryIdentity(programming, PROGRAMMING,
+                                          args.timeout)))
+      ports.append(PortInfo(native, NATIVE, '',
+                            QueryIdentity(native, NATIVE, args.timeout)))
+    fixtures, unpaired = PairPorts(ports)
+    for port in unpaired:
+      print('not paired: %s %s %s' % (port.kind, port.tty, port.identity))
+  else:
+    fixtures = DiscoverFixtures(timeout=args.timeout)
+
+  if args.action == 'list':
+    for ports in fixtures:
+      print('%-16s uid %s usb %s programming %s native %s' % (
+          ports.key, ports.identity.unique_id, ports.usb_serial or '-',
+          ports.programming, ports.native))
+    return
+
+  if args.action == 'name':
+    selected = SelectFixture(fixtures, args.selector)
+    if args.name and any(ports.identity.name == args.name and
+                         ports is not selected for ports in fixtures):
+      raise fixture.FixtureException('Fixture name %r is taken.' % args.name)
+    fixtures = [selected]
+  elif args.selectors:
+    fixtures = [SelectFixture(fixtures, selector)
+                for selector in args.selectors]
+
+  manager = FixtureManager(fixtures)
+  manager.Open()
+  try:
+    if args.action == 'name':
+      request = manager.Submit(
+          fixtures[0].key,
+          '%s%s\n' % (fixture.COMMAND.SET_IDENTITY, args.name))
+      manager.Run()
+      if request.error or request.response != '0':
+        raise fixture.FixtureException('Fixture name %r rejected.' % args.name)
+      return
+
+    for key in manager.keys:
+      for unused_cycle in range(args.cycles):
+        manager.Submit(key, fixture.COMMAND.DOWN)
+        manager.Submit(key, fixture.COMMAND.UP)
+    manager.Run()
+    for key in manager.keys:
+      print(_FormatStats(key, manager.Stats(key)))
+  finally:
+    manager.Close()
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for fixture_manager."""
+
+import os
+import pty
+import select
+import threading
+import time
+import tty
+import unittest
+from unittest import mock
+
+from cros.factory.test.fixture.touchscreen_calibration import fixture
+from cros.factory.test.fixture.touchscreen_calibration import fixture_manager
+
+
+def _Identity(name, unique_id):
+  return fixture.FixtureIdentity(name, unique_id)
+
+
+def _Port(tty_path, kind, identity, usb_serial=''):
+  return fixture_manager.PortInfo(tty_path, kind, usb_serial, identity)
+
+
+class FakeFirmware(threading.Thread):
+  """A fixture on a pair of ptys which answers like the firmware."""
+
+  def __init__(self, unique_id, name='', move_secs=0.2):
+    super(FakeFirmware, self).__init__()
+    self.daemon = True
+    self.unique_id = unique_id
+    self.name = name
+    self.move_secs = move_secs
+    self.state = 'U'
+    self.move_end = None
+    self.emergency_stop = threading.Event()
+    self.stop = threading.Event()
+    self.programming_master, self._programming_slave, self.programming = (
+        self._OpenPty())
+    self.native_master, self._native_slave, self.native = self._OpenPty()
+    self.start()
+
+  @staticmethod
+  def _OpenPty():
+    master, slave = pty.openpty()
+    tty.setraw(master)
+    tty.setraw(slave)
+    return master, slave, os.ttyname(slave)
+
+  def Close(self):
+    self.stop.set()
+    self.join()
+    for fd in (self.programming_master, self._programming_slave,
+               self.native_master, self._native_slave):
+      os.close(fd)
+
+  def _SendStateVector(self):
+    os.write(self.native_master,
+             b'<%s1001000000.6000.0.%d>' % (self.state.encode('ascii'),
+                                            int(time.time() * 1000)))
+
+  def _Respond(self, response):
+    os.write(self.programming_master, response.encode('ascii'))
+
+  def _HandleProgramming(self, data):
+    while data:
+      command, data = data[:1], data[1:]
+      if command == 'n':
+        self._Respond('<n%s,%s>' % (self.name, self.unique_id))
+      elif command == 'N':
+        self.name, unused_sep, data = data.partition('\n')
+        self._Respond('0')
+      elif command == 's':
+        self._Respond(self.state)
+      elif command == 'o':
+        # Never answered.
+        pass
+      elif command == 'd' and self.state in 'iU':
+        self.state = 'd'
+      elif command == 'u' and self.state == 'D':
+        self.state = 'u'
+      else:
+        self._Respond('1')
+        continue
+      if command in 'du':
+        self.move_end = time.time() + self.move_secs
+        self._SendStateVector()
+
+  def run(self):
+    fds = [self.programming_master, self.native_master]
+    while not self.stop.is_set():
+      readable = select.select(fds, [], [], 0.01)[0]
+      if self.programming_master in readable:
+        self._HandleProgramming(
+            os.read(self.programming_master, 1024).decode('ascii'))
+      if self.native_master in readable:
+        if b'n' in os.read(self.native_master, 1024):
+          os.write(self.native_master, b'[n%s,%s]' % (
+              self.name.encode('ascii'), self.unique_id.encode('ascii')))
+      if self.move_end is None:
+        continue
+      if self.emergency_stop.is_set():
+        self.move_end = None
+        self.state = 'e'
+        self._SendStateVector()
+      elif time.time() >= self.move_end:
+        self.move_end = None
+        self.state = self.state.upper()
+        self._SendStateVector()
+        self._Respond(self.state)
+
+
+class ParseFixtureIdentityTest(unittest.TestCase):
+
+  def testParse(self):
+    self.assertEqual(fixture.ParseFixtureIdentity('nline3-a,3a1b'),
+                     _Identity('line3-a', '3A1B'))
+    self.assertEqual(fixture.ParseFixtureIdentity('[n,3A1B]'),
+                     _Identity('', '3A1B'))
+    self.assertIsNone(fixture.ParseFixtureIdentity('o1,2,3'))
+    self.assertIsNone(fixture.ParseFixtureIdentity('nline3-a,'))
+
+
+class PairPortsTest(unittest.TestCase):
+
+  def testPair(self):
+    a = _Identity('line3-a', 'AA')
+    b = _Identity('', 'BB')
+    ports = [
+        _Port('/dev/ttyACM0', fixture_manager.PROGRAMMING, b, 'usb-b'),
+        _Port('/dev/ttyACM1', fixture_manager.NATIVE, a),
+        _Port('/dev/ttyACM2', fixture_manager.PROGRAMMING, a, 'usb-a'),
+        _Port('/dev/ttyACM3', fixture_manager.NATIVE, b),
+        _Port('/dev/ttyACM4', fixture_manager.PROGRAMMING, None),
+        _Port('/dev/ttyACM5', fixture_manager.NATIVE, _Identity('', 'CC')),
+    ]
+    fixtures, unpaired = fixture_manager.PairPorts(ports)
+    self.assertEqual(fixtures, [
+        fixture_manager.FixturePorts('BB', b, '/dev/ttyACM0', '/dev/ttyACM3',
+                                     'usb-b'),
+        fixture_manager.FixturePorts('line3-a', a, '/dev/ttyACM2',
+                                     '/dev/ttyACM1', 'usb-a'),
+    ])
+    self.assertEqual([port.tty for port in unpaired],
+                     ['/dev/ttyACM4', '/dev/ttyACM5'])
+
+  def testDuplicateNames(self):
+    ports = []
+    for unique_id in ('AA', 'BB'):
+      identity = _Identity('line3-a', unique_id)
+      ports += [_Port('/dev/p' + unique_id, fixture_manager.PROGRAMMING,
+                      identity),
+                _Port('/dev/n' + unique_id, fixture_manager.NATIVE, identity)]
+    fixtures, unused_unpaired = fixture_manager.PairPorts(ports)
+    self.assertEqual([ports.key for ports in fixtures], ['AA', 'BB'])
+
+
+class SelectFixtureTest(unittest.TestCase):
+
+  def setUp(self):
+    self.fixtures = [
+        fixture_manager.FixturePorts(
+            'line3-a', _Identity('line3-a', '00AA'), '/dev/ttyACM0',
+            '/dev/ttyACM1', '8543'),
+        fixture_manager.FixturePorts(
+            '00BB', _Identity('', '00BB'), '/dev/ttyACM2', '/dev/ttyACM3',
+            'line3-a'),
+    ]
+
+  def _Select(self, selector):
+    return fixture_manager.SelectFixture(self.fixtures, selector).key
+
+  def testSelect(self):
+    self.assertEqual(self._Select('name:line3-a'), 'line3-a')
+    self.assertEqual(self._Select('uid:bb'), '00BB')
+    self.assertEqual(self._Select('usb:8543'), 'line3-a')
+    self.assertEqual(self._Select('port:/dev/ttyACM3'), '00BB')
+    self.assertEqual(self._Select('/dev/ttyACM0'), 'line3-a')
+    self.assertEqual(self._Select('usb:line3-a'), '00BB')
+
+  def testNoneOrAmbiguous(self):
+    self.assertRaisesRegex(fixture.FixtureException, 'No fixture',
+                           self._Select, 'name:line3-b')
+    self.assertRaisesRegex(fixture.FixtureException, 'More than one',
+                           self._Select, 'line3-a')
+
+
+class FixtureManagerTest(unittest.TestCase):
+
+  def setUp(self):
+    self.firmwares = []
+    self.manager = None
+
+  def tearDown(self):
+    if self.manager:
+      self.manager.Close()
+    for firmware in self.firmwares:
+      firmware.Close()
+
+  def _StartFixtures(self, *names, **kwargs):
+    fixtures = []
+    for index, name in enumerate(names):
+      firmware = FakeFirmware('%02X' % index, name, **kwargs)
+      self.firmwares.append(firmware)
+      fixtures.append(fixture_manager.FixturePorts(
+          name, _Identity(name, firmware.unique_id), firmware.programming,
+          firmware.native, ''))
+    self.manager = fixture_manager.FixtureManager(fixtures)
+    self.manager.Open()
+
+  def testQueryIdentity(self):
+    firmware = FakeFirmware('3A1B', 'line3-a')
+    self.firmwares.append(firmware)
+    for tty_path, kind in ((firmware.programming, fixture_manager.PROGRAMMING),
+                           (firmware.native, fixture_manager.NATIVE)):
+      self.assertEqual(
+          fixture_manager.QueryIdentity(tty_path, kind, timeout=2),
+          _Identity('line3-a', '3A1B'))
+
+  def testConcurrentMoves(self):
+    self._StartFixtures('line3-a', 'line3-b', move_secs=0.3)
+    requests = []
+    for key in self.manager.keys:
+      for unused_cycle in range(2):
+        requests.append(self.manager.Submit(key, 'd'))
+        requests.append(self.manager.Submit(key, 'u'))
+    start = time.time()
+    self.manager.Run(timeout=10)
+    elapsed = time.time() - start
+
+    self.assertEqual([(request.response, request.error)
+                      for request in requests], [('D', None), ('U', None)] * 4)
+    # The 8 moves of 0.3 seconds run 4 at a time on each fixture.
+    self.assertLess(elapsed, 2.0)
+    for key in self.manager.keys:
+      stats = self.manager.Stats(key)
+      self.assertEqual(stats['state'], 'U')
+      self.assertEqual(stats['moves'], 4)
+      self.assertEqual(stats['commands'], 4)
+      self.assertEqual(stats['errors'], 0)
+      self.assertAlmostEqual(stats['down_travel_ms'], 300, delta=100)
+
+  def testEmergencyStopDropsQueue(self):
+    self._StartFixtures('line3-a', 'line3-b', move_secs=0.3)
+    self.firmwares[0].emergency_stop.set()
+    down = self.manager.Submit('line3-a', 'd')
+    up = self.manager.Submit('line3-a', 'u')
+    others = [self.manager.Submit('line3-b', command) for command in 'dus']
+    self.manager.Run(timeout=10)
+
+    self.assertEqual(down.error, 'emergency stop')
+    self.assertIn('dropped', up.error)
+    self.assertEqual([request.response for request in others], ['D', 'U', 'U'])
+    self.assertEqual(self.manager.Stats('line3-a')['emergency_stops'], 1)
+    self.assertEqual(self.manager.State('line3-a'), 'e')
+
+  def testRejectedMove(self):
+    self._StartFixtures('line3-a')
+    request = self.manager.Submit('line3-a', 'u')
+    self.manager.Run(timeout=5)
+    self.assertEqual(request.response, '1')
+    self.assertIn('rejected', request.error)
+
+  def testFrameAndCharCommands(self):
+    self._StartFixtures('line3-a')
+    rename = self.manager.Submit('line3-a', 'Nline3-c\n')
+    identity = self.manager.Submit('line3-a', 'n')
+    state = self.manager.Submit('line3-a', 's')
+    self.manager.Run(timeout=5)
+    self.assertEqual(rename.response, '0')
+    self.assertEqual(fixture.ParseFixtureIdentity(identity.response),
+                     _Identity('line3-c', '00'))
+    self.assertEqual(state.response, 'U')
+
+  def testTimeout(self):
+    self._StartFixtures('line3-a')
+    with mock.patch.object(fixture_manager, 'COMMAND_TIMEOUT', 0.2):
+      odometer = self.manager.Submit('line3-a', 'o')
+      state = self.manager.Submit('line3-a', 's')
+      self.manager.Run(timeout=5)
+    self.assertIn('timed out', odometer.error)
+    self.assertIn('dropped', state.error)
+    self.assertEqual(self.manager.Stats('line3-a')['errors'], 1)
+
+
+if __name__ == '__main__':
+  unittest.main()
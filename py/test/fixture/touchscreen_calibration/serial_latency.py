@@ -0,0 +1,349 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Measure the round trip latency of the fixture commands on its ports.
+
+A mix of commands is sent to the fixture at rest through
+serial_utils.SerialDevice, and each command is timed from the send to the
+first byte of the response and to the complete response. The transports are:
+
+  sleep       SendReceive() as FixtureSerialDevice uses it, which sleeps
+              send_receive_interval_secs between the send and the receive.
+  zero-sleep  SendReceive() without the sleep, blocking in the read.
+  select      select() on the port and read what is there until the
+              response is complete, i.e., one character or a <...> frame.
+
+The mix is given as weights of the commands, e.g., 's:3,?:1,m:1' for the
+state query, a no-op command, and the time query which is answered by a
+frame. The no-op command '?' is not a fixture command, so the firmware
+answers it with ERROR without doing anything. The native usb port is measured
+with the state query, which is answered by a state vector.
+
+  $ ./serial_latency.py --port /dev/ttyACM1 --native-usb-port /dev/ttyACM0
+  $ ./serial_latency.py --virtual --count 200 --histogram
+
+The programming port goes through the USB bridge chip and a UART at the baud
+rate of the firmware, SERIAL_BAUD_RATE in Fixture.cpp. To compare the baud
+rates on the board, build the firmware at a rate and run with the same
+--baudrates. The native usb port ignores the baud rate, and so do the ptys of
+the virtual fixture. The time of the bytes on the wire at the baud rate is
+shown beside the measured times.
+"""
+
+import argparse
+import collections
+import json
+import logging
+import math
+import random
+import select
+import sys
+import time
+
+from cros.factory.external import serial
+from cros.factory.test.fixture.touchscreen_calibration import cycle_benchmark
+from cros.factory.test.fixture.touchscreen_calibration import fixture
+from cros.factory.test.utils import serial_utils
+
+
+SLEEP = 'sleep'
+ZERO_SLEEP = 'zero-sleep'
+SELECT = 'select'
+TRANSPORTS = [SLEEP, ZERO_SLEEP, SELECT]
+
+PROGRAMMING = 'programming'
+NATIVE = 'native'
+
+NOOP_COMMAND = '?'
+DEFAULT_MIX = 's:3,?:1,m:1'
+# The commands which are answered by a frame like <m12345>.
+FRAME_COMMANDS = (fixture.COMMAND.STATS, fixture.COMMAND.ODOMETER,
+                  fixture.COMMAND.TIME, fixture.COMMAND.PROFILE,
+                  fixture.COMMAND.LATENCY, fixture.COMMAND.IDENTITY)
+# The commands which may be measured; the others move the probe or change
+# the fixture.
+SAFE_COMMANDS = (fixture.COMMAND.STATE, NOOP_COMMAND) + FRAME_COMMANDS
+
+RESPONSE_TIMEOUT = 2
+WARMUP = 3
+PERCENTILES = [50, 90, 99, 100]
+# A start bit, 8 data bits and a stop bit.
+BITS_PER_BYTE = 10
+
+# The times in seconds from the send of a command, or None for a timeout.
+Sample = collections.namedtuple('Sample',
+                                ['command', 'first_byte', 'complete', 'size'])
+Result = collections.namedtuple(
+    'Result', ['port', 'transport', 'baudrate', 'samples'])
+
+
+def ParseMix(mix):
+  """Parse a mix like 's:3,?:1,m:1' into a dict of the command weights."""
+  weights = collections.OrderedDict()
+  for item in mix.split(','):
+    command, unused_sep, weight = item.rpartition(':')
+    if not command:
+      command, weight = weight, '1'
+    if command not in SAFE_COMMANDS:
+      raise ValueError('Command %r may not be measured.' % command)
+    weights[command] = float(weight)
+  if not weights or sum(weights.values()) <= 0:
+    raise ValueError('Empty command mix: %r' % mix)
+  return weights
+
+
+def CommandSequence(weights, count, seed=0):
+  """Pick count commands by their weights."""
+  rand = random.Random(seed)
+  commands = list(weights)
+  return rand.choices(commands, [weights[c] for c in commands], k=count)
+
+
+def _IsComplete(response, framed):
+  if not framed:
+    return bool(response)
+  start = response.find(b'<')
+  return start >= 0 and response.find(b'>', start) >= 0
+
+
+def _ReceiveFrameRest(device, first_byte):
+  """Receive the rest of a frame like FixtureSerialDevice._ReceiveFrame()."""
+  response = first_byte
+  while not _IsComplete(response, True):
+    response += device.Receive(1)
+  return response
+
+
+def _MeasureSendReceive(device, command, framed, interval_secs):
+  device.FlushBuffer()
+  start = time.perf_counter()
+  response = device.SendReceive(command.encode('ascii'),
+                                interval_secs=interval_secs)
+  first_byte = time.perf_counter() - start
+  if framed:
+    response = _ReceiveFrameRest(device, response)
+  return Sample(command, first_byte, time.perf_counter() - start,
+                len(response))
+
+
+def _MeasureSelect(device, command, framed, timeout):
+  # pylint: disable=protected-access
+  port = device._serial
+  device.FlushBuffer()
+  start = time.perf_counter()
+  device.Send(command.encode('ascii'))
+  deadline = start + timeout
+  response = b''
+  first_byte = None
+  while not _IsComplete(response, framed):
+    remaining = deadline - time.perf_counter()
+    if remaining <= 0:
+      raise serial.SerialTimeoutException('No response to %r' % command)
+    if not select.select([port.fileno()], [], [], remaining)[0]:
+      continue
+    data = port.read(port.in_waiting or 1)
+    if data and first_byte is None:
+      first_byte = time.perf_counter() - start
+    response += data
+  return Sample(command, first_byte, time.perf_counter() - start,
+                len(response))
+
+
+def Measure(device, transport, command, framed, timeout=RESPONSE_TIMEOUT):
+  """Time a command on a port.
+
+  Args:
+    device: a connected serial_utils.SerialDevice.
+    transport: one of TRANSPORTS.
+    framed: whether the response is a <...> frame.
+
+  Returns:
+    The Sample, whose times are None if the response timed out.
+  """
+  try:
+    if transport == SLEEP:
+      return _MeasureSendReceive(device, command, framed, None)
+    if transport == ZERO_SLEEP:
+      return _MeasureSendReceive(device, command, framed, 0)
+    return _MeasureSelect(device, command, framed, timeout)
+  except serial.SerialTimeoutException:
+    return Sample(command, None, None, 0)
+
+
+def Run(port, transport, commands, baudrate=fixture.BAUDRATE,
+        native=False, warmup=WARMUP, timeout=RESPONSE_TIMEOUT):
+  """Measure the commands on a port with a transport.
+
+  Returns:
+    The Result.
+  """
+  device = serial_utils.SerialDevice()
+  device.Connect(port=port, baudrate=baudrate, timeout=timeout,
+                 writeTimeout=timeout)
+  try:
+    samples = []
+    for index, command in enumerate(
+        [fixture.COMMAND.STATE] * warmup + list(commands)):
+      framed = native or command in FRAME_COMMANDS
+      sample = Measure(device, transport, command, framed, timeout)
+      if index >= warmup:
+        samples.append(sample)
+  finally:
+    device.Disconnect()
+  return Result(NATIVE if native else PROGRAMMING, transport, baudrate,
+                samples)
+
+
+def Percentile(values, percentile):
+  """Get the percentile of the values by the nearest lower rank."""
+  values = sorted(values)
+  return values[int(percentile / 100.0 * (len(values) - 1))]
+
+
+def Histogram(values):
+  """Count the values in seconds by power-of-2 buckets of micro-seconds.
+
+  Returns:
+    An OrderedDict of the upper bound of each bucket in micro-seconds to the
+    count of the values, from the smallest to the largest non-empty bucket.
+  """
+  counts = collections.Counter(
+      2 ** max(0, int(math.ceil(math.log2(max(value * 1e6, 1)))))
+      for value in values)
+  if not counts:
+    return collections.OrderedDict()
+  bound = min(counts)
+  histogram = collections.OrderedDict()
+  while bound <= max(counts):
+    histogram[bound] = counts.get(bound, 0)
+    bound *= 2
+  return histogram
+
+
+def WireTime(result):
+  """Get the mean time of the bytes of a command on the UART in seconds."""
+  if result.port == NATIVE or not result.samples:
+    return None
+  total_bytes = sum(1 + sample.size for sample in result.samples)
+  return (total_bytes * BITS_PER_BYTE / float(result.baudrate) /
+          len(result.samples))
+
+
+def Summarize(result):
+  """Summarize a result as a dict of the counts and the percentiles in ms."""
+  summary = collections.OrderedDict([
+      ('port', result.port), ('transport', result.transport),
+      ('baudrate', result.baudrate), ('count', len(result.samples)),
+      ('timeouts', sum(1 for sample in result.samples
+                       if sample.complete is None))])
+  for key in ('first_byte', 'complete'):
+    values = [getattr(sample, key) for sample in result.samples
+              if sample.complete is not None]
+    summary[key] = collections.OrderedDict(
+        ('p%g' % percentile,
+         Percentile(values, percentile) * 1000 if values else None)
+        for percentile in PERCENTILES)
+    summary[key + '_histogram_us'] = Histogram(values)
+  wire_time = WireTime(result)
+  summary['wire_ms'] = None if wire_time is None else wire_time * 1000
+  return summary
+
+
+def _FormatPercentiles(percentiles):
+  return ' '.join('%s=%s' % (name, '-' if value is None else '%.2f' % value)
+                  for name, value in percentiles.items())
+
+
+def FormatSummary(summary, histogram=False):
+  lines = ['%s %s %s baud: %d commands, %d timeouts%s' % (
+      summary['port'], summary['transport'],
+      '-' if summary['port'] == NATIVE else summary['baudrate'],
+      summary['count'], summary['timeouts'],
+      '' if summary['wire_ms'] is None else
+      ', %.2f ms on the wire' % summary['wire_ms'])]
+  for key in ('first_byte', 'complete'):
+    lines.append('  %-10s (ms) %s' % (key.replace('_', ' '),
+                                      _FormatPercentiles(summary[key])))
+  if histogram:
+    buckets = summary['complete_histogram_us']
+    most = max(buckets.values()) if buckets else 0
+    for bound, count in buckets.items():
+      lines.append('  <= %8d us %6d %s' % (bound, count,
+                                           '#' * (count * 40 // most)))
+  return '\n'.join(lines)
+
+
+def _RunAll(args, port, native_usb_port):
+  weights = ParseMix(args.mix)
+  commands = CommandSequence(weights, args.count, args.seed)
+  summaries = []
+  for transport in args.transports:
+    for baudrate in args.baudrates:
+      summaries.append(Summarize(Run(port, transport, commands, baudrate,
+                                     timeout=args.timeout)))
+      print(FormatSummary(summaries[-1], args.histogram))
+    if native_usb_port:
+      summaries.append(Summarize(Run(
+          native_usb_port, transport, [fixture.COMMAND.STATE] * args.count,
+          native=True, timeout=args.timeout)))
+      print(FormatSummary(summaries[-1], args.histogram))
+  return summaries
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('--port', help='the programming port of the fixture')
+  parser.add_argument('--native-usb-port',
+                      help='the native usb port of the fixture to measure')
+  parser.add_argument('--virtual', action='store_true',
+                      help='run against the virtual fixture')
+  parser.add_argument('--binary',
+                      default=cycle_benchmark.DEFAULT_VIRTUAL_FIXTURE,
+                      help='the virtual_fixture binary built in sim')
+  parser.add_argument('--mix', default=DEFAULT_MIX,
+                      help='the weights of the commands, e.g., %(default)s')
+  parser.add_argument('--count', type=int, default=50,
+                      help='the commands of each transport')
+  parser.add_argument('--seed', type=int, default=0)
+  parser.add_argument('--transports', type=lambda s: s.split(','),
+                      default=TRANSPORTS,
+                      help='a comma separated list of %s' % ', '.join(
+                          TRANSPORTS))
+  parser.add_argument('--baudrates', type=lambda s: [int(v)
+                                                      for v in s.split(',')],
+                      default=[fixture.BAUDRATE],
+                      help='the baud rates of the programming port')
+  parser.add_argument('--timeout', type=float, default=RESPONSE_TIMEOUT)
+  parser.add_argument('--histogram', action='store_true',
+                      help='show the histogram of the complete times')
+  parser.add_argument('--json', help='write the summaries to this file')
+  args = parser.parse_args()
+  logging.basicConfig(level=logging.WARNING)
+  for transport in args.transports:
+    if transport not in TRANSPORTS:
+      parser.error('Unknown transport: %s' % transport)
+
+  if args.virtual:
+    with cycle_benchmark.VirtualFixture(args.binary) as virtual_fixture:
+      summaries = _RunAll(args, virtual_fixture.port,
+                          virtual_fixture.native_usb_port)
+  else:
+    if not args.port:
+      args.port = serial_utils.FindTtyByDriver(
+          fixture.ARDUINO_DRIVER,
+          fixture.interface_protocol_dict[fixture.PROGRAMMING_PORT])
+    summaries = _RunAll(args, args.port, args.native_usb_port)
+
+  if args.json:
+    with open(args.json, 'w') as f:
+      json.dump(summaries, f, indent=2)
+  if any(summary['timeouts'] for summary in summaries):
+    sys.exit(1)
+
+
+if __name__ == '__main__':
+  main()
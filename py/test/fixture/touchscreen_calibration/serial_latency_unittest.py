@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for serial_latency."""
+
+import os
+import pty
+import select
+import threading
+import tty
+import unittest
+from unittest import mock
+
+from cros.factory.test.fixture.touchscreen_calibration import serial_latency
+
+
+class FakeFirmware(threading.Thread):
+  """A programming port on a pty which answers the measured commands."""
+
+  def __init__(self):
+    super(FakeFirmware, self).__init__()
+    self.daemon = True
+    self.stop = threading.Event()
+    self.master, self._slave = pty.openpty()
+    tty.setraw(self.master)
+    tty.setraw(self._slave)
+    self.port = os.ttyname(self._slave)
+    self.start()
+
+  def Close(self):
+    self.stop.set()
+    self.join()
+    os.close(self.master)
+    os.close(self._slave)
+
+  def run(self):
+    while not self.stop.is_set():
+      if not select.select([self.master], [], [], 0.01)[0]:
+        continue
+      for command in os.read(self.master, 1024):
+        command = chr(command)
+        if command == 's':
+          os.write(self.master, b'U')
+        elif command == 'm':
+          os.write(self.master, b'<m1234')
+          os.write(self.master, b'5>')
+        elif command == 'o':
+          # Never answered.
+          pass
+        else:
+          os.write(self.master, b'1')
+
+
+class ParseMixTest(unittest.TestCase):
+
+  def testParse(self):
+    self.assertEqual(dict(serial_latency.ParseMix('s:3,?:1,m')),
+                     {'s': 3, '?': 1, 'm': 1})
+
+  def testUnsafeCommand(self):
+    self.assertRaisesRegex(ValueError, 'may not be measured',
+                           serial_latency.ParseMix, 'd:1')
+    self.assertRaisesRegex(ValueError, 'Empty',
+                           serial_latency.ParseMix, 's:0')
+
+  def testSequence(self):
+    weights = serial_latency.ParseMix('s:1,m:0')
+    self.assertEqual(serial_latency.CommandSequence(weights, 5), ['s'] * 5)
+
+
+class SummaryTest(unittest.TestCase):
+
+  def testHistogram(self):
+    self.assertEqual(
+        list(serial_latency.Histogram([0.0001, 0.0003, 0.0003, 0.002])
+             .items()),
+        [(128, 1), (256, 0), (512, 2), (1024, 0), (2048, 1)])
+    self.assertEqual(serial_latency.Histogram([]), {})
+
+  def testSummarize(self):
+    samples = [serial_latency.Sample('s', 0.001 * i, 0.002 * i, 1)
+               for i in range(1, 101)]
+    samples.append(serial_latency.Sample('m', None, None, 0))
+    summary = serial_latency.Summarize(serial_latency.Result(
+        serial_latency.PROGRAMMING, serial_latency.SELECT, 9600, samples))
+    self.assertEqual(summary['count'], 101)
+    self.assertEqual(summary['timeouts'], 1)
+    self.assertAlmostEqual(summary['first_byte']['p50'], 50)
+    self.assertAlmostEqual(summary['complete']['p100'], 200)
+    # 2 bytes of 10 bits at 9600 baud, less for the timeout.
+    self.assertAlmostEqual(summary['wire_ms'], 20 / 9.6 * 201 / 202)
+    self.assertIn('p90=', serial_latency.FormatSummary(summary, True))
+
+
+class RunTest(unittest.TestCase):
+
+  def setUp(self):
+    self.firmware = FakeFirmware()
+
+  def tearDown(self):
+    self.firmware.Close()
+
+  def _Run(self, transport, commands):
+    return serial_latency.Run(self.firmware.port, transport, commands,
+                              warmup=1, timeout=0.3).samples
+
+  def testTransports(self):
+    for transport in serial_latency.TRANSPORTS:
+      samples = self._Run(transport, ['s', '?', 'm'])
+      self.assertEqual([sample.size for sample in samples], [1, 1, 8])
+      for sample in samples:
+        self.assertLessEqual(sample.first_byte, sample.complete)
+
+  def testSleep(self):
+    with mock.patch.object(serial_latency.serial_utils.time, 'sleep') as sleep:
+      self._Run(serial_latency.SLEEP, ['s'])
+      self._Run(serial_latency.ZERO_SLEEP, ['s'])
+    # The warmup and the command sleep only with SendReceive's interval.
+    self.assertEqual([c[0][0] for c in sleep.call_args_list], [0.2, 0.2, 0, 0])
+
+  def testTimeout(self):
+    for transport in serial_latency.TRANSPORTS:
+      samples = self._Run(transport, ['o', 's'])
+      self.assertEqual(samples[0], serial_latency.Sample('o', None, None, 0))
+      self.assertEqual(samples[1].size, 1)
+
+
+if __name__ == '__main__':
+  unittest.main()
@@ -0,0 +1,293 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The subset of the arduino DUE core used by the fixture firmware.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "FaultInjector.h"
+#include "Simulator.h"
+
+// The default timeout of readBytes() and readBytesUntil() like Stream.
+const unsigned long SERIAL_DEFAULT_TIMEOUT = 1000;
+
+// The size of the UART transmit buffer of the DUE core.
+const uint64_t SERIAL_TX_BUFFER_SIZE = 128;
+// A byte takes 10 bits on the wire with the start and the stop bits.
+const uint64_t SERIAL_BITS_PER_BYTE = 10;
+
+SimSerial Serial("programming port");
+SimSerial SerialUSB("native usb port");
+
+
+void pinMode(uint32_t pin, uint32_t mode) {
+}
+
+void digitalWrite(uint32_t pin, uint32_t value) {
+  Simulator::instance().plant().digitalWrite(pin, value);
+}
+
+int digitalRead(uint32_t pin) {
+  return Simulator::instance().plant().digitalRead(pin);
+}
+
+void analogWrite(uint32_t pin, uint32_t value) {
+  Simulator::instance().plant().analogWrite(pin, value);
+}
+
+unsigned long millis() {
+  return (uint32_t) (Simulator::instance().now() / 1000);
+}
+
+unsigned long micros() {
+  return (uint32_t) Simulator::instance().now();
+}
+
+void delay(unsigned long ms) {
+  Simulator::instance().advance((uint64_t) ms * 1000);
+}
+
+static uint32_t randomState = 1;
+
+void randomSeed(unsigned long seed) {
+  randomState = seed ? seed : 1;
+}
+
+/**
+ * A xorshift generator, so that the firmware gets the same sequence on every
+ * host.
+ */
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig)
+    return howsmall;
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return howsmall + randomState % (howbig - howsmall);
+}
+
+/**
+ * The firmware sets clka to the pwm frequency times PWM_MAX_DUTY_CYCLE.
+ */
+uint32_t PWMC_ConfigureClocks(uint32_t clka, uint32_t clkb, uint32_t mck) {
+  Simulator::instance().plant().setPwmFrequency(clka / PWM_MAX_DUTY_CYCLE);
+  return 0;
+}
+
+
+SimSerial::SimSerial(const char *name) {
+  name_ = name;
+  masterFd_ = -1;
+  slaveFd_ = -1;
+  timeout_ = SERIAL_DEFAULT_TIMEOUT;
+  nullSink_ = false;
+  baudModel_ = false;
+  baud_ = 0;
+  txEmptyTime_ = 0;
+  blockedTime_ = 0;
+}
+
+/**
+ * Create the pseudo-terminal in raw mode.
+ *
+ * If link is not NULL, it is made a symlink to the slave side so that the
+ * host could open the port by a fixed path.
+ */
+bool SimSerial::open(const char *link) {
+  masterFd_ = posix_openpt(O_RDWR | O_NOCTTY);
+  if (masterFd_ < 0 || grantpt(masterFd_) < 0 || unlockpt(masterFd_) < 0)
+    return false;
+  slaveName_ = ptsname(masterFd_);
+
+  slaveFd_ = ::open(slaveName_.c_str(), O_RDWR | O_NOCTTY);
+  if (slaveFd_ < 0)
+    return false;
+  struct termios tio;
+  if (tcgetattr(slaveFd_, &tio) < 0)
+    return false;
+  cfmakeraw(&tio);
+  if (tcsetattr(slaveFd_, TCSANOW, &tio) < 0)
+    return false;
+
+  if (fcntl(masterFd_, F_SETFL, fcntl(masterFd_, F_GETFL) | O_NONBLOCK) < 0)
+    return false;
+
+  if (link != NULL) {
+    unlink(link);
+    if (symlink(slaveName_.c_str(), link) < 0)
+      return false;
+  }
+  return true;
+}
+
+void SimSerial::begin(unsigned long baud) {
+  baud_ = baud;
+}
+
+/**
+ * Block until the UART transmit buffer has room for a byte, then queue it.
+ *
+ * The simulated clock advances while blocking, so the plant keeps moving and
+ * the timer ISRs keep running like on the board.
+ */
+void SimSerial::blockWhileFull() {
+  Simulator &simulator = Simulator::instance();
+  uint64_t byteTime = SERIAL_BITS_PER_BYTE * 1000000 / baud_;
+  if (txEmptyTime_ < simulator.now())
+    txEmptyTime_ = simulator.now();
+  txEmptyTime_ += byteTime;
+  uint64_t queued = txEmptyTime_ - simulator.now();
+  uint64_t capacity = SERIAL_TX_BUFFER_SIZE * byteTime;
+  if (queued > capacity) {
+    blockedTime_ += queued - capacity;
+    simulator.advance(queued - capacity);
+  }
+}
+
+/**
+ * Move the bytes sent by the host into the receive buffer.
+ *
+ * Wait up to timeout milli-seconds of the wall clock for the first byte.
+ * Return true if the receive buffer is not empty.
+ */
+bool SimSerial::fill(unsigned long timeout) {
+  if (masterFd_ < 0)
+    return !rxBuffer_.empty();
+
+  struct pollfd pfd = {masterFd_, POLLIN, 0};
+  if (rxBuffer_.empty() && timeout > 0)
+    poll(&pfd, 1, timeout);
+
+  char buf[256];
+  ssize_t n;
+  while ((n = ::read(masterFd_, buf, sizeof(buf))) > 0)
+    receive(buf, n);
+  return !rxBuffer_.empty();
+}
+
+int SimSerial::available() {
+  fill(0);
+  return rxBuffer_.size();
+}
+
+int SimSerial::read() {
+  if (!fill(0))
+    return -1;
+  return takeByte();
+}
+
+/**
+ * Take a byte from the receive buffer which must not be empty.
+ */
+int SimSerial::takeByte() {
+  int c = (unsigned char) rxBuffer_[0];
+  rxBuffer_.erase(0, 1);
+  return c;
+}
+
+/**
+ * Put the bytes from the host into the receive buffer unless they are
+ * dropped by a fault.
+ */
+void SimSerial::receive(const char *bytes, size_t length) {
+  FaultInjector &injector = FaultInjector::instance();
+  uint64_t now = Simulator::instance().now();
+  for (size_t i = 0; i < length; i++) {
+    if (!injector.dropByte(this, now))
+      rxBuffer_ += bytes[i];
+  }
+}
+
+/**
+ * Send a byte to the host. The byte is dropped if the host does not drain the
+ * port, like the native USB port does when no one listens.
+ */
+size_t SimSerial::write(uint8_t c) {
+  if (nullSink_)
+    return 1;
+  if (baudModel_ && baud_ > 0)
+    blockWhileFull();
+  if (FaultInjector::instance().dropByte(this, Simulator::instance().now()))
+    return 1;
+  if (masterFd_ < 0) {
+    txBuffer_ += (char) c;
+    return 1;
+  }
+  return ::write(masterFd_, &c, 1) == 1 ? 1 : 0;
+}
+
+/**
+ * Get and clear the bytes sent without a pseudo-terminal.
+ */
+std::string SimSerial::takeOutput() {
+  std::string output;
+  output.swap(txBuffer_);
+  return output;
+}
+
+
+size_t Print::print(const char *str) {
+  size_t n = 0;
+  while (*str)
+    n += write(*str++);
+  return n;
+}
+
+size_t Print::print(char c) {
+  return write(c);
+}
+
+size_t Print::print(int value, int base) {
+  return print((long) value, base);
+}
+
+size_t Print::print(unsigned int value, int base) {
+  return print((unsigned long) value, base);
+}
+
+size_t Print::print(long value, int base) {
+  if (base != DEC && value >= 0)
+    return print((unsigned long) value, base);
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%ld", value);
+  return print(buf);
+}
+
+size_t Print::print(unsigned long value, int base) {
+  char buf[24];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lx" : "%lu", value);
+  return print(buf);
+}
+
+/**
+ * Read up to length bytes, waiting up to the timeout for each of them.
+ */
+size_t SimSerial::readBytes(char *buf, size_t length) {
+  size_t n = 0;
+  while (n < length && fill(timeout_))
+    buf[n++] = takeByte();
+  return n;
+}
+
+/**
+ * Read up to length bytes until the terminator which is discarded.
+ */
+size_t SimSerial::readBytesUntil(char terminator, char *buf, size_t length) {
+  size_t n = 0;
+  while (n < length && fill(timeout_)) {
+    char c = takeByte();
+    if (c == terminator)
+      break;
+    buf[n++] = c;
+  }
+  return n;
+}
@@ -0,0 +1,146 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The subset of the arduino DUE core used by the fixture firmware, implemented
+ * on Linux for the virtual fixture.
+ *
+ * The pins are wired to the simulated plant, the time is the simulated clock,
+ * and the programming port and the native USB port are pseudo-terminals.
+ */
+
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+
+// The size of the flash bank 1 of SAM3X8E.
+#define IFLASH1_SIZE 0x40000
+
+#define PWM_MAX_DUTY_CYCLE 255
+#define VARIANT_MCK 84000000
+
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t value);
+int digitalRead(uint32_t pin);
+void analogWrite(uint32_t pin, uint32_t value);
+
+// The time since the virtual fixture was powered on. Like on the board, the
+// values wrap around at 32 bits.
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+// The pseudo-random numbers in [howsmall, howbig).
+void randomSeed(unsigned long seed);
+long random(long howsmall, long howbig);
+
+// Interrupts are only delivered between two iterations of loop() or while a
+// write to a serial port blocks, so there is nothing to mask.
+inline void noInterrupts() {}
+inline void interrupts() {}
+// The CMSIS intrinsics to save, mask and restore the interrupts.
+inline uint32_t __get_PRIMASK() { return 0; }
+inline void __set_PRIMASK(uint32_t priMask) {}
+inline void __disable_irq() {}
+
+uint32_t PWMC_ConfigureClocks(uint32_t clka, uint32_t clkb, uint32_t mck);
+
+
+#define DEC 10
+#define HEX 16
+
+// The text output shared by the serial ports.
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+
+    size_t print(const char *str);
+    size_t print(char c);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+};
+
+
+// A serial port backed by a pseudo-terminal, or by in-memory buffers when
+// the firmware is fed with a recorded trace.
+class SimSerial : public Print {
+  public:
+    explicit SimSerial(const char *name);
+
+    void begin(unsigned long baud);
+    int available();
+    int read();
+    virtual size_t write(uint8_t c);
+    size_t readBytes(char *buf, size_t length);
+    size_t readBytesUntil(char terminator, char *buf, size_t length);
+    void setTimeout(unsigned long timeout) { timeout_ = timeout; }
+
+    // Model the transmit buffer of the UART which drains at the baud rate
+    // passed to begin(): a write blocks the loop while the buffer is full.
+    void setBaudModel(bool enabled) { baudModel_ = enabled; }
+    // The total simulated time in micro-seconds the writes have blocked.
+    uint64_t blockedTime() const { return blockedTime_; }
+    // Discard the bytes sent, e.g., to time the code which sends them.
+    void setNullSink(bool enabled) { nullSink_ = enabled; }
+
+    // Create the pseudo-terminal and optionally a symlink to its slave side.
+    bool open(const char *link);
+    const char* name() const { return name_; }
+    const std::string& slaveName() const { return slaveName_; }
+
+    // Without a pseudo-terminal, take the bytes from the host from inject()
+    // and keep the bytes to the host in the buffer of takeOutput().
+    void inject(const std::string &bytes) {
+      receive(bytes.data(), bytes.size());
+    }
+    std::string takeOutput();
+
+  private:
+    bool fill(unsigned long timeout);
+    int takeByte();
+    void receive(const char *bytes, size_t length);
+
+    const char *name_;
+    int masterFd_;
+    // The slave side is kept open so that the port survives the host closing
+    // and reopening it.
+    int slaveFd_;
+    std::string slaveName_;
+    std::string rxBuffer_;
+    std::string txBuffer_;
+    // The timeout of readBytes() and readBytesUntil() in milli-seconds.
+    unsigned long timeout_;
+
+    void blockWhileFull();
+
+    bool nullSink_;
+    bool baudModel_;
+    unsigned long baud_;
+    // The simulated time when the UART transmit buffer becomes empty.
+    uint64_t txEmptyTime_;
+    uint64_t blockedTime_;
+};
+
+extern SimSerial Serial;
+extern SimSerial SerialUSB;
+
+#endif
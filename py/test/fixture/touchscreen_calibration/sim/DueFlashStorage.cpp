@@ -0,0 +1,37 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The flash bank 1 of the virtual fixture.
+ */
+
+#include <DueFlashStorage.h>
+#include "Simulator.h"
+
+
+byte DueFlashStorage::read(uint32_t address) {
+  return Simulator::instance().flash()[address];
+}
+
+byte* DueFlashStorage::readAddress(uint32_t address) {
+  return Simulator::instance().flash() + address;
+}
+
+bool DueFlashStorage::write(uint32_t address, byte value) {
+  return write(address, &value, 1);
+}
+
+bool DueFlashStorage::write(uint32_t address, byte *data, uint32_t length) {
+  if (address + length > IFLASH1_SIZE)
+    return false;
+  memcpy(Simulator::instance().flash() + address, data, length);
+  return true;
+}
+
+uint32_t flash_read_unique_id(uint32_t *pul_data, uint32_t ul_size) {
+  const uint32_t *uniqueId = Simulator::instance().uniqueId();
+  for (uint32_t i = 0; i < ul_size && i < 4; i++)
+    pul_data[i] = uniqueId[i];
+  return 0;
+}
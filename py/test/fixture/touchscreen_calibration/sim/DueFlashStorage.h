@@ -0,0 +1,30 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The flash bank 1 with the interface of the DueFlashStorage library.
+ *
+ * The content is kept in a file mapped into memory so that the wear log and
+ * the motion profiles survive a restart of the virtual fixture.
+ */
+
+
+#ifndef DueFlashStorage_h
+#define DueFlashStorage_h
+
+#include "Arduino.h"
+
+
+class DueFlashStorage {
+  public:
+    byte read(uint32_t address);
+    byte* readAddress(uint32_t address);
+    bool write(uint32_t address, byte value);
+    bool write(uint32_t address, byte *data, uint32_t length);
+};
+
+// The unique identifier of the chip from flash_efc.h. Return 0 on success.
+uint32_t flash_read_unique_id(uint32_t *pul_data, uint32_t ul_size);
+
+#endif
@@ -0,0 +1,66 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * A periodic timer driven by the simulated clock of the virtual fixture.
+ */
+
+#include <DueTimer.h>
+#include "Simulator.h"
+
+// The states of the timers. They are zero-initialized before any global
+// constructor runs.
+struct TimerState {
+  void (*isr)();
+  bool running;
+  uint64_t period;
+  uint64_t deadline;
+};
+static TimerState timers[DueTimer::NUM_TIMERS];
+
+DueTimer Timer(0);
+
+
+/**
+ * Get the first timer without an ISR attached.
+ */
+DueTimer DueTimer::getAvailable() {
+  for (unsigned short timer = 0; timer < NUM_TIMERS; timer++) {
+    if (timers[timer].isr == NULL)
+      return DueTimer(timer);
+  }
+  return DueTimer(0);
+}
+
+DueTimer& DueTimer::attachInterrupt(void (*isr)()) {
+  timers[timer].isr = isr;
+  return *this;
+}
+
+DueTimer& DueTimer::start(long microseconds) {
+  TimerState &state = timers[timer];
+  state.period = microseconds;
+  state.deadline = Simulator::instance().now() + state.period;
+  state.running = true;
+  return *this;
+}
+
+DueTimer& DueTimer::stop() {
+  timers[timer].running = false;
+  return *this;
+}
+
+/**
+ * Run an ISR once if its deadline has passed, and schedule its next period.
+ */
+void DueTimer::serviceAll(uint64_t now) {
+  for (unsigned short timer = 0; timer < NUM_TIMERS; timer++) {
+    TimerState &state = timers[timer];
+    if (!state.running || now < state.deadline)
+      continue;
+    state.deadline += state.period;
+    if (state.isr != NULL)
+      state.isr();
+  }
+}
@@ -0,0 +1,40 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * A periodic timer with the interface of the DueTimer library, driven by the
+ * simulated clock of the virtual fixture.
+ */
+
+
+#ifndef DueTimer_h
+#define DueTimer_h
+
+#include <stdint.h>
+
+
+class DueTimer {
+  public:
+    // Like the DueTimer library, a DueTimer is a handle of a timer so that
+    // its copies control the same timer.
+    static const unsigned short NUM_TIMERS = 2;
+
+    DueTimer(unsigned short timer) : timer(timer) {}
+
+    static DueTimer getAvailable();
+
+    DueTimer& attachInterrupt(void (*isr)());
+    DueTimer& start(long microseconds);
+    DueTimer& stop();
+
+    // Run the ISRs of the timers whose periods have elapsed at the simulated
+    // time now.
+    static void serviceAll(uint64_t now);
+
+    unsigned short timer;
+};
+
+extern DueTimer Timer;
+
+#endif
@@ -0,0 +1,268 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The scriptable fault injection of the virtual fixture.
+ */
+
+#include <stdio.h>
+
+#include <sstream>
+
+#include "Arduino.h"
+#include "FaultInjector.h"
+#include "Plant.h"
+
+struct KindName {
+  FaultInjector::Kind kind;
+  const char *name;
+};
+
+static const KindName KIND_NAMES[] = {
+  {FaultInjector::CHATTER, "chatter"},
+  {FaultInjector::STUCK_HIGH, "stuck_high"},
+  {FaultInjector::STUCK_LOW, "stuck_low"},
+  {FaultInjector::MISSED_STEPS, "missed_steps"},
+  {FaultInjector::USB_DISCONNECT, "usb_disconnect"},
+  {FaultInjector::UART_DROP, "uart_drop"},
+  {FaultInjector::INTRUDE, "intrude"},
+  {FaultInjector::PRESS, "press"},
+};
+
+struct TargetPin {
+  const char *name;
+  int pin;
+};
+
+// The sensor pins which could be the target of a pin fault.
+static const TargetPin TARGET_PINS[] = {
+  {"jumper", Plant::PIN_JUMPER},
+  {"button", Plant::PIN_BUTTON_DEBUG},
+  {"extreme_up", Plant::PIN_SENSOR_EXTREME_UP},
+  {"up", Plant::PIN_SENSOR_UP},
+  {"down", Plant::PIN_SENSOR_DOWN},
+  {"safety", Plant::PIN_SENSOR_SAFETY},
+};
+
+
+FaultInjector& FaultInjector::instance() {
+  static FaultInjector injector;
+  return injector;
+}
+
+FaultInjector::FaultInjector() {
+}
+
+/**
+ * Load a fault script.
+ */
+bool FaultInjector::load(const char *path, std::string *error) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    *error = std::string("cannot open ") + path;
+    return false;
+  }
+  char line[256];
+  int lineNumber = 0;
+  bool result = true;
+  while (result && fgets(line, sizeof(line), file) != NULL) {
+    lineNumber++;
+    result = parse(line, error);
+    if (!result) {
+      char where[32];
+      snprintf(where, sizeof(where), " at line %d", lineNumber);
+      *error += where;
+    }
+  }
+  fclose(file);
+  return result;
+}
+
+/**
+ * Parse a line of the fault script and schedule the fault.
+ */
+bool FaultInjector::parse(const std::string &line, std::string *error) {
+  std::istringstream stream(line);
+  std::string name, target, option;
+  if (!(stream >> name) || name[0] == '#')
+    return true;
+  if (!(stream >> target)) {
+    *error = "no target of " + name;
+    return false;
+  }
+
+  Fault fault;
+  fault.name = name;
+  fault.target = target;
+  fault.pin = -1;
+  fault.start = 0;
+  fault.duration = 0;
+  fault.period = 0;
+  fault.probability = 1;
+
+  size_t kind;
+  for (kind = 0; kind < sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]); kind++) {
+    if (name == KIND_NAMES[kind].name)
+      break;
+  }
+  if (kind == sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0])) {
+    *error = "unknown fault " + name;
+    return false;
+  }
+  fault.kind = KIND_NAMES[kind].kind;
+
+  for (size_t i = 0; i < sizeof(TARGET_PINS) / sizeof(TARGET_PINS[0]); i++) {
+    if (target == TARGET_PINS[i].name)
+      fault.pin = TARGET_PINS[i].pin;
+  }
+  bool pinFault = (fault.kind == CHATTER || fault.kind == STUCK_HIGH ||
+                   fault.kind == STUCK_LOW);
+  if ((pinFault && fault.pin < 0) ||
+      (fault.kind == MISSED_STEPS && target != "motor") ||
+      (fault.kind == USB_DISCONNECT && target != "native") ||
+      (fault.kind == UART_DROP && target != "programming") ||
+      (fault.kind == INTRUDE && target != "safety") ||
+      (fault.kind == PRESS && target != "button")) {
+    *error = "bad target " + target + " of " + name;
+    return false;
+  }
+
+  while (stream >> option) {
+    size_t equal = option.find('=');
+    std::string key = option.substr(0, equal);
+    const char *value = equal == std::string::npos ? "" :
+                        option.c_str() + equal + 1;
+    char *end;
+    double number = strtod(value, &end);
+    if (*value == '\0' || *end != '\0' || number < 0) {
+      *error = "bad option " + option;
+      return false;
+    }
+    if (key == "at") {
+      fault.start = number * 1000;
+    } else if (key == "for") {
+      fault.duration = number * 1000;
+    } else if (key == "every") {
+      fault.period = number * 1000;
+    } else if (key == "p" && number <= 1) {
+      fault.probability = number;
+    } else {
+      *error = "bad option " + option;
+      return false;
+    }
+  }
+  if (fault.period > 0 && (fault.duration == 0 ||
+                           fault.duration > fault.period)) {
+    *error = "a repeated fault needs for= shorter than every=";
+    return false;
+  }
+
+  faults_.push_back(fault);
+  environmentActive_.push_back(false);
+  return true;
+}
+
+/**
+ * Is the fault active at the time now?
+ */
+bool FaultInjector::isActive(const Fault &fault, uint64_t now) const {
+  if (now < fault.start)
+    return false;
+  uint64_t elapsed = now - fault.start;
+  if (fault.period > 0)
+    elapsed %= fault.period;
+  return fault.duration == 0 || elapsed < fault.duration;
+}
+
+/**
+ * Get the end of the activation which covers the time now, or 0 for a fault
+ * active forever.
+ */
+uint64_t FaultInjector::activationEnd(const Fault &fault,
+                                      uint64_t now) const {
+  if (fault.duration == 0)
+    return 0;
+  uint64_t start = fault.start;
+  if (fault.period > 0 && now > start)
+    start += (now - start) / fault.period * fault.period;
+  return start + fault.duration;
+}
+
+bool FaultInjector::chance(double probability) {
+  if (probability >= 1)
+    return true;
+  return std::uniform_real_distribution<double>(0, 1)(random_) < probability;
+}
+
+/**
+ * Apply the pin faults to the raw value of a pin read by the firmware.
+ */
+int FaultInjector::filterPin(int pin, int level, uint64_t now) {
+  for (size_t i = 0; i < faults_.size(); i++) {
+    const Fault &fault = faults_[i];
+    if (fault.pin != pin || !isActive(fault, now) ||
+        !chance(fault.probability))
+      continue;
+    if (fault.kind == CHATTER)
+      level = (level == HIGH) ? LOW : HIGH;
+    else if (fault.kind == STUCK_HIGH)
+      level = HIGH;
+    else if (fault.kind == STUCK_LOW)
+      level = LOW;
+  }
+  return level;
+}
+
+/**
+ * Drop the steps missed by the motor.
+ */
+long FaultInjector::filterSteps(long steps, uint64_t now) {
+  for (size_t i = 0; i < faults_.size(); i++) {
+    const Fault &fault = faults_[i];
+    if (fault.kind != MISSED_STEPS || !isActive(fault, now))
+      continue;
+    long taken = 0;
+    for (long step = 0; step < steps; step++) {
+      if (!chance(fault.probability))
+        taken++;
+    }
+    steps = taken;
+  }
+  return steps;
+}
+
+/**
+ * Should a byte through the port be dropped?
+ */
+bool FaultInjector::dropByte(const SimSerial *port, uint64_t now) {
+  for (size_t i = 0; i < faults_.size(); i++) {
+    const Fault &fault = faults_[i];
+    if (!isActive(fault, now))
+      continue;
+    if ((fault.kind == USB_DISCONNECT && port == &SerialUSB) ||
+        (fault.kind == UART_DROP && port == &Serial &&
+         chance(fault.probability)))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Apply the events of the environment to the plant when they begin or end.
+ */
+void FaultInjector::applyEnvironment(Plant &plant, uint64_t now) {
+  for (size_t i = 0; i < faults_.size(); i++) {
+    const Fault &fault = faults_[i];
+    if (fault.kind != INTRUDE && fault.kind != PRESS)
+      continue;
+    bool active = isActive(fault, now);
+    if (active == environmentActive_[i])
+      continue;
+    environmentActive_[i] = active;
+    if (fault.kind == INTRUDE)
+      plant.setSafety(active);
+    else
+      plant.setButton(active);
+  }
+}
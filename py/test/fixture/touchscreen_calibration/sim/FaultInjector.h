@@ -0,0 +1,103 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The scriptable fault injection of the virtual fixture.
+ *
+ * A fault script has a fault per line like
+ *   chatter down at=2000 for=500 p=0.2
+ *   stuck_low safety at=10000 for=300 every=60000
+ *   missed_steps motor p=0.01
+ *   usb_disconnect native at=7000 for=50
+ *   uart_drop programming p=0.001
+ *   intrude safety at=20000 for=800
+ * where the times are in milli-seconds of the simulated clock. A fault is
+ * active from at= for for= (forever if omitted), repeated every every= if
+ * given, and applies to each sample, step, or byte with the probability p=
+ * (1 if omitted). Lines starting with # are comments.
+ *
+ * The faults:
+ *   chatter          the raw value of a sensor pin is inverted
+ *   stuck_high       the raw value of a sensor pin is HIGH
+ *   stuck_low        the raw value of a sensor pin is LOW
+ *   missed_steps     the motor misses a step
+ *   usb_disconnect   the bytes through the native usb port are lost
+ *   uart_drop        a byte through the programming port is dropped
+ * and the events of the environment:
+ *   intrude          something intrudes the safety curtain
+ *   press            the operator presses the debug button
+ */
+
+
+#ifndef FaultInjector_h
+#define FaultInjector_h
+
+#include <stdint.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+class Plant;
+class SimSerial;
+
+
+class FaultInjector {
+  public:
+    enum Kind {CHATTER,
+               STUCK_HIGH,
+               STUCK_LOW,
+               MISSED_STEPS,
+               USB_DISCONNECT,
+               UART_DROP,
+               INTRUDE,
+               PRESS,
+    };
+
+    // A scheduled fault. The times are in micro-seconds and a zero duration
+    // means forever.
+    struct Fault {
+      Kind kind;
+      std::string name;
+      std::string target;
+      int pin;
+      uint64_t start;
+      uint64_t duration;
+      uint64_t period;
+      double probability;
+    };
+
+    static FaultInjector& instance();
+
+    bool load(const char *path, std::string *error);
+    bool parse(const std::string &line, std::string *error);
+    void seed(unsigned int seed) { random_.seed(seed); }
+    // Drop all the faults, e.g., after the last one has ended.
+    void clear() {
+      faults_.clear();
+      environmentActive_.clear();
+    }
+
+    // The hooks in the plant and the serial ports.
+    int filterPin(int pin, int level, uint64_t now);
+    long filterSteps(long steps, uint64_t now);
+    bool dropByte(const SimSerial *port, uint64_t now);
+    void applyEnvironment(Plant &plant, uint64_t now);
+
+    bool isActive(const Fault &fault, uint64_t now) const;
+    // Get the end of the activation of a fault which covers the time now.
+    uint64_t activationEnd(const Fault &fault, uint64_t now) const;
+    const std::vector<Fault>& faults() const { return faults_; }
+
+  private:
+    FaultInjector();
+    bool chance(double probability);
+
+    std::vector<Fault> faults_;
+    // Whether each environment event was active at the last check.
+    std::vector<bool> environmentActive_;
+    std::mt19937 random_;
+};
+
+#endif
@@ -0,0 +1,269 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The monitor of the virtual fixture.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "FaultInjector.h"
+#include "Monitor.h"
+#include "Plant.h"
+
+// The motor must stop within this time in micro-seconds after an intrusion,
+// which is the longest safety debounce window allowed by a motion profile
+// plus a margin.
+const uint64_t SAFETY_REACTION_LIMIT = 150000;
+
+const char Monitor::STATES[] = "iduDUeb";
+
+// The transitions of the main state allowed by the state machine, as pairs of
+// the state before and after. In particular, a safety trip leaves the probe in
+// the UP position rather than in an emergency stop if the UP sensor is active.
+static const char *const LEGAL_TRANSITIONS[] = {
+  "id", "iU", "ie",
+  "dD", "du", "dU", "de",
+  "Du", "De",
+  "uU", "ue",
+  "Ud", "Ue",
+  "eb", "eU",
+  "bU", "be",
+};
+static const size_t NUM_LEGAL_TRANSITIONS =
+    sizeof(LEGAL_TRANSITIONS) / sizeof(LEGAL_TRANSITIONS[0]);
+
+// Report at most this many activations of a fault one by one.
+const unsigned int MAX_REPORTED_ACTIVATIONS = 10;
+// Abbreviate the reaction of a fault to this many transitions.
+const unsigned int MAX_REPORTED_TRANSITIONS = 12;
+
+
+Monitor::Monitor(bool keepLog) : keepLog_(keepLog) {
+  begin('i', 0);
+}
+
+/**
+ * Start monitoring from a state.
+ */
+void Monitor::begin(char state, uint64_t now) {
+  initialState_ = state;
+  beginTime_ = now;
+  state_ = state;
+  transitions_.clear();
+  memset(transitionCounts_, 0, sizeof(transitionCounts_));
+  illegalTransitions_ = 0;
+  intruded_ = false;
+  stopped_ = true;
+  intrusionStart_ = 0;
+  intrusions_ = 0;
+  safetyViolations_ = 0;
+  maxSafetyReaction_ = 0;
+  leftRest_ = now;
+  maxOutOfRest_ = 0;
+}
+
+/**
+ * Is the probe at rest in this state when no fault is active?
+ */
+bool Monitor::isRestState(char state) {
+  return (state == 'i' || state == 'U' || state == 'D');
+}
+
+/**
+ * Can the state machine go from a state to another?
+ */
+bool Monitor::isLegalTransition(char from, char to) {
+  for (size_t i = 0; i < NUM_LEGAL_TRANSITIONS; i++) {
+    if (LEGAL_TRANSITIONS[i][0] == from && LEGAL_TRANSITIONS[i][1] == to)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Get the index of a state in STATES, or -1 if it is not a main state.
+ */
+int Monitor::stateIndex(char state) {
+  const char *found = strchr(STATES, state);
+  return (state != '\0' && found != NULL) ? found - STATES : -1;
+}
+
+/**
+ * Sample the state of the firmware and the plant after an iteration of loop().
+ */
+void Monitor::sample(char state, uint64_t now, const Plant &plant) {
+  if (state != state_) {
+    Transition transition = {now, state_, state};
+    if (keepLog_)
+      transitions_.push_back(transition);
+    int from = stateIndex(state_);
+    int to = stateIndex(state);
+    if (from >= 0 && to >= 0)
+      transitionCounts_[from][to]++;
+    if (!isLegalTransition(state_, state)) {
+      if (illegalTransitions_ == 0)
+        fprintf(stderr, "illegal transition %c->%c at %.3f ms\n", state_,
+                state, now / 1000.0);
+      illegalTransitions_++;
+    }
+    if (isRestState(state_) && !isRestState(state))
+      leftRest_ = now;
+    state_ = state;
+  }
+  if (!isRestState(state))
+    maxOutOfRest_ = std::max(maxOutOfRest_, now - leftRest_);
+
+  if (plant.isIntruded() && !intruded_) {
+    intruded_ = true;
+    stopped_ = !plant.isMoving();
+    intrusionStart_ = now;
+    intrusions_++;
+  } else if (!plant.isIntruded()) {
+    intruded_ = false;
+  }
+  if (intruded_ && !stopped_) {
+    uint64_t reaction = now - intrusionStart_;
+    if (!plant.isMoving()) {
+      stopped_ = true;
+      maxSafetyReaction_ = std::max(maxSafetyReaction_, reaction);
+    } else if (reaction > SAFETY_REACTION_LIMIT) {
+      // Count a violation once per intrusion.
+      stopped_ = true;
+      safetyViolations_++;
+    }
+  }
+}
+
+/**
+ * Get the main state at a time.
+ */
+char Monitor::stateAt(uint64_t time) const {
+  char state = initialState_;
+  for (size_t i = 0; i < transitions_.size() && transitions_[i].time <= time;
+       i++)
+    state = transitions_[i].to;
+  return state;
+}
+
+/**
+ * Get the time from the end of a fault until the probe is at rest again.
+ * Return false if it never is until the end of the run.
+ */
+bool Monitor::recoveryTime(uint64_t faultEnd, uint64_t end,
+                           uint64_t *recovery) const {
+  if (isRestState(stateAt(faultEnd))) {
+    *recovery = 0;
+    return true;
+  }
+  for (size_t i = 0; i < transitions_.size(); i++) {
+    const Transition &transition = transitions_[i];
+    if (transition.time > faultEnd && transition.time <= end &&
+        isRestState(transition.to)) {
+      *recovery = transition.time - faultEnd;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Count the activations of the faults after which the probe never came to
+ * rest again.
+ */
+unsigned long Monitor::unrecoveredFaults(const FaultInjector &injector,
+                                         uint64_t end) const {
+  unsigned long unrecovered = 0;
+  const std::vector<FaultInjector::Fault> &faults = injector.faults();
+  for (size_t i = 0; i < faults.size(); i++) {
+    const FaultInjector::Fault &fault = faults[i];
+    if (fault.duration == 0)
+      continue;
+    for (uint64_t start = fault.start; start < end; start += fault.period) {
+      uint64_t recovery;
+      if (start + fault.duration <= end &&
+          !recoveryTime(start + fault.duration, end, &recovery))
+        unrecovered++;
+      if (fault.period == 0)
+        break;
+    }
+  }
+  return unrecovered;
+}
+
+/**
+ * Report the safety checks.
+ */
+void Monitor::reportSafety(FILE *out, const Plant &plant) const {
+  fprintf(out, "safety: %lu intrusions, %lu violations, "
+          "max reaction %.1f ms\n", intrusions_, safetyViolations_,
+          maxSafetyReaction_ / 1000.0);
+  fprintf(out, "mechanical limit hits: %lu\n", plant.crashes());
+  fprintf(out, "longest time out of rest: %.1f ms\n", maxOutOfRest_ / 1000.0);
+}
+
+/**
+ * Report how the firmware reacted to each activation of the faults.
+ *
+ * The reaction is the main state transitions from the beginning of the fault
+ * until the probe comes to rest after the end of the fault. The recovery is
+ * the time from the end of the fault until then.
+ */
+void Monitor::reportFaults(FILE *out, const FaultInjector &injector,
+                           uint64_t end) const {
+  const std::vector<FaultInjector::Fault> &faults = injector.faults();
+  for (size_t i = 0; i < faults.size(); i++) {
+    const FaultInjector::Fault &fault = faults[i];
+    fprintf(out, "fault %s %s p=%g:\n", fault.name.c_str(),
+            fault.target.c_str(), fault.probability);
+
+    unsigned int activations = 0;
+    unsigned int recovered = 0;
+    uint64_t maxRecovery = 0;
+    uint64_t totalRecovery = 0;
+    for (uint64_t start = fault.start; start < end; start += fault.period) {
+      uint64_t faultEnd = fault.duration ? start + fault.duration : end;
+      faultEnd = std::min(faultEnd, end);
+      uint64_t recovery = 0;
+      bool isRecovered = recoveryTime(faultEnd, end, &recovery);
+      uint64_t reactionEnd = isRecovered ? faultEnd + recovery : end;
+
+      std::string reaction(1, stateAt(start));
+      unsigned int count = 0;
+      for (size_t t = 0; t < transitions_.size(); t++) {
+        if (transitions_[t].time > start &&
+            transitions_[t].time <= reactionEnd &&
+            ++count <= MAX_REPORTED_TRANSITIONS)
+          reaction += std::string("->") + transitions_[t].to;
+      }
+      if (count > MAX_REPORTED_TRANSITIONS)
+        reaction += "->... (" + std::to_string(count) + " transitions)";
+
+      activations++;
+      if (isRecovered) {
+        recovered++;
+        maxRecovery = std::max(maxRecovery, recovery);
+        totalRecovery += recovery;
+      }
+      if (activations <= MAX_REPORTED_ACTIVATIONS) {
+        fprintf(out, "  at %.1f ms for %.1f ms: %s, ", start / 1000.0,
+                (faultEnd - start) / 1000.0, reaction.c_str());
+        if (isRecovered)
+          fprintf(out, "recovered in %.1f ms\n", recovery / 1000.0);
+        else
+          fprintf(out, "not recovered\n");
+      }
+      if (fault.period == 0)
+        break;
+    }
+    if (activations > MAX_REPORTED_ACTIVATIONS)
+      fprintf(out, "  ...\n");
+    fprintf(out, "  %u activations, %u recovered, recovery max %.1f ms "
+            "mean %.1f ms\n", activations, recovered, maxRecovery / 1000.0,
+            recovered ? totalRecovery / 1000.0 / recovered : 0.0);
+  }
+}
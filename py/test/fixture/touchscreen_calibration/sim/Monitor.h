@@ -0,0 +1,87 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The monitor of the virtual fixture which logs the main state transitions of
+ * the firmware, checks the safety of the plant, and reports how the firmware
+ * reacted to the injected faults.
+ */
+
+
+#ifndef Monitor_h
+#define Monitor_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+class FaultInjector;
+class Plant;
+
+
+class Monitor {
+  public:
+    struct Transition {
+      uint64_t time;
+      char from;
+      char to;
+    };
+
+    // The main states in the order of the transition counts.
+    static const char STATES[];
+    static const int NUM_STATES = 7;
+
+    // Keep the log of the transitions for the fault report if keepLog.
+    explicit Monitor(bool keepLog = true);
+
+    void begin(char state, uint64_t now);
+    void sample(char state, uint64_t now, const Plant &plant);
+
+    char stateAt(uint64_t time) const;
+    const std::vector<Transition>& transitions() const { return transitions_; }
+    unsigned long safetyViolations() const { return safetyViolations_; }
+    unsigned long illegalTransitions() const { return illegalTransitions_; }
+    // The number of transitions from STATES[from] to STATES[to].
+    unsigned long transitionCount(int from, int to) const {
+      return transitionCounts_[from][to];
+    }
+    uint64_t maxOutOfRest() const { return maxOutOfRest_; }
+    unsigned long unrecoveredFaults(const FaultInjector &injector,
+                                    uint64_t end) const;
+
+    void reportSafety(FILE *out, const Plant &plant) const;
+    void reportFaults(FILE *out, const FaultInjector &injector,
+                      uint64_t end) const;
+
+    static bool isRestState(char state);
+    static bool isLegalTransition(char from, char to);
+    static int stateIndex(char state);
+
+  private:
+    bool recoveryTime(uint64_t faultEnd, uint64_t end,
+                      uint64_t *recovery) const;
+
+    char initialState_;
+    uint64_t beginTime_;
+    char state_;
+    bool keepLog_;
+    std::vector<Transition> transitions_;
+    unsigned long transitionCounts_[NUM_STATES][NUM_STATES];
+    unsigned long illegalTransitions_;
+
+    // The safety curtain intrusion being checked.
+    bool intruded_;
+    bool stopped_;
+    uint64_t intrusionStart_;
+    unsigned long intrusions_;
+    unsigned long safetyViolations_;
+    uint64_t maxSafetyReaction_;
+
+    // The longest time the probe has been out of a rest state.
+    uint64_t leftRest_;
+    uint64_t maxOutOfRest_;
+};
+
+#endif
@@ -0,0 +1,165 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The simulated plant of the virtual fixture.
+ */
+
+#include <math.h>
+
+#include "Arduino.h"
+#include "FaultInjector.h"
+#include "Plant.h"
+
+// The values set on the motor direction pin, which should match Fixture.cpp.
+const int PLANT_MOTOR_DIR_UP = LOW;
+
+
+/**
+ * The probe parks at the UP position with nothing intruding.
+ */
+Plant::Plant() {
+  geometry_.travel = TRAVEL;
+  geometry_.upSensorEdge = UP_SENSOR_EDGE;
+  geometry_.extremeUpSensorEdge = EXTREME_UP_SENSOR_EDGE;
+  geometry_.topLimit = TOP_LIMIT;
+  geometry_.bottomLimit = BOTTOM_LIMIT;
+  maxStepRate_ = 0;
+  deceleration_ = 0;
+  now_ = 0;
+  position_ = 0;
+  stepRemainder_ = 0;
+  motorDir_ = PLANT_MOTOR_DIR_UP;
+  dutyCycle_ = false;
+  pwmFrequency_ = 0;
+  safety_ = false;
+  button_ = false;
+  jumper_ = true;
+  loopback_ = false;
+  loopbackLevel_ = HIGH;
+  traced_ = false;
+  tracedBits_ = 0;
+  crashes_ = 0;
+  stalls_ = 0;
+  locks_ = 0;
+  lastLockTime_ = 0;
+}
+
+/**
+ * Move the probe by the steps taken in the elapsed micro-seconds.
+ */
+void Plant::advance(uint64_t elapsed) {
+  now_ += elapsed;
+  if (!isMoving()) {
+    stepRemainder_ = 0;
+    return;
+  }
+
+  if (isStalled()) {
+    stepRemainder_ = 0;
+    return;
+  }
+
+  stepRemainder_ += elapsed * pwmFrequency_;
+  long steps = stepRemainder_ / 1000000;
+  stepRemainder_ %= 1000000;
+  moveBy(FaultInjector::instance().filterSteps(steps, now_));
+}
+
+bool Plant::isStalled() const {
+  return maxStepRate_ > 0 && pwmFrequency_ > maxStepRate_;
+}
+
+/**
+ * Move the probe by the steps in the motor direction within the mechanical
+ * limits.
+ */
+void Plant::moveBy(long steps) {
+  position_ += (motorDir_ == PLANT_MOTOR_DIR_UP) ? -steps : steps;
+  if (position_ < geometry_.topLimit) {
+    position_ = geometry_.topLimit;
+    crashes_++;
+  } else if (position_ > geometry_.bottomLimit) {
+    position_ = geometry_.bottomLimit;
+    crashes_++;
+  }
+}
+
+/**
+ * Latch the digital outputs of the firmware.
+ */
+void Plant::digitalWrite(int pin, int value) {
+  if (pin == PIN_MOTOR_DIR)
+    motorDir_ = value;
+  else if (pin == PIN_LOOPBACK)
+    loopbackLevel_ = value;
+}
+
+/**
+ * Latch the pwm duty cycle of the motor step pin.
+ */
+void Plant::analogWrite(int pin, int value) {
+  if (pin != PIN_MOTOR_STEP)
+    return;
+  if (dutyCycle_ && value == 0) {
+    locks_++;
+    lastLockTime_ = now_;
+    // The probe coasts to a stop from its speed.
+    if (deceleration_ > 0 && !isStalled())
+      moveBy(lround((double) pwmFrequency_ * pwmFrequency_ /
+                    (2 * deceleration_)));
+  }
+  bool wasMoving = isMoving();
+  dutyCycle_ = (value > 0);
+  if (!wasMoving && isStalled() && isMoving())
+    stalls_++;
+}
+
+/**
+ * Latch the pwm frequency of the motor step pin.
+ */
+void Plant::setPwmFrequency(unsigned int pwmFrequency) {
+  bool wasStalled = isMoving() && isStalled();
+  pwmFrequency_ = pwmFrequency;
+  if (!wasStalled && isMoving() && isStalled())
+    stalls_++;
+}
+
+/**
+ * Get the value on an input pin read by the firmware, including the faults.
+ */
+int Plant::digitalRead(int pin) const {
+  return FaultInjector::instance().filterPin(pin, rawLevel(pin), now_);
+}
+
+/**
+ * Get the value on an input pin as the plant drives it.
+ *
+ * The active values should match SENSOR_ACTIVE_VALUES in Fixture.cpp.
+ */
+int Plant::rawLevel(int pin) const {
+  if (traced_ && pin >= PIN_JUMPER && pin <= PIN_SENSOR_SAFETY) {
+    bool active = tracedBits_ & (1 << (pin - PIN_JUMPER));
+    if (pin == PIN_SENSOR_SAFETY)
+      return active ? LOW : HIGH;
+    return active ? HIGH : LOW;
+  }
+
+  switch (pin) {
+    case PIN_JUMPER:
+      return jumper_ ? HIGH : LOW;
+    case PIN_BUTTON_DEBUG:
+      return button_ ? HIGH : LOW;
+    case PIN_SENSOR_EXTREME_UP:
+      return position_ <= geometry_.extremeUpSensorEdge ? HIGH : LOW;
+    case PIN_SENSOR_UP:
+      return position_ <= geometry_.upSensorEdge ? HIGH : LOW;
+    case PIN_SENSOR_DOWN:
+      return position_ >= geometry_.travel ? HIGH : LOW;
+    case PIN_SENSOR_SAFETY:
+      // The safety sensor and the loopback pin pull the input low together.
+      return (safety_ || (loopback_ && loopbackLevel_ == LOW)) ? LOW : HIGH;
+  }
+  return LOW;
+}
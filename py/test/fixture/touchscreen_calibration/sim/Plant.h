@@ -0,0 +1,146 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The simulated plant of the virtual fixture: the stepper motor, the probe,
+ * the position sensors along its travel, the safety sensor, the debug button
+ * and the jumper.
+ *
+ * The probe position is counted in motor steps downward from the UP park
+ * position. The motor takes one step per pwm period while its duty cycle is
+ * on, unless the pwm frequency is over the step rate the motor could follow.
+ */
+
+
+#ifndef Plant_h
+#define Plant_h
+
+#include <stdint.h>
+
+
+class Plant {
+  public:
+    // The pins should match those in Fixture.cpp.
+    static const int PIN_JUMPER = 2;
+    static const int PIN_BUTTON_DEBUG = 3;
+    static const int PIN_SENSOR_EXTREME_UP = 4;
+    static const int PIN_SENSOR_UP = 5;
+    static const int PIN_SENSOR_DOWN = 6;
+    static const int PIN_SENSOR_SAFETY = 7;
+    static const int PIN_MOTOR_STEP = 8;
+    static const int PIN_MOTOR_DIR = 9;
+    static const int PIN_MOTOR_EN = 10;
+    static const int PIN_MOTOR_LOCK = 11;
+    // The pin driven by LatencyProbe, which could be wired to the safety
+    // sensor input by a loopback jumper.
+    static const int PIN_LOOPBACK = 12;
+
+    // The default geometry of the fixture in steps.
+    // The DOWN sensor is triggered at TRAVEL.
+    static const long TRAVEL = 24000;
+    // The UP sensor is triggered above UP_SENSOR_EDGE, and the extreme up
+    // sensor above EXTREME_UP_SENSOR_EDGE.
+    static const long UP_SENSOR_EDGE = 150;
+    static const long EXTREME_UP_SENSOR_EDGE = -300;
+    // The probe could not move beyond the mechanical limits.
+    static const long TOP_LIMIT = -600;
+    static const long BOTTOM_LIMIT = TRAVEL + 600;
+
+    // The geometry of a fixture in steps, e.g., measured on a new revision.
+    struct Geometry {
+      long travel;
+      long upSensorEdge;
+      long extremeUpSensorEdge;
+      long topLimit;
+      long bottomLimit;
+    };
+
+    Plant();
+
+    void setGeometry(const Geometry &geometry) { geometry_ = geometry; }
+    const Geometry& geometry() const { return geometry_; }
+    // The motor stalls, i.e., takes no step, above maxStepRate steps per
+    // second, and the probe coasts with the deceleration in steps per second
+    // squared when the pwm is turned off. Zero means no limit and no coasting.
+    void setMotorLimits(unsigned int maxStepRate, double deceleration) {
+      maxStepRate_ = maxStepRate;
+      deceleration_ = deceleration;
+    }
+
+    void advance(uint64_t elapsed);
+
+    // The pins driven by the firmware.
+    void digitalWrite(int pin, int value);
+    void analogWrite(int pin, int value);
+    void setPwmFrequency(unsigned int pwmFrequency);
+    int digitalRead(int pin) const;
+    int rawLevel(int pin) const;
+
+    // The inputs from the operator and the environment.
+    void setSafety(bool intruded) { safety_ = intruded; }
+    void setButton(bool pressed) { button_ = pressed; }
+    void setJumper(bool set) { jumper_ = set; }
+    void setPosition(long position) { position_ = position; }
+    void setLoopback(bool wired) { loopback_ = wired; }
+
+    // Take the raw sensor values from a trace, one bit per sensor in the
+    // order of Fixture::Sensors, instead of from the probe position and the
+    // inputs above.
+    void setTracedSensors(unsigned int bits) {
+      traced_ = true;
+      tracedBits_ = bits;
+    }
+
+    long position() const { return position_; }
+    bool isIntruded() const { return safety_; }
+    bool isMoving() const { return dutyCycle_ && pwmFrequency_ > 0; }
+    unsigned int pwmFrequency() const { return pwmFrequency_; }
+    unsigned long crashes() const { return crashes_; }
+    unsigned long stalls() const { return stalls_; }
+    // The number of times the step pwm has been turned off while on, and the
+    // simulated time of the last one.
+    unsigned long locks() const { return locks_; }
+    uint64_t lastLockTime() const { return lastLockTime_; }
+
+  private:
+    bool isStalled() const;
+    void moveBy(long steps);
+
+    Geometry geometry_;
+    unsigned int maxStepRate_;
+    double deceleration_;
+
+    // The simulated time in micro-seconds.
+    uint64_t now_;
+    // The probe position in steps, positive downward.
+    long position_;
+    // The fraction of a step accumulated, in micro-steps per second.
+    uint64_t stepRemainder_;
+
+    // The motor outputs.
+    int motorDir_;
+    bool dutyCycle_;
+    unsigned int pwmFrequency_;
+
+    // The inputs.
+    bool safety_;
+    bool button_;
+    bool jumper_;
+    // Whether the loopback jumper is set, and the level on PIN_LOOPBACK.
+    bool loopback_;
+    int loopbackLevel_;
+
+    // The raw sensor values from a trace.
+    bool traced_;
+    unsigned int tracedBits_;
+
+    // The number of times the probe has hit a mechanical limit, and the motor
+    // has started to stall.
+    unsigned long crashes_;
+    unsigned long stalls_;
+    unsigned long locks_;
+    uint64_t lastLockTime_;
+};
+
+#endif
@@ -0,0 +1,128 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The simulated board of the virtual fixture.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <DueTimer.h>
+#include "FaultInjector.h"
+#include "Simulator.h"
+
+// Sleep only when the simulated clock runs ahead of the wall clock by more
+// than this (in micro-seconds) to keep the number of system calls low.
+const uint64_t PACE_SLACK = 1000;
+
+// Erased flash reads 0xFF.
+const byte FLASH_ERASED = 0xff;
+
+
+/**
+ * Get the monotonic wall clock in micro-seconds.
+ */
+uint64_t wallClockMicros() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * Get the simulator. It is created on first use so that the firmware globals
+ * could use it in their constructors.
+ */
+Simulator& Simulator::instance() {
+  static Simulator simulator;
+  return simulator;
+}
+
+Simulator::Simulator() {
+  now_ = 0;
+  realTime_ = true;
+  wallStart_ = wallClockMicros();
+  flash_ = NULL;
+  memset(uniqueId_, 0, sizeof(uniqueId_));
+}
+
+/**
+ * Advance the simulated clock, move the plant, and run the timer ISR if due.
+ */
+void Simulator::advance(uint64_t elapsed) {
+  now_ += elapsed;
+  FaultInjector::instance().applyEnvironment(plant_, now_);
+  plant_.advance(elapsed);
+  DueTimer::serviceAll(now_);
+  if (realTime_)
+    pace();
+}
+
+/**
+ * Sleep until the wall clock catches up with the simulated clock.
+ */
+void Simulator::pace() {
+  uint64_t wall = wallClockMicros() - wallStart_;
+  if (now_ > wall + PACE_SLACK) {
+    uint64_t ahead = now_ - wall;
+    struct timespec ts = {(time_t) (ahead / 1000000),
+                          (long) (ahead % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+  }
+}
+
+/**
+ * Map the flash bank 1 to a file. A new file is filled as erased flash.
+ */
+bool Simulator::openFlash(const char *path) {
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return false;
+  }
+  if (st.st_size < IFLASH1_SIZE) {
+    byte erased[4096];
+    memset(erased, FLASH_ERASED, sizeof(erased));
+    for (off_t offset = st.st_size; offset < IFLASH1_SIZE;
+         offset += sizeof(erased)) {
+      size_t length = IFLASH1_SIZE - offset;
+      if (length > sizeof(erased))
+        length = sizeof(erased);
+      if (pwrite(fd, erased, length, offset) != (ssize_t) length) {
+        close(fd);
+        return false;
+      }
+    }
+  }
+
+  void *flash = mmap(NULL, IFLASH1_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                     fd, 0);
+  close(fd);
+  if (flash == MAP_FAILED)
+    return false;
+  flash_ = (byte *) flash;
+  return true;
+}
+
+/**
+ * Get the flash bank 1. Without a file, it is erased on every start.
+ */
+byte* Simulator::flash() {
+  if (flash_ == NULL) {
+    flash_ = (byte *) malloc(IFLASH1_SIZE);
+    memset(flash_, FLASH_ERASED, IFLASH1_SIZE);
+  }
+  return flash_;
+}
+
+void Simulator::setUniqueId(const uint32_t uniqueId[4]) {
+  memcpy(uniqueId_, uniqueId, sizeof(uniqueId_));
+}
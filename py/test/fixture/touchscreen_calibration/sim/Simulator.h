@@ -0,0 +1,56 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The simulated board of the virtual fixture: its clock, its flash, and the
+ * plant wired to its pins.
+ *
+ * The clock is advanced explicitly by the main loop and by delay(). In the
+ * real-time mode the simulator sleeps whenever the simulated clock runs ahead
+ * of the wall clock so that the host sees the same timing as with the board.
+ */
+
+
+#ifndef Simulator_h
+#define Simulator_h
+
+#include <stdint.h>
+
+#include "Arduino.h"
+#include "Plant.h"
+
+
+class Simulator {
+  public:
+    static Simulator& instance();
+
+    // The simulated time since power on in micro-seconds.
+    uint64_t now() const { return now_; }
+    void advance(uint64_t elapsed);
+
+    void setRealTime(bool realTime) { realTime_ = realTime; }
+    bool openFlash(const char *path);
+    byte* flash();
+    // The 128-bit unique identifier of the chip.
+    void setUniqueId(const uint32_t uniqueId[4]);
+    const uint32_t* uniqueId() const { return uniqueId_; }
+
+    Plant& plant() { return plant_; }
+
+  private:
+    Simulator();
+    void pace();
+
+    uint64_t now_;
+    bool realTime_;
+    // The wall clock in micro-seconds when the simulated clock started.
+    uint64_t wallStart_;
+    byte *flash_;
+    uint32_t uniqueId_[4];
+    Plant plant_;
+};
+
+uint64_t wallClockMicros();
+
+#endif
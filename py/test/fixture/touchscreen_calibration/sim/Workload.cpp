@@ -0,0 +1,202 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The headless host of the virtual fixture.
+ */
+
+#include <algorithm>
+#include <string>
+
+#include "Arduino.h"
+#include "Plant.h"
+#include "Workload.h"
+
+// Resend a command after this time in micro-seconds if the firmware has not
+// acted on it, e.g., the command was dropped on the way or the safety sensor
+// has not been clear for long enough to recover.
+const uint64_t COMMAND_RETRY_INTERVAL = 1000000;
+
+// The timing of the operator in micro-seconds.
+const uint64_t BUTTON_PRESS_TIME = 100000;
+const uint64_t BUTTON_DOUBLE_PRESS_GAP = 150000;
+const uint64_t SAFETY_TRIP_MIN_TIME = 20000;
+const uint64_t SAFETY_TRIP_MAX_TIME = 500000;
+
+// The events are mixed into this time in micro-seconds after a move starts,
+// which is about the time of a move with the default profile.
+const uint64_t MOVE_EVENT_WINDOW = 6000000;
+
+// The auxiliary commands which are served in any state.
+const char QUERY_COMMANDS[] = "stomq";
+
+// The inputs of the scheduled events.
+const char INPUT_BUTTON = 'B';
+const char INPUT_SAFETY = 'S';
+const char INPUT_COMMAND = 'C';
+
+
+Workload::Workload(unsigned long cycles, uint64_t dwell)
+    : targetCycles_(cycles), dwell_(dwell), cycles_(0), abortedCycles_(0),
+      recoveries_(0), lastCycleTime_(0), lastState_('i'), nextCommand_(dwell),
+      cycleStart_(0), reachedDown_(false), moveIterations_(0) {
+  Mix none = {0, 0, 0, 0, 0, 0};
+  mix_ = none;
+}
+
+/**
+ * Mix the events into the cycles with the probabilities.
+ */
+void Workload::setMix(const Mix &mix, unsigned int seed) {
+  mix_ = mix;
+  random_.seed(seed);
+}
+
+/**
+ * Act on the main state of the firmware after an iteration of loop().
+ *
+ * The responses are discarded since the state is taken from the firmware
+ * directly.
+ */
+void Workload::step(char state, uint64_t now, Plant &plant) {
+  Serial.takeOutput();
+  moveIterations_++;
+
+  while (!events_.empty() && events_.front().time <= now) {
+    const Event &event = events_.front();
+    if (event.input == INPUT_BUTTON)
+      plant.setButton(event.value);
+    else if (event.input == INPUT_SAFETY)
+      plant.setSafety(event.value);
+    else
+      Serial.inject(std::string(1, (char) event.value));
+    events_.pop_front();
+  }
+
+  if (state != lastState_) {
+    changeState(lastState_, state, now);
+    lastState_ = state;
+  }
+  if (now < nextCommand_)
+    return;
+
+  if ((state == 'i' || state == 'U') && !done()) {
+    startMove(now);
+  } else if (state == 'D') {
+    startMove(now);
+  } else if (state == 'e' && !plant.isIntruded()) {
+    if (chance(mix_.buttonRecover)) {
+      pressButton(now, BUTTON_PRESS_TIME);
+      nextCommand_ = now + BUTTON_PRESS_TIME + COMMAND_RETRY_INTERVAL;
+    } else {
+      send('b', now);
+    }
+  }
+}
+
+/**
+ * Count the cycles and the moves on a transition of the main state.
+ */
+void Workload::changeState(char lastState, char state, uint64_t now) {
+  bool wasAtRest = (lastState == 'i' || lastState == 'U');
+  if (wasAtRest && state == 'd') {
+    cycleStart_ = now;
+    reachedDown_ = false;
+  } else if (state == 'D') {
+    reachedDown_ = true;
+    if (lastState == 'd')
+      downIterations_.push_back(moveIterations_);
+  } else if (state == 'U' && !wasAtRest) {
+    if (lastState == 'u' && reachedDown_)
+      upIterations_.push_back(moveIterations_);
+    if (reachedDown_) {
+      cycles_++;
+      lastCycleTime_ = now;
+      cycleTimes_.push_back(now - cycleStart_);
+    } else {
+      abortedCycles_++;
+    }
+    reachedDown_ = false;
+  } else if (state == 'b' && lastState == 'e') {
+    recoveries_++;
+  }
+
+  moveIterations_ = 0;
+  if (state == 'i' || state == 'U' || state == 'D')
+    nextCommand_ = now + dwell_;
+  if (state == 'd' || state == 'u')
+    mixIntoMove(state, now);
+}
+
+/**
+ * Start a move from an end position by the host or by the debug button.
+ */
+void Workload::startMove(uint64_t now) {
+  if (chance(mix_.buttonMove)) {
+    pressButton(now, BUTTON_PRESS_TIME);
+    nextCommand_ = now + BUTTON_PRESS_TIME + COMMAND_RETRY_INTERVAL;
+  } else {
+    send(lastState_ == 'D' ? 'u' : 'd', now);
+  }
+}
+
+/**
+ * Schedule the random events during a move which has just started.
+ */
+void Workload::mixIntoMove(char state, uint64_t now) {
+  if (state == 'd' && chance(mix_.doublePress)) {
+    // The first press is ignored while going down, and the second one
+    // within the double press window aborts the move.
+    uint64_t start = now + randomTime(MOVE_EVENT_WINDOW);
+    pressButton(start, BUTTON_PRESS_TIME);
+    pressButton(start + BUTTON_PRESS_TIME + BUTTON_DOUBLE_PRESS_GAP,
+                BUTTON_PRESS_TIME);
+  }
+  if (chance(mix_.safetyTrip)) {
+    uint64_t start = now + randomTime(MOVE_EVENT_WINDOW);
+    uint64_t duration = SAFETY_TRIP_MIN_TIME +
+        randomTime(SAFETY_TRIP_MAX_TIME - SAFETY_TRIP_MIN_TIME);
+    schedule(start, INPUT_SAFETY, 1);
+    schedule(start + duration, INPUT_SAFETY, 0);
+  }
+  if (chance(mix_.query)) {
+    char command = QUERY_COMMANDS[randomTime(sizeof(QUERY_COMMANDS) - 1)];
+    schedule(now + randomTime(MOVE_EVENT_WINDOW), INPUT_COMMAND, command);
+  }
+  if (chance(mix_.badCommand))
+    schedule(now + randomTime(MOVE_EVENT_WINDOW), INPUT_COMMAND, state);
+}
+
+/**
+ * Schedule an event keeping the events ordered by time.
+ */
+void Workload::schedule(uint64_t time, char input, int value) {
+  Event event = {time, input, value};
+  std::deque<Event>::iterator it = events_.end();
+  while (it != events_.begin() && (it - 1)->time > time)
+    --it;
+  events_.insert(it, event);
+}
+
+void Workload::pressButton(uint64_t time, uint64_t duration) {
+  schedule(time, INPUT_BUTTON, 1);
+  schedule(time + duration, INPUT_BUTTON, 0);
+}
+
+void Workload::send(char command, uint64_t now) {
+  Serial.inject(std::string(1, command));
+  nextCommand_ = now + COMMAND_RETRY_INTERVAL;
+}
+
+bool Workload::chance(double probability) {
+  return (probability > 0 &&
+          std::uniform_real_distribution<double>(0, 1)(random_) < probability);
+}
+
+/**
+ * Get a random time in [0, max).
+ */
+uint64_t Workload::randomTime(uint64_t max) {
+  return std::uniform_int_distribution<uint64_t>(0, max - 1)(random_);
+}
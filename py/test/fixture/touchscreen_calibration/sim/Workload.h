@@ -0,0 +1,110 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The headless host of the virtual fixture which cycles the probe down and up
+ * through the programming port like the touchscreen calibration test, and
+ * recovers the fixture after an emergency stop.
+ *
+ * Optionally, the operator events and the auxiliary host commands are mixed
+ * into the cycles at random.
+ */
+
+
+#ifndef Workload_h
+#define Workload_h
+
+#include <stdint.h>
+
+#include <deque>
+#include <random>
+#include <vector>
+
+class Plant;
+
+
+class Workload {
+  public:
+    // The probability of each event per move.
+    struct Mix {
+      // the move is started by the debug button instead of the host
+      double buttonMove;
+      // a down move is aborted by a double press
+      double doublePress;
+      // the safety curtain is intruded during the move
+      double safetyTrip;
+      // an emergency stop is recovered by the debug button instead of the host
+      double buttonRecover;
+      // the host queries the state, the stats, the odometer, or the profile
+      double query;
+      // the host sends a motion command which is not accepted in the state
+      double badCommand;
+    };
+
+    // Run this number of down/up cycles, resting for dwell micro-seconds at
+    // each end position.
+    Workload(unsigned long cycles, uint64_t dwell);
+
+    void setMix(const Mix &mix, unsigned int seed);
+    void step(char state, uint64_t now, Plant &plant);
+
+    bool done() const { return cycles_ >= targetCycles_; }
+    unsigned long cycles() const { return cycles_; }
+    unsigned long abortedCycles() const { return abortedCycles_; }
+    unsigned long recoveries() const { return recoveries_; }
+    // The time when the last cycle completed.
+    uint64_t lastCycleTime() const { return lastCycleTime_; }
+
+    // The time in micro-seconds of each cycle from leaving the UP position
+    // until coming back to it, and the iterations of loop() of each complete
+    // move toward the DOWN and the UP position.
+    const std::vector<uint32_t>& cycleTimes() const { return cycleTimes_; }
+    const std::vector<uint32_t>& downIterations() const {
+      return downIterations_;
+    }
+    const std::vector<uint32_t>& upIterations() const { return upIterations_; }
+
+  private:
+    // An input of the plant or a command scheduled at a time.
+    struct Event {
+      uint64_t time;
+      char input;
+      int value;
+    };
+
+    void changeState(char lastState, char state, uint64_t now);
+    void startMove(uint64_t now);
+    void mixIntoMove(char state, uint64_t now);
+    void schedule(uint64_t time, char input, int value);
+    void pressButton(uint64_t time, uint64_t duration);
+    void send(char command, uint64_t now);
+    bool chance(double probability);
+    uint64_t randomTime(uint64_t max);
+
+    unsigned long targetCycles_;
+    uint64_t dwell_;
+    unsigned long cycles_;
+    unsigned long abortedCycles_;
+    unsigned long recoveries_;
+    uint64_t lastCycleTime_;
+
+    char lastState_;
+    // Do not start another move or recovery before this time.
+    uint64_t nextCommand_;
+
+    Mix mix_;
+    std::mt19937 random_;
+    // The pending events ordered by time.
+    std::deque<Event> events_;
+
+    // The current cycle and move.
+    uint64_t cycleStart_;
+    bool reachedDown_;
+    uint32_t moveIterations_;
+    std::vector<uint32_t> cycleTimes_;
+    std::vector<uint32_t> downIterations_;
+    std::vector<uint32_t> upIterations_;
+};
+
+#endif
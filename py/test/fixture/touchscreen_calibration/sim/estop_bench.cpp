@@ -0,0 +1,347 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Benchmark the emergency stop latency of the firmware, i.e., the time from
+ * the safety sensor input becoming active until the step pwm of the motor is
+ * zeroed.
+ *
+ * Each trial starts a down or an up move and breaks the safety curtain at a
+ * random time of the move. The edge is placed on the continuous simulated
+ * clock, so it falls at a random phase of loop(). The moves run under load:
+ * the raw sensors are traced through the native USB port, the host queries
+ * the state, the stats, the odometer, the profile and the clock at random,
+ * the motor changes speed, and the programming port drains at its baud rate
+ * so that a long response blocks the loop like on the board.
+ *
+ * With --loopback the trips are made by LatencyProbe in the firmware through
+ * the loopback jumper, and the latency is taken from its measurement like on
+ * the board. Note that the timer ISR of the virtual fixture runs only between
+ * two iterations of loop() or while a write blocks.
+ *
+ * The exit status is non-zero if the worst latency is over --budget-us or a
+ * trial gets stuck.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "FaultInjector.h"
+#include "Simulator.h"
+#include "sketch.h"
+
+// The simulated time taken by an iteration of loop() in micro-seconds.
+const uint64_t DEFAULT_LOOP_PERIOD = 15;
+
+const unsigned long DEFAULT_TRIALS = 1000;
+const uint64_t DEFAULT_QUERY_MS = 200;
+
+// The curtain is broken at a random time in this window (in micro-seconds)
+// after a move starts, which covers the fast and the slow part of a move.
+const uint64_t TRIP_MIN_DELAY = 20000;
+const uint64_t TRIP_MAX_DELAY = 5000000;
+// How long the curtain stays broken.
+const uint64_t TRIP_HOLD = 300000;
+// The firmware accepts the recovery when the curtain has been clear for 3 s.
+const uint64_t RECOVER_DELAY = 3100000;
+const uint64_t RECOVER_RETRY_INTERVAL = 1000000;
+// The rest time at each end position.
+const uint64_t DWELL = 100000;
+// Give up if a trial takes longer than this.
+const uint64_t STUCK_TIMEOUT = 60000000;
+
+// The queries mixed into the moves.
+const char QUERIES[] = "stoqm";
+
+enum Phase {
+  // waiting to start a trial at rest
+  IDLE,
+  // moving to the DOWN position for a trial on an up move
+  POSITIONING,
+  // the trial move is running
+  MOVING,
+  // in the emergency stop, waiting for the latency of the firmware probe
+  MEASURING,
+  // in the emergency stop, waiting to recover
+  STOPPED,
+};
+
+// The latency of a trial.
+struct Sample {
+  uint64_t latency;
+  char direction;
+  // The time from the start of the move to the trip.
+  uint64_t intoMove;
+};
+
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --trials N          the number of emergency stops\n"
+          "  --seed N            the seed of the trip times and the queries\n"
+          "  --loop-period US    the time of a loop() iteration\n"
+          "  --query-ms MS       the mean interval of the host queries, 0 for\n"
+          "                      none\n"
+          "  --no-trace          do not trace the raw sensors\n"
+          "  --no-baud-model     do not block on the programming port\n"
+          "  --loopback          trip by the latency probe of the firmware\n"
+          "  --budget-us US      fail if the worst latency is over US\n",
+          program);
+}
+
+/**
+ * Get the latency in micro-seconds from the latency frames in the output of
+ * the programming port, e.g., <K1260,84>. Return false if there is none.
+ */
+static bool parseLatency(const std::string &output, uint64_t *latency) {
+  size_t start = output.rfind("<K");
+  if (start == std::string::npos)
+    return false;
+  unsigned long cycles, cyclesPerMicrosecond;
+  if (sscanf(output.c_str() + start, "<K%lu,%lu>", &cycles,
+             &cyclesPerMicrosecond) != 2 || cyclesPerMicrosecond == 0)
+    return false;
+  *latency = cycles / cyclesPerMicrosecond;
+  return true;
+}
+
+/**
+ * Print the percentiles of the latencies in micro-seconds.
+ */
+static void printDistribution(std::vector<Sample> samples) {
+  static const double PERCENTILES[] = {0, 50, 90, 99, 99.9, 100};
+  printf("latency (us)");
+  if (samples.empty()) {
+    printf("  no samples\n");
+    return;
+  }
+  std::vector<uint64_t> latencies;
+  for (size_t i = 0; i < samples.size(); i++)
+    latencies.push_back(samples[i].latency);
+  std::sort(latencies.begin(), latencies.end());
+  for (size_t i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); i++) {
+    size_t index = (size_t) (PERCENTILES[i] / 100 * (latencies.size() - 1));
+    printf("  p%g=%llu", PERCENTILES[i],
+           (unsigned long long) latencies[index]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    {"trials", required_argument, NULL, 'n'},
+    {"seed", required_argument, NULL, 's'},
+    {"loop-period", required_argument, NULL, 'l'},
+    {"query-ms", required_argument, NULL, 'q'},
+    {"no-trace", no_argument, NULL, 'T'},
+    {"no-baud-model", no_argument, NULL, 'B'},
+    {"loopback", no_argument, NULL, 'L'},
+    {"budget-us", required_argument, NULL, 'b'},
+    {NULL, 0, NULL, 0},
+  };
+  unsigned long trials = DEFAULT_TRIALS;
+  unsigned int seed = 0;
+  uint64_t loopPeriod = DEFAULT_LOOP_PERIOD;
+  uint64_t queryInterval = DEFAULT_QUERY_MS * 1000;
+  bool trace = true;
+  bool baudModel = true;
+  bool loopback = false;
+  uint64_t budget = 0;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 'n': trials = strtoul(optarg, NULL, 10); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      case 'l': loopPeriod = strtoull(optarg, NULL, 10); break;
+      case 'q': queryInterval = strtoull(optarg, NULL, 10) * 1000; break;
+      case 'T': trace = false; break;
+      case 'B': baudModel = false; break;
+      case 'L': loopback = true; break;
+      case 'b': budget = strtoull(optarg, NULL, 10); break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  FaultInjector &injector = FaultInjector::instance();
+  Simulator &simulator = Simulator::instance();
+  simulator.setRealTime(false);
+  Plant &plant = simulator.plant();
+  plant.setLoopback(loopback);
+  Serial.setBaudModel(baudModel);
+  std::mt19937 random(seed);
+  randomSeed(seed + 1);
+
+  uint64_t wallStart = wallClockMicros();
+  setup();
+  if (trace)
+    Serial.inject(std::string(1, 'x'));
+
+  std::vector<Sample> samples;
+  unsigned long missed = 0;
+  Phase phase = IDLE;
+  char direction = 'd';
+  uint64_t nextCommand = simulator.now() + DWELL;
+  uint64_t nextQuery = 0;
+  uint64_t trialStart = simulator.now();
+  uint64_t moveStart = 0;
+  uint64_t edgeTime = 0;
+  unsigned long locksBefore = 0;
+  // Whether the trial move has been taken by the firmware.
+  bool started = false;
+  bool stuck = false;
+
+  while (samples.size() + missed < trials) {
+    loop();
+    simulator.advance(loopPeriod);
+    SerialUSB.takeOutput();
+    std::string output = Serial.takeOutput();
+    uint64_t now = simulator.now();
+    char state = fixture.state();
+
+    if (now - trialStart > STUCK_TIMEOUT) {
+      fprintf(stderr, "stuck in state %c at %.3f s\n", state, now / 1e6);
+      stuck = true;
+      break;
+    }
+
+    switch (phase) {
+      case IDLE:
+        if (now < nextCommand)
+          break;
+        if (state == 'U' || state == 'i') {
+          direction = 'd';
+          if (std::bernoulli_distribution(0.5)(random)) {
+            Serial.inject(std::string(1, 'd'));
+            phase = POSITIONING;
+            break;
+          }
+        } else if (state == 'D') {
+          direction = 'u';
+        } else {
+          break;
+        }
+        trialStart = now;
+        moveStart = now;
+        locksBefore = plant.locks();
+        if (loopback) {
+          Serial.inject(std::string(1, 'k') + direction);
+        } else {
+          Serial.inject(std::string(1, direction));
+          edgeTime = now + std::uniform_int_distribution<uint64_t>(
+              TRIP_MIN_DELAY, TRIP_MAX_DELAY)(random);
+          char fault[64];
+          snprintf(fault, sizeof(fault), "intrude safety at=%.3f for=%llu",
+                   edgeTime / 1e3, (unsigned long long) (TRIP_HOLD / 1000));
+          injector.clear();
+          std::string error;
+          injector.parse(fault, &error);
+        }
+        nextQuery = now + 1;
+        started = false;
+        phase = MOVING;
+        break;
+
+      case POSITIONING:
+        if (state == 'D') {
+          nextCommand = now + DWELL;
+          phase = IDLE;
+        }
+        break;
+
+      case MOVING:
+        if (queryInterval > 0 && now >= nextQuery) {
+          int query = std::uniform_int_distribution<int>(
+              0, sizeof(QUERIES) - 2)(random);
+          Serial.inject(std::string(1, QUERIES[query]));
+          nextQuery = now + std::exponential_distribution<double>(
+              1.0 / queryInterval)(random);
+        }
+        if (state == direction)
+          started = true;
+        if (started && (state == 'D' || state == 'U')) {
+          // The move completed before the trip.
+          missed++;
+          injector.clear();
+          latencyProbe.release();
+          nextCommand = now + DWELL;
+          phase = IDLE;
+        } else if (state == 'e') {
+          if (loopback) {
+            Serial.inject(std::string(1, 'K'));
+            phase = MEASURING;
+          } else {
+            if (plant.locks() > locksBefore && plant.lastLockTime() >= edgeTime)
+              samples.push_back((Sample) {plant.lastLockTime() - edgeTime,
+                                          direction, edgeTime - moveStart});
+            else
+              missed++;
+            nextCommand = now + TRIP_HOLD + RECOVER_DELAY;
+            phase = STOPPED;
+          }
+        }
+        break;
+
+      case MEASURING: {
+        uint64_t latency;
+        if (output.find("<K") == std::string::npos)
+          break;
+        if (parseLatency(output, &latency))
+          samples.push_back((Sample) {latency, direction,
+                                      plant.lastLockTime() - moveStart});
+        else
+          missed++;
+        nextCommand = now + RECOVER_DELAY;
+        phase = STOPPED;
+        break;
+      }
+
+      case STOPPED:
+        if (state == 'U') {
+          nextCommand = now + DWELL;
+          phase = IDLE;
+        } else if (state == 'e' && now >= nextCommand) {
+          Serial.inject(std::string(1, 'b'));
+          nextCommand = now + RECOVER_RETRY_INTERVAL;
+        }
+        break;
+    }
+  }
+  uint64_t end = simulator.now();
+  uint64_t wallTime = wallClockMicros() - wallStart;
+
+  printf("trials: %zu of %lu, missed: %lu\n", samples.size(), trials, missed);
+  printf("simulated time: %.1f s, wall time: %.1f s\n", end / 1e6,
+         wallTime / 1e6);
+  printf("load: trace %s, queries every %.0f ms, programming port %s\n",
+         trace ? "on" : "off", queryInterval / 1e3,
+         baudModel ? "blocking" : "unlimited");
+  printf("programming port blocked: %.1f ms\n", Serial.blockedTime() / 1e3);
+  printDistribution(samples);
+
+  uint64_t worst = 0;
+  if (!samples.empty()) {
+    const Sample &sample = *std::max_element(
+        samples.begin(), samples.end(),
+        [](const Sample &a, const Sample &b) { return a.latency < b.latency; });
+    worst = sample.latency;
+    printf("worst: %llu us on %s move %.3f s after its start\n",
+           (unsigned long long) sample.latency,
+           sample.direction == 'd' ? "a down" : "an up",
+           sample.intoMove / 1e6);
+  }
+
+  bool passed = !stuck && !samples.empty() && (budget == 0 || worst <= budget);
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 2;
+}
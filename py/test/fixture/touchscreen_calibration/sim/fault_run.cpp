@@ -0,0 +1,138 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Run the firmware against the simulated plant under a fault script.
+ *
+ * A headless host cycles the probe down and up while the faults are injected,
+ * and the reaction of the firmware to each fault is reported. The simulated
+ * clock runs as fast as possible. The exit status is non-zero if the safety
+ * was violated, the probe hit a mechanical limit, the probe never came to rest
+ * after a fault, or the cycles could not complete in time.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+
+#include "Arduino.h"
+#include "FaultInjector.h"
+#include "Monitor.h"
+#include "Simulator.h"
+#include "Workload.h"
+#include "sketch.h"
+
+// The simulated time taken by an iteration of loop() in micro-seconds.
+const uint64_t DEFAULT_LOOP_PERIOD = 15;
+
+const unsigned long DEFAULT_CYCLES = 10;
+const uint64_t DEFAULT_DWELL_MS = 500;
+
+// Give up if a cycle takes longer than this on average in micro-seconds.
+const uint64_t MAX_CYCLE_TIME = 60000000;
+
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --faults PATH       the fault script\n"
+          "  --cycles N          the number of down/up cycles to run\n"
+          "  --seed N            the seed of the random faults\n"
+          "  --dwell-ms MS       the rest time at each end position\n"
+          "  --loop-period US    the time of a loop() iteration\n"
+          "  --flash PATH        keep the flash content in PATH\n",
+          program);
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    {"faults", required_argument, NULL, 'F'},
+    {"cycles", required_argument, NULL, 'c'},
+    {"seed", required_argument, NULL, 's'},
+    {"dwell-ms", required_argument, NULL, 'w'},
+    {"loop-period", required_argument, NULL, 'l'},
+    {"flash", required_argument, NULL, 'f'},
+    {NULL, 0, NULL, 0},
+  };
+  const char *faultsPath = NULL;
+  const char *flashPath = NULL;
+  unsigned long cycles = DEFAULT_CYCLES;
+  unsigned int seed = 0;
+  uint64_t dwell = DEFAULT_DWELL_MS * 1000;
+  uint64_t loopPeriod = DEFAULT_LOOP_PERIOD;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 'F': faultsPath = optarg; break;
+      case 'c': cycles = strtoul(optarg, NULL, 10); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      case 'w': dwell = strtoull(optarg, NULL, 10) * 1000; break;
+      case 'l': loopPeriod = strtoull(optarg, NULL, 10); break;
+      case 'f': flashPath = optarg; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  FaultInjector &injector = FaultInjector::instance();
+  std::string error;
+  if (faultsPath != NULL && !injector.load(faultsPath, &error)) {
+    fprintf(stderr, "%s: %s\n", faultsPath, error.c_str());
+    return 1;
+  }
+  injector.seed(seed);
+
+  Simulator &simulator = Simulator::instance();
+  simulator.setRealTime(false);
+  if (flashPath != NULL && !simulator.openFlash(flashPath)) {
+    perror(flashPath);
+    return 1;
+  }
+  Plant &plant = simulator.plant();
+
+  uint64_t wallStart = wallClockMicros();
+  setup();
+  Monitor monitor;
+  monitor.begin(fixture.state(), simulator.now());
+  Workload workload(cycles, dwell);
+  uint64_t deadline = simulator.now() + (cycles + 1) * MAX_CYCLE_TIME;
+  // Keep running after the last cycle until the last fault ends, so that the
+  // recovery from every fault is observed.
+  uint64_t faultsEnd = 0;
+  for (size_t i = 0; i < injector.faults().size(); i++) {
+    const FaultInjector::Fault &fault = injector.faults()[i];
+    if (fault.duration != 0 && fault.period == 0)
+      faultsEnd = std::max(faultsEnd, fault.start + fault.duration);
+  }
+
+  while (simulator.now() < deadline &&
+         (!workload.done() || simulator.now() < faultsEnd ||
+          !Monitor::isRestState(fixture.state()))) {
+    loop();
+    simulator.advance(loopPeriod);
+    SerialUSB.takeOutput();
+    monitor.sample(fixture.state(), simulator.now(), plant);
+    workload.step(fixture.state(), simulator.now(), plant);
+  }
+  uint64_t end = simulator.now();
+  uint64_t wallTime = wallClockMicros() - wallStart;
+
+  printf("cycles: %lu of %lu, recoveries: %lu\n", workload.cycles(), cycles,
+         workload.recoveries());
+  printf("simulated time: %.3f s, wall time: %.3f s\n", end / 1e6,
+         wallTime / 1e6);
+  printf("transitions: %zu\n", monitor.transitions().size());
+  monitor.reportSafety(stdout, plant);
+  monitor.reportFaults(stdout, injector, end);
+
+  bool passed = (workload.done() && monitor.safetyViolations() == 0 &&
+                 plant.crashes() == 0 &&
+                 monitor.unrecoveredFaults(injector, end) == 0);
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed ? 0 : 2;
+}
@@ -0,0 +1,133 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Unit tests of the firmware classes which do not need the simulated plant.
+ *
+ * Each test feeds its inputs directly, e.g., the raw button values and the
+ * millis() of the samples, and checks the results. The program exits with a
+ * non-zero status if any check fails.
+ */
+
+#include <stdio.h>
+
+#include "Arduino.h"
+#include "DebugButton.h"
+#include "MotionProfile.h"
+
+static int failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, \
+              #condition); \
+      failures++; \
+    } \
+  } while (0)
+
+
+// The number of the button events of each kind, and the millis() of the first
+// one of each kind.
+struct ButtonEvents {
+  int count[DebugButton::DOUBLE_PRESS + 1];
+  unsigned long first[DebugButton::DOUBLE_PRESS + 1];
+};
+
+/**
+ * Hold the raw button value from now until the end time, sampling it every
+ * milli-second, and return the events reported.
+ */
+static ButtonEvents holdButton(DebugButton *button, bool rawActive,
+                               unsigned long *now, unsigned long end) {
+  ButtonEvents events;
+  memset(&events, 0, sizeof(events));
+  for (; *now < end; (*now)++) {
+    DebugButton::Event event = button->update(rawActive, *now);
+    if (event != DebugButton::NONE && events.count[event]++ == 0)
+      events.first[event] = *now;
+  }
+  return events;
+}
+
+static void testButtonLongPress() {
+  DebugButton button;
+  unsigned long now = 1000;
+  ButtonEvents events = holdButton(&button, true, &now, 3000);
+  CHECK(events.count[DebugButton::PRESS] == 1);
+  // The long press is reported once however long the button is held.
+  CHECK(events.count[DebugButton::LONG_PRESS] == 1);
+  CHECK(events.first[DebugButton::LONG_PRESS] -
+        events.first[DebugButton::PRESS] == 800);
+
+  events = holdButton(&button, false, &now, 3100);
+  CHECK(events.count[DebugButton::RELEASE] == 1);
+  CHECK(events.count[DebugButton::LONG_PRESS] == 0);
+}
+
+static void testButtonShortPress() {
+  DebugButton button;
+  unsigned long now = 1000;
+  holdButton(&button, true, &now, 1200);
+  ButtonEvents events = holdButton(&button, false, &now, 2000);
+  CHECK(events.count[DebugButton::RELEASE] == 1);
+  CHECK(events.count[DebugButton::LONG_PRESS] == 0);
+}
+
+static void testButtonMinimumSampleInterval() {
+  DebugButton button;
+  button.setDebounceTime(3);
+  CHECK(button.debounceTime() == BUTTON_SAMPLE_INTERVALS);
+
+  // A glitch of a few milli-seconds is rejected even if the loop samples the
+  // button many times within a milli-second.
+  for (int i = 0; i < 100; i++)
+    CHECK(button.update(true, 1000 + i / 20) == DebugButton::NONE);
+  CHECK(!button.isPressed());
+}
+
+static void testProfileButtonDebounce() {
+  unsigned int slot;
+  MotionProfile profile;
+  CHECK(MotionProfiles::parse("1,samus,8000,2000,213333,3300000,200,200,100,35",
+                              &slot, &profile));
+  CHECK(MotionProfiles::isValid(profile));
+  profile.debounceButton = BUTTON_SAMPLE_INTERVALS;
+  CHECK(MotionProfiles::isValid(profile));
+  profile.debounceButton = BUTTON_SAMPLE_INTERVALS - 1;
+  CHECK(!MotionProfiles::isValid(profile));
+}
+
+static void testProfileMinimums() {
+  unsigned int slot;
+  MotionProfile valid;
+  CHECK(MotionProfiles::parse("1,samus,8000,2000,213333,3300000,200,200,100,35",
+                              &slot, &valid));
+  uint32_t MotionProfile::*fields[] = {
+      &MotionProfile::distanceToSlowDown, &MotionProfile::timeToSlowDown,
+      &MotionProfile::debounceUp, &MotionProfile::debounceDown,
+  };
+  for (unsigned int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    MotionProfile profile = valid;
+    profile.*fields[i] = 1;
+    CHECK(MotionProfiles::isValid(profile));
+    profile.*fields[i] = 0;
+    CHECK(!MotionProfiles::isValid(profile));
+  }
+}
+
+
+int main() {
+  testButtonLongPress();
+  testButtonShortPress();
+  testButtonMinimumSampleInterval();
+  testProfileButtonDebounce();
+  testProfileMinimums();
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,264 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Time the hot paths of the firmware which run on every iteration of loop():
+ * the sensor update and its debounce check, the comparison and the copy of
+ * the state vector, sending the state vector, and the state machine dispatch.
+ *
+ * The firmware is built for the host against the simulated HAL, with the
+ * serial ports discarding the bytes sent, so the numbers are for comparing
+ * two versions of the firmware on the same machine rather than the timing on
+ * the arduino DUE. The instructions retired are counted by the perf events of
+ * Linux when they are allowed, and are steadier than the times.
+ *
+ * Each benchmark runs --repeat batches of --iterations calls after a warmup
+ * batch and reports the median batch per call.
+ */
+
+#include <getopt.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Simulator.h"
+#include "sketch.h"
+
+const unsigned long DEFAULT_ITERATIONS = 1000000;
+const unsigned long DEFAULT_REPEAT = 9;
+
+// Keep the results of the calls alive.
+static volatile bool resultSink;
+
+// Keep the compiler from moving or dropping the calls around it.
+static inline void clobber() {
+  asm volatile("" : : : "memory");
+}
+
+
+/**
+ * Reach the private hot paths of Fixture, which is a friend of this class.
+ */
+class FixtureMicrobench {
+  public:
+    static bool checkSensorValue(Fixture &fixture) {
+      return fixture.checkSensorValue(Fixture::SENSOR_SAFETY);
+    }
+};
+
+static void benchUpdateSensorStatus() {
+  fixture.updateSensorStatus();
+}
+
+static void benchCheckSensorValue() {
+  resultSink = FixtureMicrobench::checkSensorValue(fixture);
+}
+
+static void benchEqual() {
+  resultSink = (fixture == lastFixture);
+}
+
+static void benchAssign() {
+  lastFixture = fixture;
+  clobber();
+}
+
+static void benchSendStateVector() {
+  fixture.sendStateVectorByNativeUSBPort(lastFixture);
+}
+
+static void benchStateControlIdle() {
+  stateControl(NULL);
+}
+
+static void benchStateControlQuery() {
+  stateControl('s');
+}
+
+struct Benchmark {
+  const char *name;
+  void (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+  {"updateSensorStatus", benchUpdateSensorStatus},
+  {"checkSensorValue", benchCheckSensorValue},
+  {"operator==", benchEqual},
+  {"operator=", benchAssign},
+  {"sendStateVectorByNativeUSBPort", benchSendStateVector},
+  {"stateControl(none)", benchStateControlIdle},
+  {"stateControl(state query)", benchStateControlQuery},
+};
+
+
+/**
+ * Count the instructions retired in the user space by this thread.
+ */
+class InstructionCounter {
+  public:
+    InstructionCounter() {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      fd_ = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~InstructionCounter() {
+      if (fd_ >= 0)
+        close(fd_);
+    }
+
+    bool available() const { return fd_ >= 0; }
+
+    void start() {
+      if (fd_ < 0)
+        return;
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    uint64_t stop() {
+      uint64_t count = 0;
+      if (fd_ < 0)
+        return 0;
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+      if (read(fd_, &count, sizeof(count)) != sizeof(count))
+        return 0;
+      return count;
+    }
+
+  private:
+    int fd_;
+};
+
+static uint64_t monotonicNanos() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+template <typename T>
+static T median(std::vector<T> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+/**
+ * Run a benchmark and print its time and instructions per call.
+ */
+static void runBenchmark(const Benchmark &benchmark, unsigned long iterations,
+                         unsigned long repeat, InstructionCounter *counter) {
+  void (*run)() = benchmark.run;
+  for (unsigned long i = 0; i < iterations; i++) {
+    run();
+    clobber();
+  }
+
+  std::vector<uint64_t> times;
+  std::vector<uint64_t> instructions;
+  for (unsigned long r = 0; r < repeat; r++) {
+    counter->start();
+    uint64_t start = monotonicNanos();
+    for (unsigned long i = 0; i < iterations; i++) {
+      run();
+      clobber();
+    }
+    uint64_t elapsed = monotonicNanos() - start;
+    instructions.push_back(counter->stop());
+    times.push_back(elapsed);
+  }
+
+  printf("%-32s %10.1f", benchmark.name,
+         (double) median(times) / iterations);
+  if (counter->available())
+    printf(" %12.1f\n", (double) median(instructions) / iterations);
+  else
+    printf(" %12s\n", "n/a");
+}
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --iterations N      the calls in a batch\n"
+          "  --repeat N          the batches to take the median of\n"
+          "  --filter TEXT       run only the benchmarks whose name has TEXT\n"
+          "  --list              list the benchmarks\n",
+          program);
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    {"iterations", required_argument, NULL, 'n'},
+    {"repeat", required_argument, NULL, 'r'},
+    {"filter", required_argument, NULL, 'f'},
+    {"list", no_argument, NULL, 'l'},
+    {NULL, 0, NULL, 0},
+  };
+  unsigned long iterations = DEFAULT_ITERATIONS;
+  unsigned long repeat = DEFAULT_REPEAT;
+  std::string filter;
+  bool list = false;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 'n': iterations = strtoul(optarg, NULL, 10); break;
+      case 'r': repeat = strtoul(optarg, NULL, 10); break;
+      case 'f': filter = optarg; break;
+      case 'l': list = true; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (iterations == 0 || repeat == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  const size_t count = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+  if (list) {
+    for (size_t i = 0; i < count; i++)
+      printf("%s\n", BENCHMARKS[i].name);
+    return 0;
+  }
+
+  // The probe rests at the UP position with the clock standing still, so
+  // every call takes the same path.
+  Simulator::instance().setRealTime(false);
+  setup();
+  for (int i = 0; i < 1000; i++) {
+    loop();
+    Simulator::instance().advance(1000);
+  }
+  Serial.takeOutput();
+  SerialUSB.takeOutput();
+  Serial.setNullSink(true);
+  SerialUSB.setNullSink(true);
+  lastFixture = fixture;
+
+  InstructionCounter counter;
+  printf("%-32s %10s %12s\n", "benchmark", "ns/op", "instr/op");
+  for (size_t i = 0; i < count; i++) {
+    if (strstr(BENCHMARKS[i].name, filter.c_str()) == NULL)
+      continue;
+    runBenchmark(BENCHMARKS[i], iterations, repeat, &counter);
+  }
+  if (!counter.available())
+    printf("instructions not counted: perf events not allowed\n");
+  return 0;
+}
@@ -0,0 +1,404 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Search the motion parameters of the firmware against the simulated plant.
+ *
+ * The plant is set up with the measured travel, sensor positions and motor
+ * limits of a fixture. Each candidate motion profile is run through a down
+ * and an up move of the unmodified firmware in a forked process, and the
+ * fastest profile which meets the constraints is printed for the board config
+ * and the profile upload command. The constraints are:
+ *   - the peak pwm frequency leaves the stall margin below the maximum step
+ *     rate of the motor,
+ *   - the probe reaches each end sensor at no more than the approach speed,
+ *     after moving at least the approach distance at that speed,
+ *   - the probe coasts no further than the overshoot beyond the end sensor,
+ *   - the motor never stalls and the probe never hits a mechanical limit.
+ *
+ * For each pair of the peak and the approach speed on a grid, the latest
+ * time to slow down which meets the constraints is found by bisection, and
+ * the loop count to slow down is derived from it so that both conditions of
+ * the firmware are met at about the same position.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "Arduino.h"
+#include "MotionProfile.h"
+#include "Simulator.h"
+#include "sketch.h"
+
+// The simulated time taken by an iteration of loop() in micro-seconds.
+const uint64_t DEFAULT_LOOP_PERIOD = 15;
+
+const unsigned int DEFAULT_MAX_STEP_RATE = 10000;
+const double DEFAULT_DECELERATION = 200000;
+const double DEFAULT_STALL_MARGIN = 0.2;
+const unsigned int DEFAULT_MAX_APPROACH_RATE = 2000;
+const long DEFAULT_APPROACH_STEPS = 300;
+const long DEFAULT_MAX_OVERSHOOT = 20;
+
+// The number of the peak and the approach speeds on the grid.
+const int FAST_GRID = 6;
+const int SLOW_GRID = 4;
+// The speeds are rounded to this many steps per second.
+const unsigned int RATE_QUANTUM = 100;
+// Bisect the time to slow down to this resolution in micro-seconds.
+const uint32_t TIME_RESOLUTION = 1000;
+// Give up a move after this long.
+const uint64_t MOVE_TIMEOUT = 60000000;
+
+// The outcome of a down and an up move with a motion profile.
+struct Trial {
+  bool completed;
+  uint64_t downTime;
+  uint64_t upTime;
+  // The worst of the two moves.
+  unsigned int approachRate;
+  long approachSteps;
+  long overshoot;
+  unsigned long stalls;
+  unsigned long crashes;
+};
+
+// The constraints and the plant of the search.
+struct Problem {
+  Plant::Geometry geometry;
+  unsigned int maxStepRate;
+  double deceleration;
+  double stallMargin;
+  unsigned int maxApproachRate;
+  long approachSteps;
+  long maxOvershoot;
+  uint64_t loopPeriod;
+};
+
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --travel N             the steps from UP to the DOWN sensor\n"
+          "  --up-sensor N          the position of the UP sensor edge\n"
+          "  --extreme-up-sensor N  the position of the extreme UP sensor\n"
+          "                         edge\n"
+          "  --top-limit N          the upper mechanical limit\n"
+          "  --bottom-limit N       the lower mechanical limit\n"
+          "  --max-step-rate HZ     the step rate over which the motor stalls\n"
+          "  --deceleration S       the deceleration in steps/s^2 of the\n"
+          "                         coasting probe, 0 to stop at once\n"
+          "  --stall-margin R       keep the peak rate R below the maximum\n"
+          "  --max-approach HZ      the speed limit at the end sensors\n"
+          "  --approach-steps N     the steps at the approach speed before\n"
+          "                         the end sensors\n"
+          "  --max-overshoot N      the steps beyond the end sensors\n"
+          "  --loop-period US       the time of a loop() iteration\n"
+          "  --slot N               the slot of the printed profile\n"
+          "  --name NAME            the name of the printed profile\n",
+          program);
+}
+
+/**
+ * Run a move and track the approach to the end sensor.
+ */
+static bool runMove(char command, char target, const Problem &problem,
+                    uint64_t *time, Trial *trial) {
+  Simulator &simulator = Simulator::instance();
+  Plant &plant = simulator.plant();
+  bool down = (command == 'd');
+  long edge = down ? problem.geometry.travel : problem.geometry.upSensorEdge;
+  // The position where the probe is last at the approach speed, and whether
+  // the edge has been reached.
+  bool slow = false;
+  long slowSince = plant.position();
+  bool reached = false;
+
+  Serial.inject(std::string(1, command));
+  uint64_t start = simulator.now();
+  while (fixture.state() != target) {
+    if (simulator.now() - start > MOVE_TIMEOUT)
+      return false;
+    loop();
+    simulator.advance(problem.loopPeriod);
+    Serial.takeOutput();
+    SerialUSB.takeOutput();
+
+    bool isSlow = plant.pwmFrequency() <= problem.maxApproachRate;
+    if (isSlow && !slow)
+      slowSince = plant.position();
+    slow = isSlow;
+    if (!reached && (down ? plant.position() >= edge :
+                            plant.position() <= edge)) {
+      reached = true;
+      trial->approachRate = std::max(trial->approachRate,
+                                     plant.pwmFrequency());
+      long approach = down ? edge - slowSince : slowSince - edge;
+      trial->approachSteps = std::min(trial->approachSteps,
+                                      slow ? approach : 0);
+    }
+  }
+  *time = simulator.now() - start;
+  trial->overshoot = std::max(trial->overshoot, down ?
+                              plant.position() - edge :
+                              edge - plant.position());
+  return reached;
+}
+
+/**
+ * Boot the firmware with the profile and run a down and an up move.
+ */
+static Trial runTrial(const Problem &problem, const MotionProfile &profile) {
+  Simulator &simulator = Simulator::instance();
+  simulator.setRealTime(false);
+  Plant &plant = simulator.plant();
+  plant.setGeometry(problem.geometry);
+  plant.setMotorLimits(problem.maxStepRate, problem.deceleration);
+
+  Trial trial;
+  memset(&trial, 0, sizeof(trial));
+  trial.approachSteps = problem.geometry.travel;
+  setup();
+  applyMotionProfile(profile);
+  trial.completed = (runMove('d', 'D', problem, &trial.downTime, &trial) &&
+                     runMove('u', 'U', problem, &trial.upTime, &trial));
+  trial.stalls = plant.stalls();
+  trial.crashes = plant.crashes();
+  return trial;
+}
+
+/**
+ * Run a trial in a forked process so that every trial boots a fresh firmware.
+ */
+static Trial forkTrial(const Problem &problem, const MotionProfile &profile) {
+  Trial trial;
+  memset(&trial, 0, sizeof(trial));
+  int fds[2];
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    return trial;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    close(fds[0]);
+    close(fds[1]);
+    return trial;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    Trial result = runTrial(problem, profile);
+    bool written = (write(fds[1], &result, sizeof(result)) ==
+                    (ssize_t) sizeof(result));
+    _exit(written ? 0 : 1);
+  }
+  close(fds[1]);
+  if (read(fds[0], &trial, sizeof(trial)) != (ssize_t) sizeof(trial))
+    memset(&trial, 0, sizeof(trial));
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return trial;
+}
+
+static bool isFeasible(const Problem &problem, const Trial &trial) {
+  return (trial.completed && trial.stalls == 0 && trial.crashes == 0 &&
+          trial.approachRate <= problem.maxApproachRate &&
+          trial.approachSteps >= problem.approachSteps &&
+          trial.overshoot <= problem.maxOvershoot);
+}
+
+static MotionProfile makeProfile(const Problem &problem,
+                                 const MotionProfile &base, unsigned int fast,
+                                 unsigned int slow, uint32_t timeToSlowDown) {
+  MotionProfile profile = base;
+  profile.fastPwmFrequency = fast;
+  profile.slowPwmFrequency = slow;
+  profile.timeToSlowDown = timeToSlowDown;
+  profile.distanceToSlowDown = timeToSlowDown / problem.loopPeriod;
+  return profile;
+}
+
+static void printTrial(const char *name, const MotionProfile &profile,
+                       const Problem &problem, const Trial &trial) {
+  printf("%-8s fast %5u Hz, slow %5u Hz, slow down at %7.3f s: ", name,
+         profile.fastPwmFrequency, profile.slowPwmFrequency,
+         profile.timeToSlowDown / 1e6);
+  if (!trial.completed) {
+    printf("incomplete, %lu stalls\n", trial.stalls);
+    return;
+  }
+  printf("cycle %.3f s, approach %u Hz for %ld steps, overshoot %ld steps%s\n",
+         (trial.downTime + trial.upTime) / 1e6, trial.approachRate,
+         trial.approachSteps, trial.overshoot,
+         isFeasible(problem, trial) ? "" : " (violated)");
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    {"travel", required_argument, NULL, 't'},
+    {"up-sensor", required_argument, NULL, 'u'},
+    {"extreme-up-sensor", required_argument, NULL, 'x'},
+    {"top-limit", required_argument, NULL, 'T'},
+    {"bottom-limit", required_argument, NULL, 'B'},
+    {"max-step-rate", required_argument, NULL, 'r'},
+    {"deceleration", required_argument, NULL, 'd'},
+    {"stall-margin", required_argument, NULL, 'm'},
+    {"max-approach", required_argument, NULL, 'a'},
+    {"approach-steps", required_argument, NULL, 'A'},
+    {"max-overshoot", required_argument, NULL, 'o'},
+    {"loop-period", required_argument, NULL, 'l'},
+    {"slot", required_argument, NULL, 's'},
+    {"name", required_argument, NULL, 'n'},
+    {NULL, 0, NULL, 0},
+  };
+  Problem problem;
+  problem.geometry.travel = Plant::TRAVEL;
+  problem.geometry.upSensorEdge = Plant::UP_SENSOR_EDGE;
+  problem.geometry.extremeUpSensorEdge = Plant::EXTREME_UP_SENSOR_EDGE;
+  problem.geometry.topLimit = Plant::TOP_LIMIT;
+  problem.geometry.bottomLimit = 0;
+  problem.maxStepRate = DEFAULT_MAX_STEP_RATE;
+  problem.deceleration = DEFAULT_DECELERATION;
+  problem.stallMargin = DEFAULT_STALL_MARGIN;
+  problem.maxApproachRate = DEFAULT_MAX_APPROACH_RATE;
+  problem.approachSteps = DEFAULT_APPROACH_STEPS;
+  problem.maxOvershoot = DEFAULT_MAX_OVERSHOOT;
+  problem.loopPeriod = DEFAULT_LOOP_PERIOD;
+  unsigned int slot = 1;
+  const char *name = "tuned";
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 't': problem.geometry.travel = strtol(optarg, NULL, 10); break;
+      case 'u': problem.geometry.upSensorEdge = strtol(optarg, NULL, 10); break;
+      case 'x':
+        problem.geometry.extremeUpSensorEdge = strtol(optarg, NULL, 10);
+        break;
+      case 'T': problem.geometry.topLimit = strtol(optarg, NULL, 10); break;
+      case 'B': problem.geometry.bottomLimit = strtol(optarg, NULL, 10); break;
+      case 'r': problem.maxStepRate = strtoul(optarg, NULL, 10); break;
+      case 'd': problem.deceleration = strtod(optarg, NULL); break;
+      case 'm': problem.stallMargin = strtod(optarg, NULL); break;
+      case 'a': problem.maxApproachRate = strtoul(optarg, NULL, 10); break;
+      case 'A': problem.approachSteps = strtol(optarg, NULL, 10); break;
+      case 'o': problem.maxOvershoot = strtol(optarg, NULL, 10); break;
+      case 'l': problem.loopPeriod = strtoull(optarg, NULL, 10); break;
+      case 's': slot = strtoul(optarg, NULL, 10); break;
+      case 'n': name = optarg; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (problem.geometry.bottomLimit == 0)
+    problem.geometry.bottomLimit = (problem.geometry.travel +
+                                    Plant::BOTTOM_LIMIT - Plant::TRAVEL);
+  unsigned int maxFast = (unsigned int) (problem.maxStepRate *
+                                         (1 - problem.stallMargin));
+  maxFast -= maxFast % RATE_QUANTUM;
+  if (problem.geometry.travel <= problem.geometry.upSensorEdge ||
+      problem.maxApproachRate < RATE_QUANTUM || maxFast < RATE_QUANTUM ||
+      problem.loopPeriod == 0 || strlen(name) == 0 ||
+      strlen(name) >= sizeof(((MotionProfile *) NULL)->name) ||
+      strchr(name, ',') != NULL || slot == MotionProfiles::DEFAULT_SLOT ||
+      slot >= MotionProfiles::MAX_PROFILES) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  printf("travel %ld steps, motor up to %u Hz, peak up to %u Hz, "
+         "approach up to %u Hz for %ld steps, overshoot up to %ld steps\n",
+         problem.geometry.travel, problem.maxStepRate, maxFast,
+         problem.maxApproachRate, problem.approachSteps, problem.maxOvershoot);
+
+  uint64_t wallStart = wallClockMicros();
+  MotionProfile base = getDefaultMotionProfile();
+  strcpy(base.name, name);
+  Trial baseTrial = forkTrial(problem, base);
+  printTrial("default", base, problem, baseTrial);
+
+  unsigned int maxSlow = std::min(problem.maxApproachRate, maxFast);
+  maxSlow -= maxSlow % RATE_QUANTUM;
+  bool found = false;
+  MotionProfile best = base;
+  Trial bestTrial = baseTrial;
+  unsigned long trials = 1;
+  for (int i = 0; i < FAST_GRID; i++) {
+    unsigned int fast = maxFast - i * (maxFast - maxSlow) / FAST_GRID;
+    fast -= fast % RATE_QUANTUM;
+    for (int j = 0; j < SLOW_GRID; j++) {
+      unsigned int slow = maxSlow - j * maxSlow / SLOW_GRID;
+      slow -= slow % RATE_QUANTUM;
+      // Slowing down after the first loop, the earliest a legitimate profile
+      // could, is the slowest feasible choice if any, and slowing down after
+      // the whole travel at the peak speed is too late.
+      uint32_t low = problem.loopPeriod;
+      if (slow == 0 || slow > fast ||
+          !MotionProfiles::isValid(makeProfile(problem, base, fast, slow, low)))
+        continue;
+
+      uint32_t high = (uint64_t) problem.geometry.travel * 1000000 / fast;
+      MotionProfile profile = makeProfile(problem, base, fast, slow, low);
+      Trial trial = forkTrial(problem, profile);
+      trials++;
+      if (!isFeasible(problem, trial))
+        continue;
+      MotionProfile pairBest = profile;
+      Trial pairTrial = trial;
+      while (high - low > TIME_RESOLUTION) {
+        uint32_t middle = low + (high - low) / 2;
+        profile = makeProfile(problem, base, fast, slow, middle);
+        trial = forkTrial(problem, profile);
+        trials++;
+        if (isFeasible(problem, trial)) {
+          low = middle;
+          pairBest = profile;
+          pairTrial = trial;
+        } else {
+          high = middle;
+        }
+      }
+
+      printTrial("", pairBest, problem, pairTrial);
+      if (!found || (pairTrial.downTime + pairTrial.upTime <
+                     bestTrial.downTime + bestTrial.upTime)) {
+        found = true;
+        best = pairBest;
+        bestTrial = pairTrial;
+      }
+    }
+  }
+  printf("%lu trials in %.1f s\n", trials,
+         (wallClockMicros() - wallStart) / 1e6);
+
+  if (!found) {
+    printf("no feasible profile\n");
+    return 2;
+  }
+  printTrial("best", best, problem, bestTrial);
+  if (baseTrial.completed) {
+    double baseCycle = (baseTrial.downTime + baseTrial.upTime) / 1e6;
+    double bestCycle = (bestTrial.downTime + bestTrial.upTime) / 1e6;
+    printf("cycle %.3f s -> %.3f s (%+.1f%%)\n", baseCycle, bestCycle,
+           (bestCycle / baseCycle - 1) * 100);
+  }
+  char values[128];
+  snprintf(values, sizeof(values), "%u,%u,%u,%u,%u,%u,%u,%u",
+           best.fastPwmFrequency, best.slowPwmFrequency,
+           best.distanceToSlowDown, best.timeToSlowDown, best.debounceUp,
+           best.debounceDown, best.debounceSafety, best.debounceButton);
+  printf("[FixtureProfiles] of the board config:\n  %s = %s\n", name, values);
+  printf("upload command and trace_replay.py --profile:\n  %u,%s,%s\n", slot,
+         name, values);
+  return 0;
+}
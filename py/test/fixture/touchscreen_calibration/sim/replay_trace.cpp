@@ -0,0 +1,214 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Replay a trace recorded from the native USB port through the firmware.
+ *
+ * The raw sensor values and the host commands in the trace are fed into the
+ * firmware at their recorded times under the simulated clock. The firmware
+ * traces itself while replaying, so the output is a trace in the same format
+ * which could be compared with the recorded one by trace_replay.py.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Simulator.h"
+#include "sketch.h"
+
+// The simulated time taken by an iteration of loop() in micro-seconds.
+const uint64_t DEFAULT_LOOP_PERIOD = 15;
+
+// Keep running for this long in micro-seconds after the last event so that
+// the debounce windows and the moves started by it could complete.
+const uint64_t DEFAULT_TAIL = 10000000;
+
+// An event in the trace at the time relative to the trace header.
+struct TraceEvent {
+  uint64_t time;
+  char kind;
+  unsigned int value;
+};
+
+// The initial condition of the trace.
+struct TraceHeader {
+  char state;
+  unsigned int bits;
+  std::string profile;
+  unsigned int pwmFrequency;
+};
+
+
+/**
+ * Split the frames enclosed in [] or <> out of the recorded stream.
+ */
+static std::vector<std::string> splitFrames(FILE *file) {
+  std::vector<std::string> frames;
+  std::string frame;
+  int c;
+  while ((c = fgetc(file)) != EOF) {
+    if (c == '[' || c == '<') {
+      frame.assign(1, (char) c);
+    } else if (!frame.empty()) {
+      frame += (char) c;
+      if (c == ']' || c == '>') {
+        frames.push_back(frame);
+        frame.clear();
+      }
+    }
+  }
+  return frames;
+}
+
+/**
+ * Parse the trace. The micros() in the frames are unwrapped relative to the
+ * header, assuming that the keepalive frames keep the gaps short.
+ */
+static bool parseTrace(const std::vector<std::string> &frames,
+                       TraceHeader *header, std::vector<TraceEvent> *events) {
+  bool found = false;
+  uint32_t last = 0;
+  uint64_t time = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    const char *frame = frames[i].c_str();
+    if (!found) {
+      unsigned long micros;
+      char state;
+      int offset = 0;
+      if (sscanf(frame, "[H%lu,%c,%x,%n", &micros, &state, &header->bits,
+                 &offset) < 3 || offset == 0)
+        continue;
+      header->state = state;
+      header->profile = frames[i].substr(offset,
+                                         frames[i].size() - offset - 1);
+      header->pwmFrequency = 0;
+      if (i + 1 < frames.size())
+        sscanf(frames[i + 1].c_str(), "<%*[^.].%u.", &header->pwmFrequency);
+      last = micros;
+      found = true;
+      continue;
+    }
+
+    TraceEvent event;
+    unsigned long micros;
+    char command;
+    if (sscanf(frame, "[S%lu,%x]", &micros, &event.value) == 2) {
+      event.kind = 'S';
+    } else if (sscanf(frame, "[C%lu,%c]", &micros, &command) == 2) {
+      event.kind = 'C';
+      event.value = command;
+    } else {
+      continue;
+    }
+    time += (uint32_t) (micros - last);
+    last = micros;
+    event.time = time;
+    events->push_back(event);
+  }
+  return found;
+}
+
+/**
+ * Bring the firmware into the initial condition of the trace.
+ */
+static bool prepare(const TraceHeader &header, const char *profileOverride) {
+  Simulator::instance().plant().setTracedSensors(header.bits);
+  setup();
+
+  std::string spec = profileOverride ? profileOverride : header.profile;
+  unsigned int slot;
+  MotionProfile profile;
+  if (!MotionProfiles::parse(spec.c_str(), &slot, &profile)) {
+    fprintf(stderr, "bad motion profile: %s\n", spec.c_str());
+    return false;
+  }
+  applyMotionProfile(profile);
+
+  if (header.state == stateGoingDown) {
+    driveProbe(header.state, header.pwmFrequency, MOTOR_DIR_DOWN);
+  } else if (header.state == stateGoingUp ||
+             header.state == stateGoingUpAfterEmergency) {
+    driveProbe(header.state, header.pwmFrequency, MOTOR_DIR_UP);
+  } else {
+    stopProbe(header.state);
+  }
+  lastFixture = fixture;
+  Serial.takeOutput();
+  SerialUSB.takeOutput();
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    {"profile", required_argument, NULL, 'p'},
+    {"loop-period", required_argument, NULL, 'l'},
+    {"tail", required_argument, NULL, 't'},
+    {NULL, 0, NULL, 0},
+  };
+  const char *profileOverride = NULL;
+  uint64_t loopPeriod = DEFAULT_LOOP_PERIOD;
+  uint64_t tail = DEFAULT_TAIL;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 'p': profileOverride = optarg; break;
+      case 'l': loopPeriod = strtoull(optarg, NULL, 10); break;
+      case 't': tail = strtoull(optarg, NULL, 10); break;
+      default:
+        fprintf(stderr,
+                "Usage: %s [--profile SPEC] [--loop-period US] [--tail US] "
+                "TRACE\n", argv[0]);
+        return 1;
+    }
+  }
+  if (optind + 1 != argc) {
+    fprintf(stderr, "exactly one trace is required\n");
+    return 1;
+  }
+
+  FILE *file = fopen(argv[optind], "r");
+  if (file == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+  std::vector<std::string> frames = splitFrames(file);
+  fclose(file);
+
+  TraceHeader header;
+  std::vector<TraceEvent> events;
+  if (!parseTrace(frames, &header, &events)) {
+    fprintf(stderr, "no trace header in %s\n", argv[optind]);
+    return 1;
+  }
+
+  Simulator &simulator = Simulator::instance();
+  simulator.setRealTime(false);
+  if (!prepare(header, profileOverride))
+    return 1;
+
+  startTrace();
+  uint64_t start = simulator.now();
+  uint64_t end = (events.empty() ? 0 : events.back().time) + tail;
+  size_t next = 0;
+  while (simulator.now() - start < end) {
+    uint64_t elapsed = simulator.now() - start;
+    for (; next < events.size() && events[next].time <= elapsed; next++) {
+      if (events[next].kind == 'S')
+        simulator.plant().setTracedSensors(events[next].value);
+      else
+        Serial.inject(std::string(1, (char) events[next].value));
+    }
+    loop();
+    simulator.advance(loopPeriod);
+    Serial.takeOutput();
+    fputs(SerialUSB.takeOutput().c_str(), stdout);
+  }
+  fputs("\n", stdout);
+  return 0;
+}
@@ -0,0 +1,11 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Build the unmodified firmware sketch for the virtual fixture.
+ */
+
+#include "Arduino.h"
+#include "sketch.h"
+#include "../touchscreen_calibration_fixture.ino"
@@ -0,0 +1,62 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The prototypes of the functions in touchscreen_calibration_fixture.ino.
+ *
+ * The arduino IDE generates these prototypes when it builds the sketch. They
+ * have to be declared here for the virtual fixture, so keep them in sync with
+ * the sketch.
+ */
+
+
+#ifndef sketch_h
+#define sketch_h
+
+#include "DebugButton.h"
+#include "Fixture.h"
+#include "FixtureIdentity.h"
+#include "LatencyProbe.h"
+#include "MotionProfile.h"
+
+// The globals of the sketch used by the harnesses in this directory.
+extern Fixture fixture;
+extern Fixture lastFixture;
+extern FixtureIdentity fixtureIdentity;
+extern LatencyProbe latencyProbe;
+
+void setup();
+void loop();
+void sendFixtureStateVector();
+void stateControl(char command);
+bool isAuxiliaryCommand(char command);
+void handleQueryCommand(char command);
+void startTrace();
+void armLatencyProbe();
+void latencyTripISR();
+void driveMotorTowardEndPosition();
+bool isTargetSensorRawActive();
+bool holdOnRawEdge(bool rawActive);
+void handleEmergencyStop();
+void handleDebugPressed(DebugButton::Event buttonEvent);
+void handleRecoverCommand();
+bool handleSetRecoverTimeCommand(const char *payload);
+bool isAtRest();
+void startPayload(char command);
+void collectPayload();
+void finishPayload(bool complete);
+bool handleProfileCommand(char command, const char *payload);
+bool handleSetIdentityCommand(const char *payload);
+MotionProfile getDefaultMotionProfile();
+void applyMotionProfile(const MotionProfile &profile);
+void gotoUpPosition();
+void driveProbe(const char state, const int newPwmFrequency,
+                const bool direction);
+void stopProbe(const char state);
+void countStop(const char lastState, const char state);
+void adjustSpeedByCount();
+void speedTimerISR();
+void setSpeed(unsigned int newPwmFrequency);
+
+#endif
@@ -0,0 +1,391 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * Soak the firmware state machine with a large number of simulated down/up
+ * cycles mixed with the host commands, the debug button gestures, and the
+ * safety trips.
+ *
+ * The cycles could be split over several processes, each of which runs its
+ * own simulated board with a different seed. The report covers the
+ * distribution of the cycle time and the loop iterations per move, the
+ * coverage of the state transitions, and any illegal transition, stuck state,
+ * safety violation, or mechanical limit hit, which fails the soak.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+#include "Monitor.h"
+#include "Simulator.h"
+#include "Workload.h"
+#include "sketch.h"
+
+// The simulated time taken by an iteration of loop() in micro-seconds.
+const uint64_t DEFAULT_LOOP_PERIOD = 15;
+
+const unsigned long DEFAULT_CYCLES = 1000000;
+const uint64_t DEFAULT_DWELL_MS = 100;
+
+// The firmware is stuck if the main state does not change for this time in
+// micro-seconds. Every move completes or is recovered well within it.
+const uint64_t STUCK_TIMEOUT = 60000000;
+
+// Print the progress of each process every this number of cycles.
+const unsigned long PROGRESS_INTERVAL = 10000;
+
+// The default probabilities of the events per move.
+const Workload::Mix DEFAULT_MIX = {
+  0.1,     // buttonMove
+  0.01,    // doublePress
+  0.01,    // safetyTrip
+  0.5,     // buttonRecover
+  0.2,     // query
+  0.05,    // badCommand
+};
+
+
+// The result of the cycles run by a process.
+struct SoakResult {
+  struct Counters {
+    unsigned long cycles;
+    unsigned long abortedCycles;
+    unsigned long recoveries;
+    unsigned long stuck;
+    unsigned long illegalTransitions;
+    unsigned long safetyViolations;
+    unsigned long crashes;
+    uint64_t iterations;
+    uint64_t simulatedTime;
+    uint64_t maxOutOfRest;
+    unsigned long transitionCounts[Monitor::NUM_STATES][Monitor::NUM_STATES];
+  } counters;
+  std::vector<uint32_t> cycleTimes;
+  std::vector<uint32_t> downIterations;
+  std::vector<uint32_t> upIterations;
+
+  SoakResult() { memset(&counters, 0, sizeof(counters)); }
+  void merge(const SoakResult &other);
+  bool write(int fd) const;
+  bool read(int fd);
+};
+
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --cycles N          the number of down/up cycles to run\n"
+          "  --jobs N            split the cycles over N processes\n"
+          "  --seed N            the seed of the first process\n"
+          "  --dwell-ms MS       the rest time at each end position\n"
+          "  --loop-period US    the time of a loop() iteration\n"
+          "  --safety-trip P     the probability of a safety trip per move\n"
+          "  --button P          the probability of a button move per move\n"
+          "  --query P           the probability of a host query per move\n"
+          "  --progress          print the progress to stderr\n",
+          program);
+}
+
+static bool writeAll(int fd, const void *buf, size_t length) {
+  const char *data = (const char *) buf;
+  while (length > 0) {
+    ssize_t n = ::write(fd, data, length);
+    if (n <= 0)
+      return false;
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+static bool readAll(int fd, void *buf, size_t length) {
+  char *data = (char *) buf;
+  while (length > 0) {
+    ssize_t n = ::read(fd, data, length);
+    if (n <= 0)
+      return false;
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+static bool writeSamples(int fd, const std::vector<uint32_t> &samples) {
+  uint64_t size = samples.size();
+  return (writeAll(fd, &size, sizeof(size)) &&
+          writeAll(fd, samples.data(), size * sizeof(uint32_t)));
+}
+
+static bool readSamples(int fd, std::vector<uint32_t> *samples) {
+  uint64_t size;
+  if (!readAll(fd, &size, sizeof(size)))
+    return false;
+  samples->resize(size);
+  return readAll(fd, samples->data(), size * sizeof(uint32_t));
+}
+
+void SoakResult::merge(const SoakResult &other) {
+  Counters &c = counters;
+  const Counters &o = other.counters;
+  c.cycles += o.cycles;
+  c.abortedCycles += o.abortedCycles;
+  c.recoveries += o.recoveries;
+  c.stuck += o.stuck;
+  c.illegalTransitions += o.illegalTransitions;
+  c.safetyViolations += o.safetyViolations;
+  c.crashes += o.crashes;
+  c.iterations += o.iterations;
+  c.simulatedTime += o.simulatedTime;
+  c.maxOutOfRest = std::max(c.maxOutOfRest, o.maxOutOfRest);
+  for (int from = 0; from < Monitor::NUM_STATES; from++) {
+    for (int to = 0; to < Monitor::NUM_STATES; to++)
+      c.transitionCounts[from][to] += o.transitionCounts[from][to];
+  }
+  cycleTimes.insert(cycleTimes.end(), other.cycleTimes.begin(),
+                    other.cycleTimes.end());
+  downIterations.insert(downIterations.end(), other.downIterations.begin(),
+                        other.downIterations.end());
+  upIterations.insert(upIterations.end(), other.upIterations.begin(),
+                      other.upIterations.end());
+}
+
+bool SoakResult::write(int fd) const {
+  return (writeAll(fd, &counters, sizeof(counters)) &&
+          writeSamples(fd, cycleTimes) &&
+          writeSamples(fd, downIterations) &&
+          writeSamples(fd, upIterations));
+}
+
+bool SoakResult::read(int fd) {
+  return (readAll(fd, &counters, sizeof(counters)) &&
+          readSamples(fd, &cycleTimes) &&
+          readSamples(fd, &downIterations) &&
+          readSamples(fd, &upIterations));
+}
+
+/**
+ * Run the cycles on the simulated board of this process.
+ */
+static SoakResult runSoak(unsigned long cycles, unsigned int seed,
+                          uint64_t dwell, uint64_t loopPeriod,
+                          const Workload::Mix &mix, bool progress) {
+  Simulator &simulator = Simulator::instance();
+  simulator.setRealTime(false);
+  Plant &plant = simulator.plant();
+
+  setup();
+  Monitor monitor(false);
+  monitor.begin(fixture.state(), simulator.now());
+  Workload workload(cycles, dwell);
+  workload.setMix(mix, seed);
+
+  SoakResult result;
+  uint64_t lastChange = simulator.now();
+  char lastState = fixture.state();
+  unsigned long nextProgress = PROGRESS_INTERVAL;
+  while (!workload.done()) {
+    loop();
+    simulator.advance(loopPeriod);
+    SerialUSB.takeOutput();
+    monitor.sample(fixture.state(), simulator.now(), plant);
+    workload.step(fixture.state(), simulator.now(), plant);
+    result.counters.iterations++;
+
+    if (fixture.state() != lastState) {
+      lastState = fixture.state();
+      lastChange = simulator.now();
+    } else if (simulator.now() - lastChange > STUCK_TIMEOUT) {
+      fprintf(stderr, "seed %u: stuck in state %c at position %ld after "
+              "%lu cycles\n", seed, lastState, plant.position(),
+              workload.cycles());
+      result.counters.stuck++;
+      break;
+    }
+    if (progress && workload.cycles() >= nextProgress) {
+      fprintf(stderr, "seed %u: %lu cycles\n", seed, workload.cycles());
+      nextProgress += PROGRESS_INTERVAL;
+    }
+  }
+
+  SoakResult::Counters &c = result.counters;
+  c.cycles = workload.cycles();
+  c.abortedCycles = workload.abortedCycles();
+  c.recoveries = workload.recoveries();
+  c.illegalTransitions = monitor.illegalTransitions();
+  c.safetyViolations = monitor.safetyViolations();
+  c.crashes = plant.crashes();
+  c.simulatedTime = simulator.now();
+  c.maxOutOfRest = monitor.maxOutOfRest();
+  for (int from = 0; from < Monitor::NUM_STATES; from++) {
+    for (int to = 0; to < Monitor::NUM_STATES; to++)
+      c.transitionCounts[from][to] = monitor.transitionCount(from, to);
+  }
+  result.cycleTimes = workload.cycleTimes();
+  result.downIterations = workload.downIterations();
+  result.upIterations = workload.upIterations();
+  return result;
+}
+
+/**
+ * Print the percentiles of the samples scaled by 1/scale.
+ */
+static void printDistribution(const char *name, std::vector<uint32_t> samples,
+                              double scale) {
+  static const double PERCENTILES[] = {0, 50, 90, 99, 99.9, 100};
+  printf("%-24s", name);
+  if (samples.empty()) {
+    printf(" no samples\n");
+    return;
+  }
+  std::sort(samples.begin(), samples.end());
+  for (size_t i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); i++) {
+    size_t index = (size_t) (PERCENTILES[i] / 100 * (samples.size() - 1));
+    printf("  p%g=%.*f", PERCENTILES[i], scale > 1 ? 1 : 0,
+           samples[index] / scale);
+  }
+  printf("\n");
+}
+
+static bool report(const SoakResult &result, unsigned long cycles,
+                   uint64_t wallTime) {
+  const SoakResult::Counters &c = result.counters;
+  printf("cycles: %lu of %lu, aborted: %lu, recoveries: %lu\n", c.cycles,
+         cycles, c.abortedCycles, c.recoveries);
+  printf("simulated time: %.1f h, wall time: %.1f s, %.0fx real time\n",
+         c.simulatedTime / 3.6e9, wallTime / 1e6,
+         (double) c.simulatedTime / std::max<uint64_t>(wallTime, 1));
+  printf("loop iterations: %llu\n", (unsigned long long) c.iterations);
+  printDistribution("cycle time (ms)", result.cycleTimes, 1000);
+  printDistribution("down move (iterations)", result.downIterations, 1);
+  printDistribution("up move (iterations)", result.upIterations, 1);
+
+  int legal = 0;
+  int covered = 0;
+  std::string missed;
+  printf("transitions:\n");
+  for (int from = 0; from < Monitor::NUM_STATES; from++) {
+    for (int to = 0; to < Monitor::NUM_STATES; to++) {
+      char fromState = Monitor::STATES[from];
+      char toState = Monitor::STATES[to];
+      unsigned long count = c.transitionCounts[from][to];
+      bool isLegal = Monitor::isLegalTransition(fromState, toState);
+      if (isLegal) {
+        legal++;
+        if (count > 0)
+          covered++;
+        else
+          missed += std::string(" ") + fromState + "->" + toState;
+      }
+      if (count > 0)
+        printf("  %c->%c %12lu%s\n", fromState, toState, count,
+               isLegal ? "" : "  ILLEGAL");
+    }
+  }
+  printf("transition coverage: %d of %d legal transitions%s%s\n", covered,
+         legal, missed.empty() ? "" : ", missed:", missed.c_str());
+  printf("illegal transitions: %lu\n", c.illegalTransitions);
+  printf("stuck: %lu\n", c.stuck);
+  printf("safety violations: %lu\n", c.safetyViolations);
+  printf("mechanical limit hits: %lu\n", c.crashes);
+  printf("longest time out of rest: %.1f ms\n", c.maxOutOfRest / 1000.0);
+
+  bool passed = (c.cycles >= cycles && c.illegalTransitions == 0 &&
+                 c.stuck == 0 && c.safetyViolations == 0 && c.crashes == 0);
+  printf("%s\n", passed ? "PASSED" : "FAILED");
+  return passed;
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    {"cycles", required_argument, NULL, 'c'},
+    {"jobs", required_argument, NULL, 'j'},
+    {"seed", required_argument, NULL, 's'},
+    {"dwell-ms", required_argument, NULL, 'w'},
+    {"loop-period", required_argument, NULL, 'l'},
+    {"safety-trip", required_argument, NULL, 'S'},
+    {"button", required_argument, NULL, 'B'},
+    {"query", required_argument, NULL, 'Q'},
+    {"progress", no_argument, NULL, 'P'},
+    {NULL, 0, NULL, 0},
+  };
+  unsigned long cycles = DEFAULT_CYCLES;
+  unsigned int jobs = 1;
+  unsigned int seed = 0;
+  uint64_t dwell = DEFAULT_DWELL_MS * 1000;
+  uint64_t loopPeriod = DEFAULT_LOOP_PERIOD;
+  Workload::Mix mix = DEFAULT_MIX;
+  bool progress = false;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 'c': cycles = strtoul(optarg, NULL, 10); break;
+      case 'j': jobs = std::max(1ul, strtoul(optarg, NULL, 10)); break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      case 'w': dwell = strtoull(optarg, NULL, 10) * 1000; break;
+      case 'l': loopPeriod = strtoull(optarg, NULL, 10); break;
+      case 'S': mix.safetyTrip = strtod(optarg, NULL); break;
+      case 'B': mix.buttonMove = strtod(optarg, NULL); break;
+      case 'Q': mix.query = strtod(optarg, NULL); break;
+      case 'P': progress = true; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  uint64_t wallStart = wallClockMicros();
+  std::vector<pid_t> children;
+  std::vector<int> pipes;
+  for (unsigned int job = 0; job < jobs; job++) {
+    unsigned long jobCycles = cycles / jobs + (job < cycles % jobs ? 1 : 0);
+    int fds[2];
+    if (pipe(fds) < 0) {
+      perror("pipe");
+      return 1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      SoakResult result = runSoak(jobCycles, seed + job, dwell, loopPeriod,
+                                  mix, progress);
+      _exit(result.write(fds[1]) ? 0 : 1);
+    }
+    close(fds[1]);
+    children.push_back(pid);
+    pipes.push_back(fds[0]);
+  }
+
+  SoakResult total;
+  bool complete = true;
+  for (unsigned int job = 0; job < jobs; job++) {
+    SoakResult result;
+    if (result.read(pipes[job]))
+      total.merge(result);
+    else
+      complete = false;
+    close(pipes[job]);
+    int status;
+    waitpid(children[job], &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      complete = false;
+  }
+  if (!complete)
+    fprintf(stderr, "some of the soak processes failed\n");
+
+  bool passed = report(total, cycles, wallClockMicros() - wallStart);
+  return (passed && complete) ? 0 : 2;
+}
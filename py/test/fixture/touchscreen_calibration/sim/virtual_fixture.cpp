@@ -0,0 +1,207 @@
+// Copyright 2014 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+/*
+ * The virtual fixture runs the firmware sketch against the simulated plant
+ * and exposes the programming port and the native USB port as
+ * pseudo-terminals which the host code could open like the real ones.
+ *
+ * The plant could be controlled by the lines on stdin:
+ *   safety 0|1     clear or intrude the safety sensor
+ *   button 0|1     release or press the debug button
+ *   jumper 0|1     remove or set the jumper
+ *   position [N]   print the probe position, or move the probe to N
+ *   quit           exit
+ */
+
+#include <getopt.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "FaultInjector.h"
+#include "Simulator.h"
+#include "sketch.h"
+
+// The simulated time taken by an iteration of loop() in micro-seconds.
+// It is derived from DISTANCE_TO_SLOW_DOWN and TIME_TO_SLOW_DOWN which were
+// tuned so that both conditions are met at about the same position.
+const uint64_t DEFAULT_LOOP_PERIOD = 15;
+
+// Check stdin for control lines every this simulated micro-seconds.
+const uint64_t CONTROL_POLL_INTERVAL = 1000;
+
+
+static void usage(const char *program) {
+  fprintf(stderr,
+          "Usage: %s [options]\n"
+          "  --programming-link PATH  symlink PATH to the programming port\n"
+          "  --native-link PATH       symlink PATH to the native usb port\n"
+          "  --flash PATH             keep the flash content in PATH\n"
+          "  --loop-period US         the time of a loop() iteration\n"
+          "  --position N             boot with the probe N steps below UP\n"
+          "  --faults PATH            inject the faults in the script\n"
+          "  --seed N                 the seed of the random faults\n"
+          "  --unique-id HEX          the 128-bit unique id of the chip\n"
+          "  --loopback               wire the latency probe to the safety\n"
+          "                           sensor input\n",
+          program);
+}
+
+/**
+ * Handle a control line. Return false to quit.
+ */
+static bool handleControl(const char *line) {
+  Plant &plant = Simulator::instance().plant();
+  char name[32];
+  long value;
+  int n = sscanf(line, "%31s %ld", name, &value);
+  if (n < 1)
+    return true;
+
+  if (strcmp(name, "quit") == 0)
+    return false;
+  if (strcmp(name, "position") == 0) {
+    if (n == 2)
+      plant.setPosition(value);
+    printf("position %ld\n", plant.position());
+  } else if (n == 2 && strcmp(name, "safety") == 0) {
+    plant.setSafety(value);
+  } else if (n == 2 && strcmp(name, "button") == 0) {
+    plant.setButton(value);
+  } else if (n == 2 && strcmp(name, "jumper") == 0) {
+    plant.setJumper(value);
+  } else {
+    printf("unknown control: %s", line);
+  }
+  fflush(stdout);
+  return true;
+}
+
+/**
+ * Read the control lines available on stdin. Return false to quit.
+ */
+static bool pollControl() {
+  static bool eof = false;
+  static std::string pending;
+  struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+  if (eof || poll(&pfd, 1, 0) <= 0)
+    return true;
+
+  char buf[256];
+  ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+  if (n <= 0) {
+    eof = true;
+    return true;
+  }
+  pending.append(buf, n);
+  size_t end;
+  while ((end = pending.find('\n')) != std::string::npos) {
+    std::string line = pending.substr(0, end + 1);
+    pending.erase(0, end + 1);
+    if (!handleControl(line.c_str()))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Set the unique id of the chip from up to 32 hex digits, which are padded
+ * with leading zeros. Return false if it is not legitimate.
+ */
+static bool setUniqueId(const char *hex) {
+  size_t length = strlen(hex);
+  if (length == 0 || length > 32 ||
+      strspn(hex, "0123456789abcdefABCDEF") != length)
+    return false;
+  std::string digits = std::string(32 - length, '0') + hex;
+  uint32_t uniqueId[4];
+  for (int i = 0; i < 4; i++)
+    uniqueId[i] = strtoul(digits.substr(i * 8, 8).c_str(), NULL, 16);
+  Simulator::instance().setUniqueId(uniqueId);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+    {"programming-link", required_argument, NULL, 'p'},
+    {"native-link", required_argument, NULL, 'n'},
+    {"flash", required_argument, NULL, 'f'},
+    {"loop-period", required_argument, NULL, 'l'},
+    {"faults", required_argument, NULL, 'F'},
+    {"seed", required_argument, NULL, 's'},
+    {"position", required_argument, NULL, 'P'},
+    {"loopback", no_argument, NULL, 'L'},
+    {"unique-id", required_argument, NULL, 'u'},
+    {NULL, 0, NULL, 0},
+  };
+  const char *programmingLink = NULL;
+  const char *nativeLink = NULL;
+  const char *flashPath = NULL;
+  const char *faultsPath = NULL;
+  unsigned int seed = 0;
+  long position = 0;
+  bool loopback = false;
+  const char *uniqueId = NULL;
+  uint64_t loopPeriod = DEFAULT_LOOP_PERIOD;
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (opt) {
+      case 'p': programmingLink = optarg; break;
+      case 'n': nativeLink = optarg; break;
+      case 'f': flashPath = optarg; break;
+      case 'l': loopPeriod = strtoull(optarg, NULL, 10); break;
+      case 'F': faultsPath = optarg; break;
+      case 's': seed = strtoul(optarg, NULL, 10); break;
+      case 'P': position = strtol(optarg, NULL, 10); break;
+      case 'L': loopback = true; break;
+      case 'u': uniqueId = optarg; break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  FaultInjector &injector = FaultInjector::instance();
+  std::string error;
+  if (faultsPath != NULL && !injector.load(faultsPath, &error)) {
+    fprintf(stderr, "%s: %s\n", faultsPath, error.c_str());
+    return 1;
+  }
+  injector.seed(seed);
+
+  Simulator &simulator = Simulator::instance();
+  if (uniqueId != NULL && !setUniqueId(uniqueId)) {
+    fprintf(stderr, "invalid unique id: %s\n", uniqueId);
+    return 1;
+  }
+  if (flashPath != NULL && !simulator.openFlash(flashPath)) {
+    perror(flashPath);
+    return 1;
+  }
+  if (!Serial.open(programmingLink) || !SerialUSB.open(nativeLink)) {
+    perror("failed to create the ports");
+    return 1;
+  }
+  printf("%s: %s\n", Serial.name(), Serial.slaveName().c_str());
+  printf("%s: %s\n", SerialUSB.name(), SerialUSB.slaveName().c_str());
+  fflush(stdout);
+
+  simulator.plant().setPosition(position);
+  simulator.plant().setLoopback(loopback);
+  setup();
+  uint64_t nextControlPoll = 0;
+  while (true) {
+    loop();
+    simulator.advance(loopPeriod);
+    if (simulator.now() >= nextControlPoll) {
+      nextControlPoll = simulator.now() + CONTROL_POLL_INTERVAL;
+      if (!pollControl())
+        break;
+    }
+  }
+  return 0;
+}
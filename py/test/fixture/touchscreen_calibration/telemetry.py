@@ -0,0 +1,482 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Record the fixture state vectors to a compact columnar file and query it.
+
+The touchscreen_calibration test appends every state vector from the native
+USB port to a telemetry file, so that the behavior of a fixture could be
+looked back over shifts:
+
+  $ ./telemetry.py /var/tmp/touchscreen_calibration/fixture_telemetry.bin \\
+        --start '2014-06-02 08:00' --end '2014-06-03 08:00'
+
+prints the down and up move durations, the emergency stops and how long each
+sensor stayed active in the time range.
+
+The file starts with a header and is followed by groups of blocks. A group
+starts with an index block which has a slot for each of its data blocks, and
+is patched in place after each data block is appended. A data block holds a
+batch of frames column by column in fixed widths: the time and the count are
+delta encoded from the previous frame. A query reads the index blocks only and
+skips the groups and the blocks outside its time range without decoding them.
+"""
+
+import argparse
+import array
+import collections
+import itertools
+import os
+import struct
+import sys
+import time
+
+
+MAGIC = b'FXTM'
+VERSION = 1
+
+# The flags following the main state in a state vector, which are packed in
+# Frame.sensor_bits by their indexes. The ordering should match
+# Fixture::sendStateVectorByNativeUSBPort in Fixture.cpp.
+FLAG_NAMES = ['jumper', 'button debug', 'sensor extreme up', 'sensor up',
+              'sensor down', 'sensor safety', 'motor direction',
+              'motor enabled', 'motor locked', 'motor duty cycle']
+SENSOR_FLAGS = FLAG_NAMES[:6]
+
+# A data block is written when this many frames are pending, or when the
+# oldest pending frame is older than FLUSH_INTERVAL_MS.
+FRAMES_PER_BLOCK = 1024
+BLOCKS_PER_GROUP = 64
+FLUSH_INTERVAL_MS = 10 * 60 * 1000
+
+# The time delta of a frame is an unsigned 32-bit column.
+MAX_DELTA_MS = (1 << 32) - 1
+
+FILE_HEADER = struct.Struct('<4sH')
+# tag, the number of slots and of data blocks, the first and the last time in
+# the group, and the file offset after the last data block of the group.
+INDEX_HEADER = struct.Struct('<4sIIqqQ')
+# offset, the first and the last time, and the number of frames of a block.
+INDEX_ENTRY = struct.Struct('<QqqI')
+# tag, the number of frames, the time and the count of the first frame.
+DATA_HEADER = struct.Struct('<4sIqq')
+INDEX_TAG = b'IDX\0'
+DATA_TAG = b'DAT\0'
+
+# The name, the width in bytes, and the signedness of each column in a data
+# block.
+COLUMNS = [('time_delta', 4, False), ('state', 1, False),
+           ('sensor_bits', 2, False), ('pwm_frequency', 2, False),
+           ('count_delta', 4, True)]
+FRAME_BYTES = sum(width for unused_name, width, unused_signed in COLUMNS)
+
+Frame = collections.namedtuple(
+    'Frame', ['time_ms', 'state', 'sensor_bits', 'pwm_frequency', 'count'])
+IndexEntry = collections.namedtuple(
+    'IndexEntry', ['offset', 'first_ms', 'last_ms', 'num_frames'])
+# An index block at the offset and the data blocks after it up to the end.
+Group = collections.namedtuple('Group', ['offset', 'slots', 'end', 'entries'])
+Move = collections.namedtuple('Move', ['direction', 'start_ms', 'duration_ms'])
+Report = collections.namedtuple(
+    'Report', ['frames', 'blocks', 'moves', 'emergency_stops', 'dwell_ms'])
+
+# The moves from the main state on the left to the main state on the right.
+MOVE_END_STATES = {'d': 'D', 'u': 'U'}
+EMERGENCY_STOP_STATE = 'e'
+
+
+class TelemetryError(Exception):
+  pass
+
+
+def _TypeCode(width, signed):
+  """Get the array typecode of the width, which varies by the platform."""
+  for typecode in ('bhilq' if signed else 'BHILQ'):
+    if array.array(typecode).itemsize == width:
+      return typecode
+  raise TelemetryError('No array typecode of %d bytes' % width)
+
+
+_TYPECODES = [_TypeCode(width, signed)
+              for unused_name, width, signed in COLUMNS]
+
+
+def _ToBytes(values):
+  if sys.byteorder == 'big':
+    values = array.array(values.typecode, values)
+    values.byteswap()
+  return values.tobytes()
+
+
+def _FromBytes(typecode, data):
+  values = array.array(typecode)
+  values.frombytes(data)
+  if sys.byteorder == 'big':
+    values.byteswap()
+  return values
+
+
+def ParseStateVector(state_string, time_ms):
+  """Parse a state vector like <i1001000000.6000.0.12345> into a Frame.
+
+  Returns:
+    The Frame at time_ms, or None if the state vector is malformed.
+  """
+  fields = state_string.strip().strip('<>').split('.')
+  if len(fields) < 3 or len(fields[0]) != 1 + len(FLAG_NAMES):
+    return None
+  flags = fields[0][1:]
+  if any(flag not in '01' for flag in flags):
+    return None
+  try:
+    pwm_frequency = int(fields[1])
+    count = int(fields[2])
+  except ValueError:
+    return None
+  sensor_bits = sum(1 << i for i, flag in enumerate(flags) if flag == '1')
+  return Frame(int(time_ms), fields[0][0], sensor_bits, pwm_frequency, count)
+
+
+class TelemetryRecorder:
+  """Append the frames to a telemetry file.
+
+  Usage:
+    recorder = TelemetryRecorder(path)
+    recorder.Record(ParseStateVector(state_string, time.time() * 1000))
+    recorder.Close()
+
+  An existing file is appended to. A data block which was cut short by a crash
+  is dropped when the file is opened again.
+  """
+
+  def __init__(self, path, frames_per_block=FRAMES_PER_BLOCK,
+               blocks_per_group=BLOCKS_PER_GROUP,
+               flush_interval_ms=FLUSH_INTERVAL_MS):
+    self.frames_per_block = frames_per_block
+    self.blocks_per_group = blocks_per_group
+    self.flush_interval_ms = flush_interval_ms
+    self._pending = []
+    # The offset of the index block of the current group, its number of slots
+    # and its entries.
+    self._index_offset = None
+    self._slots = 0
+    self._entries = []
+    # The last frame written, which the deltas of the next block start from.
+    self._last_frame = None
+
+    if os.path.exists(path) and os.path.getsize(path) > 0:
+      self._file = open(path, 'r+b')
+      self._Resume()
+    else:
+      self._file = open(path, 'wb')
+      self._file.write(FILE_HEADER.pack(MAGIC, VERSION))
+      self._file.flush()
+
+  def _Resume(self):
+    """Find the last group of the file and drop anything after it."""
+    reader = TelemetryReader(self._file)
+    end = FILE_HEADER.size
+    for group in reader.Groups():
+      self._index_offset = group.offset
+      self._slots = group.slots
+      self._entries = group.entries
+      end = group.end
+    if self._entries:
+      self._last_frame = reader.ReadBlock(self._entries[-1])[-1]
+    self._file.truncate(end)
+    self._file.seek(end)
+
+  def Record(self, frame):
+    """Record a frame. The frames should come in the order of time."""
+    last = self._pending[-1] if self._pending else self._last_frame
+    if last is not None and frame.time_ms < last.time_ms:
+      # The host clock stepped back. Keep the time monotonic.
+      frame = frame._replace(time_ms=last.time_ms)
+    if self._pending and frame.time_ms - last.time_ms > MAX_DELTA_MS:
+      self.Flush()
+    self._pending.append(frame)
+    if (len(self._pending) >= self.frames_per_block or
+        frame.time_ms - self._pending[0].time_ms >= self.flush_interval_ms):
+      self.Flush()
+
+  def Flush(self):
+    """Write the pending frames as a data block."""
+    if not self._pending:
+      return
+    frames, self._pending = self._pending, []
+    if self._index_offset is None or len(self._entries) >= self._slots:
+      self._StartGroup()
+
+    columns = [array.array(typecode) for typecode in _TYPECODES]
+    last_ms, last_count = frames[0].time_ms, frames[0].count
+    for frame in frames:
+      columns[0].append(frame.time_ms - last_ms)
+      columns[1].append(ord(frame.state))
+      columns[2].append(frame.sensor_bits)
+      columns[3].append(frame.pwm_frequency)
+      columns[4].append(frame.count - last_count)
+      last_ms, last_count = frame.time_ms, frame.count
+
+    offset = self._file.seek(0, os.SEEK_END)
+    self._file.write(DATA_HEADER.pack(DATA_TAG, len(frames), frames[0].time_ms,
+                                      frames[0].count))
+    for column in columns:
+      self._file.write(_ToBytes(column))
+    # Write the data before the index refers to it.
+    self._file.flush()
+    entry = IndexEntry(offset, frames[0].time_ms, frames[-1].time_ms,
+                       len(frames))
+    self._entries.append(entry)
+    self._last_frame = frames[-1]
+    self._WriteIndex(self._file.tell())
+
+  def _StartGroup(self):
+    self._index_offset = self._file.seek(0, os.SEEK_END)
+    self._slots = self.blocks_per_group
+    self._entries = []
+    self._file.write(INDEX_HEADER.pack(INDEX_TAG, self._slots, 0, 0, 0, 0))
+    self._file.write(b'\0' * (INDEX_ENTRY.size * self._slots))
+
+  def _WriteIndex(self, group_end):
+    self._file.seek(self._index_offset)
+    self._file.write(INDEX_HEADER.pack(
+        INDEX_TAG, self._slots, len(self._entries), self._entries[0].first_ms,
+        self._entries[-1].last_ms, group_end))
+    self._file.seek(self._index_offset + INDEX_HEADER.size +
+                    INDEX_ENTRY.size * (len(self._entries) - 1))
+    self._file.write(INDEX_ENTRY.pack(*self._entries[-1]))
+    self._file.seek(group_end)
+    self._file.flush()
+
+  def Close(self):
+    self.Flush()
+    self._file.close()
+
+  def __enter__(self):
+    return self
+
+  def __exit__(self, exc_type, exc_value, tb):
+    self.Close()
+
+
+class TelemetryReader:
+  """Read the frames of a telemetry file in a time range."""
+
+  def __init__(self, path_or_file):
+    if isinstance(path_or_file, str):
+      self._file = open(path_or_file, 'rb')
+    else:
+      self._file = path_or_file
+    try:
+      self._CheckHeader()
+    except TelemetryError:
+      self._file.close()
+      raise
+
+  def _CheckHeader(self):
+    self._file.seek(0)
+    header = self._file.read(FILE_HEADER.size)
+    if len(header) < FILE_HEADER.size:
+      raise TelemetryError('Not a telemetry file')
+    magic, version = FILE_HEADER.unpack(header)
+    if magic != MAGIC:
+      raise TelemetryError('Not a telemetry file')
+    if version != VERSION:
+      raise TelemetryError('Unsupported telemetry version %d' % version)
+
+  def Close(self):
+    self._file.close()
+
+  def Groups(self, start_ms=None, end_ms=None):
+    """Iterate over the groups which overlap the time range.
+
+    Yields:
+      The Group of each index block.
+    """
+    offset = FILE_HEADER.size
+    while True:
+      self._file.seek(offset)
+      header = self._file.read(INDEX_HEADER.size)
+      if len(header) < INDEX_HEADER.size:
+        return
+      tag, slots, num_blocks, first_ms, last_ms, group_end = (
+          INDEX_HEADER.unpack(header))
+      if tag != INDEX_TAG or num_blocks == 0:
+        # An index block without any data block written yet.
+        return
+      if _Overlaps(first_ms, last_ms, start_ms, end_ms):
+        data = self._file.read(INDEX_ENTRY.size * num_blocks)
+        entries = [IndexEntry(*INDEX_ENTRY.unpack_from(data, i))
+                   for i in range(0, len(data), INDEX_ENTRY.size)]
+        yield Group(offset, slots, group_end, entries)
+      offset = group_end
+
+  def Blocks(self, start_ms=None, end_ms=None):
+    """Iterate over the index entries of the blocks overlapping the range."""
+    for group in self.Groups(start_ms, end_ms):
+      for entry in group.entries:
+        if _Overlaps(entry.first_ms, entry.last_ms, start_ms, end_ms):
+          yield entry
+
+  def ReadBlock(self, entry):
+    """Decode the frames of a data block."""
+    self._file.seek(entry.offset)
+    data = self._file.read(DATA_HEADER.size + FRAME_BYTES * entry.num_frames)
+    if len(data) < DATA_HEADER.size + FRAME_BYTES * entry.num_frames:
+      raise TelemetryError('Truncated block at %d' % entry.offset)
+    tag, num_frames, first_ms, first_count = DATA_HEADER.unpack_from(data)
+    if tag != DATA_TAG or num_frames != entry.num_frames:
+      raise TelemetryError('Corrupted block at %d' % entry.offset)
+    columns = []
+    offset = DATA_HEADER.size
+    for typecode, (unused_name, width, unused_signed) in zip(_TYPECODES,
+                                                             COLUMNS):
+      size = width * num_frames
+      columns.append(_FromBytes(typecode, data[offset:offset + size]))
+      offset += size
+    times = itertools.accumulate(columns[0], initial=first_ms)
+    counts = itertools.accumulate(columns[4], initial=first_count)
+    next(times)
+    next(counts)
+    states = columns[1].tobytes().decode('ascii')
+    return [Frame(*values) for values in
+            zip(times, states, columns[2], columns[3], counts)]
+
+  def Frames(self, start_ms=None, end_ms=None):
+    """Iterate over the frames in the time range."""
+    for entry in self.Blocks(start_ms, end_ms):
+      for frame in self.ReadBlock(entry):
+        if ((start_ms is None or frame.time_ms >= start_ms) and
+            (end_ms is None or frame.time_ms <= end_ms)):
+          yield frame
+
+
+  def LastFrameBefore(self, time_ms):
+    """Get the last frame before the time, or None if there is none."""
+    last_entry = None
+    for last_entry in self.Blocks(None, time_ms - 1):
+      pass
+    if last_entry is None:
+      return None
+    return [frame for frame in self.ReadBlock(last_entry)
+            if frame.time_ms < time_ms][-1]
+
+
+def _Overlaps(first_ms, last_ms, start_ms, end_ms):
+  return ((start_ms is None or last_ms >= start_ms) and
+          (end_ms is None or first_ms <= end_ms))
+
+
+def Analyze(frames, start_ms=None):
+  """Summarize the frames in the order of time.
+
+  A sensor dwells in its value until the next frame. The first frame may be
+  the last one before start_ms to give the state at the start of the range. A
+  move or an emergency stop is counted only if it starts after the first
+  frame.
+  """
+  moves = []
+  emergency_stops = 0
+  dwell_ms = collections.OrderedDict((name, 0) for name in SENSOR_FLAGS)
+  sensor_masks = [(name, 1 << i) for i, name in enumerate(SENSOR_FLAGS)]
+  num_frames = 0
+  last = None
+  move_start = None
+  for frame in frames:
+    if start_ms is None or frame.time_ms >= start_ms:
+      num_frames += 1
+    if last is not None:
+      elapsed = frame.time_ms - max(last.time_ms, start_ms or 0)
+      for name, mask in sensor_masks:
+        if last.sensor_bits & mask:
+          dwell_ms[name] += elapsed
+      if frame.state != last.state:
+        if frame.state == EMERGENCY_STOP_STATE:
+          emergency_stops += 1
+        if move_start is not None and (
+            frame.state == MOVE_END_STATES[move_start.state]):
+          moves.append(Move(move_start.state, move_start.time_ms,
+                            frame.time_ms - move_start.time_ms))
+        move_start = frame if frame.state in MOVE_END_STATES else None
+    last = frame
+  return Report(num_frames, None, moves, emergency_stops, dwell_ms)
+
+
+def Query(path, start_ms=None, end_ms=None):
+  """Summarize the frames of a telemetry file in the time range."""
+  reader = TelemetryReader(path)
+  try:
+    num_blocks = len(list(reader.Blocks(start_ms, end_ms)))
+    frames = reader.Frames(start_ms, end_ms)
+    if start_ms is not None:
+      previous = reader.LastFrameBefore(start_ms)
+      if previous is not None:
+        frames = itertools.chain([previous], frames)
+    report = Analyze(frames, start_ms)
+  finally:
+    reader.Close()
+  return report._replace(blocks=num_blocks)
+
+
+def FormatReport(report):
+  lines = ['frames: %d in %d blocks' % (report.frames, report.blocks)]
+  for direction, name in (('d', 'down'), ('u', 'up')):
+    durations = sorted(move.duration_ms for move in report.moves
+                       if move.direction == direction)
+    if durations:
+      lines.append('%s moves: %d, min %.3f s, median %.3f s, max %.3f s' % (
+          name, len(durations), durations[0] / 1000.0,
+          durations[len(durations) // 2] / 1000.0, durations[-1] / 1000.0))
+    else:
+      lines.append('%s moves: 0' % name)
+  lines.append('emergency stops: %d' % report.emergency_stops)
+  lines.append('sensor dwell (s):' + ''.join(
+      '  %s=%.1f' % (name, ms / 1000.0)
+      for name, ms in report.dwell_ms.items()))
+  return '\n'.join(lines)
+
+
+def _ParseTime(value):
+  """Parse the seconds since the epoch or a local time into milli-seconds."""
+  try:
+    return int(float(value) * 1000)
+  except ValueError:
+    pass
+  for time_format in ('%Y-%m-%d %H:%M:%S', '%Y-%m-%d %H:%M', '%Y-%m-%d'):
+    try:
+      return int(time.mktime(time.strptime(value, time_format)) * 1000)
+    except ValueError:
+      pass
+  raise argparse.ArgumentTypeError('invalid time: %r' % value)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('path', help='the telemetry file')
+  parser.add_argument('--start', type=_ParseTime,
+                      help='the start of the range, in the seconds since the '
+                      'epoch or as YYYY-mm-dd [HH:MM[:SS]] in the local time')
+  parser.add_argument('--end', type=_ParseTime, help='the end of the range')
+  parser.add_argument('--moves', action='store_true',
+                      help='list every move')
+  args = parser.parse_args()
+
+  start = time.time()
+  report = Query(args.path, args.start, args.end)
+  elapsed = time.time() - start
+  if args.moves:
+    for move in report.moves:
+      print('%s %s %.3f s' % (
+          time.strftime('%Y-%m-%d %H:%M:%S',
+                        time.localtime(move.start_ms / 1000.0)),
+          'down' if move.direction == 'd' else 'up',
+          move.duration_ms / 1000.0))
+  print(FormatReport(report))
+  print('query time: %.1f ms' % (elapsed * 1000))
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for telemetry."""
+
+import os
+import shutil
+import tempfile
+import unittest
+
+from cros.factory.test.fixture.touchscreen_calibration import telemetry
+
+
+# The sensor bits of the probe at rest in the UP and the DOWN positions, with
+# the jumper and the motor enabled and locked.
+UP_BITS = 0x1 | 0x8 | 0x180
+DOWN_BITS = 0x1 | 0x10 | 0x180
+SAFETY_BIT = 0x20
+
+
+def _MakeCycle(start_ms, count, down_ms=5000, up_ms=4000):
+  """Make the frames of a down and up cycle starting at UP."""
+  return [
+      telemetry.Frame(start_ms, 'd', 0x1 | 0x80, 6000, count),
+      telemetry.Frame(start_ms + down_ms, 'D', DOWN_BITS, 2000, count + 30),
+      telemetry.Frame(start_ms + down_ms + 1000, 'u', 0x1 | 0x80, 6000,
+                      count + 30),
+      telemetry.Frame(start_ms + down_ms + 1000 + up_ms, 'U', UP_BITS, 2000,
+                      count + 60),
+  ]
+
+
+class TelemetryTest(unittest.TestCase):
+
+  def setUp(self):
+    self.temp_dir = tempfile.mkdtemp()
+    self.path = os.path.join(self.temp_dir, 'telemetry.bin')
+
+  def tearDown(self):
+    shutil.rmtree(self.temp_dir)
+
+  def _Record(self, frames, **kwargs):
+    with telemetry.TelemetryRecorder(self.path, **kwargs) as recorder:
+      for frame in frames:
+        recorder.Record(frame)
+
+  def _ReadAll(self, start_ms=None, end_ms=None):
+    reader = telemetry.TelemetryReader(self.path)
+    try:
+      return list(reader.Frames(start_ms, end_ms))
+    finally:
+      reader.Close()
+
+  def testParseStateVector(self):
+    self.assertEqual(
+        telemetry.ParseStateVector('<U1001000110.2000.60.12345>', 1500),
+        telemetry.Frame(1500, 'U', UP_BITS, 2000, 60))
+    self.assertIsNone(telemetry.ParseStateVector('<U10x1000110.2000.60>', 0))
+    self.assertIsNone(telemetry.ParseStateVector('<U1001000110>', 0))
+
+  def testRoundTrip(self):
+    frames = []
+    for cycle in range(50):
+      frames.extend(_MakeCycle(1000000 + cycle * 20000, cycle * 60))
+    self._Record(frames, frames_per_block=16, blocks_per_group=4,
+                 flush_interval_ms=1000000)
+    self.assertEqual(self._ReadAll(), frames)
+    self.assertEqual(os.path.getsize(self.path),
+                     telemetry.FILE_HEADER.size +
+                     len(frames) * telemetry.FRAME_BYTES +
+                     13 * telemetry.DATA_HEADER.size +
+                     4 * (telemetry.INDEX_HEADER.size +
+                          4 * telemetry.INDEX_ENTRY.size))
+
+  def testAppendAfterReopen(self):
+    first = _MakeCycle(1000, 0)
+    second = _MakeCycle(30000, 60)
+    self._Record(first, frames_per_block=3, blocks_per_group=2)
+    self._Record(second, frames_per_block=3, blocks_per_group=2)
+    self.assertEqual(self._ReadAll(), first + second)
+
+  def testDropTornBlock(self):
+    frames = _MakeCycle(1000, 0)
+    self._Record(frames)
+    size = os.path.getsize(self.path)
+    with open(self.path, 'ab') as f:
+      f.write(telemetry.DATA_HEADER.pack(telemetry.DATA_TAG, 100, 0, 0))
+    more = _MakeCycle(30000, 60)
+    self._Record(more)
+    self.assertEqual(self._ReadAll(), frames + more)
+    self.assertGreater(os.path.getsize(self.path), size)
+
+  def testClockSteppedBack(self):
+    self._Record([telemetry.Frame(2000, 'U', UP_BITS, 2000, 0),
+                  telemetry.Frame(1000, 'd', 0x81, 6000, 0)])
+    self.assertEqual([frame.time_ms for frame in self._ReadAll()],
+                     [2000, 2000])
+
+  def testTimeRange(self):
+    frames = []
+    for cycle in range(100):
+      frames.extend(_MakeCycle(cycle * 20000, cycle * 60))
+    self._Record(frames, frames_per_block=8, blocks_per_group=4)
+    reader = telemetry.TelemetryReader(self.path)
+    try:
+      blocks = list(reader.Blocks(400000, 600000))
+      selected = list(reader.Frames(400000, 600000))
+    finally:
+      reader.Close()
+    # Each block holds two cycles of 40 seconds.
+    self.assertEqual(len(blocks), 6)
+    self.assertEqual(selected, [frame for frame in frames
+                                if 400000 <= frame.time_ms <= 600000])
+
+  def testQuery(self):
+    frames = [telemetry.Frame(0, 'U', UP_BITS, 2000, 0)]
+    frames += _MakeCycle(1000, 0) + _MakeCycle(20000, 60, down_ms=6000)
+    # An emergency stop during a down move, and the recovery to UP.
+    frames += [
+        telemetry.Frame(40000, 'd', 0x81, 6000, 120),
+        telemetry.Frame(41000, 'e', 0x1 | SAFETY_BIT | 0x100, 6000, 125),
+        telemetry.Frame(41500, 'e', 0x1 | 0x100, 6000, 125),
+        telemetry.Frame(45000, 'b', 0x81, 2000, 125),
+        telemetry.Frame(46000, 'U', UP_BITS, 2000, 130),
+    ]
+    self._Record(frames, frames_per_block=4)
+    report = telemetry.Query(self.path)
+    self.assertEqual(report.frames, len(frames))
+    self.assertEqual(report.blocks, 4)
+    self.assertEqual(report.moves, [
+        telemetry.Move('d', 1000, 5000), telemetry.Move('u', 7000, 4000),
+        telemetry.Move('d', 20000, 6000), telemetry.Move('u', 27000, 4000)])
+    self.assertEqual(report.emergency_stops, 1)
+    self.assertEqual(report.dwell_ms['sensor safety'], 500)
+    self.assertEqual(report.dwell_ms['sensor down'], 2000)
+    self.assertEqual(report.dwell_ms['sensor up'], 1000 + 9000 + 9000)
+
+    report = telemetry.Query(self.path, 20000, 35000)
+    self.assertEqual(report.moves, [telemetry.Move('d', 20000, 6000),
+                                    telemetry.Move('u', 27000, 4000)])
+    self.assertEqual(report.emergency_stops, 0)
+    self.assertIn('down moves: 1', telemetry.FormatReport(report))
+
+  def testEmptyFile(self):
+    self._Record([])
+    report = telemetry.Query(self.path)
+    self.assertEqual(report.frames, 0)
+    self.assertEqual(report.moves, [])
+
+  def testNotTelemetry(self):
+    with open(self.path, 'wb') as f:
+      f.write(b'<U1001000110.2000.60.12345>\n')
+    self.assertRaises(telemetry.TelemetryError, telemetry.TelemetryReader,
+                      self.path)
+
+
+if __name__ == '__main__':
+  unittest.main()
@@ -7,7 +7,12 @@
  */
 
 #include <DueTimer.h>
+#include "DebugButton.h"
 #include "Fixture.h"
+#include "FixtureIdentity.h"
+#include "LatencyProbe.h"
+#include "MotionProfile.h"
+#include "WearLog.h"
 
 
 // Commands from the host
@@ -21,10 +26,59 @@ const char cmdState = 's';
 const char cmdCount = 'c';
 // Query the PWM speed.
 const char cmdPwm = 'p';
+// Query the sensor health statistics.
+const char cmdStats = 't';
+// Reset the sensor health statistics.
+const char cmdResetStats = 'T';
+// Query the lifetime odometer kept in flash.
+const char cmdOdometer = 'o';
+// Query the fixture clock, i.e., millis(), for clock synchronization.
+const char cmdTime = 'm';
+// Command the probe to go back to the UP position after an emergency stop.
+const char cmdRecover = 'b';
+// Set how long the safety sensor must have been clear before cmdRecover is
+// accepted. The command is followed by the time in milli-seconds and a newline.
+const char cmdSetRecoverTime = 'B';
+// Query the active motion profile.
+const char cmdProfile = 'q';
+// Upload a motion profile. The command is followed by the profile in the
+// format of MotionProfiles::parse() and a newline.
+const char cmdUploadProfile = 'l';
+// Select the active motion profile. The command is followed by a slot digit.
+const char cmdSelectProfile = 'w';
+// Start/stop tracing the raw sensor values and the host commands through the
+// native USB port.
+const char cmdStartTrace = 'x';
+const char cmdStopTrace = 'X';
+// Arm the emergency stop latency probe, and query its last measurement.
+const char cmdArmLatencyProbe = 'k';
+const char cmdLatency = 'K';
+// Query the identity of the fixture, which is served on both ports so that the
+// host could pair them. Assign the fixture name; the command is followed by
+// the name and a newline.
+const char cmdIdentity = 'n';
+const char cmdSetIdentity = 'N';
 
 // Define SUCCESS and ERROR.
 const char SUCCESS = '0';
 const char ERROR = '1';
+// The reasons why cmdRecover is rejected.
+const char ERROR_NOT_EMERGENCY_STOP = '2';
+const char ERROR_SAFETY_NOT_CLEAR = '3';
+
+// The longest payload of a command in bytes, e.g., the profile of
+// cmdUploadProfile without its newline.
+const size_t MAX_PAYLOAD_LENGTH = 79;
+// The payload of a command must be complete within this time (in
+// milli-seconds) from the command, which covers the longest payload at the
+// baud rate of the programming port.
+const unsigned long PAYLOAD_TIMEOUT = 250;
+
+// The safety sensor must have been clear for this long (in milli-seconds)
+// before the host could command the probe to recover from an emergency stop.
+// The host could change it with cmdSetRecoverTime, but not below the minimum.
+const unsigned long SAFETY_CLEAR_TIME_TO_RECOVER = 3000;
+const unsigned long MIN_SAFETY_CLEAR_TIME_TO_RECOVER = 1000;
 
 // The pwm frequency: the higher the value, the faster the motor speed.
 const int FAST_PWM_FREQUENCY = 6000;
@@ -41,36 +95,97 @@ const int SLOW_PWM_FREQUENCY = 2000;
 const unsigned int DISTANCE_TO_SLOW_DOWN = 256000 * 5 / 6; // in loop count
 const unsigned int TIME_TO_SLOW_DOWN = 3300000;            // in micro-seconds
 
+// The constants above make up the default motion profile. The motion
+// parameters below are taken from the active motion profile.
+unsigned int fastPwmFrequency = FAST_PWM_FREQUENCY;
+unsigned int slowPwmFrequency = SLOW_PWM_FREQUENCY;
+unsigned int distanceToSlowDown = DISTANCE_TO_SLOW_DOWN;
+unsigned int timeToSlowDown = TIME_TO_SLOW_DOWN;
+
+// The time set by the host for the safety sensor to be clear before recovery.
+unsigned long safetyClearTimeToRecover = SAFETY_CLEAR_TIME_TO_RECOVER;
+
+// Lock the motor on the first raw edge of the target end sensor instead of
+// stepping on through its whole debounce window. The debounce continues while
+// the probe is held, and the move resumes if the edge turns out to be a glitch.
+const bool PREDICTIVE_STOP = true;
+
+// Whether the probe is held on a raw edge of the target end sensor.
+bool probeHeld = false;
+
 // the pwm frequency, either fast or slow
 volatile unsigned int pwmFrequency = SLOW_PWM_FREQUENCY;
 
 // Get a timer interrupt to slow down the probe.
 DueTimer speedTimer = Timer.getAvailable().attachInterrupt(speedTimerISR);
 
+// Get a timer interrupt to trip the safety sensor input by the latency probe.
+DueTimer tripTimer = Timer.getAvailable().attachInterrupt(latencyTripISR);
+
 // The command delivered by the host.
 char command = NULL;
 
+// The command whose payload is being collected, or NULL. The payload is
+// collected across the iterations of loop() so that the sensors are still
+// checked while it arrives.
+char payloadCommand = NULL;
+char payload[MAX_PAYLOAD_LENGTH + 1];
+// The length of the payload so far, which may exceed MAX_PAYLOAD_LENGTH.
+size_t payloadLength = 0;
+unsigned long payloadStartTime = 0;
+// Whether the command has been rejected, in which case its payload is just
+// discarded.
+bool payloadRejected = false;
+
 // Maintain current and last fixture properties.
 Fixture fixture = Fixture();
 Fixture lastFixture = Fixture(fixture);
 
+// Detect the gestures of the debug button.
+DebugButton debugButton = DebugButton();
+
+// Whether the debug button has been pressed after an emergency stop while the
+// safety sensor is clear, so that its release recovers from the stop.
+bool recoverPressed = false;
+
+// Keep the lifetime odometer of the fixture.
+WearLog wearLog = WearLog();
+
+// Keep the motion profiles uploaded by the host.
+MotionProfiles motionProfiles = MotionProfiles();
+
+// Measure the emergency stop latency with a loopback jumper.
+LatencyProbe latencyProbe = LatencyProbe();
+
+// Tell this fixture from the others driven by the same host.
+FixtureIdentity fixtureIdentity = FixtureIdentity();
+
 
 /**
  * Initialize the test fixture to a known state.
  */
 void setup() {
+  // Load the motion profiles from flash before the sensors are debounced.
+  motionProfiles.begin(getDefaultMotionProfile());
+  applyMotionProfile(motionProfiles.active());
+  fixtureIdentity.begin();
+
   // Enable the motor and wait for the hardware to become stable.
   fixture.start();
+  latencyProbe.begin();
+
+  // Load the odometer from flash and count this boot.
+  wearLog.begin();
 
   // Ensure that the probe parks at the UP position initially.
   if (fixture.isSensorUp()) {
     stopProbe(stateInit);
-    setSpeed(FAST_PWM_FREQUENCY);
+    setSpeed(fastPwmFrequency);
   } else {
     // If the probe does not park at the DOWN position, use a slow speed.
     // Otherwise, there is no way to know when to slow down.
     driveProbe(stateGoingUp,
-               fixture.isSensorDown() ? FAST_PWM_FREQUENCY : SLOW_PWM_FREQUENCY,
+               fixture.isSensorDown() ? fastPwmFrequency : slowPwmFrequency,
                MOTOR_DIR_UP);
   }
 
@@ -86,11 +201,18 @@ void setup() {
  * The loop polls the host command continuously and processes the command.
  */
 void loop() {
-  // Responds to the host command.
-  command = fixture.getCmdByProgrammingPort();
+  // Responds to the host command. The bytes following a command with a payload
+  // belong to the payload instead.
+  command = (payloadCommand == NULL ? fixture.getCmdByProgrammingPort() : NULL);
+  if (command != NULL)
+    fixture.traceCommand(command);
   stateControl(command);
   sendFixtureStateVector();
   lastFixture = fixture;
+
+  // Flash writes are allowed only at rest so that they never delay motion.
+  if (fixture.state() == stateInit || fixture.isInStopState())
+    wearLog.commitAtRest();
 }
 
 /**
@@ -98,11 +220,18 @@ void loop() {
  * (1) there is a state change or
  * (2) when the fixture receives a state query command (for debug)
  *     from the host.
+ * The identity query is also served on the native USB port.
  */
 void sendFixtureStateVector() {
-  if ((fixture != lastFixture) || fixture.getCmdByNativeUSBPort() == cmdState) {
+  if (fixture != lastFixture) {
     fixture.sendStateVectorByNativeUSBPort(fixture);
+    return;
   }
+  char nativeCommand = fixture.getCmdByNativeUSBPort();
+  if (nativeCommand == cmdState)
+    fixture.sendStateVectorByNativeUSBPort(fixture);
+  else if (nativeCommand == cmdIdentity)
+    fixtureIdentity.sendByNativeUSBPort();
 }
 
 /**
@@ -111,27 +240,42 @@ void sendFixtureStateVector() {
 void stateControl(char command) {
   // Check all of the sensors continuously and update the status.
   fixture.updateSensorStatus();
+  DebugButton::Event buttonEvent = debugButton.update(
+      fixture.isRawActive(Fixture::BUTTON_DEBUG), millis());
+  bool buttonPressed = (fixture.jumper() && buttonEvent == DebugButton::PRESS);
+
+  if (command == cmdRecover)
+    handleRecoverCommand();
+  else if (command == cmdUploadProfile || command == cmdSelectProfile ||
+           command == cmdSetIdentity || command == cmdSetRecoverTime)
+    startPayload(command);
+  if (payloadCommand != NULL)
+    collectPayload();
 
   // Checks if there is an emergency stop.
   if (fixture.isSensorSafety()) {
     handleEmergencyStop();
   } else if (fixture.state() == stateEmergencyStop) {
-    handleDebugPressed();
+    handleDebugPressed(buttonEvent);
   } else if (fixture.state() == stateGoingUpAfterEmergency) {
     gotoUpPosition();
   } else {
     // Responds to the host command.
-    if ((command == cmdDown ||
-         (fixture.jumper() && fixture.isDebugPressed())) &&
+    if ((command == cmdDown || buttonPressed) &&
         (fixture.state() == stateInit || fixture.state() == stateStopUp)) {
       // Takes the go Down command only when the probe is in its Up position.
-      driveProbe(stateGoingDown, FAST_PWM_FREQUENCY, MOTOR_DIR_DOWN);
-    } else if ((command == cmdUp ||
-                (fixture.jumper() && fixture.isDebugPressed())) &&
+      driveProbe(stateGoingDown, fastPwmFrequency, MOTOR_DIR_DOWN);
+    } else if ((command == cmdUp || buttonPressed) &&
                (fixture.state() == stateStopDown)) {
       // Takes the go Up command only when the probe is in its Down position.
-      driveProbe(stateGoingUp, FAST_PWM_FREQUENCY, MOTOR_DIR_UP);
-    } else if (command != cmdState && command != NULL) {
+      driveProbe(stateGoingUp, fastPwmFrequency, MOTOR_DIR_UP);
+    } else if (fixture.jumper() && buttonEvent == DebugButton::DOUBLE_PRESS &&
+               fixture.state() == stateGoingDown) {
+      // A double press aborts the down move which has been started by its
+      // first press. There is no way to know when to slow down from the
+      // middle of the way, so use the slow speed.
+      driveProbe(stateGoingUp, slowPwmFrequency, MOTOR_DIR_UP);
+    } else if (!isAuxiliaryCommand(command) && command != NULL) {
       fixture.sendResponseByProgrammingPort(ERROR);
     }
     driveMotorTowardEndPosition();
@@ -145,8 +289,96 @@ void stateControl(char command) {
   if (fixture.isInStopState())
     fixture.checkJumper();
 
-  if (command == cmdState)
+  handleQueryCommand(command);
+}
+
+/**
+ * Is the command served outside of the down/up motion commands?
+ */
+bool isAuxiliaryCommand(char command) {
+  return (command == cmdState || command == cmdStats ||
+          command == cmdResetStats || command == cmdOdometer ||
+          command == cmdTime || command == cmdRecover ||
+          command == cmdProfile || command == cmdUploadProfile ||
+          command == cmdSelectProfile || command == cmdStartTrace ||
+          command == cmdStopTrace || command == cmdArmLatencyProbe ||
+          command == cmdLatency || command == cmdIdentity ||
+          command == cmdSetIdentity || command == cmdSetRecoverTime);
+}
+
+/**
+ * Respond to the query commands which do not change the fixture state.
+ */
+void handleQueryCommand(char command) {
+  if (command == cmdState) {
     fixture.sendResponseByProgrammingPort(fixture.state());
+  } else if (command == cmdStats) {
+    fixture.sendSensorStatsByProgrammingPort();
+  } else if (command == cmdResetStats) {
+    fixture.resetSensorStats();
+    fixture.sendResponseByProgrammingPort(SUCCESS);
+  } else if (command == cmdOdometer) {
+    wearLog.sendByProgrammingPort();
+  } else if (command == cmdTime) {
+    fixture.sendTimeByProgrammingPort();
+  } else if (command == cmdProfile) {
+    motionProfiles.sendByProgrammingPort();
+  } else if (command == cmdArmLatencyProbe) {
+    armLatencyProbe();
+  } else if (command == cmdLatency) {
+    latencyProbe.sendByProgrammingPort();
+  } else if (command == cmdIdentity) {
+    fixtureIdentity.sendByProgrammingPort();
+  } else if (command == cmdStartTrace) {
+    startTrace();
+    fixture.sendResponseByProgrammingPort(SUCCESS);
+  } else if (command == cmdStopTrace) {
+    fixture.stopTrace();
+    fixture.sendResponseByProgrammingPort(SUCCESS);
+  }
+}
+
+/**
+ * Start tracing and mark the initial condition of the trace.
+ *
+ * The trace header looks like
+ * [H12345678,U,2c,1,samus,8000,2000,213333,3300000,200,200,100,500]
+ * which are micros(), the state, the raw sensor values in hex, and the active
+ * motion profile. It is followed by the state vector.
+ */
+void startTrace() {
+  fixture.startTrace();
+  SerialUSB.print("[H");
+  SerialUSB.print(micros());
+  SerialUSB.print(',');
+  SerialUSB.print(fixture.state());
+  SerialUSB.print(',');
+  SerialUSB.print(fixture.rawSensorBits(), HEX);
+  SerialUSB.print(',');
+  motionProfiles.printActive(SerialUSB);
+  SerialUSB.print("]");
+  fixture.sendStateVectorByNativeUSBPort(fixture);
+}
+
+/**
+ * Arm the latency probe to trip the safety sensor input at a random time of
+ * the next move. The probe is armed only at rest.
+ */
+void armLatencyProbe() {
+  if (fixture.state() == stateInit || fixture.isInStopState()) {
+    latencyProbe.arm();
+    fixture.sendResponseByProgrammingPort(SUCCESS);
+  } else {
+    fixture.sendResponseByProgrammingPort(ERROR);
+  }
+}
+
+/**
+ * The ISR to trip the safety sensor input by the latency probe, once.
+ */
+void latencyTripISR() {
+  tripTimer.stop();
+  latencyProbe.trip();
 }
 
 /**
@@ -154,46 +386,278 @@ void stateControl(char command) {
  */
 void driveMotorTowardEndPosition() {
   if (fixture.state() == stateGoingDown || fixture.state() == stateGoingUp) {
-    fixture.inc_count();
     if (fixture.state() == stateGoingDown && fixture.isSensorDown()) {
       stopProbe(stateStopDown);
       fixture.sendResponseByProgrammingPort(fixture.state());
     } else if (fixture.state() == stateGoingUp && fixture.isSensorUp()) {
       stopProbe(stateStopUp);
       fixture.sendResponseByProgrammingPort(fixture.state());
-    } else {
+    } else if (!holdOnRawEdge(isTargetSensorRawActive())) {
+      fixture.inc_count();
       adjustSpeedByCount();
     }
   }
 }
 
+/**
+ * Is the raw value of the end sensor which the probe is moving toward active?
+ */
+bool isTargetSensorRawActive() {
+  if (fixture.state() == stateGoingDown)
+    return fixture.isRawActive(Fixture::SENSOR_DOWN);
+  return (fixture.isRawActive(Fixture::SENSOR_UP) ||
+          fixture.isRawActive(Fixture::SENSOR_EXTREME_UP));
+}
+
+/**
+ * Hold the probe while the raw value of the target end sensor is active.
+ *
+ * The motor is locked on the first raw edge so that the probe does not
+ * overshoot during the debounce window. If the raw value becomes inactive
+ * before the debounce confirms it, the edge is a glitch and the motor is
+ * unlocked to resume the move in the same direction and speed.
+ * Return true if the probe is held.
+ */
+bool holdOnRawEdge(bool rawActive) {
+  if (!PREDICTIVE_STOP)
+    return false;
+
+  if (rawActive && !probeHeld) {
+    fixture.lockMotor();
+    wearLog.motorLocked();
+    probeHeld = true;
+  } else if (!rawActive && probeHeld) {
+    fixture.unlockMotor();
+    wearLog.motorUnlocked(fixture.motorDir(), pwmFrequency);
+    probeHeld = false;
+  }
+  return probeHeld;
+}
+
 /**
  * Emergency stop due to sensor safety pin being triggered.
  */
 void handleEmergencyStop() {
+  // A press held through the safety trip could not recover from the stop.
+  recoverPressed = false;
   if (fixture.isSensorUp()) {
     fixture.set_state(stateStopUp);
+    latencyProbe.emergencyStopped(false);
   } else {
+    bool wasRunning = fixture.isMotorRunning();
     stopProbe(stateEmergencyStop);
+    latencyProbe.emergencyStopped(wasRunning);
   }
 }
 
 /**
- * Once the debug button is pressed after an emergency stop, prepare to drive
- * the probe back to the UP position.
+ * Once the debug button is pressed and released after an emergency stop,
+ * prepare to drive the probe back to the UP position.
+ *
+ * The whole gesture has to be made while the safety sensor is clear since the
+ * probe starts moving right after it. The probe starts moving one debounce time
+ * of the button after the release, well within the active duration of
+ * BUTTON_DEBUG.
  */
-void handleDebugPressed() {
-  if (fixture.isDebugPressed()) {
-    driveProbe(stateGoingUpAfterEmergency, SLOW_PWM_FREQUENCY, MOTOR_DIR_UP);
+void handleDebugPressed(DebugButton::Event buttonEvent) {
+  if (buttonEvent == DebugButton::PRESS ||
+      buttonEvent == DebugButton::DOUBLE_PRESS) {
+    recoverPressed = true;
+  } else if (buttonEvent == DebugButton::RELEASE && recoverPressed) {
+    recoverPressed = false;
+    driveProbe(stateGoingUpAfterEmergency, slowPwmFrequency, MOTOR_DIR_UP);
   }
 }
 
+/**
+ * The host commands the probe to go back to the UP position after an
+ * emergency stop. This is the remote counterpart of pressing the debug button.
+ *
+ * For safety, the command is accepted only if the safety sensor has been
+ * clear for safetyClearTimeToRecover. The response is
+ * stateGoingUpAfterEmergency if accepted or an error code of the reason.
+ */
+void handleRecoverCommand() {
+  if (fixture.state() != stateEmergencyStop) {
+    fixture.sendResponseByProgrammingPort(ERROR_NOT_EMERGENCY_STOP);
+  } else if (fixture.isSensorSafety() ||
+             fixture.inactiveDuration(Fixture::SENSOR_SAFETY) <
+                 safetyClearTimeToRecover) {
+    fixture.sendResponseByProgrammingPort(ERROR_SAFETY_NOT_CLEAR);
+  } else {
+    driveProbe(stateGoingUpAfterEmergency, slowPwmFrequency, MOTOR_DIR_UP);
+    fixture.sendResponseByProgrammingPort(fixture.state());
+  }
+}
+
+/**
+ * Set the time for the safety sensor to be clear before cmdRecover is accepted
+ * with the payload of the command, which is kept until the next reset.
+ * Return true if the time is valid, i.e., no shorter than the minimum.
+ */
+bool handleSetRecoverTimeCommand(const char *payload) {
+  char *end;
+  unsigned long time = strtoul(payload, &end, 10);
+  if (end == payload || *end != '\0' ||
+      time < MIN_SAFETY_CLEAR_TIME_TO_RECOVER)
+    return false;
+  safetyClearTimeToRecover = time;
+  return true;
+}
+
+/**
+ * Is the probe at rest at either end position?
+ */
+bool isAtRest() {
+  return (fixture.state() == stateInit || fixture.state() == stateStopUp ||
+          fixture.state() == stateStopDown);
+}
+
+/**
+ * Start collecting the payload of a command.
+ *
+ * The commands which write flash are accepted only when the probe is at rest.
+ * Otherwise the command is rejected at once and its payload is discarded as it
+ * arrives.
+ */
+void startPayload(char command) {
+  payloadCommand = command;
+  payloadLength = 0;
+  payloadStartTime = millis();
+  payloadRejected = (command != cmdSetRecoverTime && !isAtRest());
+  if (payloadRejected)
+    fixture.sendResponseByProgrammingPort(ERROR);
+}
+
+/**
+ * Collect the bytes of the payload which have arrived without waiting for the
+ * others, and finish the command once the payload is complete or timed out.
+ *
+ * The payload of cmdSelectProfile is a slot digit, and the other payloads end
+ * with a newline.
+ */
+void collectPayload() {
+  while (Serial.available()) {
+    char ch = Serial.read();
+    if (ch != '\n') {
+      if (payloadLength < MAX_PAYLOAD_LENGTH)
+        payload[payloadLength] = ch;
+      payloadLength++;
+    }
+    if (ch == '\n' || payloadCommand == cmdSelectProfile) {
+      finishPayload(true);
+      return;
+    }
+  }
+  if (millis() - payloadStartTime >= PAYLOAD_TIMEOUT)
+    finishPayload(false);
+}
+
+/**
+ * Handle the command with its payload, and respond to it unless it has been
+ * rejected already.
+ */
+void finishPayload(bool complete) {
+  char command = payloadCommand;
+  payloadCommand = NULL;
+  if (payloadRejected)
+    return;
+
+  bool result = false;
+  if (complete && payloadLength <= MAX_PAYLOAD_LENGTH) {
+    payload[payloadLength] = '\0';
+    if (command == cmdSetIdentity)
+      result = handleSetIdentityCommand(payload);
+    else if (command == cmdSetRecoverTime)
+      result = handleSetRecoverTimeCommand(payload);
+    else
+      result = handleProfileCommand(command, payload);
+  }
+  fixture.sendResponseByProgrammingPort(result ? SUCCESS : ERROR);
+}
+
+/**
+ * Upload or select a motion profile with the payload of the command.
+ *
+ * The profiles are stored in flash, so they could be changed only when the
+ * probe is at rest at either end position. The probe might have started moving
+ * by the debug button while the payload arrived.
+ * Return true if the profile is uploaded or selected.
+ */
+bool handleProfileCommand(char command, const char *payload) {
+  if (!isAtRest())
+    return false;
+
+  bool result = false;
+  if (command == cmdUploadProfile) {
+    unsigned int slot;
+    MotionProfile profile;
+    result = (MotionProfiles::parse(payload, &slot, &profile) &&
+              motionProfiles.upload(slot, profile));
+  } else if (command == cmdSelectProfile) {
+    result = (payload[0] >= '0' && payload[0] <= '9' && payload[1] == '\0' &&
+              motionProfiles.select(payload[0] - '0'));
+  }
+  // Re-apply the active profile in case it has been overwritten or changed.
+  if (result)
+    applyMotionProfile(motionProfiles.active());
+  return result;
+}
+
+/**
+ * Assign the fixture name with the payload of the command. The name is stored
+ * in flash, so it could be changed only when the probe is at rest at either end
+ * position.
+ * Return true if the name is assigned.
+ */
+bool handleSetIdentityCommand(const char *payload) {
+  return (isAtRest() && strlen(payload) <= FixtureIdentity::MAX_NAME_LENGTH &&
+          fixtureIdentity.setName(payload));
+}
+
+/**
+ * Get the built-in motion profile from the constants, the default sensor
+ * active durations and the default debounce time of the debug button.
+ */
+MotionProfile getDefaultMotionProfile() {
+  MotionProfile profile;
+  memset(&profile, 0, sizeof(profile));
+  strcpy(profile.name, "default");
+  profile.fastPwmFrequency = FAST_PWM_FREQUENCY;
+  profile.slowPwmFrequency = SLOW_PWM_FREQUENCY;
+  profile.distanceToSlowDown = DISTANCE_TO_SLOW_DOWN;
+  profile.timeToSlowDown = TIME_TO_SLOW_DOWN;
+  profile.debounceUp = fixture.activeDuration(Fixture::SENSOR_UP);
+  profile.debounceDown = fixture.activeDuration(Fixture::SENSOR_DOWN);
+  profile.debounceSafety = fixture.activeDuration(Fixture::SENSOR_SAFETY);
+  profile.debounceButton = debugButton.debounceTime();
+  return profile;
+}
+
+/**
+ * Take the motion parameters, the sensor active durations and the debounce time
+ * of the debug button from a profile.
+ */
+void applyMotionProfile(const MotionProfile &profile) {
+  fastPwmFrequency = profile.fastPwmFrequency;
+  slowPwmFrequency = profile.slowPwmFrequency;
+  distanceToSlowDown = profile.distanceToSlowDown;
+  timeToSlowDown = profile.timeToSlowDown;
+  fixture.setActiveDuration(Fixture::SENSOR_EXTREME_UP, profile.debounceUp);
+  fixture.setActiveDuration(Fixture::SENSOR_UP, profile.debounceUp);
+  fixture.setActiveDuration(Fixture::SENSOR_DOWN, profile.debounceDown);
+  fixture.setActiveDuration(Fixture::SENSOR_SAFETY, profile.debounceSafety);
+  debugButton.setDebounceTime(profile.debounceButton);
+}
+
 /**
  * The probe goes to the UP position.
  */
 void gotoUpPosition() {
   if (fixture.isSensorUp())
     stopProbe(stateStopUp);
+  else
+    holdOnRawEdge(isTargetSensorRawActive());
 }
 
 /**
@@ -201,17 +665,45 @@ void gotoUpPosition() {
  */
 void driveProbe(const char state, const int newPwmFrequency,
                 const bool direction) {
-  speedTimer.start(TIME_TO_SLOW_DOWN);
+  speedTimer.start(timeToSlowDown);
+  if (latencyProbe.startMove())
+    tripTimer.start(latencyProbe.tripDelay());
+  probeHeld = false;
   pwmFrequency = newPwmFrequency,
   fixture.driveProbe(state, pwmFrequency, direction);
+  wearLog.motorUnlocked(direction, pwmFrequency);
 }
 
 /**
  * A wraper of Fixutre::stopProbe with timer stop.
  */
 void stopProbe(const char state) {
+  char lastState = fixture.state();
   fixture.stopProbe(state);
+  probeHeld = false;
   speedTimer.stop();
+  wearLog.motorLocked();
+  countStop(lastState, state);
+}
+
+/**
+ * Count the stop in the odometer according to the state transition.
+ *
+ * Reaching the UP position with the extreme up sensor triggered means that
+ * the probe has overtravelled, which is counted as a fault stop.
+ */
+void countStop(const char lastState, const char state) {
+  if (state == stateStopDown && lastState == stateGoingDown) {
+    wearLog.addCycle(MOTOR_DIR_DOWN);
+  } else if (state == stateStopUp &&
+             (lastState == stateGoingUp ||
+              lastState == stateGoingUpAfterEmergency)) {
+    wearLog.addCycle(MOTOR_DIR_UP);
+    if (fixture.isSensorExtremeUp())
+      wearLog.addFaultStop();
+  } else if (state == stateEmergencyStop && lastState != stateEmergencyStop) {
+    wearLog.addEmergencyStop();
+  }
 }
 
 
@@ -219,9 +711,9 @@ void stopProbe(const char state) {
  * Adjust the pwm frequency speed according to count, i.e., the probe position.
  */
 void adjustSpeedByCount() {
-  if ((pwmFrequency == FAST_PWM_FREQUENCY) &&
-      (fixture.count() >= DISTANCE_TO_SLOW_DOWN)) {
-    setSpeed(SLOW_PWM_FREQUENCY);
+  if ((pwmFrequency == fastPwmFrequency) &&
+      (fixture.count() >= distanceToSlowDown)) {
+    setSpeed(slowPwmFrequency);
   }
 }
 
@@ -229,7 +721,7 @@ void adjustSpeedByCount() {
  * The ISR to slow down the probe when the timer goes off.
  */
 void speedTimerISR() {
-  setSpeed(SLOW_PWM_FREQUENCY);
+  setSpeed(slowPwmFrequency);
   speedTimer.stop();
 }
 
@@ -239,4 +731,5 @@ void speedTimerISR() {
 void setSpeed(unsigned int newPwmFrequency) {
     pwmFrequency = newPwmFrequency;
     fixture.setSpeed(pwmFrequency);
+    wearLog.speedChanged(pwmFrequency);
 }
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Replay the fixture traces through a simulated build of the firmware.
+
+A trace is recorded from the native usb port when tracing is started by
+FixtureSerialDevice.StartTrace(). It holds the raw sensor values and the host
+commands with their timestamps, and the state vectors sent by the firmware.
+
+The traces are fed into sim/build/replay_trace, which runs the firmware under
+the simulated clock and outputs a trace of the same format. The main state
+transitions and their timing in the two traces are compared so that a new
+debounce window or motion profile could be checked against the field traces
+before it reaches the line:
+
+  $ make -C sim
+  $ ./trace_replay.py --profile 1,fast,8000,2000,213333,3300000,100,100,50,500 \\
+        fixture_trace_*.txt
+"""
+
+import argparse
+import collections
+import logging
+import multiprocessing
+import os
+import re
+import subprocess
+import sys
+
+
+DEFAULT_REPLAY_BINARY = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                     'sim', 'build', 'replay_trace')
+
+# millis() of the firmware wraps around at 32 bits.
+MILLIS_WRAP = 1 << 32
+
+# The states in which the probe is moving toward an end position.
+MOVING_STATES = 'dub'
+
+_HEADER_RE = re.compile(r'\[H(\d+),(.),([0-9a-f]+),(.*)\]$')
+_STATE_RE = re.compile(r'<(.)[^.]*\.\d+\.\d+\.(\d+)>$')
+_FRAME_RE = re.compile(r'\[[^\[\]<>]*\]|<[^\[\]<>]*>')
+
+TraceHeader = collections.namedtuple(
+    'TraceHeader', ['micros', 'state', 'sensor_bits', 'profile'])
+# A state vector at time_ms relative to the start of the trace.
+StateFrame = collections.namedtuple('StateFrame', ['time_ms', 'state', 'frame'])
+Transition = collections.namedtuple('Transition', ['time_ms', 'state'])
+CompareResult = collections.namedtuple(
+    'CompareResult', ['matched', 'num_transitions', 'divergence',
+                      'max_delta_ms', 'recorded_move_ms', 'replayed_move_ms'])
+
+
+class TraceError(Exception):
+  pass
+
+
+class Trace:
+  """A parsed trace."""
+
+  def __init__(self, header, states, num_events):
+    self.header = header
+    self.states = states
+    self.num_events = num_events
+
+  def Transitions(self):
+    """Get the changes of the main state, starting with the initial one."""
+    transitions = []
+    for frame in self.states:
+      if not transitions or transitions[-1].state != frame.state:
+        transitions.append(Transition(frame.time_ms, frame.state))
+    return transitions
+
+
+def ParseTrace(text):
+  """Parse a trace from the text recorded from the native usb port.
+
+  The frames before the first header are ignored. The time of a state vector
+  is its millis() relative to the state vector right after the header, which
+  marks the start of the trace.
+
+  Raises:
+    TraceError if there is no header.
+  """
+  header = None
+  states = []
+  num_events = 0
+  start_millis = None
+  for frame in _FRAME_RE.findall(text):
+    if header is None:
+      match = _HEADER_RE.match(frame)
+      if match:
+        header = TraceHeader(int(match.group(1)), match.group(2),
+                             int(match.group(3), 16), match.group(4))
+      continue
+    if frame.startswith('['):
+      num_events += 1
+      continue
+    match = _STATE_RE.match(frame)
+    if not match:
+      continue
+    millis = int(match.group(2))
+    if start_millis is None:
+      start_millis = millis
+    time_ms = (millis - start_millis) % MILLIS_WRAP
+    states.append(StateFrame(time_ms, match.group(1), frame))
+
+  if header is None:
+    raise TraceError('No trace header')
+  return Trace(header, states, num_events)
+
+
+def MoveDurations(transitions):
+  """Get the durations of the moves which have reached an end position."""
+  return [end.time_ms - start.time_ms
+          for start, end in zip(transitions, transitions[1:])
+          if start.state in MOVING_STATES and end.state not in MOVING_STATES]
+
+
+def _Mean(values):
+  return float(sum(values)) / len(values) if values else None
+
+
+def Compare(recorded, replayed, tolerance_ms=None):
+  """Compare the main state transitions of the recorded and replayed traces.
+
+  The traces match if they go through the same states, and if tolerance_ms is
+  given, every transition of the replayed trace happens within tolerance_ms
+  of the recorded one.
+
+  Args:
+    recorded, replayed: Trace objects.
+    tolerance_ms: the tolerance of the transition timing, or None to report
+        the timing only.
+
+  Returns:
+    A CompareResult where divergence is the index of the first transition
+    which differs, or None.
+  """
+  expected = recorded.Transitions()
+  actual = replayed.Transitions()
+  divergence = None
+  max_delta_ms = 0
+  for index, (want, got) in enumerate(zip(expected, actual)):
+    if want.state != got.state:
+      divergence = index
+      break
+    delta = abs(got.time_ms - want.time_ms)
+    max_delta_ms = max(max_delta_ms, delta)
+    if tolerance_ms is not None and delta > tolerance_ms:
+      divergence = index
+      break
+  if divergence is None and len(expected) != len(actual):
+    divergence = min(len(expected), len(actual))
+
+  return CompareResult(divergence is None, len(expected), divergence,
+                       max_delta_ms, _Mean(MoveDurations(expected)),
+                       _Mean(MoveDurations(actual)))
+
+
+def ReplayTrace(trace_path, binary=DEFAULT_REPLAY_BINARY, profile=None):
+  """Replay a trace through the firmware and parse the resulting trace."""
+  command = [binary]
+  if profile:
+    command.append('--profile=%s' % profile)
+  command.append(trace_path)
+  return ParseTrace(subprocess.check_output(command, encoding='ascii'))
+
+
+def FormatResult(trace_path, result, recorded, replayed):
+  """Format a CompareResult in a line."""
+  if result.matched:
+    status = 'OK'
+  else:
+    index = result.divergence
+    want = recorded.Transitions()[index:index + 1]
+    got = replayed.Transitions()[index:index + 1]
+    status = 'DIVERGED at transition %d: recorded %s, replayed %s' % (
+        index, tuple(want[0]) if want else None, tuple(got[0]) if got else None)
+
+  line = '%s: %s, %d transitions, max delta %d ms' % (
+      trace_path, status, result.num_transitions, result.max_delta_ms)
+  if result.recorded_move_ms is not None and result.replayed_move_ms is not None:
+    line += ', mean move %.1f -> %.1f ms (%+.1f)' % (
+        result.recorded_move_ms, result.replayed_move_ms,
+        result.replayed_move_ms - result.recorded_move_ms)
+  return line
+
+
+def _ReplayOne(args):
+  trace_path, binary, profile, tolerance_ms = args
+  with open(trace_path) as f:
+    recorded = ParseTrace(f.read())
+  replayed = ReplayTrace(trace_path, binary, profile)
+  result = Compare(recorded, replayed, tolerance_ms)
+  return result, FormatResult(trace_path, result, recorded, replayed)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('traces', nargs='+', help='the recorded traces')
+  parser.add_argument('--profile',
+                      help='replay with this motion profile instead of the '
+                      'recorded one, in the format of MotionProfiles::parse()')
+  parser.add_argument('--tolerance-ms', type=float, default=None,
+                      help='fail if a transition moves by more than this')
+  parser.add_argument('--binary', default=DEFAULT_REPLAY_BINARY,
+                      help='the replay_trace binary built in sim')
+  parser.add_argument('--jobs', '-j', type=int, default=os.cpu_count(),
+                      help='the number of traces replayed in parallel')
+  args = parser.parse_args()
+  logging.basicConfig(level=logging.INFO)
+
+  jobs = [(path, args.binary, args.profile, args.tolerance_ms)
+          for path in args.traces]
+  with multiprocessing.Pool(args.jobs) as pool:
+    outcomes = pool.map(_ReplayOne, jobs)
+
+  failures = 0
+  move_changes = []
+  for result, line in outcomes:
+    print(line)
+    failures += not result.matched
+    if (result.recorded_move_ms is not None and
+        result.replayed_move_ms is not None):
+      move_changes.append(result.replayed_move_ms - result.recorded_move_ms)
+
+  print('%d traces, %d diverged' % (len(outcomes), failures))
+  if move_changes:
+    print('mean move time change: %+.1f ms' % _Mean(move_changes))
+  sys.exit(1 if failures else 0)
+
+
+if __name__ == '__main__':
+  main()
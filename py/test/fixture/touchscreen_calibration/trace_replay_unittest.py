@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+#
+# Copyright 2014 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for trace_replay."""
+
+import unittest
+
+from cros.factory.test.fixture.touchscreen_calibration import trace_replay
+
+
+def _MakeTrace(transitions, start_millis=1000, noise=''):
+  """Make a trace text with a state vector at each (time_ms, state)."""
+  lines = [noise, '[H12345678,U,d,0,default,6000,2000,213333,3300000,200,200,'
+           '100,500]']
+  for time_ms, state in transitions:
+    millis = (start_millis + time_ms) % trace_replay.MILLIS_WRAP
+    lines.append('<%s1001000000.6000.0.%d>' % (state, millis))
+    lines.append('[S%d,2c]' % (millis * 1000 % (1 << 32)))
+  return '\n'.join(lines)
+
+
+class ParseTraceTest(unittest.TestCase):
+
+  def testParse(self):
+    trace = trace_replay.ParseTrace(
+        _MakeTrace([(0, 'U'), (10, 'd'), (5010, 'D')], noise='<i10.0.0.1>'))
+    self.assertEqual(trace.header.state, 'U')
+    self.assertEqual(trace.header.sensor_bits, 0xd)
+    self.assertEqual(trace.header.profile,
+                     '0,default,6000,2000,213333,3300000,200,200,100,500')
+    self.assertEqual([frame.time_ms for frame in trace.states], [0, 10, 5010])
+    self.assertEqual(trace.num_events, 3)
+
+  def testNoHeader(self):
+    self.assertRaises(trace_replay.TraceError, trace_replay.ParseTrace,
+                      '<U1001000000.6000.0.1000>')
+
+  def testMillisWrapAround(self):
+    trace = trace_replay.ParseTrace(
+        _MakeTrace([(0, 'U'), (100, 'd')],
+                   start_millis=trace_replay.MILLIS_WRAP - 50))
+    self.assertEqual(trace.Transitions()[-1].time_ms, 100)
+
+  def testTransitionsAndMoves(self):
+    trace = trace_replay.ParseTrace(_MakeTrace(
+        [(0, 'U'), (5, 'U'), (10, 'd'), (5010, 'D'), (6000, 'u'),
+         (11000, 'U')]))
+    self.assertEqual([tuple(t) for t in trace.Transitions()],
+                     [(0, 'U'), (10, 'd'), (5010, 'D'), (6000, 'u'),
+                      (11000, 'U')])
+    self.assertEqual(trace_replay.MoveDurations(trace.Transitions()),
+                     [5000, 5000])
+
+
+class CompareTest(unittest.TestCase):
+
+  def setUp(self):
+    self.recorded = trace_replay.ParseTrace(
+        _MakeTrace([(0, 'U'), (10, 'd'), (5010, 'D')]))
+
+  def testMatchedFaster(self):
+    replayed = trace_replay.ParseTrace(
+        _MakeTrace([(0, 'U'), (10, 'd'), (4810, 'D')]))
+    result = trace_replay.Compare(self.recorded, replayed)
+    self.assertTrue(result.matched)
+    self.assertEqual(result.max_delta_ms, 200)
+    self.assertEqual(result.recorded_move_ms, 5000)
+    self.assertEqual(result.replayed_move_ms, 4800)
+
+  def testTolerance(self):
+    replayed = trace_replay.ParseTrace(
+        _MakeTrace([(0, 'U'), (10, 'd'), (4810, 'D')]))
+    result = trace_replay.Compare(self.recorded, replayed, tolerance_ms=100)
+    self.assertFalse(result.matched)
+    self.assertEqual(result.divergence, 2)
+
+  def testDivergedState(self):
+    replayed = trace_replay.ParseTrace(
+        _MakeTrace([(0, 'U'), (10, 'd'), (3000, 'e')]))
+    result = trace_replay.Compare(self.recorded, replayed)
+    self.assertFalse(result.matched)
+    self.assertEqual(result.divergence, 2)
+
+  def testMissingTransition(self):
+    replayed = trace_replay.ParseTrace(_MakeTrace([(0, 'U'), (10, 'd')]))
+    result = trace_replay.Compare(self.recorded, replayed)
+    self.assertFalse(result.matched)
+    self.assertEqual(result.divergence, 2)
+
+
+if __name__ == '__main__':
+  unittest.main()
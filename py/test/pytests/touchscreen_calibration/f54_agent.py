@@ -0,0 +1,284 @@
+#!/usr/bin/env python3
+#
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""An agent on the DUT serving the F54 reports of a Synaptics touch device.
+
+f54test opens the hidraw device, initializes the vendor library and resets the
+touch controller on every run. This agent opens the hidraw device once and
+serves the reports over its stdin and stdout, so that a read costs only the
+transfer of the report.
+
+The agent talks RMI4 over HID like drivers/hid/hid-rmi.c, and gets the reports
+of the F54 analog function like drivers/input/rmi4/rmi_f54.c.
+
+A request is REQUEST, i.e., an op, a report type and the byte count of the
+report. A response is RESPONSE_HEADER, i.e., MAGIC, a status and the byte
+count of the payload, followed by the payload, which is the result of the op
+or the error message.
+
+Note: this module does not have any dependency on factory stuffs so that
+      it could be copied to and run on the DUT:
+
+  $ python3 f54_agent.py /dev/hidraw0
+"""
+
+import argparse
+import collections
+import os
+import select
+import struct
+import sys
+import time
+
+
+REQUEST = struct.Struct('<cBI')
+RESPONSE_HEADER = struct.Struct('<2sBI')
+MAGIC = b'F5'
+
+# The payload of OP_INFO is INFO, i.e., the numbers of the tx and rx electrodes.
+OP_INFO = b'i'
+OP_READ = b'r'
+# Reset the device, which recalibrates its baseline.
+OP_RESET = b'c'
+OP_QUIT = b'q'
+INFO = struct.Struct('<BB')
+
+STATUS_OK = 0
+STATUS_ERROR = 1
+
+# The RMI4 over HID reports.
+WRITE_REPORT_ID = 0x09
+READ_ADDR_REPORT_ID = 0x0a
+READ_DATA_REPORT_ID = 0x0b
+INPUT_REPORT_MAX_SIZE = 4096
+
+# The page description table of each page lists the functions downwards.
+PDT_START = 0x00e9
+PDT_ENTRY_SIZE = 6
+PDT_PAGES = 4
+FunctionDescriptor = collections.namedtuple(
+    'FunctionDescriptor',
+    ['query_base', 'command_base', 'control_base', 'data_base'])
+
+F01 = 0x01
+F01_CMD_DEVICE_RESET = 0x01
+RESET_DELAY = 0.1
+
+F54 = 0x54
+F54_FIFO_OFFSET = 1
+F54_REPORT_DATA_OFFSET = 3
+F54_GET_REPORT = 0x01
+F54_REPORT_CHUNK_SIZE = 256
+# The TRx tests reconfigure the analog front end, so the device is reset after
+# them like f54test does after every report.
+TRX_REPORT_TYPES = (24, 25, 26)
+
+READ_TIMEOUT = 1
+GET_REPORT_TIMEOUT = 2
+POLL_INTERVAL = 0.005
+
+
+class Error(Exception):
+  pass
+
+
+class RMIDevice:
+  """A Synaptics RMI4 device on a hidraw node.
+
+  Args:
+    fd: the file descriptor of the hidraw node.
+    output_report_size: pad the output reports to this size, or 0 not to pad.
+  """
+
+  def __init__(self, fd, output_report_size=0, timeout=READ_TIMEOUT):
+    self.fd = fd
+    self.output_report_size = output_report_size
+    self.timeout = timeout
+
+  def _WriteReport(self, report):
+    report = report.ljust(self.output_report_size, b'\0')
+    if os.write(self.fd, report) != len(report):
+      raise Error('Short write of the report 0x%02x' % report[0])
+
+  def Write(self, addr, data):
+    """Write the bytes to the registers from the address."""
+    self._WriteReport(struct.pack('<BBH', WRITE_REPORT_ID, len(data), addr) +
+                      bytes(data))
+
+  def Read(self, addr, size):
+    """Read the bytes of the registers from the address.
+
+    The input reports other than the read data, e.g., the attention reports,
+    are skipped.
+    """
+    self._WriteReport(struct.pack('<BBHH', READ_ADDR_REPORT_ID, 0, addr, size))
+    data = b''
+    deadline = time.time() + self.timeout
+    while len(data) < size:
+      remaining = max(0, deadline - time.time())
+      if not select.select([self.fd], [], [], remaining)[0]:
+        raise Error('Timed out reading %d bytes at 0x%04x' % (size, addr))
+      report = os.read(self.fd, INPUT_REPORT_MAX_SIZE)
+      if len(report) >= 2 and report[0] == READ_DATA_REPORT_ID:
+        data += report[2:2 + report[1]]
+    return data[:size]
+
+  def ScanPDT(self):
+    """Get the FunctionDescriptors of the functions by their numbers."""
+    functions = {}
+    for page in range(PDT_PAGES):
+      addr = (page << 8) | PDT_START
+      while addr & 0xff >= PDT_ENTRY_SIZE:
+        entry = self.Read(addr, PDT_ENTRY_SIZE)
+        if entry[5] in (0x00, 0xff):
+          break
+        functions[entry[5]] = FunctionDescriptor(
+            *[(page << 8) | base for base in entry[:4]])
+        addr -= PDT_ENTRY_SIZE
+    return functions
+
+
+class F54Reader:
+  """Gets the F54 reports of an RMIDevice."""
+
+  def __init__(self, device):
+    self.device = device
+    functions = device.ScanPDT()
+    if F01 not in functions or F54 not in functions:
+      raise Error('No F01 or F54 in the functions %s' %
+                  sorted('%02x' % number for number in functions))
+    self.f01 = functions[F01]
+    self.f54 = functions[F54]
+    self.num_rx, self.num_tx = device.Read(self.f54.query_base, 2)
+
+  def ReadReport(self, report_type, size):
+    """Get the report of the type."""
+    self.device.Write(self.f54.data_base, [report_type])
+    self.device.Write(self.f54.command_base, [F54_GET_REPORT])
+    deadline = time.time() + GET_REPORT_TIMEOUT
+    while self.device.Read(self.f54.command_base, 1)[0] & F54_GET_REPORT:
+      if time.time() > deadline:
+        raise Error('Timed out getting the report %d' % report_type)
+      time.sleep(POLL_INTERVAL)
+
+    report = b''
+    while len(report) < size:
+      self.device.Write(self.f54.data_base + F54_FIFO_OFFSET,
+                        struct.pack('<H', len(report)))
+      report += self.device.Read(self.f54.data_base + F54_REPORT_DATA_OFFSET,
+                                 min(F54_REPORT_CHUNK_SIZE, size - len(report)))
+    if report_type in TRX_REPORT_TYPES:
+      self.Reset()
+    return report
+
+  def Reset(self):
+    self.device.Write(self.f01.command_base, [F01_CMD_DEVICE_RESET])
+    time.sleep(RESET_DELAY)
+
+
+def Serve(reader, stdin, stdout):
+  """Serve the requests from stdin until OP_QUIT or the end of the input."""
+  while True:
+    request = stdin.read(REQUEST.size)
+    if len(request) < REQUEST.size:
+      return
+    op, report_type, size = REQUEST.unpack(request)
+    if op == OP_QUIT:
+      return
+    try:
+      if op == OP_INFO:
+        payload = INFO.pack(reader.num_tx, reader.num_rx)
+      elif op == OP_READ:
+        payload = reader.ReadReport(report_type, size)
+      elif op == OP_RESET:
+        reader.Reset()
+        payload = b''
+      else:
+        raise Error('Unknown op %r' % op)
+      status = STATUS_OK
+    except (Error, OSError) as e:
+      status, payload = STATUS_ERROR, str(e).encode('utf-8')
+    stdout.write(RESPONSE_HEADER.pack(MAGIC, status, len(payload)) + payload)
+    stdout.flush()
+
+
+class AgentClient:
+  """A client of the agent through the pipes of its process.
+
+  Args:
+    process: an object like subprocess.Popen with binary stdin and stdout.
+  """
+
+  def __init__(self, process):
+    self.process = process
+
+  def _ReadExactly(self, size):
+    data = b''
+    while len(data) < size:
+      chunk = self.process.stdout.read(size - len(data))
+      if not chunk:
+        raise Error('The agent exited')
+      data += chunk
+    return data
+
+  def _Request(self, op, report_type=0, size=0):
+    try:
+      self.process.stdin.write(REQUEST.pack(op, report_type, size))
+      self.process.stdin.flush()
+    except OSError as e:
+      raise Error('The agent exited: %s' % e)
+    magic, status, length = RESPONSE_HEADER.unpack(
+        self._ReadExactly(RESPONSE_HEADER.size))
+    if magic != MAGIC:
+      raise Error('Bad response %r from the agent' % magic)
+    payload = self._ReadExactly(length)
+    if status != STATUS_OK:
+      raise Error('The agent failed: %s' % payload.decode('utf-8', 'replace'))
+    return payload
+
+  def GetDimensions(self):
+    """Get (num_tx, num_rx), i.e., the numbers of rows and columns."""
+    return INFO.unpack(self._Request(OP_INFO))
+
+  def ReadReport(self, report_type, size):
+    return self._Request(OP_READ, report_type, size)
+
+  def Reset(self):
+    self._Request(OP_RESET)
+
+  def Close(self):
+    try:
+      self.process.stdin.write(REQUEST.pack(OP_QUIT, 0, 0))
+      self.process.stdin.close()
+    except OSError:
+      pass
+    self.process.wait()
+
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+  parser.add_argument('hidraw', help='the hidraw node, e.g., /dev/hidraw0')
+  parser.add_argument('--output-report-size', type=int, default=0,
+                      help='pad the output reports to this size')
+  args = parser.parse_args()
+
+  fd = os.open(args.hidraw, os.O_RDWR)
+  try:
+    reader = F54Reader(RMIDevice(fd, args.output_report_size))
+  except Error as e:
+    # Fail the first request with the error.
+    sys.stdin.buffer.read(REQUEST.size)
+    message = str(e).encode('utf-8')
+    sys.stdout.buffer.write(
+        RESPONSE_HEADER.pack(MAGIC, STATUS_ERROR, len(message)) + message)
+    sys.stdout.buffer.flush()
+    sys.exit(1)
+  Serve(reader, sys.stdin.buffer, sys.stdout.buffer)
+  os.close(fd)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,193 @@
+#!/usr/bin/env python3
+#
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for f54_agent."""
+
+import os
+import socket
+import struct
+import threading
+import unittest
+from unittest import mock
+
+from cros.factory.test.pytests.touchscreen_calibration import f54_agent
+
+
+F01_BASES = (0x10, 0x11, 0x12, 0x13)
+F54_BASES = (0x20, 0x21, 0x22, 0x23)
+NUM_TX = 3
+NUM_RX = 5
+
+
+class FakeRMIDevice(threading.Thread):
+  """A Synaptics RMI4 device behind a hidraw node.
+
+  The hidraw node is one end of a socket pair which keeps the boundaries of
+  the reports. F01 is on page 0 and F54 is on page 1.
+  """
+
+  def __init__(self, chunk_size=7):
+    super(FakeRMIDevice, self).__init__()
+    self.daemon = True
+    self.fd, self._device = socket.socketpair(socket.AF_UNIX,
+                                              socket.SOCK_SEQPACKET)
+    self.chunk_size = chunk_size
+    self.registers = bytearray(0x100 * f54_agent.PDT_PAGES)
+    self._SetPDTEntry(0x00e9, F01_BASES, f54_agent.F01)
+    self._SetPDTEntry(0x01e9, F54_BASES, f54_agent.F54)
+    f54_query = 0x100 | F54_BASES[0]
+    self.registers[f54_query:f54_query + 2] = bytes([NUM_RX, NUM_TX])
+    self.fifo_index = 0
+    self.report = b''
+    self.resets = 0
+    self.pending_polls = 0
+    self.start()
+
+  def _SetPDTEntry(self, addr, bases, number):
+    self.registers[addr:addr + 6] = bytes(bases + (0, number))
+
+  def Close(self):
+    self.fd.shutdown(socket.SHUT_RDWR)
+    self.join()
+    self.fd.close()
+    self._device.close()
+
+  @staticmethod
+  def Report(report_type):
+    if report_type in f54_agent.TRX_REPORT_TYPES:
+      return bytes(range(11))
+    values = [(-1) ** i * i * 100 for i in range(NUM_TX * NUM_RX)]
+    return struct.pack('<%dh' % len(values), *values)
+
+  def _Write(self, addr, data):
+    f54_data = 0x100 | F54_BASES[3]
+    f54_command = 0x100 | F54_BASES[1]
+    if addr == F01_BASES[1] and data[0] & f54_agent.F01_CMD_DEVICE_RESET:
+      self.resets += 1
+    elif addr == f54_data + f54_agent.F54_FIFO_OFFSET:
+      self.fifo_index = struct.unpack('<H', data)[0]
+    elif addr == f54_command and data[0] & f54_agent.F54_GET_REPORT:
+      self.report = self.Report(self.registers[f54_data])
+      # The command bit clears after a few polls.
+      self.pending_polls = 3
+      self.registers[addr] = data[0]
+    else:
+      self.registers[addr:addr + len(data)] = data
+
+  def _Read(self, addr, size):
+    f54_command = 0x100 | F54_BASES[1]
+    if addr == (0x100 | F54_BASES[3]) + f54_agent.F54_REPORT_DATA_OFFSET:
+      data = self.report[self.fifo_index:self.fifo_index + size]
+    else:
+      data = bytes(self.registers[addr:addr + size])
+      if addr == f54_command and self.pending_polls:
+        self.pending_polls -= 1
+        if not self.pending_polls:
+          self.registers[addr] = 0
+    # An attention report of a touch comes in between.
+    self._device.send(bytes([0x0c, 3, 1, 2, 3]))
+    for start in range(0, len(data), self.chunk_size):
+      chunk = data[start:start + self.chunk_size]
+      self._device.send(bytes([f54_agent.READ_DATA_REPORT_ID, len(chunk)]) +
+                        chunk.ljust(self.chunk_size, b'\0'))
+
+  def run(self):
+    while True:
+      report = self._device.recv(64)
+      if not report:
+        return
+      if report[0] == f54_agent.WRITE_REPORT_ID:
+        size, addr = struct.unpack('<BH', report[1:4])
+        self._Write(addr, report[4:4 + size])
+      elif report[0] == f54_agent.READ_ADDR_REPORT_ID:
+        addr, size = struct.unpack('<HH', report[2:6])
+        self._Read(addr, size)
+
+
+class F54ReaderTest(unittest.TestCase):
+
+  def setUp(self):
+    self.device = FakeRMIDevice()
+    self.reader = f54_agent.F54Reader(
+        f54_agent.RMIDevice(self.device.fd.fileno(), output_report_size=16))
+
+  def tearDown(self):
+    self.device.Close()
+
+  def testScan(self):
+    self.assertEqual(self.reader.f54.data_base, 0x100 | F54_BASES[3])
+    self.assertEqual((self.reader.num_tx, self.reader.num_rx), (NUM_TX, NUM_RX))
+
+  def testReadReport(self):
+    size = NUM_TX * NUM_RX * 2
+    with mock.patch.object(f54_agent, 'F54_REPORT_CHUNK_SIZE', 8):
+      self.assertEqual(self.reader.ReadReport(2, size),
+                       FakeRMIDevice.Report(2))
+    self.assertEqual(self.device.resets, 0)
+    self.assertEqual(self.reader.ReadReport(25, 11), bytes(range(11)))
+    self.assertEqual(self.device.resets, 1)
+
+  def testTimeout(self):
+    self.reader.device.timeout = 0.1
+    with mock.patch.object(FakeRMIDevice, '_Read'):
+      self.assertRaisesRegex(f54_agent.Error, 'Timed out reading',
+                             self.reader.device.Read, 0x10, 1)
+
+
+class AgentTest(unittest.TestCase):
+
+  def setUp(self):
+    self.device = FakeRMIDevice()
+    reader = f54_agent.F54Reader(f54_agent.RMIDevice(self.device.fd.fileno()))
+    request_read, request_write = os.pipe()
+    response_read, response_write = os.pipe()
+    self.process = mock.Mock(stdin=os.fdopen(request_write, 'wb'),
+                             stdout=os.fdopen(response_read, 'rb'))
+    stdin = os.fdopen(request_read, 'rb')
+    stdout = os.fdopen(response_write, 'wb')
+
+    def _Serve():
+      with stdin, stdout:
+        f54_agent.Serve(reader, stdin, stdout)
+
+    self.server = threading.Thread(target=_Serve)
+    self.server.start()
+    self.client = f54_agent.AgentClient(self.process)
+
+  def tearDown(self):
+    self.client.Close()
+    self.server.join()
+    self.process.stdout.close()
+    self.device.Close()
+
+  def testRequests(self):
+    self.assertEqual(self.client.GetDimensions(), (NUM_TX, NUM_RX))
+    for unused_i in range(2):
+      self.assertEqual(self.client.ReadReport(3, NUM_TX * NUM_RX * 2),
+                       FakeRMIDevice.Report(3))
+    self.client.Reset()
+    self.assertEqual(self.device.resets, 1)
+
+  def testError(self):
+    # The device ignores the writes, so the command bit never clears.
+    self.device.registers[0x100 | F54_BASES[1]] = f54_agent.F54_GET_REPORT
+    with mock.patch.object(f54_agent, 'GET_REPORT_TIMEOUT', 0), \
+        mock.patch.object(FakeRMIDevice, '_Write'):
+      self.assertRaisesRegex(f54_agent.Error, 'Timed out getting',
+                             self.client.ReadReport, 2, 30)
+    # The agent still serves the next request.
+    self.assertEqual(self.client.GetDimensions(), (NUM_TX, NUM_RX))
+
+  def testAgentExited(self):
+    self.process.stdin.write(f54_agent.REQUEST.pack(f54_agent.OP_QUIT, 0, 0))
+    self.process.stdin.flush()
+    self.server.join()
+    self.assertRaisesRegex(f54_agent.Error, 'exited',
+                           self.client.GetDimensions)
+
+
+if __name__ == '__main__':
+  unittest.main()
@@ -11,15 +11,21 @@ Note: this module does not have any dependency on factory stuffs so that
       it could be run as a pure server e.g. on a Beagle Bone.
 """
 
-import codecs
+import array
 import configparser
+import hashlib
+import itertools
 import logging
 import os
 import re
+import shlex
+import subprocess
 import sys
+import tarfile
 import time
 import xmlrpc.server
 
+from cros.factory.test.pytests.touchscreen_calibration import f54_agent
 from cros.factory.test.pytests.touchscreen_calibration import touchscreen_calibration_utils as utils  # pylint: disable=line-too-long
 
 
@@ -57,6 +63,68 @@ def ScpCommand(ip, filename, remote_path):
   return utils.IsSuccessful(utils.SimpleSystem(' '.join(remote_args)))
 
 
+def _MakeImage(values, num_rows, num_cols):
+  """Shape an array of values into a num_rows x num_cols memoryview."""
+  if not num_rows or not num_cols:
+    # A memoryview could not have a 0 in its shape.
+    return memoryview(values)
+  return memoryview(values).cast('B').cast(values.typecode,
+                                           (num_rows, num_cols))
+
+
+def DecodeImage(data, num_rows, num_cols, typecode='h'):
+  """Decode an image of little-endian 16-bit values.
+
+  Args:
+    data: the bytes of num_rows rows, each of which contains num_cols
+        consecutive values.
+    typecode: the array typecode of the values, 'h' or 'H'.
+
+  Returns:
+    a num_rows x num_cols memoryview of the values in one contiguous buffer,
+    which is indexed like image[row, col]. ImageRows() converts it to the
+    lists of rows to be sent as JSON or through XML-RPC.
+  """
+  values = array.array(typecode)
+  if len(data) != num_rows * num_cols * values.itemsize:
+    raise Error('Expected %d values but got %d bytes.' %
+                (num_rows * num_cols, len(data)))
+  values.frombytes(data)
+  if sys.byteorder != 'little':
+    values.byteswap()
+  return _MakeImage(values, num_rows, num_cols)
+
+
+def AsImage(data):
+  """Get an image as a memoryview like the one returned by DecodeImage().
+
+  Args:
+    data: the memoryview, which is returned as is, or the lists of rows, e.g.,
+        received through XML-RPC or parsed from the output of f54test.
+  """
+  if isinstance(data, memoryview):
+    return data
+  num_cols = len(data[0]) if data else 0
+  return _MakeImage(array.array('i', itertools.chain.from_iterable(data)),
+                    len(data), num_cols)
+
+
+def ImageRows(image):
+  """Get the lists of rows of an image, e.g., to send it as JSON."""
+  return image.tolist() if isinstance(image, memoryview) else image
+
+
+def IterImage(image):
+  """Iterate over (row, col, value) of the sensors of an image."""
+  image = AsImage(image)
+  if image.ndim != 2:
+    return
+  num_cols = image.shape[1]
+  for index, value in enumerate(image.cast('B').cast(image.format)):
+    row, col = divmod(index, num_cols)
+    yield row, col, value
+
+
 class TSConfig:
   """Manage the touchscreen config data."""
 
@@ -93,7 +161,11 @@ class BaseSensorService:
     self.config = TSConfig(board)
     self.log = log
     kernel_module_name = self.config.Read('Misc', 'kernel_module_name')
-    self.kernel_module = utils.KernelModule(kernel_module_name)
+    self.kernel_module = utils.KernelModule(
+        kernel_module_name,
+        sysfs_entry=self.config.Read('Sensors', 'sysfs_entry'),
+        keep_loaded=(
+            self.config.Read('Misc', 'KEEP_KERNEL_MODULE_LOADED') == 'True'))
     self.delta_lower_bound = int(
         self.config.Read('TouchSensors', 'DELTA_LOWER_BOUND'))
     self.delta_higher_bound = int(
@@ -118,7 +190,7 @@ class BaseSensorService:
     """Implementation of sensor reading method.
 
     Returns:
-      Sensor data: a list of lists of row sensor data
+      Sensor data: an image like the one returned by DecodeImage()
     """
     raise NotImplementedError(
         'Should implement the Read() method in the subclass.')
@@ -143,22 +215,21 @@ class BaseSensorService:
     failed_sensors = []
     min_value = float('inf')
     max_value = float('-inf')
-    mean = (sum([sum(row_data) for row_data in data]) /
-            sum([len(row_data) for row_data in data]))
-    max_row_number = len(data) - 1
-    max_col_number = len(data[0]) - 1
-    for row, row_data in enumerate(data):
-      for col, value in enumerate(row_data):
-        min_value = min(min_value, value)
-        max_value = max(max_value, value)
-        normalized_deviation = abs(value - mean) / mean
-        if IsEdge(row, col):
-          threshold = self.normalized_edge_deviation_threshold
-        else:
-          threshold = self.normalized_deviation_threshold
-        if normalized_deviation > threshold:
-          failed_sensors.append((row, col, value))
-          test_pass = False
+    image = AsImage(data)
+    values = image.cast('B').cast(image.format)
+    mean = sum(values) / len(values)
+    max_row_number, max_col_number = [size - 1 for size in image.shape]
+    for row, col, value in IterImage(image):
+      min_value = min(min_value, value)
+      max_value = max(max_value, value)
+      normalized_deviation = abs(value - mean) / mean
+      if IsEdge(row, col):
+        threshold = self.normalized_edge_deviation_threshold
+      else:
+        threshold = self.normalized_deviation_threshold
+      if normalized_deviation > threshold:
+        failed_sensors.append((row, col, value))
+        test_pass = False
     return test_pass, failed_sensors, min_value, max_value
 
   def VerifyDeltasUntouched(self, data):
@@ -171,13 +242,12 @@ class BaseSensorService:
     failed_sensors = []
     min_value = float('inf')
     max_value = float('-inf')
-    for row, row_data in enumerate(data):
-      for col, value in enumerate(row_data):
-        min_value = min(min_value, value)
-        max_value = max(max_value, value)
-        if abs(value) > self.delta_untouched_higher_bound:
-          failed_sensors.append((row, col, value))
-          test_pass = False
+    for row, col, value in IterImage(data):
+      min_value = min(min_value, value)
+      max_value = max(max_value, value)
+      if abs(value) > self.delta_untouched_higher_bound:
+        failed_sensors.append((row, col, value))
+        test_pass = False
     return test_pass, failed_sensors, min_value, max_value
 
   def _VerifyDeltasTouched(self, data, touched_cols):
@@ -190,9 +260,10 @@ class BaseSensorService:
     failed_sensors = []
     min_value = float('inf')
     max_value = float('-inf')
-    for row, row_data in enumerate(data):
+    image = AsImage(data)
+    for row in range(len(image)):
       for col in touched_cols:
-        value = row_data[col]
+        value = image[row, col]
         min_value = min(min_value, value)
         max_value = max(max_value, value)
         if value < self.delta_lower_bound or value > self.delta_higher_bound:
@@ -217,11 +288,12 @@ class BaseSensorService:
     return True
 
   def PreTest(self):
-    """A method to invoke before conducting the test."""
-    if not self.kernel_module.IsLoaded():
-      self.kernel_module.Insert()
-      time.sleep(1)
-    return True
+    """A method to invoke before conducting the test.
+
+    Returns:
+      True if the touch device is detected.
+    """
+    return self.kernel_module.Probe()
 
   def PostTest(self):
     """An optional method to invoke after conducting the test."""
@@ -233,6 +305,21 @@ class SensorServiceSamus(BaseSensorService):
 
   On Samus, the sensor data are manipulated through sys fs and kernel debug fs.
   """
+  # A write to the sys fs object entry looks like 'TYPE OFFSET VALUE' in hex.
+  # Reading the entry shows the registers of the objects like
+  #   Object[1] (Type 7)
+  #     [ 0]: 20 (32)
+  REGISTER_WRITE_RE = re.compile(
+      r'^\s*([0-9a-f]+)\s+([0-9a-f]+)\s+([0-9a-f]+)\s*$', re.I)
+  OBJECT_TYPE_RE = re.compile(r'\(Type (\d+)\)')
+  OBJECT_REGISTER_RE = re.compile(r'^\s*\[\s*(\d+)\]:\s*([0-9a-f]+)', re.I)
+  # A write to the command processor (T6), e.g., reset or calibrate, triggers
+  # an action rather than sets a value, and its registers read back as 0 once
+  # the action is done. So the writes to it are never skipped nor read back.
+  COMMAND_OBJECT_TYPES = (6,)
+  SYSFS_WRITE_DELAY = 0.1
+  SYSFS_READBACK_TIMEOUT = 1
+  SYSFS_READBACK_INTERVAL = 0.01
 
   def __init__(self, log=None):
     super(SensorServiceSamus, self).__init__(SAMUS, log=log)
@@ -257,7 +344,7 @@ class SensorServiceSamus(BaseSensorService):
 
   def PostTest(self):
     """A method to invoke after conducting the test."""
-    return self.kernel_module.Remove()
+    return self.kernel_module.Release()
 
   def _Make_Symlink(self, target, link_name):
     """Make the symlink to the target."""
@@ -295,21 +382,26 @@ class SensorServiceSamus(BaseSensorService):
       section_items = []
       return False
 
+    # The register writes between the updates are written in a batch.
+    contents = []
     for command, description in section_items:
       self.log.info('  %s: %s', command, description)
       if command.startswith('update_'):
         if description == 'None':
           continue
+        if contents and self.WriteSysfsBatch(contents) is None:
+          return False
+        contents = []
         # Try to auto update the touch firmware/configuration
         config_filename, link_name = description.split()
         if not self._TouchFileUpdate(config_filename, link_name,
                                      update_fw=command.endswith('_fw')):
           self.log.error('Failed to update touch fw/cfg: ', str(section_items))
           return False
-      elif not self.WriteSysfs(command):
+      else:
         # Try to update the configuration registers.
-        return False
-    return True
+        contents.append(command)
+    return not contents or self.WriteSysfsBatch(contents) is not None
 
   def CheckStatus(self):
     """Checks if the touchscreen sysfs object is present.
@@ -335,6 +427,110 @@ class SensorServiceSamus(BaseSensorService):
     time.sleep(0.1)
     return True
 
+  @classmethod
+  def _ParseRegisterWrite(cls, content):
+    """Parse a register write.
+
+    Returns:
+      ((type, offset), value), or None if the content is not a register write.
+    """
+    result = cls.REGISTER_WRITE_RE.match(content)
+    if not result:
+      return None
+    object_type, offset, value = [int(field, 16) for field in result.groups()]
+    return (object_type, offset), value
+
+  @classmethod
+  def ParseSysfsRegisters(cls, text):
+    """Parse the registers shown by the sys fs object entry.
+
+    Returns:
+      a dict of (type, offset) to the register value
+    """
+    registers = {}
+    object_type = None
+    for line in text.splitlines():
+      result = cls.OBJECT_TYPE_RE.search(line)
+      if result:
+        object_type = int(result.group(1))
+        continue
+      result = cls.OBJECT_REGISTER_RE.match(line)
+      if result and object_type is not None:
+        registers[object_type, int(result.group(1))] = int(result.group(2), 16)
+    return registers
+
+  def ReadSysfsRegisters(self):
+    """Read the registers from sys fs.
+
+    Returns:
+      a dict of (type, offset) to the register value, which is empty if the
+      registers could not be read
+    """
+    try:
+      with open(self.sysfs_entry) as f:
+        return self.ParseSysfsRegisters(f.read())
+    except Exception as e:
+      self.log.info('ReadSysfsRegisters failed: %s' % e)
+      return {}
+
+  def WriteSysfsBatch(self, contents):
+    """Writes a batch of contents to sysfs.
+
+    The writes which would not change the registers are skipped, except the
+    writes to COMMAND_OBJECT_TYPES. The others are written through one open of
+    the sysfs entry, and then the registers are read back until they hold the
+    written values. If some of the writes could not be read back, e.g., the
+    commands, it waits for SYSFS_WRITE_DELAY once instead.
+
+    Args:
+      contents: the list of contents to be written to sysfs
+
+    Returns:
+      the list of the contents which were written, or None on failure
+    """
+    current = self.ReadSysfsRegisters()
+    verifiable = bool(current)
+    expected = {}
+    changed = []
+    for content in contents:
+      write = self._ParseRegisterWrite(content)
+      if write is None or write[0][0] in self.COMMAND_OBJECT_TYPES:
+        verifiable = False
+      elif expected.get(write[0], current.get(write[0])) == write[1]:
+        continue
+      else:
+        expected[write[0]] = write[1]
+      changed.append(content)
+    self.log.info('WriteSysfsBatch: %d of %d writes needed: %s',
+                  len(changed), len(contents), changed)
+    if not changed:
+      return changed
+
+    try:
+      fd = os.open(self.sysfs_entry, os.O_WRONLY)
+      try:
+        for content in changed:
+          os.write(fd, content.encode('utf-8'))
+      finally:
+        os.close(fd)
+    except Exception as e:
+      self.log.info('WriteSysfsBatch failed to write %s: %s' % (content, e))
+      return None
+
+    if not verifiable:
+      time.sleep(self.SYSFS_WRITE_DELAY)
+      return changed
+    deadline = time.time() + self.SYSFS_READBACK_TIMEOUT
+    while True:
+      registers = self.ReadSysfsRegisters()
+      if all(registers.get(register) == value
+             for register, value in expected.items()):
+        return changed
+      if time.time() > deadline:
+        self.log.info('WriteSysfsBatch: registers not updated: %s' % changed)
+        return None
+      time.sleep(self.SYSFS_READBACK_INTERVAL)
+
   def Read(self, category):
     """Reads touchscreen sensors raw data.
 
@@ -342,28 +538,14 @@ class SensorServiceSamus(BaseSensorService):
       category: could be 'deltas' or 'refs'.
 
     Returns:
-      the list of raw sensor values
+      the image of the raw sensor values
     """
     debugfs = '%s/%s' % (self.debugfs, category)
+    # The debug fs content is composed of num_rows, where each row
+    # contains (num_cols * 2) bytes of num_cols consecutive sensor values.
     with open(debugfs, 'rb') as f:
-      # The debug fs content is composed of num_rows, where each row
-      # contains (num_cols * 2) bytes of num_cols consecutive sensor values.
-      num_bytes_per_row = self.num_cols * 2
-      out_data = []
-      for _ in range(self.num_rows):
-        row_data = f.read(num_bytes_per_row)
-        values = []
-        for i in range(self.num_cols):
-          # Correct endianness
-          s = row_data[i * 2 : i * 2 + 2][::-1]
-          # TODO(kerker) Use int.from_bytes(s, 'big', signed=True) in py3
-          val = int(codecs.encode(s, 'hex'), 16)
-          # Correct signed value
-          if val > 32768:
-            val = val - 65535
-          values.append(val)
-        out_data.append(values)
-    return out_data
+      data = f.read(self.num_rows * self.num_cols * 2)
+    return DecodeImage(data, self.num_rows, self.num_cols)
 
   def Verify(self, data):
     """Verify sensor data.
@@ -381,7 +563,9 @@ class SensorServiceSamus(BaseSensorService):
 class SensorServiceRyu(BaseSensorService):
   """Sensor services for Ryu.
 
-  On Ryu, the sensor data are provided by a user-level program f54test.
+  On Ryu, the sensor data are provided by a user-level program f54test, or by
+  f54_agent.py which keeps running on the DUT to serve the reports without
+  launching f54test and resetting the device for every read.
   """
   # Refer to the vendor developer guide for details of the various report types.
   REPORT_TYPE = {'deltas': 2, 'refs': 3,
@@ -393,10 +577,14 @@ class SensorServiceRyu(BaseSensorService):
           [0x00, 0x00, 0xfc, 0xff, 0xff, 0xff, 0xff, 0xff, 0x1f, 0x00, 0x00],
       'trx-shorts':
           [0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00]}
+  # The array typecodes of the values of the image reports.
+  IMAGE_FORMAT = {'deltas': 'h', 'refs': 'H'}
+  HIDRAW_DEVICE = '/dev/hidraw0'
+  AGENT = 'f54_agent.py'
 
   def __init__(self, ip, dut, remote_bin_root='', remote_data_dir='', tool='',
                fw_update_tool='', hid_tool='', fw_file='', install_flag=True,
-               log=None):
+               use_agent=False, log=None):
     super(SensorServiceRyu, self).__init__(RYU, log=log)
     self.ip = ip
     self.dut = dut
@@ -406,21 +594,21 @@ class SensorServiceRyu(BaseSensorService):
     self.fw_update_tool = fw_update_tool
     self.hid_tool = hid_tool
     self.fw_file = fw_file
+    self.use_agent = use_agent
+    self.agent = None
 
     self.remote_tool_bin_dir = os.path.join(self.remote_bin_root, 'bin')
     self.src_dir = os.path.join(os.path.dirname(__file__), 'boards', self.board)
     self.read_cmd_prefix = '%s -r ' % self._GetToolPath(tool)
-    self.check_cmd = 'test -e %s'
     self.num_rows = None
     self.num_cols = None
 
     if install_flag:
-      self.dut.Call('mount -o remount,rw ' + self.remote_bin_root)
       if self.InstallFiles():
         self.log.info('Sucessfully installed files.')
       else:
         self.log.error('Failed to install files.')
-      self.Read('deltas')
+      self._ReadDimensions()
       self.status_flag = self.num_rows is not None and self.num_cols is not None
     else:
       self.status_flag = True
@@ -433,31 +621,154 @@ class SensorServiceRyu(BaseSensorService):
     """Return the filepath of a data file."""
     return os.path.join(self.remote_data_dir, filename)
 
-  def _CheckFileExistence(self, filepath):
-    """Check if the file exists in the DUT."""
-    return utils.IsSuccessful(self.dut.Call(self.check_cmd % filepath))
+  def _ReadDimensions(self):
+    """Read the numbers of rows and columns."""
+    if self._GetAgent():
+      return
+    self.Read('deltas')
+
+  def _GetAgent(self):
+    """Get the client of the agent, starting it on the first use.
+
+    The agent exits at the end of its input, i.e., when this process exits.
+
+    Returns:
+      The f54_agent.AgentClient, or None if the agent is not used.
+    """
+    if not self.use_agent or self.agent:
+      return self.agent
+    try:
+      process = self.dut.Popen(
+          ['python3', self._GetToolPath(self.AGENT), self.HIDRAW_DEVICE],
+          stdin=subprocess.PIPE, stdout=subprocess.PIPE, encoding=None)
+    except Exception as e:
+      self._StopAgent(e)
+      return None
+    self.agent = f54_agent.AgentClient(process)
+    try:
+      self.num_rows, self.num_cols = self.agent.GetDimensions()
+    except f54_agent.Error as e:
+      self._StopAgent(e)
+    return self.agent
+
+  def _CloseAgent(self):
+    if self.agent:
+      self.agent.Close()
+      self.agent = None
+
+  def _StopAgent(self, error):
+    """Stop the agent after an error and fall back to f54test."""
+    self.log.warning('Fall back to %s: %s', self.tool, error)
+    self._CloseAgent()
+    self.use_agent = False
+
+  def _ReadReport(self, category, size):
+    """Read a report through the agent.
+
+    Returns:
+      The bytes of the report, or None if the agent is not used.
+    """
+    agent = self._GetAgent()
+    if not agent:
+      return None
+    try:
+      return agent.ReadReport(self.REPORT_TYPE[category], size)
+    except f54_agent.Error as e:
+      self._StopAgent(e)
+      return None
+
+  def _GetInstallBundle(self):
+    """Get the files to install.
+
+    Returns:
+      a dict of the remote file paths to the local file paths
+    """
+    bundle = {}
+    for dst_dir, filename in ((self.remote_tool_bin_dir, self.tool),
+                              (self.remote_tool_bin_dir, self.fw_update_tool),
+                              (self.remote_tool_bin_dir, self.hid_tool),
+                              (self.remote_data_dir, self.fw_file)):
+      if filename:
+        bundle[os.path.join(dst_dir, filename)] = os.path.join(self.src_dir,
+                                                               filename)
+    if self.use_agent:
+      bundle[self._GetToolPath(self.AGENT)] = os.path.join(
+          os.path.dirname(os.path.abspath(__file__)), self.AGENT)
+    return bundle
+
+  @staticmethod
+  def _HashFile(filepath):
+    with open(filepath, 'rb') as f:
+      return hashlib.sha1(f.read()).hexdigest()
+
+  def _GetRemoteHashes(self, filepaths):
+    """Get the sha1 of the remote files in one call.
+
+    Returns:
+      a dict of the existing remote file paths to their sha1
+    """
+    output = self.dut.CheckOutput(
+        'sha1sum %s 2>/dev/null; true' %
+        ' '.join(shlex.quote(filepath) for filepath in filepaths))
+    hashes = {}
+    for line in output.splitlines():
+      digest, unused_sep, filepath = line.partition('  ')
+      hashes[filepath] = digest
+    return hashes
+
+  def _SendFiles(self, bundle):
+    """Send the files through one tar stream extracted at the DUT root.
+
+    Returns:
+      True if the files are extracted.
+    """
+    def _OwnedByRoot(tarinfo):
+      tarinfo.uid = tarinfo.gid = 0
+      tarinfo.uname = tarinfo.gname = 'root'
+      return tarinfo
+
+    process = self.dut.Popen(
+        'mount -o remount,rw %s 2>/dev/null; tar -x -C / -f -' %
+        shlex.quote(self.remote_bin_root), stdin=subprocess.PIPE, encoding=None)
+    try:
+      with tarfile.open(fileobj=process.stdin, mode='w|') as tar:
+        for dst_filepath, src_filepath in sorted(bundle.items()):
+          tar.add(src_filepath, arcname=dst_filepath.lstrip('/'),
+                  filter=_OwnedByRoot)
+    finally:
+      process.stdin.close()
+    return utils.IsSuccessful(process.wait())
 
   def InstallFiles(self):
-    """Install the tools and the data file on the remote machine."""
-    return (self._InstallFile(self.remote_tool_bin_dir, self.tool) and
-            self._InstallFile(self.remote_tool_bin_dir, self.fw_update_tool) and
-            self._InstallFile(self.remote_tool_bin_dir, self.hid_tool) and
-            self._InstallFile(self.remote_data_dir, self.fw_file))
-
-  def _InstallFile(self, dst_dir, filename):
-    """Install the file on the remote machine."""
-    dst_filepath = os.path.join(dst_dir, filename)
-    # If the filename is '' or the dst_filepath already exists, just return.
-    if not filename or self._CheckFileExistence(dst_filepath):
-      return True
+    """Install the tools and the data file on the remote machine.
 
-    src_filepath = os.path.join(self.src_dir, filename)
-    with open(src_filepath) as f:
-      self.dut.WriteFile(dst_filepath, f.read())
-    return True
+    Only the files whose sha1 differ from the remote ones are sent, so that
+    the tools are updated when they change, and nothing is sent in the
+    common case.
+    """
+    bundle = self._GetInstallBundle()
+    remote_hashes = self._GetRemoteHashes(sorted(bundle))
+    stale = {dst_filepath: src_filepath
+             for dst_filepath, src_filepath in bundle.items()
+             if remote_hashes.get(dst_filepath) != self._HashFile(src_filepath)}
+    if not stale:
+      return True
+    self.log.info('Install files: %s', ', '.join(sorted(stale)))
+    return self._SendFiles(stale)
 
   def CalibrateBaseline(self):
-    """Do baseline calibration."""
+    """Do baseline calibration.
+
+    Resetting the device recalibrates its baseline, which f54test does after
+    every read.
+    """
+    agent = self._GetAgent()
+    if agent:
+      try:
+        agent.Reset()
+        return True
+      except f54_agent.Error as e:
+        self._StopAgent(e)
     return len(self.Read('deltas')) > 0
 
   def CheckStatus(self):
@@ -495,7 +806,14 @@ class SensorServiceRyu(BaseSensorService):
     Resetting...
     Reset completed.
 
+    The agent gets the same values as a little-endian binary report instead.
     """
+    if category in self.IMAGE_FORMAT and self._GetAgent():
+      report = self._ReadReport(category, self.num_rows * self.num_cols * 2)
+      if report is not None:
+        return DecodeImage(report, self.num_rows, self.num_cols,
+                           self.IMAGE_FORMAT[category])
+
     out_data = []
     for line in self._ReadRawData(category).splitlines():
       if line.startswith('tx'):
@@ -512,7 +830,7 @@ class SensorServiceRyu(BaseSensorService):
         values = line.split()
         if len(values) == self.num_cols:
           out_data.append(list(map(int, values)))
-    return out_data
+    return AsImage(out_data)
 
   def VerifyDeltasTouched(self, data):
     """Verify sensor data when the panel is touched.
@@ -538,6 +856,10 @@ class SensorServiceRyu(BaseSensorService):
     Returns:
       a list of bytes
     """
+    report = self._ReadReport(category, len(self.EXPECTED_VALUES[category]))
+    if report is not None:
+      return list(report)
+
     out_data = []
     for line in self._ReadRawData(category).splitlines():
       if ':' in line:
@@ -600,17 +922,20 @@ class SensorServiceRyu(BaseSensorService):
       self.log.info(msg % (existing_fw_version, existing_fw_config))
       return True
 
-    cmd_update = '%s -f -d /dev/hidraw0 %s' % (
-        self._GetToolPath(self.fw_update_tool),
+    cmd_update = '%s -f -d %s %s' % (
+        self._GetToolPath(self.fw_update_tool), self.HIDRAW_DEVICE,
         self._GetDataPath(self.fw_file))
     self.log.info('flashing a new firmware %s:%s...' % (fw_version, fw_config))
+    # The agent is started again on the next read of the flashed device.
+    self._CloseAgent()
     return utils.IsSuccessful(self.dut.Call(cmd_update))
 
   def ReadFirmwareVersion(self):
     """Read whether the firmware version and config are correct."""
     fw_version = None
     fw_config = None
-    read_cmd = '%s -o /dev/hidraw0' % self._GetToolPath(self.hid_tool)
+    read_cmd = '%s -o %s' % (self._GetToolPath(self.hid_tool),
+                             self.HIDRAW_DEVICE)
     for line in self.dut.CheckOutput(read_cmd).splitlines():
       if ':' in line:
         name, value = [elm.strip() for elm in line.split(':')]
@@ -673,7 +998,11 @@ def RunXMLRPCSysfsServer(addr, board, log=logging):
     board_sensors = GetSensorServiceClass(board)
     # i.e. kernel_module, as its member. This flag helps register
     # the functions in kernel_module as well.
-    server.register_instance(board_sensors(log), allow_dotted_names=True)
+    sensors = board_sensors(log)
+    server.register_instance(sensors, allow_dotted_names=True)
+    # XML-RPC could not marshal the images, so they are sent as lists of rows.
+    server.register_function(
+        lambda category: ImageRows(sensors.Read(category)), 'Read')
     print('XMLRPCServer(%s) serves sys fs data forever....' % str(addr))
     server.serve_forever()
 
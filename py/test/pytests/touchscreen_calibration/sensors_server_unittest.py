@@ -0,0 +1,243 @@
+#!/usr/bin/env python3
+#
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for sensors_server."""
+
+import os
+import shutil
+import struct
+import tempfile
+import unittest
+from unittest import mock
+
+from cros.factory.test.pytests.touchscreen_calibration import sensors_server
+from cros.factory.utils import sys_interface
+
+
+CONFIG = {
+    ('Misc', 'kernel_module_name'): 'atmel_mxt_ts',
+    ('TouchSensors', 'DELTA_LOWER_BOUND'): '300',
+    ('TouchSensors', 'DELTA_HIGHER_BOUND'): '1900',
+    ('TouchSensors', 'DELTA_UNTOUCHED_HIGHER_BOUND'): '60',
+    ('TouchSensors', 'NORMALIZED_DEVIATION_THRESHOLD'): '0.1',
+    ('TouchSensors', 'NORMALIZED_EDGE_DEVIATION_THRESHOLD'): '0.2',
+    ('TouchSensors', 'NUM_ROWS'): '2',
+    ('TouchSensors', 'NUM_COLS'): '3',
+}
+
+
+class DecodeImageTest(unittest.TestCase):
+
+  def testSigned(self):
+    data = struct.pack('<6h', -1, -32768, 32767, 0, 1, -2)
+    image = sensors_server.DecodeImage(data, 2, 3)
+    self.assertEqual(image.shape, (2, 3))
+    self.assertTrue(image.c_contiguous)
+    self.assertEqual(image[1, 2], -2)
+    self.assertEqual(sensors_server.ImageRows(image),
+                     [[-1, -32768, 32767], [0, 1, -2]])
+
+  def testUnsigned(self):
+    data = struct.pack('<2H', 65535, 1)
+    self.assertEqual(
+        sensors_server.DecodeImage(data, 1, 2, 'H').tolist(), [[65535, 1]])
+
+  def testShortData(self):
+    self.assertRaisesRegex(sensors_server.Error, 'Expected 6 values',
+                           sensors_server.DecodeImage, b'\0' * 11, 2, 3)
+
+  def testAsImage(self):
+    # The rows received through XML-RPC are packed like a decoded image.
+    image = sensors_server.AsImage([[1, 2, 3], [4, 5, 70000]])
+    self.assertEqual(image.shape, (2, 3))
+    self.assertEqual(list(sensors_server.IterImage(image))[-2:],
+                     [(1, 1, 5), (1, 2, 70000)])
+    self.assertIs(sensors_server.AsImage(image), image)
+    self.assertEqual(sensors_server.ImageRows([[1]]), [[1]])
+    self.assertEqual(sensors_server.ImageRows(sensors_server.AsImage([])), [])
+
+
+class SensorServiceSamusTest(unittest.TestCase):
+
+  def setUp(self):
+    self.debugfs = tempfile.mkdtemp()
+    self.sysfs_entry = os.path.join(self.debugfs, 'object')
+    open(self.sysfs_entry, 'w').close()
+    paths = {'debugfs': self.debugfs, 'sysfs_entry': self.sysfs_entry}
+    self.config = mock.patch.object(sensors_server, 'TSConfig').start()
+    self.config.return_value.Read.side_effect = (
+        lambda section, option: CONFIG.get((section, option),
+                                           paths.get(option)))
+    mock.patch.object(sensors_server.utils, 'KernelModule').start()
+    mock.patch.object(sensors_server.utils, 'GetSysfsEntry').start()
+    self.sensors = sensors_server.SensorServiceSamus(log=mock.Mock())
+
+  def tearDown(self):
+    mock.patch.stopall()
+    shutil.rmtree(self.debugfs)
+
+  def testRead(self):
+    with open(os.path.join(self.debugfs, 'deltas'), 'wb') as f:
+      # The trailing bytes beyond the image are ignored.
+      f.write(struct.pack('<7h', 5, -5, 1000, -1000, -1, 0, 9))
+    self.assertEqual(self.sensors.Read('deltas').tolist(),
+                     [[5, -5, 1000], [-1000, -1, 0]])
+
+  def testVerify(self):
+    data = struct.pack('<6h', 10, 500, 20, 30, 2000, -61)
+    image = sensors_server.DecodeImage(data, 2, 3)
+    # The verifiers take the decoded image, or its rows sent back through
+    # XML-RPC.
+    for data in image, image.tolist():
+      self.assertEqual(self.sensors._VerifyDeltasTouched(data, [1]),
+                       (False, [(1, 1, 2000)], 500, 2000))
+      self.assertEqual(self.sensors.VerifyDeltasUntouched(data),
+                       (False, [(0, 1, 500), (1, 1, 2000), (1, 2, -61)], -61,
+                        2000))
+
+  def testVerifyRefs(self):
+    image = sensors_server.AsImage([[100] * 3, [100, 130, 100], [100] * 3])
+    self.assertEqual(self.sensors.VerifyRefs(image),
+                     (False, [(1, 1, 130)], 100, 130))
+
+  def _SetRegisters(self, *registers):
+    """Set the registers read back from sysfs by the successive reads."""
+    mock.patch.object(self.sensors, 'ReadSysfsRegisters',
+                      side_effect=list(registers)).start()
+
+  def _ReadWrites(self):
+    with open(self.sysfs_entry) as f:
+      return f.read()
+
+  def testParseSysfsRegisters(self):
+    text = ('Object[1] (Type 7)\n\t[ 0]: 20 (32)\n\t[ 1]: ff (255)\n'
+            'Object[2] (Type 37)\n\nObject[3] (Type 100)\n\t[10]: 0a (10)\n')
+    self.assertEqual(
+        sensors_server.SensorServiceSamus.ParseSysfsRegisters(text),
+        {(7, 0): 0x20, (7, 1): 0xff, (100, 10): 0x0a})
+
+  def testWriteSysfsBatch(self):
+    self._SetRegisters({(7, 0): 0x20, (7, 1): 0x10},
+                       {(7, 0): 0x20, (7, 1): 0x10},
+                       {(7, 0): 0x20, (7, 1): 0x11, (9, 2): 0x1})
+    with mock.patch.object(sensors_server.time, 'sleep') as sleep:
+      changed = self.sensors.WriteSysfsBatch(['7 0 20', '7 1 11', '9 2 1'])
+    self.assertEqual(changed, ['7 1 11', '9 2 1'])
+    self.assertEqual(self._ReadWrites(), '7 1 119 2 1')
+    # It polled the registers once instead of sleeping for every write.
+    sleep.assert_called_once_with(
+        sensors_server.SensorServiceSamus.SYSFS_READBACK_INTERVAL)
+
+  def testWriteSysfsBatchOrder(self):
+    # The later write of a register wins over the current value.
+    self._SetRegisters({(7, 0): 0x0}, {(7, 0): 0x0})
+    self.assertEqual(self.sensors.WriteSysfsBatch(['7 0 1', '7 0 0']),
+                     ['7 0 1', '7 0 0'])
+
+  def testWriteSysfsBatchTimeout(self):
+    self._SetRegisters(*[{(7, 0): 0x0}] * 1000)
+    with mock.patch.object(sensors_server.SensorServiceSamus,
+                           'SYSFS_READBACK_TIMEOUT', 0.05):
+      self.assertIsNone(self.sensors.WriteSysfsBatch(['7 0 1']))
+
+  def testWriteSysfsBatchNotVerifiable(self):
+    self._SetRegisters({})
+    with mock.patch.object(sensors_server.time, 'sleep') as sleep:
+      self.assertEqual(self.sensors.WriteSysfsBatch(['7 0 1', 'reset']),
+                       ['7 0 1', 'reset'])
+    sleep.assert_called_once_with(
+        sensors_server.SensorServiceSamus.SYSFS_WRITE_DELAY)
+
+  def testWriteSysfsBatchCommand(self):
+    # The reset register of the command processor reads back as 0, but the
+    # reset is still written, and then waited for instead of read back.
+    self._SetRegisters({(6, 0): 0x0, (7, 0): 0x0})
+    with mock.patch.object(sensors_server.time, 'sleep') as sleep:
+      self.assertEqual(self.sensors.WriteSysfsBatch(['7 0 1', '6 0 0']),
+                       ['7 0 1', '6 0 0'])
+    self.assertEqual(self._ReadWrites(), '7 0 16 0 0')
+    sleep.assert_called_once_with(
+        sensors_server.SensorServiceSamus.SYSFS_WRITE_DELAY)
+
+  def testWriteSysfsSection(self):
+    self.config.return_value.GetItems.return_value = [
+        ('7 0 1', 'idle acquisition'), ('update_fw', 'None'),
+        ('7 1 2', 'active acquisition')]
+    self._SetRegisters({(7, 0): 0x1, (7, 1): 0x0}, {(7, 0): 0x1, (7, 1): 0x2})
+    self.assertTrue(self.sensors.PreRead())
+    self.assertEqual(self._ReadWrites(), '7 1 2')
+
+
+class SensorServiceRyuTest(unittest.TestCase):
+
+  def setUp(self):
+    self.temp_dir = tempfile.mkdtemp()
+    self.src_dir = os.path.join(self.temp_dir, 'src')
+    self.remote_root = os.path.join(self.temp_dir, 'dut', 'usr', 'local')
+    os.makedirs(self.src_dir)
+    for filename in ('f54test', 'fw.bin'):
+      self._WriteSource(filename, filename + ' v1')
+    config = mock.patch.object(sensors_server, 'TSConfig').start()
+    config.return_value.Read.side_effect = (
+        lambda section, option: CONFIG.get((section, option)))
+    mock.patch.object(sensors_server.utils, 'KernelModule').start()
+    # Run the commands of the DUT locally.
+    self.dut = mock.Mock(wraps=sys_interface.SystemInterface())
+    self.sensors = sensors_server.SensorServiceRyu(
+        None, self.dut, remote_bin_root=self.remote_root,
+        remote_data_dir=os.path.join(self.remote_root, 'data'),
+        tool='f54test', fw_file='fw.bin', install_flag=False, use_agent=True,
+        log=mock.Mock())
+    self.sensors.src_dir = self.src_dir
+
+  def tearDown(self):
+    mock.patch.stopall()
+    shutil.rmtree(self.temp_dir)
+
+  def _WriteSource(self, filename, content):
+    with open(os.path.join(self.src_dir, filename), 'w') as f:
+      f.write(content)
+    os.chmod(os.path.join(self.src_dir, filename), 0o755)
+
+  def _ReadRemote(self, *path):
+    with open(os.path.join(self.remote_root, *path)) as f:
+      return f.read()
+
+  def _Install(self):
+    self.dut.reset_mock()
+    self.assertTrue(self.sensors.InstallFiles())
+    return len(self.dut.method_calls)
+
+  def testInstallFiles(self):
+    # The first install sends all the files in one stream.
+    self.assertEqual(self._Install(), 2)
+    self.assertEqual(self._ReadRemote('bin', 'f54test'), 'f54test v1')
+    self.assertEqual(self._ReadRemote('data', 'fw.bin'), 'fw.bin v1')
+    self.assertTrue(os.access(os.path.join(self.remote_root, 'bin', 'f54test'),
+                              os.X_OK))
+    with open(sensors_server.f54_agent.__file__) as f:
+      self.assertEqual(self._ReadRemote('bin', 'f54_agent.py'), f.read())
+
+    # The installed files are only checked.
+    self.assertEqual(self._Install(), 1)
+
+    # A stale file is updated.
+    self._WriteSource('f54test', 'f54test v2')
+    self.assertEqual(self._Install(), 2)
+    self.assertEqual(self._ReadRemote('bin', 'f54test'), 'f54test v2')
+    self.assertEqual(self.dut.Popen.call_count, 1)
+
+  def testAgentNotStarted(self):
+    self.dut.Popen.side_effect = OSError('No such file or directory')
+    self.assertIsNone(self.sensors._GetAgent())
+    self.assertFalse(self.sensors.use_agent)
+    # The agent is not tried again.
+    self.assertIsNone(self.sensors._GetAgent())
+    self.assertEqual(self.dut.Popen.call_count, 1)
+
+
+if __name__ == '__main__':
+  unittest.main()
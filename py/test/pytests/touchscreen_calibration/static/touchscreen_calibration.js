@@ -82,6 +82,9 @@ const setTouchscreenStatus = (status) =>
 
 const showProbeState = (state) => setStatus('probe-state', state, true);
 
+const showFixtureDrift = (metrics) =>
+    setStatus('fixture-drift', metrics || 'None', !metrics);
+
 const setHostNetworkStatus = (ip) =>
     setStatus('host-network-status', ip, ip === 'False');
 
@@ -108,6 +111,7 @@ const exports = {
   setControllerStatus,
   setTouchscreenStatus,
   showProbeState,
+  showFixtureDrift,
   setHostNetworkStatus,
   setBBNetworkStatus,
   setShopfloorNetworkStatus
@@ -14,7 +14,10 @@ import xmlrpc.client
 from cros.factory.device import device_utils
 from cros.factory.test import device_data
 from cros.factory.test import event_log  # TODO(chuntsen): Deprecate event log.
+from cros.factory.test.fixture.touchscreen_calibration import drift
 from cros.factory.test.fixture.touchscreen_calibration import fixture
+from cros.factory.test.fixture.touchscreen_calibration import fixture_manager
+from cros.factory.test.fixture.touchscreen_calibration import telemetry
 from cros.factory.test.i18n import _
 from cros.factory.test.pytests.touchscreen_calibration import sensors_server
 from cros.factory.test.pytests.touchscreen_calibration import touchscreen_calibration_utils  # pylint: disable=line-too-long
@@ -34,6 +37,12 @@ test_name = __name__.split('.')[-1]
 
 Event = collections.namedtuple('Event', ['data'])
 
+# The key of the fixture in the file of the drift baselines if it is not
+# selected by the fixture argument.
+DRIFT_FIXTURE_ID = 'fixture'
+# The seconds to wait for the thread monitoring the native USB port to stop.
+MONITOR_STOP_TIMEOUT = 5
+
 
 class Error(Exception):
   def __init__(self, msg):
@@ -81,8 +90,31 @@ class TouchscreenCalibration(test_case.TestCase):
       Arg('hid_tool', str, 'The hid tool to query version information',
           default=None),
       Arg('tool', str, 'The test tool', default=''),
+      Arg('use_f54_agent', bool,
+          'Whether to read the reports through f54_agent.py kept running on '
+          'the DUT instead of running the test tool for every read. Check its '
+          'reports against the test tool on the hardware before enabling it',
+          default=False),
       Arg('keep_raw_logs', bool, 'Whether to attach the log by Testlog',
           default=True),
+      Arg('trace_fixture', bool,
+          'Whether to record the raw sensor trace of the fixture in the local '
+          'log directory for replay', default=False),
+      Arg('record_telemetry', bool,
+          'Whether to append the fixture state vectors to the telemetry file '
+          'in the local log directory', default=False),
+      Arg('detect_fixture_drift', bool,
+          'Whether to flag the drift of the fixture moves from their '
+          'baselines kept in the local log directory', default=True),
+      Arg('fixture', str,
+          'The fixture to drive when several fixtures are attached to the '
+          'host, e.g., "name:line3-a"; see fixture_manager.SelectFixture. '
+          'If None, the first fixture found is driven', default=None),
+      Arg('recover_clear_time', (int, float),
+          'The seconds the safety curtain must be clear before the fixture '
+          'accepts the "Recover" button, no less than '
+          'fixture.MIN_RECOVER_CLEAR_TIME. If None, the fixture default of 3 '
+          'seconds is kept', default=None),
   ]
 
   def setUp(self):
@@ -94,6 +126,12 @@ class TouchscreenCalibration(test_case.TestCase):
     self.dev_path = '/dev/sdb' if os.path.exists('/dev/sdb1') else '/dev/sdc'
     self.dump_frames = 3
     self._monitor_thread = None
+    self._monitor_stop = None
+    self._monitor_native_usb = None
+    self._telemetry = None
+    self._drift_detector = None
+    self._move_tracker = None
+    self._fixture_key = DRIFT_FIXTURE_ID
     self.query_fixture_state_flag = False
     self._mounted_media_flag = True
     self._local_log_dir = '/var/tmp/%s' % test_name
@@ -120,6 +158,9 @@ class TouchscreenCalibration(test_case.TestCase):
     self.num_rx = 0
     self.touchscreen_status = False
 
+  def tearDown(self):
+    self._StopMonitorPort()
+
   def _ReadConfig(self):
     self.config = sensors_server.TSConfig(self._board)
     self.use_sensors_server = (
@@ -131,6 +172,7 @@ class TouchscreenCalibration(test_case.TestCase):
     self.direct_host_ip = self.config.Read('Sensors', 'DIRECT_HOST_IP')
     self.direct_sensors_ip = self.config.Read('Sensors', 'DIRECT_SENSORS_IP')
     self.sensors_port = int(self.config.Read('Sensors', 'SENSORS_PORT'))
+    self.fixture_profile = self.config.Read('Misc', 'FIXTURE_PROFILE')
 
   def _SetupEnvironment(self):
     if not self.network_status:
@@ -195,6 +237,7 @@ class TouchscreenCalibration(test_case.TestCase):
           hid_tool=self.args.hid_tool,
           fw_file=self.args.fw_file,
           install_flag=(self.args.phase == self.PHASE_SETUP_ENVIRONMENT),
+          use_agent=self.args.use_f54_agent,
           log=session.console)
       _CheckStatus('Use local sensors object.')
 
@@ -220,7 +263,7 @@ class TouchscreenCalibration(test_case.TestCase):
   def ReadTest(self):
     """Reads the raw sensor data.."""
     if self.sensors:
-      data = self.sensors.Read(self.DELTAS)
+      data = sensors_server.ImageRows(self.sensors.Read(self.DELTAS))
       session.console.info('Get data %s', data)
       self.ui.CallJSFunction('displayDebugData', data)
     else:
@@ -234,9 +277,17 @@ class TouchscreenCalibration(test_case.TestCase):
 
   def RefreshFixture(self):
     """Refreshes the fixture."""
+    self._StopMonitorPort()
     try:
       if self.fake_fixture:
         self.fixture = fixture.FakeFixture(self.ui, state='i')
+      elif self.args.fixture:
+        ports = fixture_manager.SelectFixture(
+            fixture_manager.DiscoverFixtures(), self.args.fixture)
+        session.console.info('Selected fixture %s: %s', ports.key, ports)
+        self.fixture = fixture.FixtureSerialDevice(
+            port=ports.programming, native_usb_port=ports.native)
+        self._fixture_key = ports.key
       else:
         self.fixture = fixture.FixtureSerialDevice()
 
@@ -253,6 +304,10 @@ class TouchscreenCalibration(test_case.TestCase):
             'the USB cable.'))
       self.fixture = None
 
+    self._LogFixtureOdometer()
+    self._SetupFixtureProfile()
+    self._SetupFixtureRecovery()
+    self._StartFixtureTrace()
     fixture_ready = bool(self.fixture) and not self.fixture.IsEmergencyStop()
     self.ui.CallJSFunction('setControllerStatus', fixture_ready)
 
@@ -264,10 +319,89 @@ class TouchscreenCalibration(test_case.TestCase):
             'on screen.\n'
             '(2) The test fixture is already powered on. '
             'The fixture may be in the emergency stop state.\n'
-            '    Press debug button on the test fixture and '
-            'click "RefreshFixture" button on screen.'))
+            '    Press and release the debug button on the test fixture, '
+            'or clear the safety curtain and click "Recover" button on '
+            'screen. Then click "RefreshFixture" button on screen.'))
     self._CreateMonitorPort()
 
+  def RecoverFixture(self):
+    """Drives the probe home after an emergency stop from the station UI."""
+    self._CheckFixtureConnection()
+    try:
+      self.fixture.RecoverFromEmergencyStop(
+          'operator request from the station UI')
+    except Exception as e:
+      session.console.warn('Failed to recover the fixture: %s', e)
+      self.ui.Alert(_('Fail to recover the fixture. Make sure that nothing '
+                      'is inside the fixture and try again.'))
+      return
+    self.ui.CallJSFunction('setControllerStatus',
+                           not self.fixture.IsEmergencyStop())
+
+  def _SetupFixtureProfile(self):
+    """Upload the motion profiles in the board config and select one.
+
+    The profiles are listed in the [FixtureProfiles] section like
+      samus = 8000,2000,213333,3300000,200,200,100,500
+    where the fields are ordered as fixture.MotionProfile. The profile to use
+    is specified by FIXTURE_PROFILE in the [Misc] section, which matches the
+    profile names in any case. The name 'default' is reserved for the built-in
+    profile of the firmware.
+    """
+    if not self.fixture or not self.fixture_profile:
+      return
+    try:
+      profiles = []
+      if self.config.parser.has_section('FixtureProfiles'):
+        profiles = [(name, fixture.ParseMotionProfile(value_str))
+                    for name, value_str in
+                    self.config.GetItems('FixtureProfiles')]
+      self.fixture.UploadMotionProfiles(profiles)
+      self.fixture.SelectMotionProfile(self.fixture_profile)
+    except Exception as e:
+      session.console.warn('Failed to set up fixture profile %s: %s',
+                           self.fixture_profile, e)
+
+  def _SetupFixtureRecovery(self):
+    """Set how long the safety curtain must be clear before recovery."""
+    if not self.fixture or self.args.recover_clear_time is None:
+      return
+    try:
+      self.fixture.SetRecoverClearTime(self.args.recover_clear_time)
+    except Exception as e:
+      session.console.warn('Failed to set the recover clear time: %s', e)
+
+  def _StartFixtureTrace(self):
+    """Record the raw sensor trace of the fixture if enabled.
+
+    The trace could be replayed against a new firmware by
+    cros.factory.test.fixture.touchscreen_calibration.trace_replay.
+    """
+    if not self.args.trace_fixture or not isinstance(
+        self.fixture, fixture.FixtureSerialDevice):
+      return
+    try:
+      os.makedirs(self._local_log_dir, exist_ok=True)
+      trace_path = os.path.join(
+          self._local_log_dir,
+          'fixture_trace_%s.txt' % time.strftime('%Y%m%d-%H%M%S'))
+      self.fixture.StartTrace(trace_path)
+    except Exception as e:
+      session.console.warn('Failed to start fixture trace: %s', e)
+
+  def _LogFixtureOdometer(self):
+    """Log the lifetime odometer of the fixture for maintenance."""
+    if not self.fixture:
+      return
+    try:
+      odometer = self.fixture.GetOdometer()
+    except Exception as e:
+      session.console.warn('Failed to query fixture odometer: %s', e)
+      return
+    for name in fixture.ODOMETER_FIELDS:
+      if name in odometer:
+        session.console.info('Fixture odometer %s: %s', name, odometer[name])
+
   def RefreshTouchscreen(self):
     """Refreshes all possible saved state for the old touchscreen.
 
@@ -387,6 +521,9 @@ class TouchscreenCalibration(test_case.TestCase):
     except Exception:
       self.ui.Alert(_('Probe not in the UP position, aborted'))
       raise
+    if isinstance(self.fixture, fixture.FixtureSerialDevice):
+      # Refresh the drift estimation while the DUT is swapped.
+      self.fixture.SyncClockIfDue()
 
   def _ExecuteCommand(self, command, fail_msg='Failed: '):
     """Execute a command."""
@@ -505,13 +642,18 @@ class TouchscreenCalibration(test_case.TestCase):
 
   def _ReadAndVerifySensorData(self, sn, phase, category, verify_method):
     # Get data based on the category, i.e., REFS or DELTAS.
-    data = self.sensors.Read(category)
+    read_time = time.time()
+    image = self.sensors.Read(category)
+    session.console.info('%s: read %s data at host time %.3f-%.3f',
+                         phase, category, read_time, time.time())
+    # The image is verified as it is, and is shown and logged as rows.
+    data = sensors_server.ImageRows(image)
     self.ui.CallJSFunction('displayDebugData', data)
     session.console.debug('%s: get %s data: %s', phase, category, data)
     self.Sleep(1)
 
     # Verifies whether the sensor data is good or not by the verify_method.
-    self.test_pass, failed_sensors, min_value, max_value = verify_method(data)
+    self.test_pass, failed_sensors, min_value, max_value = verify_method(image)
     session.console.info('Invoked verify_method: %s', verify_method.func_name)
     for sensor in failed_sensors:
       session.console.debug('Failed sensor at (%d, %d) value %d', *sensor)
@@ -666,9 +808,8 @@ class TouchscreenCalibration(test_case.TestCase):
 
   def _InsertAndDetectTouchKernelModule(self):
     """Insert the touch kernel module and make sure it is detected."""
-    if (not self.sensors.kernel_module.Insert() or
-        not self.sensors.kernel_module.IsDeviceDetected()):
-      self.sensors.kernel_module.Remove()
+    if not self.sensors.kernel_module.Probe():
+      self.sensors.kernel_module.Release()
       session.console.error('Failed to insert the kernel module: %s.',
                             self.sensors.kernel_module.name)
       self.ui.Alert(
@@ -752,13 +893,39 @@ class TouchscreenCalibration(test_case.TestCase):
       except Exception as e:
         session.console.warn('Failed to query fixture state: %s', e)
 
-  def _MonitorNativeUsb(self, native_usb):
-    """Get the complete state and show the values that are changed."""
+  def QuerySensorStats(self):
+    """Query the health statistics of the fixture sensors."""
+    try:
+      sensor_stats = self.fixture.GetSensorStats()
+    except Exception as e:
+      session.console.warn('Failed to query sensor stats: %s', e)
+      return
+    session.console.info('Sensor stats:')
+    for name in fixture.SENSOR_NAMES:
+      if name in sensor_stats:
+        session.console.info('      %s: %s', name, sensor_stats[name])
+
+  def _MonitorNativeUsb(self, native_usb, stop):
+    """Get the complete state and show the values that are changed.
+
+    The monitor runs until stop is set by _StopMonitorPort().
+    """
     self.ui.CallJSFunction('showProbeState', 'N/A')
     self.QueryFixtureState()
     self.Sleep(0.5)
-    while True:
-      native_usb.GetState()
+    while not stop.is_set():
+      try:
+        native_usb.GetState()
+      except Exception:
+        if stop.is_set():
+          return
+        raise
+      if stop.is_set():
+        return
+      frame = self._GetStateFrame(native_usb)
+      if frame:
+        self._RecordTelemetry(frame)
+        self._CheckDrift(frame)
 
       if self.query_fixture_state_flag:
         state_list = native_usb.CompleteState()
@@ -766,7 +933,11 @@ class TouchscreenCalibration(test_case.TestCase):
       else:
         state_list = native_usb.DiffState()
       if state_list:
-        session.console.info('Internal state:')
+        host_time = native_usb.StateHostTime()
+        if host_time is None:
+          session.console.info('Internal state:')
+        else:
+          session.console.info('Internal state (host time %.3f):', host_time)
         for name, value in state_list:
           if name == 'state':
             try:
@@ -776,15 +947,130 @@ class TouchscreenCalibration(test_case.TestCase):
               session.console.warn(msg)
           session.console.info('      %s: %s', name, value)
 
+  def _OpenTelemetry(self):
+    """Open the telemetry file of the fixture if enabled.
+
+    The file could be queried by
+    cros.factory.test.fixture.touchscreen_calibration.telemetry.
+    """
+    if not self.args.record_telemetry:
+      return
+    try:
+      os.makedirs(self._local_log_dir, exist_ok=True)
+      self._telemetry = telemetry.TelemetryRecorder(
+          os.path.join(self._local_log_dir, 'fixture_telemetry.bin'))
+    except Exception as e:
+      session.console.warn('Failed to open fixture telemetry: %s', e)
+
+  def _CloseTelemetry(self):
+    if self._telemetry:
+      self._telemetry.Close()
+      self._telemetry = None
+
+  def _GetStateFrame(self, native_usb):
+    """Parse the latest state vector into a telemetry frame."""
+    host_time = native_usb.StateHostTime()
+    return telemetry.ParseStateVector(
+        native_usb.state_string,
+        (time.time() if host_time is None else host_time) * 1000)
+
+  def _RecordTelemetry(self, frame):
+    """Append the latest state vector to the telemetry file."""
+    if not self._telemetry:
+      return
+    try:
+      self._telemetry.Record(frame)
+    except Exception as e:
+      session.console.warn('Failed to record fixture telemetry: %s', e)
+      self._telemetry = None
+
+  def _DriftStatePath(self):
+    return os.path.join(self._local_log_dir, 'fixture_drift.json')
+
+  def _OpenDriftDetector(self):
+    """Load the baselines of the fixture moves if the detection is enabled.
+
+    The moves are tracked from the state vectors of one monitor thread, so the
+    detector and the tracker are dropped by _CloseDriftDetector() when the
+    thread is stopped.
+    """
+    if not self.args.detect_fixture_drift:
+      return
+    self._drift_detector = drift.LoadDetector(self._DriftStatePath(),
+                                              self._fixture_key)
+    self._move_tracker = drift.MoveTracker()
+    self._ShowFixtureDrift(self._drift_detector)
+
+  def _CloseDriftDetector(self):
+    self._drift_detector = None
+    self._move_tracker = None
+
+  def _ShowFixtureDrift(self, detector):
+    try:
+      self.ui.CallJSFunction('showFixtureDrift',
+                             ', '.join(detector.Drifting()))
+    except Exception:
+      session.console.warn('Not able to show the fixture drift.')
+
+  def _CheckDrift(self, frame):
+    """Check the move completed by the frame against its baselines."""
+    detector, tracker = self._drift_detector, self._move_tracker
+    if not detector:
+      return
+    record = tracker.AddFrame(frame)
+    if record is None:
+      return
+    events = detector.AddMove(record)
+    for event in events:
+      if event.drifting:
+        session.console.warn('Fixture drift: %s', drift.FormatEvent(event))
+      else:
+        session.console.info('Fixture drift: %s', drift.FormatEvent(event))
+    if events:
+      self._ShowFixtureDrift(detector)
+    try:
+      os.makedirs(self._local_log_dir, exist_ok=True)
+      drift.SaveDetector(self._DriftStatePath(), detector)
+    except Exception as e:
+      session.console.warn('Failed to save the fixture baselines: %s', e)
+
   def _CreateMonitorPort(self):
-    """Create a thread to monitor the native USB port."""
+    """Create a thread to monitor the native USB port.
+
+    The telemetry file and the drift detector fed by the thread are opened for
+    it, and are closed by _StopMonitorPort() when the fixture is refreshed.
+    """
+    self._StopMonitorPort()
     if self.fixture and self.fixture.native_usb:
+      self._OpenTelemetry()
+      self._OpenDriftDetector()
+      self._monitor_stop = threading.Event()
+      self._monitor_native_usb = self.fixture.native_usb
       try:
         self._monitor_thread = process_utils.StartDaemonThread(
-            target=self._MonitorNativeUsb, args=[self.fixture.native_usb])
+            target=self._MonitorNativeUsb,
+            args=[self._monitor_native_usb, self._monitor_stop])
       except threading.ThreadError:
         session.console.warn('Cannot start thread for _MonitorNativeUsb()')
 
+  def _StopMonitorPort(self):
+    """Stop the thread monitoring the native USB port and close its files.
+
+    The drift detector is dropped too, so that the moves of two fixtures never
+    interleave in a tracker.
+    """
+    if self._monitor_thread:
+      self._monitor_stop.set()
+      self._monitor_native_usb.CancelGetState()
+      self._monitor_thread.join(MONITOR_STOP_TIMEOUT)
+      if self._monitor_thread.is_alive():
+        session.console.warn('The thread of _MonitorNativeUsb() did not stop.')
+      self._monitor_native_usb.Disconnect()
+      self._monitor_thread = None
+      self._monitor_native_usb = None
+    self._CloseTelemetry()
+    self._CloseDriftDetector()
+
   def runTest(self):
     os.environ['DISPLAY'] = ':0'
     self.start_time = self._GetTime()
@@ -795,7 +1081,7 @@ class TouchscreenCalibration(test_case.TestCase):
         # Events that are emitted from buttons on the factory UI.
         'ReadTest', 'RefreshFixture', 'RefreshTouchscreen', 'ProbeSelfTest',
         'DriveProbeDown', 'DriveProbeUp', 'Shutdown', 'QueryFixtureState',
-        'RefreshNetwork',
+        'QuerySensorStats', 'RecoverFixture', 'RefreshNetwork',
 
         # Events that are emitted from other callback functions.
         'FinishTest',
@@ -19,9 +19,11 @@ import re
 import subprocess
 from subprocess import PIPE
 from subprocess import STDOUT
+import time
 
 
 _SYSFS_I2C_PATH = '/sys/bus/i2c/devices'
+_SYSFS_I2C_DRIVERS_PATH = '/sys/bus/i2c/drivers'
 _DEBUG_PATH = '/sys/kernel/debug'
 
 ATMEL = 'atmel'
@@ -190,11 +192,22 @@ class NetworkStatus:
 
 
 class KernelModule:
-  """A simple class to manage a kernel module."""
+  """A simple class to manage a kernel module.
 
-  def __init__(self, name):
+  If keep_loaded is True, the module stays loaded across the panels, and the
+  touch device is unbound from and bound to the driver instead, so that a new
+  panel costs only the probe of the device.
+  """
+
+  PROBE_TIMEOUT = 5
+  PROBE_INTERVAL = 0.01
+
+  def __init__(self, name, sysfs_entry=None, keep_loaded=False,
+               vendor=ATMEL):
     self.name = name
-    self.sysfs_entry = GetSysfsEntry()
+    self.sysfs_entry = sysfs_entry or GetSysfsEntry()
+    self.keep_loaded = keep_loaded
+    self.driver = _TOUCH_DRIVER.get(vendor)
 
   def IsLoaded(self):
     """Is the module loaded?"""
@@ -213,6 +226,93 @@ class KernelModule:
       return IsSuccessful(SimpleSystem('modprobe %s' % self.name))
     return True
 
+  def _GetDevice(self):
+    """Get the i2c device name of the touch device, e.g., 'i2c-ATML0001:01'.
+
+    The sysfs entry is looked up again if it was not found, e.g., when the
+    device was not bound as the module was created.
+    """
+    if not self.sysfs_entry:
+      self.sysfs_entry = GetSysfsEntry()
+    return (os.path.basename(os.path.dirname(self.sysfs_entry))
+            if self.sysfs_entry else None)
+
+  def _WriteDriver(self, filename, device):
+    """Write the device to the bind or unbind file of the driver."""
+    try:
+      with open(os.path.join(_SYSFS_I2C_DRIVERS_PATH, self.driver, filename),
+                'w') as f:
+        f.write(device)
+    except IOError as e:
+      logging.warning('Failed to %s %s: %s', filename, device, e)
+      return False
+    return True
+
+  def IsBound(self):
+    """Is the touch device bound to the driver?"""
+    device = self._GetDevice()
+    return bool(device) and os.path.exists(
+        os.path.join(_SYSFS_I2C_DRIVERS_PATH, self.driver, device))
+
+  def Unbind(self):
+    """Unbind the touch device from the driver."""
+    if not self.IsBound():
+      return True
+    return self._WriteDriver('unbind', self._GetDevice())
+
+  def Rebind(self):
+    """Bind the touch device to the driver again to probe a new panel."""
+    device = self._GetDevice()
+    if not device or not self.Unbind():
+      return False
+    return self._WriteDriver('bind', device)
+
   def IsDeviceDetected(self):
     """Is the device detected properly?"""
-    return os.path.isfile(os.path.join(self.sysfs_entry, 'fw_version'))
+    return bool(self.sysfs_entry) and os.path.isfile(
+        os.path.join(os.path.dirname(self.sysfs_entry), 'fw_version'))
+
+  def WaitDeviceDetected(self, timeout=None):
+    """Wait for the device to be detected.
+
+    Args:
+      timeout: the timeout in seconds, or None for PROBE_TIMEOUT.
+
+    Returns:
+      True if the device is detected within the timeout.
+    """
+    deadline = time.time() + (self.PROBE_TIMEOUT if timeout is None
+                              else timeout)
+    while not self.IsDeviceDetected():
+      if time.time() > deadline:
+        return False
+      time.sleep(self.PROBE_INTERVAL)
+    return True
+
+  def Probe(self):
+    """Insert the module, or bind the device again if the module is kept
+    loaded, and wait for the device to be detected.
+
+    Nothing is waited for if the module is already loaded and not kept loaded,
+    or if the touch device is not known, e.g., a device without the sysfs
+    object entry.
+
+    Returns:
+      True if the device is detected, or nothing is waited for.
+    """
+    if not self.IsLoaded():
+      if not self.Insert():
+        return False
+    elif not self.keep_loaded:
+      return True
+    elif not self.Rebind():
+      return False
+    if not self._GetDevice():
+      return True
+    return self.WaitDeviceDetected()
+
+  def Release(self):
+    """Unbind the device if the module is kept loaded, or remove the module."""
+    if self.keep_loaded:
+      return self.Unbind()
+    return self.Remove()
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+#
+# Copyright 2015 The Chromium OS Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+"""Unittest for touchscreen_calibration_utils."""
+
+import os
+import shutil
+import tempfile
+import threading
+import unittest
+from unittest import mock
+
+from cros.factory.test.pytests.touchscreen_calibration import touchscreen_calibration_utils as utils  # pylint: disable=line-too-long
+
+
+DEVICE = 'i2c-ATML0001:01'
+
+
+class KernelModuleTest(unittest.TestCase):
+
+  def setUp(self):
+    self.temp_dir = tempfile.mkdtemp()
+    self.device_path = os.path.join(self.temp_dir, 'devices', DEVICE)
+    self.driver_path = os.path.join(self.temp_dir, 'drivers', 'atmel_mxt_ts')
+    os.makedirs(self.device_path)
+    os.makedirs(self.driver_path)
+    mock.patch.object(utils, '_SYSFS_I2C_DRIVERS_PATH',
+                      os.path.dirname(self.driver_path)).start()
+    self.loaded = True
+    mock.patch.object(utils, 'SimpleSystemOutput', side_effect=(
+        lambda cmd: 'atmel_mxt_ts 1 0' if self.loaded else '')).start()
+    self.system = mock.patch.object(utils, 'SimpleSystem',
+                                    return_value=0).start()
+    self.writes = []
+    mock.patch.object(utils.KernelModule, '_WriteDriver',
+                      side_effect=self._WriteDriver).start()
+    self.timers = []
+    self._Bind()
+
+  def tearDown(self):
+    for timer in self.timers:
+      timer.cancel()
+    mock.patch.stopall()
+    shutil.rmtree(self.temp_dir)
+
+  def _Bind(self):
+    with open(os.path.join(self.driver_path, DEVICE), 'w'):
+      pass
+    with open(os.path.join(self.device_path, 'fw_version'), 'w'):
+      pass
+
+  def _WriteDriver(self, filename, device):
+    """Unbind the device at once, and bind it after a probe time."""
+    self.writes.append((filename, device))
+    if filename == 'unbind':
+      os.remove(os.path.join(self.driver_path, device))
+      os.remove(os.path.join(self.device_path, 'fw_version'))
+    else:
+      self.timers.append(threading.Timer(0.05, self._Bind))
+      self.timers[-1].start()
+    return True
+
+  def _KernelModule(self, keep_loaded):
+    return utils.KernelModule('atmel_mxt_ts', os.path.join(self.device_path,
+                                                           'object'),
+                              keep_loaded=keep_loaded)
+
+  def testKeepLoaded(self):
+    module = self._KernelModule(keep_loaded=True)
+    self.assertTrue(module.Release())
+    self.assertFalse(module.IsBound())
+    self.assertTrue(module.Probe())
+    self.assertTrue(module.IsDeviceDetected())
+    # The device is bound again while it was bound.
+    self.assertTrue(module.Probe())
+    self.assertEqual(self.writes, [('unbind', DEVICE), ('bind', DEVICE),
+                                   ('unbind', DEVICE), ('bind', DEVICE)])
+    self.system.assert_not_called()
+
+  def testInsertAndRemove(self):
+    module = self._KernelModule(keep_loaded=False)
+    self.assertTrue(module.Release())
+    self.system.assert_called_once_with('rmmod atmel_mxt_ts')
+    self.loaded = False
+    self.assertTrue(module.Probe())
+    self.system.assert_called_with('modprobe atmel_mxt_ts')
+    self.assertEqual(self.writes, [])
+
+  def testProbeLoaded(self):
+    module = self._KernelModule(keep_loaded=False)
+    # The module is loaded, so it returns at once without any wait.
+    with mock.patch.object(utils.KernelModule, 'WaitDeviceDetected') as wait:
+      self.assertTrue(module.Probe())
+    wait.assert_not_called()
+    self.system.assert_not_called()
+
+  def testProbeUnknownDevice(self):
+    self.loaded = False
+    with mock.patch.object(utils, 'GetSysfsEntry', return_value=None):
+      module = utils.KernelModule('atmel_mxt_ts')
+      with mock.patch.object(utils.KernelModule, 'WaitDeviceDetected') as wait:
+        self.assertTrue(module.Probe())
+    self.system.assert_called_once_with('modprobe atmel_mxt_ts')
+    wait.assert_not_called()
+
+  def testProbeTimeout(self):
+    module = self._KernelModule(keep_loaded=True)
+    module.Release()
+    # The bind fails to probe the device.
+    with mock.patch.object(utils.KernelModule, '_WriteDriver',
+                           return_value=True), \
+        mock.patch.object(utils.KernelModule, 'PROBE_TIMEOUT', 0.05):
+      self.assertFalse(module.Probe())
+
+if __name__ == '__main__':
+  unittest.main()